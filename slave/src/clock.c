@@ -0,0 +1,311 @@
+#include "clock.h"
+#include "hal.h"
+#include "irq.h"
+#include "smp.h"
+
+#define NS_PER_SECOND       1000000000ull
+#define US_PER_SECOND       1000000ull
+
+// Rate the Pi firmware programs into CNTFRQ, if it was left unset
+#define CLOCK_DEFAULT_FREQ  19200000
+
+// Counter ticks to time units: ticks * (whole + frac / 2^32), with 32x32
+// multiplies only, so no 64-bit division on the timestamp path
+typedef struct {
+    uint32_t whole;
+    uint32_t frac;
+} scale_t;
+
+typedef struct {
+    uint32_t id;                // 0 when free
+    uint64_t when;              // Counter ticks
+    clock_deadline_t fn;
+    void* user;
+} deadline_t;
+
+// Deadline expired, called once the timer is reprogrammed
+typedef struct {
+    clock_deadline_t fn;
+    uint32_t id;
+    void* user;
+} expiry_t;
+
+// Each core has its own physical timer, and its deadlines are only touched
+// by that core and its timer interrupt
+typedef struct {
+    deadline_t deadlines[CLOCK_MAX_DEADLINES];
+    uint32_t ctl;               // CNTP_CTL as programmed
+    int in_irq;
+    int in_frame;
+    uint64_t frame_ns;
+    uint64_t frame_us;
+    clock_stats_t stats;
+} core_clock_t;
+
+static struct {
+    uint32_t frequency;
+    scale_t ns;
+    scale_t us;
+    uint32_t next_id;
+    core_clock_t cores[SMP_MAX_CORES];
+} timebase;
+
+static scale_t make_scale(uint64_t per_second, uint32_t frequency) {
+    scale_t scale;
+    scale.whole = (uint32_t)(per_second / frequency);
+    scale.frac = (uint32_t)(((per_second % frequency) << 32) / frequency);
+    return scale;
+}
+
+static inline uint64_t apply(uint64_t ticks, scale_t scale) {
+    uint32_t lo = (uint32_t)ticks;
+    uint32_t hi = (uint32_t)(ticks >> 32);
+    return ticks * scale.whole + (uint64_t)hi * scale.frac +
+           (((uint64_t)lo * scale.frac) >> 32);
+}
+
+// The clock works before clock_init(): the rate is read on first use
+static void read_frequency(void) {
+    uint32_t frequency = hal_counter_freq();
+    if (frequency == 0) {
+        frequency = CLOCK_DEFAULT_FREQ;
+    }
+    timebase.ns = make_scale(NS_PER_SECOND, frequency);
+    timebase.us = make_scale(US_PER_SECOND, frequency);
+    timebase.frequency = frequency;
+}
+
+static void clock_irq_handler(void) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    self->in_irq = 1;
+    clock_deadline_poll();
+    self->in_irq = 0;
+}
+
+// Read the counter rate, forget every deadline and take the timer
+// interrupt on this core
+int clock_init(void) {
+    read_frequency();
+    __builtin_memset(timebase.cores, 0, sizeof(timebase.cores));
+    timebase.next_id = 1;
+
+    irq_register(IRQ_LOCAL_CNTPNS, clock_irq_handler);
+    irq_register(IRQ_LOCAL_CNTPS, clock_irq_handler);
+    clock_init_cpu();
+    return 1;
+}
+
+// Take the calling core's timer interrupt: the non-secure or the secure
+// one, depending on how the firmware started us
+void clock_init_cpu(void) {
+    uint32_t core = smp_core_id();
+    hal_timer_control(0);
+    irq_local_enable(core, IRQ_LOCAL_CNTPNS);
+    irq_local_enable(core, IRQ_LOCAL_CNTPS);
+}
+
+uint64_t clock_ticks(void) {
+    return hal_counter();
+}
+
+uint64_t clock_now_ns(void) {
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    return apply(hal_counter(), timebase.ns);
+}
+
+uint64_t clock_now_us(void) {
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    return apply(hal_counter(), timebase.us);
+}
+
+uint64_t clock_ticks_to_ns(uint64_t ticks) {
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    return apply(ticks, timebase.ns);
+}
+
+// Rounded up, so a deadline never fires early
+uint64_t clock_ns_to_ticks(uint64_t ns) {
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    uint64_t part = (ns % NS_PER_SECOND) * timebase.frequency;
+    return (ns / NS_PER_SECOND) * timebase.frequency +
+           (part + NS_PER_SECOND - 1) / NS_PER_SECOND;
+}
+
+// Latch this core's frame time; returns it in microseconds
+uint64_t clock_frame_begin(void) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    uint64_t ticks = hal_counter();
+    self->frame_ns = apply(ticks, timebase.ns);
+    self->frame_us = apply(ticks, timebase.us);
+    self->in_frame = 1;
+    return self->frame_us;
+}
+
+void clock_frame_end(void) {
+    timebase.cores[smp_core_id()].in_frame = 0;
+}
+
+// The frame's time, or the current time outside a frame
+uint64_t clock_frame_ns(void) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    return self->in_frame ? self->frame_ns : clock_now_ns();
+}
+
+uint64_t clock_frame_us(void) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    return self->in_frame ? self->frame_us : clock_now_us();
+}
+
+// Keep the timer interrupt off while the deadlines change; the handler
+// itself already runs with it masked
+static void lock(core_clock_t* self) {
+    if (!self->in_irq) {
+        hal_timer_control(self->ctl | HAL_TIMER_IMASK);
+    }
+}
+
+// Aim the compare value at the earliest deadline, or stop the timer
+static void unlock(core_clock_t* self) {
+    uint64_t earliest = UINT64_MAX;
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES; i++) {
+        if (self->deadlines[i].id && self->deadlines[i].when < earliest) {
+            earliest = self->deadlines[i].when;
+        }
+    }
+    if (earliest != UINT64_MAX) {
+        hal_timer_compare(earliest);
+        self->ctl = HAL_TIMER_ENABLE;
+    } else {
+        self->ctl = 0;
+    }
+    hal_timer_control(self->ctl);
+}
+
+// Call fn(id, user) at when_ns on this core. Returns the deadline's id, or
+// 0 if all slots are taken. A deadline already past fires at once.
+uint32_t clock_deadline_at(uint64_t when_ns, clock_deadline_t fn, void* user) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    if (!fn) {
+        return 0;
+    }
+    uint64_t when = clock_ns_to_ticks(when_ns);
+
+    lock(self);
+    deadline_t* slot = 0;
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES && !slot; i++) {
+        if (!self->deadlines[i].id) {
+            slot = &self->deadlines[i];
+        }
+    }
+    uint32_t id = 0;
+    if (slot) {
+        do {
+            id = __atomic_fetch_add(&timebase.next_id, 1, __ATOMIC_RELAXED);
+        } while (id == 0);
+        *slot = (deadline_t){ id, when, fn, user };
+        self->stats.armed++;
+    } else {
+        self->stats.rejected++;
+    }
+    unlock(self);
+    return id;
+}
+
+uint32_t clock_deadline_in(uint64_t delay_ns, clock_deadline_t fn, void* user) {
+    return clock_deadline_at(clock_now_ns() + delay_ns, fn, user);
+}
+
+// Returns 1 if the deadline was still pending on this core
+int clock_deadline_cancel(uint32_t id) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    int found = 0;
+
+    lock(self);
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES && id; i++) {
+        if (self->deadlines[i].id == id) {
+            self->deadlines[i].id = 0;
+            self->stats.cancelled++;
+            found = 1;
+        }
+    }
+    unlock(self);
+    return found;
+}
+
+int clock_deadline_pending(uint32_t id) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES; i++) {
+        if (id && self->deadlines[i].id == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Run this core's expired deadlines. Returns the number still pending.
+uint32_t clock_deadline_poll(void) {
+    core_clock_t* self = &timebase.cores[smp_core_id()];
+    expiry_t expired[CLOCK_MAX_DEADLINES];
+    uint32_t count = 0;
+    uint32_t pending = 0;
+
+    lock(self);
+    uint64_t now = hal_counter();
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES; i++) {
+        deadline_t* deadline = &self->deadlines[i];
+        if (!deadline->id) {
+            continue;
+        }
+        if (deadline->when > now) {
+            pending++;
+            continue;
+        }
+        uint64_t late = clock_ticks_to_ns(now - deadline->when);
+        if (late > self->stats.max_late_ns) {
+            self->stats.max_late_ns = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+        }
+        expired[count++] = (expiry_t){ deadline->fn, deadline->id, deadline->user };
+        deadline->id = 0;
+        self->stats.fired++;
+    }
+    unlock(self);
+
+    // Callbacks last, so they may set the next deadline
+    for (uint32_t i = 0; i < count; i++) {
+        expired[i].fn(expired[i].id, expired[i].user);
+    }
+    return pending;
+}
+
+// Totals over every core
+void clock_get_stats(clock_stats_t* stats) {
+    if (!stats) {
+        return;
+    }
+    __builtin_memset(stats, 0, sizeof(*stats));
+    if (!timebase.frequency) {
+        read_frequency();
+    }
+    stats->frequency = timebase.frequency;
+    for (uint32_t core = 0; core < SMP_MAX_CORES; core++) {
+        const clock_stats_t* own = &timebase.cores[core].stats;
+        stats->armed += own->armed;
+        stats->fired += own->fired;
+        stats->cancelled += own->cancelled;
+        stats->rejected += own->rejected;
+        if (own->max_late_ns > stats->max_late_ns) {
+            stats->max_late_ns = own->max_late_ns;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+// Monotonic clock and deadline timers on the ARM generic timer
+//
+// Timestamps come from the CNTPCT counter, a coprocessor read instead of the
+// system timer's MMIO words, scaled to nanoseconds or microseconds with
+// multiplies fixed from CNTFRQ. Microseconds share the epoch of
+// get_system_time(), which now reads this clock.
+//
+// A frame latches "now" once with clock_frame_begin(); code running inside
+// it, up to clock_frame_end(), reads the cached value through
+// clock_frame_ns()/clock_frame_us(), which read the clock outside a frame.
+// Each core has its own frame time.
+//
+// Deadlines call a function at a given time on the core that set them, from
+// that core's CNTP compare interrupt once clock_init_cpu() has routed it
+// there; cores running with interrupts off call clock_deadline_poll()
+// instead. A callback may set the next deadline.
+
+#define CLOCK_MAX_DEADLINES     16
+
+typedef void (*clock_deadline_t)(uint32_t id, void* user);
+
+typedef struct {
+    uint32_t frequency;         // Counter ticks per second
+    uint32_t armed;             // Deadlines set
+    uint32_t fired;
+    uint32_t cancelled;
+    uint32_t rejected;          // No free slot
+    uint32_t max_late_ns;       // Worst delay from deadline to callback
+} clock_stats_t;
+
+// Function Prototypes
+int clock_init(void);
+void clock_init_cpu(void);
+uint64_t clock_ticks(void);
+uint64_t clock_now_ns(void);
+uint64_t clock_now_us(void);
+uint64_t clock_ticks_to_ns(uint64_t ticks);
+uint64_t clock_ns_to_ticks(uint64_t ns);
+uint64_t clock_frame_begin(void);
+void clock_frame_end(void);
+uint64_t clock_frame_ns(void);
+uint64_t clock_frame_us(void);
+uint32_t clock_deadline_at(uint64_t when_ns, clock_deadline_t fn, void* user);
+uint32_t clock_deadline_in(uint64_t delay_ns, clock_deadline_t fn, void* user);
+int clock_deadline_cancel(uint32_t id);
+int clock_deadline_pending(uint32_t id);
+uint32_t clock_deadline_poll(void);
+void clock_get_stats(clock_stats_t* stats);
+
+#endif // CLOCK_H
@@ -0,0 +1,193 @@
+#include "combo.h"
+
+// Hash slot for a button mask
+static inline uint32_t symbol_slot(uint16_t mask) {
+    return ((uint32_t)mask * 0x9E3779B1u) >> 25;
+}
+
+// Symbol for a mask, 0 if no combo uses it
+static inline uint8_t symbol_lookup(const combo_matcher_t* matcher, uint16_t mask) {
+    uint32_t slot = symbol_slot(mask);
+    while (matcher->symbols[slot].symbol) {
+        if (matcher->symbols[slot].mask == mask) {
+            return matcher->symbols[slot].symbol;
+        }
+        slot = (slot + 1) & (COMBO_SYMBOL_SLOTS - 1);
+    }
+    return 0;
+}
+
+// Symbol for a mask, allocating one if new. 0 if the alphabet is full.
+static uint8_t symbol_intern(combo_matcher_t* matcher, uint16_t mask) {
+    uint8_t symbol = symbol_lookup(matcher, mask);
+    if (symbol) {
+        return symbol;
+    }
+    if (matcher->symbol_count >= COMBO_MAX_SYMBOLS) {
+        return 0;
+    }
+    
+    uint32_t slot = symbol_slot(mask);
+    while (matcher->symbols[slot].symbol) {
+        slot = (slot + 1) & (COMBO_SYMBOL_SLOTS - 1);
+    }
+    matcher->symbols[slot].mask = mask;
+    matcher->symbols[slot].symbol = (uint8_t)matcher->symbol_count++;
+    return matcher->symbols[slot].symbol;
+}
+
+// Build the automaton from the registered combos
+static int combo_compile(combo_matcher_t* matcher) {
+    static uint8_t fail[COMBO_MAX_STATES];
+    static uint8_t queue[COMBO_MAX_STATES];
+    
+    __builtin_memset(matcher->symbols, 0, sizeof(matcher->symbols));
+    __builtin_memset(matcher->transitions, COMBO_NONE, sizeof(matcher->transitions));
+    __builtin_memset(matcher->first_combo, COMBO_NONE, sizeof(matcher->first_combo));
+    __builtin_memset(matcher->output_link, COMBO_NONE, sizeof(matcher->output_link));
+    matcher->symbol_count = 1;
+    matcher->state_count = 1;
+    
+    // Trie of button sequences; combos sharing a sequence share its last node
+    for (uint32_t i = 0; i < matcher->combo_count; i++) {
+        combo_t* combo = &matcher->combos[i];
+        uint8_t node = 0;
+        
+        for (uint32_t step = 0; step < combo->length; step++) {
+            uint8_t symbol = symbol_intern(matcher, combo->buttons[step]);
+            if (!symbol) {
+                return 0;
+            }
+            if (matcher->transitions[node][symbol] == COMBO_NONE) {
+                if (matcher->state_count >= COMBO_MAX_STATES) {
+                    return 0;
+                }
+                matcher->transitions[node][symbol] = (uint8_t)matcher->state_count++;
+            }
+            node = matcher->transitions[node][symbol];
+        }
+        
+        // Append so earlier registrations are tried first
+        combo->next_same_state = COMBO_NONE;
+        uint8_t* link = &matcher->first_combo[node];
+        while (*link != COMBO_NONE) {
+            link = &matcher->combos[*link].next_same_state;
+        }
+        *link = (uint8_t)i;
+    }
+    
+    // Breadth-first: complete every missing transition from the failure
+    // state so that matching never has to walk failure links
+    uint32_t head = 0, tail = 0;
+    for (uint32_t symbol = 0; symbol < COMBO_MAX_SYMBOLS; symbol++) {
+        uint8_t child = matcher->transitions[0][symbol];
+        if (child == COMBO_NONE) {
+            matcher->transitions[0][symbol] = 0;
+        } else {
+            fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    
+    while (head < tail) {
+        uint8_t node = queue[head++];
+        uint8_t suffix = fail[node];
+        
+        matcher->output_link[node] = matcher->first_combo[suffix] != COMBO_NONE ?
+                                     suffix : matcher->output_link[suffix];
+        
+        for (uint32_t symbol = 0; symbol < COMBO_MAX_SYMBOLS; symbol++) {
+            uint8_t child = matcher->transitions[node][symbol];
+            if (child == COMBO_NONE) {
+                matcher->transitions[node][symbol] = matcher->transitions[suffix][symbol];
+            } else {
+                fail[child] = matcher->transitions[suffix][symbol];
+                queue[tail++] = child;
+            }
+        }
+    }
+    
+    matcher->state = 0;
+    return 1;
+}
+
+// Timing guards of a combo against the most recent edges
+static int combo_guards_pass(const combo_matcher_t* matcher, const combo_t* combo) {
+    for (uint32_t step = 1; step < combo->length; step++) {
+        uint32_t gap = matcher->gaps[(matcher->gap_pos - combo->length + step) & (COMBO_MAX_LENGTH - 1)];
+        if (combo->timing[step] && gap > combo->timing[step]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Remove all combos
+void combo_matcher_reset(combo_matcher_t* matcher) {
+    matcher->combo_count = 0;
+    matcher->last_mask = 0;
+    matcher->last_edge_us = 0;
+    matcher->gap_pos = 0;
+    combo_compile(matcher);
+}
+
+// Forget the edges seen so far; the combos stay registered
+void combo_matcher_restart(combo_matcher_t* matcher) {
+    matcher->state = 0;
+    matcher->last_mask = 0;
+    matcher->last_edge_us = 0;
+    matcher->gap_pos = 0;
+}
+
+// Register a combo and recompile. Returns 0 if it does not fit.
+int combo_matcher_add(combo_matcher_t* matcher, const uint16_t* buttons,
+                      const uint32_t* timings, uint32_t length, const ps5_state_t* result) {
+    if (matcher->combo_count >= COMBO_MAX_COMBOS || length == 0 || length > COMBO_MAX_LENGTH) {
+        return 0;
+    }
+    
+    combo_t* combo = &matcher->combos[matcher->combo_count];
+    for (uint32_t i = 0; i < length; i++) {
+        combo->buttons[i] = buttons[i];
+        combo->timing[i] = timings ? timings[i] : 0;
+    }
+    combo->length = length;
+    combo->result_state = *result;
+    matcher->combo_count++;
+    
+    if (!combo_compile(matcher)) {
+        // Too many states or symbols: drop it and restore the old automaton
+        matcher->combo_count--;
+        combo_compile(matcher);
+        return 0;
+    }
+    return 1;
+}
+
+// Feed the current buttons. On an edge, advance the automaton and return the
+// index of the combo it completes, or -1.
+int combo_matcher_feed(combo_matcher_t* matcher, uint16_t mask, uint64_t now_us) {
+    if (mask == matcher->last_mask) {
+        return -1;
+    }
+    
+    uint64_t gap = now_us - matcher->last_edge_us;
+    matcher->gaps[matcher->gap_pos++ & (COMBO_MAX_LENGTH - 1)] = gap > UINT32_MAX ? UINT32_MAX : (uint32_t)gap;
+    matcher->last_edge_us = now_us;
+    matcher->last_mask = mask;
+    
+    matcher->state = matcher->transitions[matcher->state][symbol_lookup(matcher, mask)];
+    
+    // Longest completed combo whose timing holds
+    uint8_t node = matcher->first_combo[matcher->state] != COMBO_NONE ?
+                   matcher->state : matcher->output_link[matcher->state];
+    while (node != COMBO_NONE) {
+        for (uint8_t i = matcher->first_combo[node]; i != COMBO_NONE; i = matcher->combos[i].next_same_state) {
+            if (combo_guards_pass(matcher, &matcher->combos[i])) {
+                return i;
+            }
+        }
+        node = matcher->output_link[node];
+    }
+    return -1;
+}
@@ -0,0 +1,60 @@
+#ifndef COMBO_H
+#define COMBO_H
+
+#include <stdint.h>
+#include "ps5.h"
+
+// Combo matcher
+//
+// All registered combos are compiled into one deterministic automaton
+// (Aho-Corasick over button masks). Every button edge is a symbol lookup and
+// a single table transition, however many combos are loaded. Timing windows
+// are checked as guards only when the automaton reaches an accepting state.
+
+#define COMBO_MAX_COMBOS    32
+#define COMBO_MAX_LENGTH    16
+#define COMBO_MAX_STATES    255   // Trie nodes, root included
+#define COMBO_MAX_SYMBOLS   64    // Distinct button masks, symbol 0 is "other"
+#define COMBO_SYMBOL_SLOTS  128   // Mask lookup hash, power of two
+#define COMBO_NONE          0xFF
+
+// Combo definition
+typedef struct {
+    uint16_t buttons[COMBO_MAX_LENGTH];  // Button mask per step
+    uint32_t timing[COMBO_MAX_LENGTH];   // Max gap from the previous step in us, 0 = any (step 0 unused)
+    uint32_t length;                     // Steps in the combo
+    ps5_state_t result_state;            // State to apply when the combo completes
+    uint8_t next_same_state;             // Next combo ending on the same node
+} combo_t;
+
+typedef struct {
+    combo_t combos[COMBO_MAX_COMBOS];
+    uint32_t combo_count;
+    
+    // Compiled automaton
+    uint8_t transitions[COMBO_MAX_STATES][COMBO_MAX_SYMBOLS];
+    uint8_t first_combo[COMBO_MAX_STATES];   // First combo ending here
+    uint8_t output_link[COMBO_MAX_STATES];   // Nearest proper suffix with a combo
+    uint32_t state_count;
+    uint32_t symbol_count;
+    struct {
+        uint16_t mask;
+        uint8_t symbol;                      // 0 = empty slot
+    } symbols[COMBO_SYMBOL_SLOTS];
+    
+    // Runtime
+    uint8_t state;
+    uint16_t last_mask;
+    uint64_t last_edge_us;
+    uint32_t gaps[COMBO_MAX_LENGTH];         // Recent edge gaps, ring
+    uint32_t gap_pos;
+} combo_matcher_t;
+
+// Function Prototypes
+void combo_matcher_reset(combo_matcher_t* matcher);
+void combo_matcher_restart(combo_matcher_t* matcher);
+int combo_matcher_add(combo_matcher_t* matcher, const uint16_t* buttons,
+                      const uint32_t* timings, uint32_t length, const ps5_state_t* result);
+int combo_matcher_feed(combo_matcher_t* matcher, uint16_t mask, uint64_t now_us);
+
+#endif // COMBO_H
@@ -0,0 +1,441 @@
+#include "cores.h"
+#include "smp.h"
+#include "irq.h"
+#include "ps5.h"
+#include "optimize.h"
+#include "script.h"
+#include "script_lib.h"
+#include "script_gui.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "clock.h"
+
+// GUI/telemetry pacing
+#define GUI_RENDER_INTERVAL_US   33333     // ~30 Hz
+#define PERF_CHECK_INTERVAL_US   1000000   // 1 second
+
+// Input core: owns the controller state while the link is up
+static struct {
+    volatile int link_up;     // Console and controller present (set by core 0)
+    volatile int busy;        // Inside a frame
+    int window_retired;       // Reply owed to the GUI core
+    uint32_t script_count;    // Scripts in the snapshot
+    ps5_state_t state;
+    ps5_output_t output;
+} input_core;
+
+// GUI core: telemetry and pacing
+static struct {
+    uint64_t last_render;
+    uint64_t last_perf_check;
+    int window_requested;     // Waiting for the input core to retire a window
+    performance_stats_t stats;
+    core_telemetry_t telemetry;
+} gui_core;
+
+// Script statistics for the GUI core's telemetry, taken by the input core
+// along with each retired window
+static script_snapshot_t script_snapshots[SCRIPT_MAX_SCRIPTS];
+
+// Script core: completed jobs, read by the GUI core
+static volatile uint32_t script_jobs_done;
+
+// Script core: loads and unloads handed to the input core, not yet answered.
+// At most MAILBOX_SIZE, so the input core's replies always fit.
+static uint32_t script_jobs_in_flight;
+
+// Script core: the SD card's packages have been read
+static int script_local_loaded;
+
+// Script core: the library's pages for the GUI core, which never reads
+// the library itself
+static script_pager_t script_pager;
+static const script_page_t* script_page_owed;   // Answer not yet sent
+static uint32_t script_generation_sent;         // Last change announced
+
+// Requests from the other cores, served between frames on this core,
+// which is the only writer of what they touch: the script engine runs
+// here, so scripts are only loaded and unloaded here
+static int input_core_requests(void) {
+    mailbox_msg_t msg;
+    int handled = 0;
+    
+    while (smp_receive(SMP_CORE_SCRIPTS, &msg)) {
+        mailbox_msg_t reply = { 0, msg.arg0, 0, 0 };
+        if (msg.type == CORE_MSG_SCRIPT_LOAD) {
+            reply.type = CORE_MSG_SCRIPT_LOADED;
+            reply.arg1 = (uint32_t)script_load_package(msg.data, msg.arg1);
+        } else if (msg.type == CORE_MSG_SCRIPT_UNLOAD) {
+            reply.type = CORE_MSG_SCRIPT_UNLOADED;
+            script_unload((const char*)msg.data);
+        } else {
+            continue;
+        }
+        smp_send(SMP_CORE_SCRIPTS, &reply);
+        handled++;
+    }
+    
+    while (smp_receive(SMP_CORE_GUI, &msg)) {
+        if (msg.type == CORE_MSG_RETIRE_WINDOW) {
+            optimize_retire_window();
+            input_core.script_count = script_snapshot(script_snapshots, SCRIPT_MAX_SCRIPTS);
+            input_core.window_retired = 1;
+            handled++;
+        }
+    }
+    
+    // Frame telemetry shares the mailbox and may have filled it; retry
+    if (input_core.window_retired) {
+        mailbox_msg_t reply = { CORE_MSG_WINDOW_RETIRED, input_core.script_count, 0, script_snapshots };
+        input_core.window_retired = !smp_send(SMP_CORE_GUI, &reply);
+    }
+    return handled;
+}
+
+// Forward one frame: newest input report, battery LED, merged output report
+static int input_core_step(void) {
+    int handled = input_core_requests();
+    if (!input_core.link_up) {
+        return handled;
+    }
+    
+    // Core 0 may drop the link to reset USB; re-check after claiming the frame
+    input_core.busy = 1;
+    hal_dmb();
+    if (!input_core.link_up) {
+        input_core.busy = 0;
+        return handled;
+    }
+    
+    PROFILE_BEGIN(PROFILE_ZONE_FRAME);
+    clock_frame_begin();
+    int forwarded = optimize_process_input(&input_core.state);
+    if (forwarded) {
+        // Update LED color based on battery level
+        ps5_output_t* output = &input_core.output;
+        uint8_t battery = ps5_get_battery_level();
+        if (battery < 20) {
+            output->led_r = 255; output->led_g = 0; output->led_b = 0;    // Red for low battery
+        } else if (battery < 50) {
+            output->led_r = 255; output->led_g = 165; output->led_b = 0;  // Orange for medium
+        } else {
+            output->led_r = 0; output->led_g = 255; output->led_b = 0;    // Green for good
+        }
+        
+        // Process output with optimizations; unchanged fields cost nothing
+        optimize_process_output(output);
+        
+        // Telemetry is best effort: a full mailbox never holds up the frame
+        uint32_t age = (uint32_t)(clock_now_us() - ps5_get_input_timestamp());
+        uint16_t buttons;
+        __builtin_memcpy(&buttons, &input_core.state.buttons, sizeof(buttons));
+        mailbox_msg_t msg = { CORE_MSG_FRAME, age, buttons, 0 };
+        smp_send(SMP_CORE_GUI, &msg);
+    }
+    
+    // Send output changes held back by per-category rate limits
+    ps5_flush_output();
+    clock_frame_end();
+    PROFILE_END(PROFILE_ZONE_FRAME);
+    
+    hal_dmb();
+    input_core.busy = 0;
+    return forwarded || handled;
+}
+
+// Take the USB interrupt on this core so the ring producer and consumer
+// share a core and input is never delayed by work elsewhere, and this
+// core's timer interrupt for its own deadlines. The script engine is
+// this core's too.
+static void input_core_init(void) {
+    script_init();
+    irq_init_cpu();
+    irq_route_to_core(SMP_CORE_INPUT);
+    clock_init_cpu();
+    irq_cpu_enable();
+}
+
+// Hand a load or unload to the input core. Returns 0 if the job is
+// already complete.
+static int script_core_post(uint32_t type, uint32_t key, uint32_t size, const void* data) {
+    mailbox_msg_t msg = { type, key, size, data };
+    if (!smp_send(SMP_CORE_INPUT, &msg)) {
+        return 0;
+    }
+    script_jobs_in_flight++;
+    return 1;
+}
+
+// Activation picks and pins the body here; the input core loads it
+static int script_core_activate(const char* name) {
+    uint32_t key;
+    uint32_t size;
+    const void* body;
+    if (!script_lib_begin_activate(name, &key, &body, &size) || !body) {
+        return 0;
+    }
+    if (!script_core_post(CORE_MSG_SCRIPT_LOAD, key, size, body)) {
+        script_lib_finish_activate(key, 0);
+        return 0;
+    }
+    return 1;
+}
+
+// The body stays pinned until the input core has unloaded the script
+static int script_core_deactivate(const char* name) {
+    uint32_t key;
+    const char* script_run;
+    if (!script_lib_begin_deactivate(name, &key, &script_run) || !script_run) {
+        return 0;
+    }
+    if (!script_core_post(CORE_MSG_SCRIPT_UNLOAD, key, 0, script_run)) {
+        script_lib_finish_deactivate(key, 0);
+        return 0;
+    }
+    return 1;
+}
+
+// Run script library jobs queued by the GUI
+static int script_core_step(void) {
+    mailbox_msg_t msg;
+    int handled = 0;
+    
+    // The SD card scan is this core's first job rather than part of init:
+    // card bring-up alone may take a second, and smp_start_core only waits
+    // 100 ms for a core to come up
+    if (!script_local_loaded) {
+        script_local_loaded = 1;
+        script_lib_load_local("/scripts");
+        return 1;
+    }
+    
+    // An answer that did not fit in the GUI core's mailbox last time
+    if (script_page_owed) {
+        mailbox_msg_t reply = { CORE_MSG_PAGE, 0, 0, script_page_owed };
+        if (smp_send(SMP_CORE_GUI, &reply)) {
+            script_page_owed = 0;
+        }
+    }
+    
+    // Loads and unloads the input core has finished
+    while (smp_receive(SMP_CORE_INPUT, &msg)) {
+        if (msg.type == CORE_MSG_SCRIPT_LOADED) {
+            script_lib_finish_activate(msg.arg0, (int)msg.arg1);
+        } else if (msg.type == CORE_MSG_SCRIPT_UNLOADED) {
+            script_lib_finish_deactivate(msg.arg0, 1);
+        } else {
+            continue;
+        }
+        script_jobs_in_flight--;
+        script_jobs_done++;
+        handled++;
+    }
+    
+    // New jobs wait in the mailbox while the input core's queue is full
+    while (script_jobs_in_flight < MAILBOX_SIZE && smp_receive(SMP_CORE_GUI, &msg)) {
+        if (msg.type == CORE_MSG_PAGE_REQUEST) {
+            script_page_owed = script_lib_page(&script_pager, (const script_page_request_t*)msg.data);
+            mailbox_msg_t reply = { CORE_MSG_PAGE, 0, 0, script_page_owed };
+            if (smp_send(SMP_CORE_GUI, &reply)) {
+                script_page_owed = 0;
+            }
+            handled++;
+            continue;
+        }
+        if (msg.type != CORE_MSG_SCRIPT_JOB) {
+            continue;
+        }
+        
+        // Jobs name the entry by key: one removed since is not replaced
+        // by whichever entry took its place
+        script_handle_t script = script_lib_find_key(msg.arg1);
+        if (script == SCRIPT_HANDLE_NONE) {
+            script_jobs_done++;
+            handled++;
+            continue;
+        }
+        const char* name = script_lib_name(script);
+        int posted = 0;
+        switch ((gui_event_t)msg.arg0) {
+            case GUI_EVENT_ACTIVATE:
+                posted = script_core_activate(name);
+                break;
+            case GUI_EVENT_DEACTIVATE:
+                posted = script_core_deactivate(name);
+                break;
+            case GUI_EVENT_DOWNLOAD:
+                script_lib_download(name);
+                break;
+            default:
+                break;
+        }
+        if (!posted) {
+            script_jobs_done++;
+        }
+        handled++;
+    }
+    
+    // Tell the GUI core its rows may be out of date
+    uint32_t generation = script_lib_generation();
+    if (generation != script_generation_sent) {
+        mailbox_msg_t changed = { CORE_MSG_LIBRARY_CHANGED, generation, 0, 0 };
+        if (smp_send(SMP_CORE_GUI, &changed)) {
+            script_generation_sent = generation;
+        }
+    }
+    
+    return handled;
+}
+
+// No I/O here, so the core reports running at once; the SD card is read
+// by the first step
+static void script_core_init(void) {
+    script_lib_init();
+    script_local_loaded = 0;
+    script_pager.open = 0;
+    script_page_owed = 0;
+}
+
+// GUI actions that touch the script library run on the script core
+static void gui_event_handler(gui_event_t event, void* data) {
+    (void)data;
+    
+    if (event != GUI_EVENT_ACTIVATE && event != GUI_EVENT_DEACTIVATE &&
+        event != GUI_EVENT_DOWNLOAD) {
+        return;
+    }
+    
+    const script_row_t* script = script_gui_get_selected();
+    if (script) {
+        mailbox_msg_t msg = { CORE_MSG_SCRIPT_JOB, event, script->key, 0 };
+        smp_send(SMP_CORE_SCRIPTS, &msg);
+    }
+}
+
+// Tune on the window the input core just retired. It and the script
+// snapshot stay put until this core asks for the next one.
+static void gui_core_tune(const script_snapshot_t* scripts, uint32_t script_count) {
+    optimize_get_stats(&gui_core.stats);
+    
+    // Auto-tune performance based on metrics
+    optimize_tune_performance();
+    
+    // Check temperature and throttle if needed
+    if (gui_core.stats.temperature > 80) { // 80°C threshold
+        optimize_set_mode(PROCESS_MODE_NORMAL);
+    } else if (gui_core.stats.temperature < 70) {
+        optimize_set_mode(PROCESS_MODE_FAST);
+    }
+    
+    gui_core.telemetry.tune_passes++;
+    
+    // Same snapshot, plus where each core's cycles went, to the UART
+    telemetry_send_pipeline(&gui_core.stats, scripts, script_count);
+    telemetry_send_profile();
+}
+
+// Collect telemetry, tune performance and render the GUI
+static int gui_core_step(void) {
+    mailbox_msg_t msg;
+    
+    while (smp_receive(SMP_CORE_INPUT, &msg)) {
+        if (msg.type == CORE_MSG_FRAME) {
+            gui_core.telemetry.frames++;
+            if (msg.arg0 > gui_core.telemetry.max_latency_us) {
+                gui_core.telemetry.max_latency_us = msg.arg0;
+            }
+        } else if (msg.type == CORE_MSG_WINDOW_RETIRED) {
+            gui_core.window_requested = 0;
+            gui_core_tune((const script_snapshot_t*)msg.data, msg.arg0);
+        }
+    }
+    gui_core.telemetry.script_jobs = script_jobs_done;
+    
+    // Library pages and changes from the script core
+    while (smp_receive(SMP_CORE_SCRIPTS, &msg)) {
+        if (msg.type == CORE_MSG_PAGE) {
+            script_gui_take_page((const script_page_t*)msg.data);
+        } else if (msg.type == CORE_MSG_LIBRARY_CHANGED) {
+            script_gui_library_changed();
+        }
+    }
+    const script_page_request_t* page_request = script_gui_page_request();
+    if (page_request) {
+        mailbox_msg_t request = { CORE_MSG_PAGE_REQUEST, 0, 0, page_request };
+        if (smp_send(SMP_CORE_SCRIPTS, &request)) {
+            script_gui_page_requested();
+        }
+    }
+    
+    uint64_t now = clock_now_us();
+    
+    // Performance monitoring and tuning: one window per interval, tuned
+    // once the input core has retired it
+    if (!gui_core.window_requested && now - gui_core.last_perf_check >= PERF_CHECK_INTERVAL_US) {
+        mailbox_msg_t request = { CORE_MSG_RETIRE_WINDOW, 0, 0, 0 };
+        if (smp_send(SMP_CORE_INPUT, &request)) {
+            gui_core.window_requested = 1;
+            gui_core.last_perf_check = now;
+        }
+    }
+    
+    if (now - gui_core.last_render >= GUI_RENDER_INTERVAL_US) {
+        script_gui_render();
+        gui_core.telemetry.renders++;
+        gui_core.last_render = now;
+    }
+    
+    // Hand queued telemetry to the DMA engine
+    telemetry_pump();
+    
+    // Paced by the timer, so never idle
+    return 1;
+}
+
+static void gui_core_init(void) {
+    uint64_t now = clock_now_us();
+    
+    __builtin_memset(&gui_core, 0, sizeof(gui_core));
+    gui_core.last_render = now;
+    gui_core.last_perf_check = now;
+    
+    script_gui_init();
+    script_gui_set_callback(gui_event_handler);
+}
+
+// Release cores 1-3 into their roles
+int cores_start(void) {
+    input_core.link_up = 0;
+    input_core.busy = 0;
+    input_core.window_retired = 0;
+    script_jobs_done = 0;
+    script_jobs_in_flight = 0;
+    
+    return smp_start_core(SMP_CORE_INPUT, input_core_init, input_core_step) &&
+           smp_start_core(SMP_CORE_SCRIPTS, script_core_init, script_core_step) &&
+           smp_start_core(SMP_CORE_GUI, gui_core_init, gui_core_step);
+}
+
+// Start or stop input forwarding. Stopping waits for the frame in flight,
+// so the caller may then reset USB and the controller safely.
+void cores_set_link(int up) {
+    if (up) {
+        ps5_get_output(&input_core.output);
+        hal_dmb();
+        input_core.link_up = 1;
+        return;
+    }
+    
+    input_core.link_up = 0;
+    hal_dmb();
+    while (input_core.busy) {
+        // Frame in flight on the input core
+    }
+}
+
+// Snapshot of the GUI core's telemetry
+void cores_get_telemetry(core_telemetry_t* telemetry) {
+    if (telemetry) {
+        *telemetry = gui_core.telemetry;
+    }
+}
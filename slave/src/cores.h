@@ -0,0 +1,34 @@
+#ifndef CORES_H
+#define CORES_H
+
+#include <stdint.h>
+
+// Messages between the core roles
+#define CORE_MSG_FRAME        1   // Input -> GUI: arg0 = report age (us), arg1 = buttons
+#define CORE_MSG_SCRIPT_JOB   2   // GUI -> scripts: arg0 = gui_event_t, arg1 = entry key (script_row_t)
+#define CORE_MSG_RETIRE_WINDOW 3  // GUI -> input: close the tuning window
+#define CORE_MSG_WINDOW_RETIRED 4 // Input -> GUI: closed, arg0 = scripts in data, data = script_snapshot_t[];
+                                  // both safe to read until the next request
+#define CORE_MSG_SCRIPT_LOAD  5   // Scripts -> input: arg0 = body key, arg1 = size, data = package
+#define CORE_MSG_SCRIPT_UNLOAD 6  // Scripts -> input: arg0 = body key, data = script name
+#define CORE_MSG_SCRIPT_LOADED 7  // Input -> scripts: arg0 = body key, arg1 = loaded
+#define CORE_MSG_SCRIPT_UNLOADED 8 // Input -> scripts: arg0 = body key
+#define CORE_MSG_PAGE_REQUEST 9   // GUI -> scripts: data = script_page_request_t, untouched until answered
+#define CORE_MSG_PAGE         10  // Scripts -> GUI: data = script_page_t, valid until the next request
+#define CORE_MSG_LIBRARY_CHANGED 11 // Scripts -> GUI: arg0 = library generation
+
+// Telemetry gathered on the GUI core
+typedef struct {
+    uint32_t frames;              // Frames forwarded by the input core
+    uint32_t max_latency_us;      // Worst report age seen
+    uint32_t script_jobs;         // Jobs completed by the script core
+    uint32_t renders;             // GUI frames rendered
+    uint32_t tune_passes;         // Performance tuning passes
+} core_telemetry_t;
+
+// Function Prototypes
+int cores_start(void);
+void cores_set_link(int up);
+void cores_get_telemetry(core_telemetry_t* telemetry);
+
+#endif // CORES_H
@@ -0,0 +1,180 @@
+#include "crc32.h"
+
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+
+#define CRC32_POLY 0xEDB88320u
+
+// Engines work on the inverted register; crc32_update() does the inversion
+typedef uint32_t (*crc32_fn_t)(uint32_t crc, const uint8_t* bytes, uint32_t size);
+
+static struct {
+    crc32_fn_t update;
+    crc32_engine_t engine;
+    uint32_t table[8][256];     // table[k][b]: CRC of byte b followed by k zero bytes
+    int tables_ready;
+} crc;
+
+// Bitwise reference implementation
+static uint32_t crc32_bitwise(uint32_t value, const uint8_t* bytes, uint32_t size) {
+    while (size--) {
+        value ^= *bytes++;
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            value = (value >> 1) ^ (CRC32_POLY & (0u - (value & 1)));
+        }
+    }
+    return value;
+}
+
+static void build_tables(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint8_t byte = (uint8_t)b;
+        crc.table[0][b] = crc32_bitwise(0, &byte, 1);
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (uint32_t k = 1; k < 8; k++) {
+            uint32_t prev = crc.table[k - 1][b];
+            crc.table[k][b] = (prev >> 8) ^ crc.table[0][prev & 0xFF];
+        }
+    }
+    crc.tables_ready = 1;
+}
+
+// Slicing-by-8: two words per step, eight independent table lookups.
+// Words are loaded little-endian, as on both the Pi and the host.
+static uint32_t crc32_slice8(uint32_t value, const uint8_t* bytes, uint32_t size) {
+    while (size && ((uintptr_t)bytes & 3)) {
+        value = (value >> 8) ^ crc.table[0][(value ^ *bytes++) & 0xFF];
+        size--;
+    }
+    
+    while (size >= 8) {
+        uint32_t one, two;
+        __builtin_memcpy(&one, bytes, 4);
+        __builtin_memcpy(&two, bytes + 4, 4);
+        one ^= value;
+        value = crc.table[7][one & 0xFF] ^ crc.table[6][(one >> 8) & 0xFF] ^
+                crc.table[5][(one >> 16) & 0xFF] ^ crc.table[4][one >> 24] ^
+                crc.table[3][two & 0xFF] ^ crc.table[2][(two >> 8) & 0xFF] ^
+                crc.table[1][(two >> 16) & 0xFF] ^ crc.table[0][two >> 24];
+        bytes += 8;
+        size -= 8;
+    }
+    
+    while (size--) {
+        value = (value >> 8) ^ crc.table[0][(value ^ *bytes++) & 0xFF];
+    }
+    return value;
+}
+
+#ifdef __ARM_FEATURE_CRC32
+// One CRC32W per word (CRC32X per doubleword on AArch64)
+static uint32_t crc32_armv8(uint32_t value, const uint8_t* bytes, uint32_t size) {
+    while (size && ((uintptr_t)bytes & 7)) {
+        value = __crc32b(value, *bytes++);
+        size--;
+    }
+    
+#ifdef __aarch64__
+    while (size >= 8) {
+        uint64_t word;
+        __builtin_memcpy(&word, bytes, 8);
+        value = __crc32d(value, word);
+        bytes += 8;
+        size -= 8;
+    }
+#else
+    while (size >= 8) {
+        uint32_t one, two;
+        __builtin_memcpy(&one, bytes, 4);
+        __builtin_memcpy(&two, bytes + 4, 4);
+        value = __crc32w(__crc32w(value, one), two);
+        bytes += 8;
+        size -= 8;
+    }
+#endif
+    
+    while (size--) {
+        value = __crc32b(value, *bytes++);
+    }
+    return value;
+}
+
+// Whether the core implements the CRC32 instructions
+static int armv8_supported(void) {
+#if defined(__BARE_METAL__) && !defined(__aarch64__)
+    // ID_ISAR5.CRC32, bits [19:16]
+    uint32_t isar5;
+    __asm__ volatile("mrc p15, 0, %0, c0, c2, 5" : "=r" (isar5));
+    return ((isar5 >> 16) & 0xF) != 0;
+#else
+    // The compiler was told the target has them
+    return 1;
+#endif
+}
+#endif
+
+// Pick the fastest engine available
+crc32_engine_t crc32_init(void) {
+    if (!crc32_select(CRC32_ENGINE_ARMV8)) {
+        crc32_select(CRC32_ENGINE_SLICE8);
+    }
+    return crc.engine;
+}
+
+// Use a particular engine. Returns 0 if the core does not support it.
+int crc32_select(crc32_engine_t engine) {
+    switch (engine) {
+        case CRC32_ENGINE_BITWISE:
+            crc.update = crc32_bitwise;
+            break;
+            
+        case CRC32_ENGINE_SLICE8:
+            if (!crc.tables_ready) {
+                build_tables();
+            }
+            crc.update = crc32_slice8;
+            break;
+            
+        case CRC32_ENGINE_ARMV8:
+#ifdef __ARM_FEATURE_CRC32
+            if (!armv8_supported()) {
+                return 0;
+            }
+            crc.update = crc32_armv8;
+            break;
+#else
+            return 0;
+#endif
+            
+        default:
+            return 0;
+    }
+    crc.engine = engine;
+    return 1;
+}
+
+crc32_engine_t crc32_engine(void) {
+    if (!crc.update) {
+        crc32_select(CRC32_ENGINE_SLICE8);
+    }
+    return crc.engine;
+}
+
+const char* crc32_engine_name(crc32_engine_t engine) {
+    switch (engine) {
+        case CRC32_ENGINE_BITWISE: return "bitwise";
+        case CRC32_ENGINE_SLICE8:  return "slicing-by-8";
+        case CRC32_ENGINE_ARMV8:   return "armv8-crc32";
+        default:                   return "unknown";
+    }
+}
+
+// Continue a checksum over more data
+uint32_t crc32_update(uint32_t value, const void* data, uint32_t size) {
+    if (!crc.update) {
+        crc32_select(CRC32_ENGINE_SLICE8);
+    }
+    return ~crc.update(~value, (const uint8_t*)data, size);
+}
@@ -0,0 +1,51 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320), zlib convention:
+// start from 0 and feed the previous result back in to continue.
+//
+// crc32_init() picks the fastest engine the core supports: the ARMv8
+// CRC32 instructions where available, otherwise table-driven
+// slicing-by-8. Until then the slicing-by-8 engine is used.
+
+typedef enum {
+    CRC32_ENGINE_BITWISE,   // Reference, one bit per step
+    CRC32_ENGINE_SLICE8,    // 8 KB of tables, 8 bytes per step
+    CRC32_ENGINE_ARMV8,     // CRC32B/W instructions
+    CRC32_ENGINE_COUNT
+} crc32_engine_t;
+
+// Running checksum over data that arrives in pieces
+typedef struct {
+    uint32_t crc;
+    uint32_t length;        // Bytes fed so far
+} crc32_stream_t;
+
+// Function Prototypes
+crc32_engine_t crc32_init(void);
+int crc32_select(crc32_engine_t engine);
+crc32_engine_t crc32_engine(void);
+const char* crc32_engine_name(crc32_engine_t engine);
+uint32_t crc32_update(uint32_t crc, const void* data, uint32_t size);
+
+static inline uint32_t crc32(const void* data, uint32_t size) {
+    return crc32_update(0, data, size);
+}
+
+static inline void crc32_stream_init(crc32_stream_t* stream) {
+    stream->crc = 0;
+    stream->length = 0;
+}
+
+static inline void crc32_stream_feed(crc32_stream_t* stream, const void* data, uint32_t size) {
+    stream->crc = crc32_update(stream->crc, data, size);
+    stream->length += size;
+}
+
+static inline uint32_t crc32_stream_final(const crc32_stream_t* stream) {
+    return stream->crc;
+}
+
+#endif // CRC32_H
@@ -0,0 +1,383 @@
+#include "dma.h"
+#include "irq.h"
+
+// Engine channel numbers
+static const uint8_t channels[DMA_ENGINE_CHANNELS] = { 0, 2, 4 };
+
+// Control blocks and fill sources are read by the engine from the
+// non-cacheable section
+static dma_cb_t HAL_DMA_BUFFER cb_pool[DMA_CB_POOL];
+static uint32_t HAL_DMA_BUFFER fill_words[DMA_MAX_REQUESTS];
+
+typedef enum {
+    REQUEST_FREE,
+    REQUEST_QUEUED,
+    REQUEST_ACTIVE
+} request_state_t;
+
+typedef struct {
+    uint32_t ticket;
+    request_state_t state;
+    uint32_t count;
+    uint8_t cbs[DMA_MAX_SEGMENTS];              // One control block per segment
+    dma_segment_t segments[DMA_MAX_SEGMENTS];   // Destinations to invalidate
+    dma_callback_t done;
+    void* user;
+} request_t;
+
+// Callback owed once the engine state is consistent again
+typedef struct {
+    dma_callback_t done;
+    uint32_t ticket;
+    int ok;
+    void* user;
+} completion_t;
+
+static struct {
+    int ready;
+    uint8_t busy;                               // Spinlock
+    dma_completion_t mode;
+    int in_irq;
+    uint32_t next_ticket;
+    uint8_t free_cbs[DMA_CB_POOL];
+    uint32_t free_count;
+    request_t requests[DMA_MAX_REQUESTS];
+    int running[DMA_ENGINE_CHANNELS];           // Request index, -1 when idle
+    uint8_t queue[DMA_MAX_REQUESTS];            // Requests waiting for a channel
+    uint32_t queue_head;
+    uint32_t queue_count;
+    dma_stats_t stats;
+} engine;
+
+// Any core may use the engine, so its state sits behind a spinlock. In IRQ
+// mode the channel interrupts are masked first, so the handler can never
+// spin on a lock held by the code it interrupted.
+static void lock(void) {
+    if (engine.mode == DMA_COMPLETE_IRQ && !engine.in_irq) {
+        for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+            irq_disable(IRQ_DMA0 + channels[i]);
+        }
+    }
+    while (__atomic_test_and_set(&engine.busy, __ATOMIC_ACQUIRE)) {
+        // Another core is submitting or retiring
+    }
+}
+
+static void unlock(void) {
+    __atomic_clear(&engine.busy, __ATOMIC_RELEASE);
+    if (engine.mode == DMA_COMPLETE_IRQ && !engine.in_irq) {
+        for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+            irq_enable(IRQ_DMA0 + channels[i]);
+        }
+    }
+}
+
+static void dma_irq_handler(void) {
+    engine.in_irq = 1;
+    dma_poll();
+    engine.in_irq = 0;
+}
+
+static void reset_channel(uint32_t channel) {
+    *DMA_CHANNEL_CS(channel) = DMA_CS_RESET;
+    while (*DMA_CHANNEL_CS(channel) & DMA_CS_RESET) {
+        // Channel reset
+    }
+    *DMA_CHANNEL_CS(channel) = DMA_CS_END | DMA_CS_INT;
+}
+
+// Reset the engine channels and forget every request; callbacks of
+// requests in flight are not called
+int dma_init(dma_completion_t mode) {
+    __builtin_memset(&engine, 0, sizeof(engine));
+    engine.mode = mode;
+    engine.next_ticket = 1;
+    for (uint32_t i = 0; i < DMA_CB_POOL; i++) {
+        engine.free_cbs[i] = (uint8_t)i;
+    }
+    engine.free_count = DMA_CB_POOL;
+
+    for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+        engine.running[i] = -1;
+        *DMA_ENABLE |= 1u << channels[i];
+        reset_channel(channels[i]);
+        if (mode == DMA_COMPLETE_IRQ) {
+            irq_register(IRQ_DMA0 + channels[i], dma_irq_handler);
+            irq_enable(IRQ_DMA0 + channels[i]);
+        } else {
+            irq_disable(IRQ_DMA0 + channels[i]);
+        }
+    }
+
+    engine.ready = 1;
+    return 1;
+}
+
+// Hand a request's chain to a channel
+static void start(uint32_t index, uint32_t r) {
+    request_t* request = &engine.requests[r];
+    uint32_t channel = channels[index];
+
+    request->state = REQUEST_ACTIVE;
+    engine.running[index] = (int)r;
+    *DMA_CHANNEL_CONBLK(channel) = hal_bus_addr(&cb_pool[request->cbs[0]]);
+    *DMA_CHANNEL_CS(channel) = DMA_CS_ACTIVE | DMA_CS_WAIT_WRITES;
+}
+
+// Give a channel that just went idle the oldest queued request
+static void start_next(uint32_t index) {
+    if (engine.queue_count) {
+        uint32_t next = engine.queue[engine.queue_head];
+        engine.queue_head = (engine.queue_head + 1) % DMA_MAX_REQUESTS;
+        engine.queue_count--;
+        start(index, next);
+    }
+}
+
+// Build the control block chain and start it, or queue it behind the
+// others. A fill writes value over its one segment. Called with the
+// engine locked.
+static uint32_t submit(const dma_segment_t* segments, uint32_t count, int fill, uint8_t value,
+                       dma_callback_t done, void* user) {
+    uint32_t r = 0;
+    while (r < DMA_MAX_REQUESTS && engine.requests[r].state != REQUEST_FREE) {
+        r++;
+    }
+    if (r == DMA_MAX_REQUESTS || count > engine.free_count) {
+        engine.stats.rejected++;
+        return 0;
+    }
+
+    request_t* request = &engine.requests[r];
+    request->ticket = engine.next_ticket++;
+    if (engine.next_ticket == 0) {
+        engine.next_ticket = 1;
+    }
+    request->count = count;
+    request->done = done;
+    request->user = user;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const dma_segment_t* segment = &segments[i];
+        uint8_t index = engine.free_cbs[--engine.free_count];
+        dma_cb_t* cb = &cb_pool[index];
+        request->cbs[i] = index;
+        request->segments[i] = *segment;
+
+        if (fill) {
+            // 32-bit reads of the same word
+            fill_words[r] = value * 0x01010101u;
+            cb->ti = DMA_TI_DEST_INC | DMA_TI_WAIT_RESP;
+            cb->source_ad = hal_bus_addr(&fill_words[r]);
+        } else {
+            cb->ti = DMA_TI_SRC_INC | DMA_TI_DEST_INC | DMA_TI_WAIT_RESP | DMA_TI_BURST(4);
+            if ((((uintptr_t)segment->dest | (uintptr_t)segment->src | segment->size) & 15) == 0) {
+                cb->ti |= DMA_TI_SRC_WIDTH | DMA_TI_DEST_WIDTH;
+            }
+            cb->source_ad = hal_bus_addr(segment->src);
+            hal_dcache_clean(segment->src, segment->size);
+        }
+        cb->dest_ad = hal_bus_addr(segment->dest);
+        cb->txfr_len = segment->size;
+        cb->stride = 0;
+        cb->nextconbk = 0;
+        if (i > 0) {
+            cb_pool[request->cbs[i - 1]].nextconbk = hal_bus_addr(cb);
+        }
+
+        // Dirty destination lines must not be evicted over the result
+        hal_dcache_clean_invalidate(segment->dest, segment->size);
+        engine.stats.bytes += segment->size;
+    }
+    if (engine.mode == DMA_COMPLETE_IRQ) {
+        cb_pool[request->cbs[count - 1]].ti |= DMA_TI_INTEN;
+    }
+    hal_dsb();
+    engine.stats.submitted++;
+
+    for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+        if (engine.running[i] < 0) {
+            start(i, r);
+            return request->ticket;
+        }
+    }
+    request->state = REQUEST_QUEUED;
+    engine.queue[(engine.queue_head + engine.queue_count) % DMA_MAX_REQUESTS] = (uint8_t)r;
+    engine.queue_count++;
+    engine.stats.queued++;
+    return request->ticket;
+}
+
+static int valid(const dma_segment_t* segment, int fill) {
+    return segment->dest && (fill || segment->src) &&
+           segment->size > 0 && segment->size <= DMA_MAX_SEGMENT;
+}
+
+// Copy a scatter-gather list. Returns the ticket, or 0 if the list is
+// invalid or the engine is out of request slots or control blocks.
+uint32_t dma_submit(const dma_segment_t* segments, uint32_t count,
+                    dma_callback_t done, void* user) {
+    if (!engine.ready || !segments || count == 0 || count > DMA_MAX_SEGMENTS) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!valid(&segments[i], 0)) {
+            return 0;
+        }
+    }
+
+    lock();
+    uint32_t ticket = submit(segments, count, 0, 0, done, user);
+    unlock();
+    return ticket;
+}
+
+// Set size bytes at dest to value
+uint32_t dma_fill(void* dest, uint8_t value, uint32_t size,
+                  dma_callback_t done, void* user) {
+    dma_segment_t segment = { dest, 0, size };
+    if (!engine.ready || !valid(&segment, 1)) {
+        return 0;
+    }
+
+    lock();
+    uint32_t ticket = submit(&segment, 1, 1, value, done, user);
+    unlock();
+    return ticket;
+}
+
+// Retire finished requests, start queued ones and run the callbacks.
+// Returns the number of requests still outstanding.
+uint32_t dma_poll(void) {
+    completion_t completions[DMA_ENGINE_CHANNELS];
+    uint32_t completed = 0;
+    uint32_t outstanding = 0;
+
+    if (!engine.ready) {
+        return 0;
+    }
+
+    lock();
+    for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+        uint32_t channel = channels[i];
+        uint32_t cs = *DMA_CHANNEL_CS(channel);
+        if (cs & DMA_CS_INT) {
+            *DMA_CHANNEL_CS(channel) = DMA_CS_INT;
+        }
+
+        int r = engine.running[i];
+        if (r < 0 || (cs & DMA_CS_ACTIVE)) {
+            continue;
+        }
+
+        request_t* request = &engine.requests[r];
+        int ok = !(cs & DMA_CS_ERROR);
+        if (!ok) {
+            reset_channel(channel);
+            engine.stats.failed++;
+        }
+
+        // Drop lines speculatively refilled during the transfer
+        for (uint32_t s = 0; s < request->count; s++) {
+            hal_dcache_invalidate(request->segments[s].dest, request->segments[s].size);
+            engine.free_cbs[engine.free_count++] = request->cbs[s];
+        }
+        completions[completed++] = (completion_t){ request->done, request->ticket, ok, request->user };
+        request->state = REQUEST_FREE;
+        request->ticket = 0;
+        engine.stats.completed++;
+        engine.running[i] = -1;
+        start_next(i);
+    }
+    for (uint32_t r = 0; r < DMA_MAX_REQUESTS; r++) {
+        outstanding += engine.requests[r].state != REQUEST_FREE;
+    }
+    unlock();
+
+    // Callbacks last, so they may submit again
+    for (uint32_t i = 0; i < completed; i++) {
+        if (completions[i].done) {
+            completions[i].done(completions[i].ticket, completions[i].ok, completions[i].user);
+        }
+    }
+    return outstanding;
+}
+
+// A ticket is done once its callback has been called; 0 is never pending
+int dma_done(uint32_t ticket) {
+    for (uint32_t r = 0; r < DMA_MAX_REQUESTS; r++) {
+        if (ticket && engine.requests[r].ticket == ticket) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Poll until the request completes. Returns 0 on timeout.
+int dma_wait(uint32_t ticket) {
+    uint64_t start = get_system_time();
+    while (!dma_done(ticket)) {
+        dma_poll();
+        if (get_system_time() - start > DMA_WAIT_TIMEOUT_US) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Withdraw a request that has not completed: a queued one leaves the FIFO
+// and a running one has its channel reset, which may leave its destination
+// partly written. Its callback is never called. Returns 0 if the ticket
+// already completed.
+int dma_cancel(uint32_t ticket) {
+    int cancelled = 0;
+
+    if (!engine.ready || !ticket) {
+        return 0;
+    }
+
+    lock();
+    for (uint32_t r = 0; r < DMA_MAX_REQUESTS; r++) {
+        request_t* request = &engine.requests[r];
+        if (request->ticket != ticket) {
+            continue;
+        }
+
+        if (request->state == REQUEST_QUEUED) {
+            uint32_t kept = 0;
+            for (uint32_t q = 0; q < engine.queue_count; q++) {
+                uint8_t waiting = engine.queue[(engine.queue_head + q) % DMA_MAX_REQUESTS];
+                if (waiting != r) {
+                    engine.queue[(engine.queue_head + kept++) % DMA_MAX_REQUESTS] = waiting;
+                }
+            }
+            engine.queue_count = kept;
+        } else {
+            for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+                if (engine.running[i] == (int)r) {
+                    reset_channel(channels[i]);
+                    engine.running[i] = -1;
+                    start_next(i);
+                }
+            }
+        }
+
+        for (uint32_t s = 0; s < request->count; s++) {
+            hal_dcache_invalidate(request->segments[s].dest, request->segments[s].size);
+            engine.free_cbs[engine.free_count++] = request->cbs[s];
+        }
+        request->state = REQUEST_FREE;
+        request->ticket = 0;
+        engine.stats.cancelled++;
+        cancelled = 1;
+        break;
+    }
+    unlock();
+    return cancelled;
+}
+
+void dma_get_stats(dma_stats_t* stats) {
+    if (stats) {
+        *stats = engine.stats;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stdint.h>
+#include "hardware.h"
+
+// Asynchronous memory-to-memory DMA
+//
+// A submission is a scatter-gather list of copies (or one fill) that becomes
+// a chain of control blocks from a shared pool and runs on the first free
+// engine channel; when all channels are busy it waits in a FIFO. Submitting
+// returns a ticket at once. The request completes in dma_poll(), or in the
+// channel's interrupt when the engine runs in DMA_COMPLETE_IRQ mode, which
+// retires it, starts the next queued request and then calls its callback.
+//
+// Sources are cleaned and destinations cleaned and invalidated from the data
+// cache at submission, and destinations invalidated again at completion, so
+// buffers may be cacheable. Neither may be touched until completion, or
+// until dma_cancel() withdraws the request.
+// Any core may submit, and a callback runs on whichever core retires its
+// request.
+//
+// The UART telemetry channel (telemetry.c) is DREQ-paced and separate.
+
+// Channels 0, 2 and 4: full channels left free by the boot firmware
+#define DMA_ENGINE_CHANNELS     3
+#define DMA_CB_POOL             64
+#define DMA_MAX_REQUESTS        16
+#define DMA_MAX_SEGMENTS        16
+#define DMA_MAX_SEGMENT         (1u << 30)  // TXFR_LEN limit of a full channel
+#define DMA_WAIT_TIMEOUT_US     100000
+
+// Control block as read by the engine (32-byte aligned)
+typedef struct __attribute__((aligned(32))) {
+    uint32_t ti;
+    uint32_t source_ad;
+    uint32_t dest_ad;
+    uint32_t txfr_len;
+    uint32_t stride;
+    uint32_t nextconbk;
+    uint32_t reserved[2];
+} dma_cb_t;
+
+// One piece of a scatter-gather copy
+typedef struct {
+    void* dest;
+    const void* src;
+    uint32_t size;
+} dma_segment_t;
+
+typedef enum {
+    DMA_COMPLETE_POLL,          // Completion in dma_poll()
+    DMA_COMPLETE_IRQ            // Completion in the channel interrupt
+} dma_completion_t;
+
+// Called once per request; ok is 0 if the engine reported an error
+typedef void (*dma_callback_t)(uint32_t ticket, int ok, void* user);
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;            // Completed with an engine error
+    uint32_t rejected;          // No request slot or control blocks left
+    uint32_t queued;            // Had to wait for a channel
+    uint32_t cancelled;         // Withdrawn by dma_cancel()
+    uint64_t bytes;
+} dma_stats_t;
+
+// Function Prototypes
+int dma_init(dma_completion_t mode);
+uint32_t dma_submit(const dma_segment_t* segments, uint32_t count,
+                    dma_callback_t done, void* user);
+uint32_t dma_fill(void* dest, uint8_t value, uint32_t size,
+                  dma_callback_t done, void* user);
+uint32_t dma_poll(void);
+int dma_done(uint32_t ticket);
+int dma_wait(uint32_t ticket);
+int dma_cancel(uint32_t ticket);
+void dma_get_stats(dma_stats_t* stats);
+
+#endif // DMA_H
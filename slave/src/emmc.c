@@ -0,0 +1,230 @@
+#include "emmc.h"
+#include "hardware.h"
+
+// SD slot pins 48-53 (CLK, CMD, DAT0-3)
+#define GPIO_BASE           (MMIO_BASE + 0x200000)
+#define GPIO_GPFSEL4        HAL_REG(GPIO_BASE + 0x10)
+#define GPIO_GPFSEL5        HAL_REG(GPIO_BASE + 0x14)
+#define GPIO_ALT3           7
+
+// Timeouts
+#define EMMC_RESET_TIMEOUT_US   10000
+#define EMMC_CMD_TIMEOUT_US     100000
+#define EMMC_DATA_TIMEOUT_US    500000
+#define EMMC_INIT_TIMEOUT_US    1000000   // ACMD41 power-up
+
+// Card bus clocks
+#define EMMC_IDENT_CLOCK    400000
+#define EMMC_TRANSFER_CLOCK 25000000
+
+// Commands
+#define SD_GO_IDLE          0
+#define SD_ALL_SEND_CID     2
+#define SD_SEND_RCA         3
+#define SD_SELECT_CARD      7
+#define SD_SEND_IF_COND     8
+#define SD_STOP             12
+#define SD_SET_BLOCKLEN     16
+#define SD_READ_SINGLE      17
+#define SD_READ_MULTIPLE    18
+#define SD_APP_CMD          55
+#define SD_APP_BUS_WIDTH    6
+#define SD_APP_OP_COND      41
+
+// OCR bits
+#define OCR_BUSY            (1U << 31)  // Set when power-up is done
+#define OCR_CCS             (1U << 30)  // SDHC/SDXC: block addressing
+#define OCR_VOLTAGE_3V3     0x00FF8000
+#define IF_COND_3V3         0x1AA
+
+static struct {
+    int ready;
+    int block_addressing;
+    uint32_t rca;
+    emmc_stats_t stats;
+} emmc;
+
+// Wait for any of the interrupt bits, or an error. Returns the bits seen,
+// or 0 on error or timeout.
+static uint32_t emmc_wait(uint32_t mask, uint32_t timeout_us) {
+    uint64_t start = get_system_time();
+    uint32_t irq;
+    
+    while (!((irq = *EMMC_INTERRUPT) & (mask | EMMC_INT_ERR))) {
+        if (get_system_time() - start > timeout_us) {
+            emmc.stats.timeouts++;
+            return 0;
+        }
+    }
+    if (irq & EMMC_INT_ERR) {
+        emmc.stats.errors++;
+        *EMMC_INTERRUPT = EMMC_INT_ERRORS;
+        return 0;
+    }
+    return irq & mask;
+}
+
+// Issue a command and wait for its response
+static int emmc_command(uint32_t index, uint32_t flags, uint32_t arg) {
+    uint64_t start = get_system_time();
+    while (*EMMC_STATUS & EMMC_STATUS_CMD_INHIBIT) {
+        if (get_system_time() - start > EMMC_CMD_TIMEOUT_US) {
+            emmc.stats.timeouts++;
+            return 0;
+        }
+    }
+    
+    *EMMC_INTERRUPT = 0xFFFFFFFF;
+    *EMMC_ARG1 = arg;
+    *EMMC_CMDTM = CMDTM_INDEX(index) | flags;
+    emmc.stats.commands++;
+    return emmc_wait(EMMC_INT_CMD_DONE, EMMC_CMD_TIMEOUT_US) != 0;
+}
+
+// Application command (CMD55 prefix)
+static int emmc_app_command(uint32_t index, uint32_t flags, uint32_t arg) {
+    return emmc_command(SD_APP_CMD, CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, emmc.rca) &&
+           emmc_command(index, flags, arg);
+}
+
+// Program the SD clock divider and wait for it to settle
+static int emmc_set_clock(uint32_t hz) {
+    uint32_t divider = (EMMC_BASE_CLOCK + 2 * hz - 1) / (2 * hz);
+    if (divider > 0x3FF) {
+        divider = 0x3FF;
+    }
+    
+    *EMMC_CONTROL1 &= ~EMMC_CLK_EN;
+    *EMMC_CONTROL1 = (*EMMC_CONTROL1 & ~EMMC_CLK_DIV(0x3FF)) | EMMC_CLK_DIV(divider) | EMMC_CLK_INTLEN;
+    
+    uint64_t start = get_system_time();
+    while (!(*EMMC_CONTROL1 & EMMC_CLK_STABLE)) {
+        if (get_system_time() - start > EMMC_RESET_TIMEOUT_US) {
+            emmc.stats.timeouts++;
+            return 0;
+        }
+    }
+    *EMMC_CONTROL1 |= EMMC_CLK_EN;
+    return 1;
+}
+
+// Reset the controller and bring the card to the transfer state
+int emmc_init(void) {
+    emmc.ready = 0;
+    emmc.rca = 0;
+    
+    // Route the SD slot to EMMC
+    *GPIO_GPFSEL4 = (*GPIO_GPFSEL4 & ~(0x3FU << 24)) | (GPIO_ALT3 << 24) | (GPIO_ALT3 << 27);
+    *GPIO_GPFSEL5 = (*GPIO_GPFSEL5 & ~0xFFFU) | GPIO_ALT3 | (GPIO_ALT3 << 3) |
+                    (GPIO_ALT3 << 6) | (GPIO_ALT3 << 9);
+    
+    // Controller reset
+    *EMMC_CONTROL0 = 0;
+    *EMMC_CONTROL1 = EMMC_SRST_HC;
+    uint64_t start = get_system_time();
+    while (*EMMC_CONTROL1 & EMMC_SRST_HC) {
+        if (get_system_time() - start > EMMC_RESET_TIMEOUT_US) {
+            emmc.stats.timeouts++;
+            return 0;
+        }
+    }
+    *EMMC_CONTROL1 = EMMC_DATA_TOUNIT(0xE);
+    if (!emmc_set_clock(EMMC_IDENT_CLOCK)) {
+        return 0;
+    }
+    
+    // Status bits latch into INTERRUPT; nothing is routed to the ARM
+    *EMMC_IRPT_EN = 0;
+    *EMMC_IRPT_MASK = 0xFFFFFFFF;
+    
+    // Identification: a version 2 card echoes the check pattern
+    emmc_command(SD_GO_IDLE, CMDTM_RSP_NONE, 0);
+    if (!emmc_command(SD_SEND_IF_COND, CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, IF_COND_3V3) ||
+        (*EMMC_RESP0 & 0xFFF) != IF_COND_3V3) {
+        return 0;
+    }
+    
+    // Power up, asking for high capacity
+    uint32_t ocr = 0;
+    start = get_system_time();
+    while (!(ocr & OCR_BUSY)) {
+        if (!emmc_app_command(SD_APP_OP_COND, CMDTM_RSP_48, OCR_CCS | OCR_VOLTAGE_3V3) ||
+            get_system_time() - start > EMMC_INIT_TIMEOUT_US) {
+            return 0;
+        }
+        ocr = *EMMC_RESP0;
+    }
+    emmc.block_addressing = (ocr & OCR_CCS) != 0;
+    
+    // Address assignment and selection
+    if (!emmc_command(SD_ALL_SEND_CID, CMDTM_RSP_136 | CMDTM_CRCCHK_EN, 0) ||
+        !emmc_command(SD_SEND_RCA, CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, 0)) {
+        return 0;
+    }
+    emmc.rca = *EMMC_RESP0 & 0xFFFF0000;
+    if (!emmc_command(SD_SELECT_CARD, CMDTM_RSP_48_BUSY | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, emmc.rca)) {
+        return 0;
+    }
+    
+    // Full speed, 4-bit bus, 512-byte blocks
+    if (!emmc_set_clock(EMMC_TRANSFER_CLOCK) ||
+        !emmc_app_command(SD_APP_BUS_WIDTH, CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, 2)) {
+        return 0;
+    }
+    *EMMC_CONTROL0 |= EMMC_CONTROL0_4BIT;
+    if (!emmc.block_addressing &&
+        !emmc_command(SD_SET_BLOCKLEN, CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN, EMMC_BLOCK_SIZE)) {
+        return 0;
+    }
+    
+    emmc.ready = 1;
+    return 1;
+}
+
+// Read blocks into a word-aligned buffer. Runs of more than one block go
+// out as a single CMD18.
+int emmc_read(uint32_t lba, uint32_t count, void* buffer) {
+    uint32_t* words = (uint32_t*)buffer;
+    
+    if (!emmc.ready || !buffer || ((uintptr_t)buffer & 3)) {
+        return 0;
+    }
+    
+    while (count) {
+        uint32_t blocks = count > EMMC_MAX_BLOCKS ? EMMC_MAX_BLOCKS : count;
+        uint32_t flags = CMDTM_ISDATA | CMDTM_DAT_DIR_READ | CMDTM_RSP_48 | CMDTM_CRCCHK_EN | CMDTM_IXCHK_EN;
+        uint32_t index = SD_READ_SINGLE;
+        if (blocks > 1) {
+            flags |= CMDTM_MULTI_BLOCK | CMDTM_BLKCNT_EN | CMDTM_AUTO_CMD12;
+            index = SD_READ_MULTIPLE;
+        }
+        
+        *EMMC_BLKSIZECNT = (blocks << 16) | EMMC_BLOCK_SIZE;
+        if (!emmc_command(index, flags, emmc.block_addressing ? lba : lba * EMMC_BLOCK_SIZE)) {
+            return 0;
+        }
+        
+        for (uint32_t block = 0; block < blocks; block++) {
+            if (!emmc_wait(EMMC_INT_READ_RDY, EMMC_DATA_TIMEOUT_US)) {
+                return 0;
+            }
+            *EMMC_INTERRUPT = EMMC_INT_READ_RDY;
+            for (uint32_t i = 0; i < EMMC_BLOCK_SIZE / 4; i++) {
+                *words++ = *EMMC_DATA;
+            }
+        }
+        if (!emmc_wait(EMMC_INT_DATA_DONE, EMMC_DATA_TIMEOUT_US)) {
+            return 0;
+        }
+        
+        emmc.stats.reads++;
+        emmc.stats.blocks_read += blocks;
+        lba += blocks;
+        count -= blocks;
+    }
+    return 1;
+}
+
+void emmc_get_stats(emmc_stats_t* stats) {
+    *stats = emmc.stats;
+}
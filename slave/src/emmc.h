@@ -0,0 +1,87 @@
+#ifndef EMMC_H
+#define EMMC_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// SD card on the Arasan SDHCI controller ("EMMC")
+//
+// The boot firmware leaves the SD slot on SDHOST; emmc_init() moves GPIO
+// 48-53 over to EMMC and brings the card up in 4-bit, 25 MHz mode. Reads
+// are PIO and use CMD18 with auto CMD12 for more than one block. Host
+// builds talk to the simulator's card model, which is backed by a disk
+// image (sim_sd_attach_image).
+
+#define EMMC_BASE           (MMIO_BASE + 0x300000)
+#define EMMC_BLKSIZECNT     HAL_REG(EMMC_BASE + 0x04)
+#define EMMC_ARG1           HAL_REG(EMMC_BASE + 0x08)
+#define EMMC_CMDTM          HAL_REG(EMMC_BASE + 0x0C)
+#define EMMC_RESP0          HAL_REG(EMMC_BASE + 0x10)
+#define EMMC_RESP1          HAL_REG(EMMC_BASE + 0x14)
+#define EMMC_RESP2          HAL_REG(EMMC_BASE + 0x18)
+#define EMMC_RESP3          HAL_REG(EMMC_BASE + 0x1C)
+#define EMMC_DATA           HAL_REG(EMMC_BASE + 0x20)
+#define EMMC_STATUS         HAL_REG(EMMC_BASE + 0x24)
+#define EMMC_CONTROL0       HAL_REG(EMMC_BASE + 0x28)
+#define EMMC_CONTROL1       HAL_REG(EMMC_BASE + 0x2C)
+#define EMMC_INTERRUPT      HAL_REG(EMMC_BASE + 0x30)
+#define EMMC_IRPT_MASK      HAL_REG(EMMC_BASE + 0x34)
+#define EMMC_IRPT_EN        HAL_REG(EMMC_BASE + 0x38)
+
+// CMDTM fields
+#define CMDTM_BLKCNT_EN     (1 << 1)
+#define CMDTM_AUTO_CMD12    (1 << 2)
+#define CMDTM_DAT_DIR_READ  (1 << 4)
+#define CMDTM_MULTI_BLOCK   (1 << 5)
+#define CMDTM_RSP_NONE      (0 << 16)
+#define CMDTM_RSP_136       (1 << 16)
+#define CMDTM_RSP_48        (2 << 16)
+#define CMDTM_RSP_48_BUSY   (3 << 16)
+#define CMDTM_CRCCHK_EN     (1 << 19)
+#define CMDTM_IXCHK_EN      (1 << 20)
+#define CMDTM_ISDATA        (1 << 21)
+#define CMDTM_INDEX(n)      ((uint32_t)(n) << 24)
+
+// STATUS bits
+#define EMMC_STATUS_CMD_INHIBIT (1 << 0)
+#define EMMC_STATUS_DAT_INHIBIT (1 << 1)
+
+// CONTROL0 bits
+#define EMMC_CONTROL0_4BIT  (1 << 1)
+
+// CONTROL1 fields
+#define EMMC_CLK_INTLEN     (1 << 0)
+#define EMMC_CLK_STABLE     (1 << 1)
+#define EMMC_CLK_EN         (1 << 2)
+#define EMMC_CLK_DIV(d)     ((((d) & 0xFF) << 8) | ((((d) >> 8) & 0x3) << 6))
+#define EMMC_DATA_TOUNIT(x) (((x) & 0xF) << 16)
+#define EMMC_SRST_HC        (1 << 24)
+
+// INTERRUPT bits (write 1 to clear)
+#define EMMC_INT_CMD_DONE   (1 << 0)
+#define EMMC_INT_DATA_DONE  (1 << 1)
+#define EMMC_INT_READ_RDY   (1 << 5)
+#define EMMC_INT_ERR        (1 << 15)
+#define EMMC_INT_ERRORS     0xFFFF8000u
+
+// Card geometry
+#define EMMC_BLOCK_SIZE     512
+#define EMMC_MAX_BLOCKS     0xFFFF      // BLKSIZECNT block count field
+
+// VideoCore EMMC clock as left by the boot firmware
+#define EMMC_BASE_CLOCK     250000000
+
+typedef struct {
+    uint32_t commands;      // Commands sent, including ACMD prefixes
+    uint32_t reads;         // Read transfers
+    uint32_t blocks_read;
+    uint32_t errors;        // Command and data errors
+    uint32_t timeouts;
+} emmc_stats_t;
+
+// Function Prototypes
+int emmc_init(void);
+int emmc_read(uint32_t lba, uint32_t count, void* buffer);
+void emmc_get_stats(emmc_stats_t* stats);
+
+#endif // EMMC_H
@@ -0,0 +1,469 @@
+#include "fat32.h"
+#include "emmc.h"
+#include "util.h"
+
+#define FAT32_ENTRY_MASK    0x0FFFFFFF
+#define FAT32_ENTRY_SIZE    32
+#define FAT32_DELETED       0xE5
+#define FAT32_LFN_LAST      0x40
+#define FAT32_LFN_CHARS     13
+#define FAT32_DIR_SIZE      0xFFFFFFFF      // Directories end with their chain
+
+// Cached directory listing
+typedef struct {
+    uint32_t cluster;       // First cluster, 0 if the slot is free
+    uint32_t first;         // Index into entries
+    uint32_t count;
+    uint32_t stamp;         // Last use
+} dir_slot_t;
+
+static struct {
+    int mounted;
+    uint32_t fat_lba;
+    uint32_t fat_sectors;
+    uint32_t data_lba;              // Cluster 2
+    uint32_t cluster_count;
+    uint32_t cluster_shift;         // log2 of sectors per cluster
+    uint32_t root_cluster;
+    
+    // Sectors held by the data and FAT windows
+    uint32_t window_lba;
+    uint32_t window_count;
+    uint32_t fat_window_lba;
+    uint32_t fat_window_count;
+    
+    // Directory listings share the entries pool, which is reset when full
+    dir_slot_t dirs[FAT32_DIR_CACHE];
+    uint32_t entry_count;
+    uint32_t stamp;
+    
+    fat32_stats_t stats;
+} fat;
+
+static uint8_t window[FAT32_READAHEAD_SECTORS * FAT32_SECTOR_SIZE] HAL_BULK_BUFFER;
+static uint8_t fat_window[FAT32_FAT_SECTORS * FAT32_SECTOR_SIZE] HAL_BULK_BUFFER;
+static fat32_dirent_t entries[FAT32_DIR_ENTRIES] HAL_BULK_BUFFER;
+
+// On-disk fields are little-endian and not always aligned
+static inline uint32_t read16(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    return read16(p) | (read16(p + 2) << 16);
+}
+
+static inline int valid_cluster(uint32_t cluster) {
+    return cluster >= 2 && cluster < fat.cluster_count + 2;
+}
+
+static inline uint32_t cluster_lba(uint32_t cluster) {
+    return fat.data_lba + ((cluster - 2) << fat.cluster_shift);
+}
+
+// A FAT32 boot sector: 512-byte sectors and no FAT16 root directory
+static int is_fat32_bpb(const uint8_t* sector) {
+    uint32_t spc = sector[13];
+    return read16(sector + 11) == FAT32_SECTOR_SIZE && spc && !(spc & (spc - 1)) &&
+           read16(sector + 14) && (sector[16] == 1 || sector[16] == 2) &&
+           read16(sector + 17) == 0 && read16(sector + 22) == 0 && read32(sector + 36) &&
+           read16(sector + 510) == 0xAA55;
+}
+
+// Next cluster in a chain, or 0 at the end of the chain or on error
+static uint32_t next_cluster(uint32_t cluster) {
+    uint32_t lba = fat.fat_lba + cluster / (FAT32_SECTOR_SIZE / 4);
+    
+    if (lba - fat.fat_window_lba >= fat.fat_window_count) {
+        uint32_t count = fat.fat_lba + fat.fat_sectors - lba;
+        if (count > FAT32_FAT_SECTORS) {
+            count = FAT32_FAT_SECTORS;
+        }
+        fat.fat_window_count = 0;
+        if (!emmc_read(lba, count, fat_window)) {
+            return 0;
+        }
+        fat.fat_window_lba = lba;
+        fat.fat_window_count = count;
+        fat.stats.fat_fills++;
+        fat.stats.sectors_read += count;
+    }
+    
+    uint32_t offset = (lba - fat.fat_window_lba) * FAT32_SECTOR_SIZE +
+                      (cluster % (FAT32_SECTOR_SIZE / 4)) * 4;
+    uint32_t next = read32(fat_window + offset) & FAT32_ENTRY_MASK;
+    return valid_cluster(next) ? next : 0;
+}
+
+// Mount the first FAT32 volume on the card
+int fat32_mount(void) {
+    static uint32_t sector[FAT32_SECTOR_SIZE / 4];
+    const uint8_t* bytes = (const uint8_t*)sector;
+    
+    fat32_unmount();
+    if (!emmc_init() || !emmc_read(0, 1, sector)) {
+        return 0;
+    }
+    
+    // A partitioned card: take the first FAT32 partition
+    uint32_t start = 0;
+    if (!is_fat32_bpb(bytes)) {
+        if (read16(bytes + 510) != 0xAA55) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < 4 && !start; i++) {
+            const uint8_t* partition = bytes + 446 + i * 16;
+            if (partition[4] == 0x0B || partition[4] == 0x0C) {
+                start = read32(partition + 8);
+            }
+        }
+        if (!start || !emmc_read(start, 1, sector) || !is_fat32_bpb(bytes)) {
+            return 0;
+        }
+    }
+    
+    uint32_t reserved = read16(bytes + 14);
+    uint32_t fats = bytes[16];
+    uint32_t total = read16(bytes + 19) ? read16(bytes + 19) : read32(bytes + 32);
+    uint32_t metadata = reserved + fats * read32(bytes + 36);
+    if (total <= metadata) {
+        return 0;
+    }
+    
+    fat.fat_lba = start + reserved;
+    fat.fat_sectors = read32(bytes + 36);
+    fat.data_lba = start + metadata;
+    fat.cluster_shift = (uint32_t)__builtin_ctz(bytes[13]);
+    fat.cluster_count = (total - metadata) >> fat.cluster_shift;
+    
+    // Only clusters the FAT can describe are usable
+    if (fat.cluster_count + 2 > fat.fat_sectors * (FAT32_SECTOR_SIZE / 4)) {
+        fat.cluster_count = fat.fat_sectors * (FAT32_SECTOR_SIZE / 4) - 2;
+    }
+    fat.root_cluster = read32(bytes + 44);
+    if (!valid_cluster(fat.root_cluster)) {
+        return 0;
+    }
+    
+    fat.mounted = 1;
+    return 1;
+}
+
+// Forget the volume and everything cached from it
+void fat32_unmount(void) {
+    mem_set(&fat, 0, sizeof(fat));
+}
+
+void fat32_open_entry(fat32_file_t* file, const fat32_dirent_t* entry) {
+    file->first_cluster = entry->first_cluster;
+    file->cluster = entry->first_cluster;
+    file->size = (entry->attr & FAT32_ATTR_DIRECTORY) ? FAT32_DIR_SIZE : entry->size;
+    file->position = 0;
+    if (!valid_cluster(file->cluster)) {
+        file->size = 0;
+    }
+}
+
+// Map the next piece of a file without copying. The piece stays valid
+// until the next read from any file. Returns its length, 0 at the end.
+uint32_t fat32_map(fat32_file_t* file, const uint8_t** data, uint32_t max_size) {
+    uint32_t cluster_bytes = FAT32_SECTOR_SIZE << fat.cluster_shift;
+    
+    if (!fat.mounted || file->position >= file->size || !max_size) {
+        return 0;
+    }
+    
+    uint32_t offset = file->position & (cluster_bytes - 1);
+    uint32_t sector = offset / FAT32_SECTOR_SIZE;
+    uint32_t lba = cluster_lba(file->cluster) + sector;
+    
+    if (lba - fat.window_lba >= fat.window_count) {
+        // Read ahead over the contiguous clusters of the chain, up to the
+        // window size and the end of the file
+        uint32_t remaining = file->size - file->position;
+        uint32_t wanted = FAT32_READAHEAD_SECTORS;
+        if (remaining < FAT32_READAHEAD_SECTORS * FAT32_SECTOR_SIZE) {
+            wanted = (offset % FAT32_SECTOR_SIZE + remaining + FAT32_SECTOR_SIZE - 1) / FAT32_SECTOR_SIZE;
+        }
+        
+        uint32_t count = (1U << fat.cluster_shift) - sector;
+        uint32_t cluster = file->cluster;
+        while (count < wanted) {
+            uint32_t next = next_cluster(cluster);
+            if (next != cluster + 1) {
+                break;
+            }
+            cluster = next;
+            count += 1U << fat.cluster_shift;
+        }
+        if (count > wanted) {
+            count = wanted;
+        }
+        
+        fat.window_count = 0;
+        if (!emmc_read(lba, count, window)) {
+            return 0;
+        }
+        fat.window_lba = lba;
+        fat.window_count = count;
+        fat.stats.window_fills++;
+        fat.stats.sectors_read += count;
+    } else {
+        fat.stats.window_hits++;
+    }
+    
+    // Contiguous bytes: to the end of the window, cluster, file or request
+    uint32_t length = (fat.window_lba + fat.window_count - lba) * FAT32_SECTOR_SIZE - offset % FAT32_SECTOR_SIZE;
+    if (length > cluster_bytes - offset) {
+        length = cluster_bytes - offset;
+    }
+    if (length > file->size - file->position) {
+        length = file->size - file->position;
+    }
+    if (length > max_size) {
+        length = max_size;
+    }
+    *data = window + (lba - fat.window_lba) * FAT32_SECTOR_SIZE + offset % FAT32_SECTOR_SIZE;
+    
+    // Keep the cluster in step with the position; a chain that ends early
+    // ends the file
+    file->position += length;
+    if (!(file->position & (cluster_bytes - 1)) && file->position < file->size) {
+        uint32_t next = next_cluster(file->cluster);
+        if (next) {
+            file->cluster = next;
+        } else {
+            file->size = file->position;
+        }
+    }
+    return length;
+}
+
+// Copy out up to size bytes. Returns the bytes read.
+uint32_t fat32_read(fat32_file_t* file, void* buffer, uint32_t size) {
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t total = 0;
+    const uint8_t* data;
+    uint32_t length;
+    
+    while (total < size && (length = fat32_map(file, &data, size - total)) > 0) {
+        __builtin_memcpy(out + total, data, length);
+        total += length;
+    }
+    return total;
+}
+
+// 8.3 name with the NT lowercase flags applied
+static void short_name(const uint8_t* entry, char* name) {
+    uint32_t length = 0;
+    
+    for (uint32_t i = 0; i < 8 && entry[i] != ' '; i++) {
+        char c = (char)(i == 0 && entry[0] == 0x05 ? FAT32_DELETED : entry[i]);
+        name[length++] = (entry[12] & 0x08) && c >= 'A' && c <= 'Z' ? (char)(c + 32) : c;
+    }
+    if (entry[8] != ' ') {
+        name[length++] = '.';
+        for (uint32_t i = 8; i < 11 && entry[i] != ' '; i++) {
+            char c = (char)entry[i];
+            name[length++] = (entry[12] & 0x10) && c >= 'A' && c <= 'Z' ? (char)(c + 32) : c;
+        }
+    }
+    name[length] = '\0';
+}
+
+// Parse a directory chain into the pool from index first. Returns 0 if the
+// pool runs out.
+static int dir_parse(uint32_t cluster, uint32_t first, uint32_t* count) {
+    static const uint8_t lfn_offsets[FAT32_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    fat32_dirent_t dir_entry = { "", cluster, 0, FAT32_ATTR_DIRECTORY };
+    fat32_file_t dir;
+    char long_name[FAT32_NAME_MAX];
+    int long_valid = 0;
+    uint32_t long_sequence = 0;
+    uint8_t long_checksum = 0;
+    uint32_t n = first;
+    int end = 0;
+    const uint8_t* data;
+    uint32_t length;
+    
+    fat32_open_entry(&dir, &dir_entry);
+    while (!end && (length = fat32_map(&dir, &data, FAT32_READAHEAD_SECTORS * FAT32_SECTOR_SIZE)) > 0) {
+        for (const uint8_t* entry = data; !end && entry < data + length; entry += FAT32_ENTRY_SIZE) {
+            if (entry[0] == 0) {
+                end = 1;
+                continue;
+            }
+            if (entry[0] == FAT32_DELETED) {
+                long_valid = 0;
+                continue;
+            }
+            
+            // Long name pieces come last piece first, each 13 UCS-2 characters
+            if ((entry[11] & 0x3F) == FAT32_ATTR_LONG_NAME) {
+                uint32_t sequence = entry[0] & 0x1F;
+                if (entry[0] & FAT32_LFN_LAST) {
+                    mem_set(long_name, 0, sizeof(long_name));
+                    long_valid = sequence > 0;
+                    long_checksum = entry[13];
+                } else if (sequence + 1 != long_sequence || entry[13] != long_checksum) {
+                    long_valid = 0;
+                }
+                long_sequence = sequence;
+                for (uint32_t i = 0; long_valid && i < FAT32_LFN_CHARS; i++) {
+                    uint32_t c = read16(entry + lfn_offsets[i]);
+                    uint32_t at = (sequence - 1) * FAT32_LFN_CHARS + i;
+                    if (c == 0 || c == 0xFFFF) {
+                        break;
+                    }
+                    if (at >= FAT32_NAME_MAX - 1) {
+                        long_valid = 0;
+                    } else {
+                        long_name[at] = c < 0x80 ? (char)c : '?';
+                    }
+                }
+                continue;
+            }
+            
+            if ((entry[11] & FAT32_ATTR_VOLUME_ID) || entry[0] == '.') {
+                long_valid = 0;
+                continue;
+            }
+            if (n == FAT32_DIR_ENTRIES) {
+                return 0;
+            }
+            
+            // The long name belongs to this entry if its checksum matches
+            uint8_t checksum = 0;
+            for (uint32_t i = 0; i < 11; i++) {
+                checksum = (uint8_t)(((checksum & 1) << 7) + (checksum >> 1) + entry[i]);
+            }
+            fat32_dirent_t* out = &entries[n++];
+            if (long_valid && long_sequence == 1 && checksum == long_checksum) {
+                str_copy(out->name, long_name, FAT32_NAME_MAX);
+            } else {
+                short_name(entry, out->name);
+            }
+            out->first_cluster = (read16(entry + 20) << 16) | read16(entry + 26);
+            out->size = read32(entry + 28);
+            out->attr = entry[11];
+            long_valid = 0;
+        }
+    }
+    
+    *count = n - first;
+    fat.entry_count = n;
+    return 1;
+}
+
+// Cached listing of the directory starting at a cluster
+static int dir_load(uint32_t cluster, const fat32_dirent_t** list, uint32_t* count) {
+    dir_slot_t* slot = &fat.dirs[0];
+    
+    fat.stamp++;
+    for (uint32_t i = 0; i < FAT32_DIR_CACHE; i++) {
+        if (fat.dirs[i].cluster == cluster) {
+            fat.dirs[i].stamp = fat.stamp;
+            fat.stats.dir_hits++;
+            *list = &entries[fat.dirs[i].first];
+            *count = fat.dirs[i].count;
+            return 1;
+        }
+        if (fat.dirs[i].stamp < slot->stamp) {
+            slot = &fat.dirs[i];
+        }
+    }
+    fat.stats.dir_misses++;
+    
+    uint32_t first = fat.entry_count;
+    uint32_t n;
+    if (!dir_parse(cluster, first, &n)) {
+        // Out of room: drop every listing and start the pool over
+        if (first == 0) {
+            return 0;
+        }
+        mem_set(fat.dirs, 0, sizeof(fat.dirs));
+        slot = &fat.dirs[0];
+        first = 0;
+        if (!dir_parse(cluster, first, &n)) {
+            return 0;
+        }
+    }
+    
+    slot->cluster = cluster;
+    slot->first = first;
+    slot->count = n;
+    slot->stamp = fat.stamp;
+    *list = &entries[first];
+    *count = n;
+    return 1;
+}
+
+// Path component comparison, ignoring ASCII case
+static int name_matches(const char* name, const char* component, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        char a = name[i];
+        char b = component[i];
+        if (a >= 'A' && a <= 'Z') a = (char)(a + 32);
+        if (b >= 'A' && b <= 'Z') b = (char)(b + 32);
+        if (a != b || a == '\0') {
+            return 0;
+        }
+    }
+    return name[length] == '\0';
+}
+
+// Look up the entry for a path; the root is a directory entry with no name
+static int walk(const char* path, fat32_dirent_t* found) {
+    mem_set(found, 0, sizeof(*found));
+    found->first_cluster = fat.root_cluster;
+    found->attr = FAT32_ATTR_DIRECTORY;
+    
+    while (*path) {
+        if (*path == '/') {
+            path++;
+            continue;
+        }
+        uint32_t length = 0;
+        while (path[length] && path[length] != '/') {
+            length++;
+        }
+        
+        const fat32_dirent_t* list;
+        uint32_t count;
+        uint32_t i;
+        if (!(found->attr & FAT32_ATTR_DIRECTORY) || !dir_load(found->first_cluster, &list, &count)) {
+            return 0;
+        }
+        for (i = 0; i < count && !name_matches(list[i].name, path, length); i++);
+        if (i == count) {
+            return 0;
+        }
+        *found = list[i];
+        path += length;
+    }
+    return 1;
+}
+
+// List a directory. The entries stay valid until the next list or open.
+int fat32_list(const char* path, const fat32_dirent_t** list, uint32_t* count) {
+    fat32_dirent_t dir;
+    
+    if (!fat.mounted || !path || !walk(path, &dir) || !(dir.attr & FAT32_ATTR_DIRECTORY)) {
+        return 0;
+    }
+    return dir_load(dir.first_cluster, list, count);
+}
+
+int fat32_open(fat32_file_t* file, const char* path) {
+    fat32_dirent_t entry;
+    
+    if (!fat.mounted || !path || !walk(path, &entry) || (entry.attr & FAT32_ATTR_DIRECTORY)) {
+        return 0;
+    }
+    fat32_open_entry(file, &entry);
+    return 1;
+}
+
+void fat32_get_stats(fat32_stats_t* stats) {
+    *stats = fat.stats;
+}
@@ -0,0 +1,65 @@
+#ifndef FAT32_H
+#define FAT32_H
+
+#include <stdint.h>
+
+// Read-only FAT32 over the SD card (emmc.h)
+//
+// The volume is either the first FAT32 partition of an MBR or a whole
+// unpartitioned card. Directory listings are parsed once, long names
+// included, and cached. File data is read through a 32 KB window: a miss
+// fills it with one multi-block read covering the run of contiguous
+// clusters ahead of the read position. FAT sectors have their own window.
+
+#define FAT32_SECTOR_SIZE       512
+#define FAT32_NAME_MAX          64      // Including the terminator
+#define FAT32_READAHEAD_SECTORS 64
+#define FAT32_FAT_SECTORS       8
+#define FAT32_DIR_CACHE         8       // Directories
+#define FAT32_DIR_ENTRIES       1024    // Entries over all cached directories
+
+// Attributes
+#define FAT32_ATTR_READ_ONLY    0x01
+#define FAT32_ATTR_HIDDEN       0x02
+#define FAT32_ATTR_SYSTEM       0x04
+#define FAT32_ATTR_VOLUME_ID    0x08
+#define FAT32_ATTR_DIRECTORY    0x10
+#define FAT32_ATTR_ARCHIVE      0x20
+#define FAT32_ATTR_LONG_NAME    0x0F
+
+// Directory entry
+typedef struct {
+    char name[FAT32_NAME_MAX];  // Long name if present, else 8.3
+    uint32_t first_cluster;
+    uint32_t size;
+    uint8_t attr;
+} fat32_dirent_t;
+
+// Open file or directory
+typedef struct {
+    uint32_t first_cluster;
+    uint32_t cluster;           // Cluster holding position
+    uint32_t size;              // Bytes; directories read to the end of their chain
+    uint32_t position;
+} fat32_file_t;
+
+typedef struct {
+    uint32_t dir_hits;
+    uint32_t dir_misses;
+    uint32_t window_hits;
+    uint32_t window_fills;
+    uint32_t fat_fills;
+    uint32_t sectors_read;
+} fat32_stats_t;
+
+// Function Prototypes
+int fat32_mount(void);
+void fat32_unmount(void);
+int fat32_list(const char* path, const fat32_dirent_t** entries, uint32_t* count);
+int fat32_open(fat32_file_t* file, const char* path);
+void fat32_open_entry(fat32_file_t* file, const fat32_dirent_t* entry);
+uint32_t fat32_map(fat32_file_t* file, const uint8_t** data, uint32_t max_size);
+uint32_t fat32_read(fat32_file_t* file, void* buffer, uint32_t size);
+void fat32_get_stats(fat32_stats_t* stats);
+
+#endif // FAT32_H
@@ -0,0 +1,153 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hardware abstraction layer
+//
+// Every peripheral register in the firmware is reached through HAL_REG().
+// On the Pi (__BARE_METAL__) it is a plain volatile pointer to the BCM2837
+// address. Host builds route the access through the register-level
+// simulator in test/sim.c instead, so the same sources run as a Linux
+// process.
+
+// Cortex-A53 cache line
+#define HAL_CACHE_LINE  64
+
+// CNTP_CTL bits of the generic timer
+#define HAL_TIMER_ENABLE    (1 << 0)
+#define HAL_TIMER_IMASK     (1 << 1)
+#define HAL_TIMER_ISTATUS   (1 << 2)
+
+#ifdef __BARE_METAL__
+
+#define HAL_REG(addr)   ((volatile uint32_t*)(uintptr_t)(addr))
+
+// ARM physical address of a buffer; RAM is identity mapped
+static inline uint32_t hal_phys_addr(const void* ptr) {
+    return (uint32_t)(uintptr_t)ptr;
+}
+
+// Memory barriers
+static inline void hal_dmb(void) { __asm__ volatile("dmb" ::: "memory"); }
+static inline void hal_dsb(void) { __asm__ volatile("dsb" ::: "memory"); }
+static inline void hal_isb(void) { __asm__ volatile("isb" ::: "memory"); }
+
+// Buffers shared with bus masters live in the non-cacheable MMU section
+#define HAL_DMA_BUFFER  __attribute__((section(".dma_buffers"), aligned(HAL_CACHE_LINE)))
+
+// Large static buffers live in cacheable RAM outside the 1 MB image region
+#define HAL_BULK_BUFFER __attribute__((section(".bulk_buffers"), aligned(HAL_CACHE_LINE)))
+
+// Data cache maintenance by virtual address to the point of coherency
+#define HAL_DCACHE_OP(name, crm, opc2)                                          \
+    static inline void name(const void* ptr, size_t size) {                     \
+        uintptr_t addr = (uintptr_t)ptr & ~(uintptr_t)(HAL_CACHE_LINE - 1);     \
+        uintptr_t end = (uintptr_t)ptr + size;                                  \
+        for (; addr < end; addr += HAL_CACHE_LINE) {                            \
+            __asm__ volatile("mcr p15, 0, %0, c7, " #crm ", " #opc2             \
+                             : : "r" (addr) : "memory");                        \
+        }                                                                       \
+        __asm__ volatile("dsb" ::: "memory");                                   \
+    }
+
+HAL_DCACHE_OP(hal_dcache_clean, c10, 1)              // DCCMVAC
+HAL_DCACHE_OP(hal_dcache_invalidate, c6, 1)          // DCIMVAC
+HAL_DCACHE_OP(hal_dcache_clean_invalidate, c14, 1)   // DCCIMVAC
+
+// PMU cycle counter (PMCCNTR), once profile_init() has enabled it
+static inline uint32_t hal_cycles(void) {
+    uint32_t cycles;
+    __asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (cycles));
+    return cycles;
+}
+
+// ARM generic timer: the CNTPCT count, its CNTFRQ rate, and the calling
+// core's physical timer (CNTP_CVAL compare value, CNTP_CTL control)
+static inline uint64_t hal_counter(void) {
+    uint64_t count;
+    __asm__ volatile("isb\n"
+                     "mrrc p15, 0, %Q0, %R0, c14" : "=r" (count) : : "memory");
+    return count;
+}
+
+static inline uint32_t hal_counter_freq(void) {
+    uint32_t freq;
+    __asm__ volatile("mrc p15, 0, %0, c14, c0, 0" : "=r" (freq));
+    return freq;
+}
+
+static inline void hal_timer_compare(uint64_t cval) {
+    __asm__ volatile("mcrr p15, 2, %Q0, %R0, c14\n"
+                     "isb" : : "r" (cval) : "memory");
+}
+
+static inline void hal_timer_control(uint32_t ctl) {
+    __asm__ volatile("mcr p15, 0, %0, c14, c2, 1\n"
+                     "isb" : : "r" (ctl) : "memory");
+}
+
+#else
+
+// Simulator hooks (test/sim.c)
+volatile uint32_t* sim_reg(uintptr_t addr);
+uint32_t sim_phys_addr(const void* ptr);
+uint32_t sim_cycles(void);
+uint64_t sim_counter(void);
+uint32_t sim_counter_freq(void);
+void sim_timer_compare(uint64_t cval);
+void sim_timer_control(uint32_t ctl);
+
+#define HAL_REG(addr)   (sim_reg((uintptr_t)(addr)))
+
+static inline uint32_t hal_phys_addr(const void* ptr) {
+    return sim_phys_addr(ptr);
+}
+
+static inline void hal_dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void hal_dsb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void hal_isb(void) { }
+
+// The simulator has no caches; DMA buffers are ordinary memory
+#define HAL_DMA_BUFFER  __attribute__((aligned(HAL_CACHE_LINE)))
+#define HAL_BULK_BUFFER __attribute__((aligned(HAL_CACHE_LINE)))
+
+static inline void hal_dcache_clean(const void* ptr, size_t size) { (void)ptr; (void)size; }
+static inline void hal_dcache_invalidate(const void* ptr, size_t size) { (void)ptr; (void)size; }
+static inline void hal_dcache_clean_invalidate(const void* ptr, size_t size) { (void)ptr; (void)size; }
+
+// Host nanoseconds stand in for a 1 GHz cycle counter
+static inline uint32_t hal_cycles(void) { return sim_cycles(); }
+
+// The simulator's generic timer counts its clock, virtual or host
+static inline uint64_t hal_counter(void) { return sim_counter(); }
+static inline uint32_t hal_counter_freq(void) { return sim_counter_freq(); }
+static inline void hal_timer_compare(uint64_t cval) { sim_timer_compare(cval); }
+static inline void hal_timer_control(uint32_t ctl) { sim_timer_control(ctl); }
+
+#endif // __BARE_METAL__
+
+// Peripheral window
+#define MMIO_BASE       0x3F000000UL
+#define MMIO_SIZE       0x01000000UL
+
+// VideoCore bus aliases seen by DMA and USB masters: the peripheral window
+// at 0x7E000000, and SDRAM through the L2-uncached 0xC0000000 alias
+#define HAL_BUS_PERIPH  0x7E000000UL
+#define HAL_BUS_SDRAM   0xC0000000UL
+
+// Translate an ARM physical address to the bus address a master needs
+static inline uint32_t hal_phys_to_bus(uint32_t phys) {
+    if (phys >= MMIO_BASE && phys < MMIO_BASE + MMIO_SIZE) {
+        return (uint32_t)(phys - MMIO_BASE + HAL_BUS_PERIPH);
+    }
+    return (uint32_t)(phys | HAL_BUS_SDRAM);
+}
+
+// Address of a buffer as seen by bus masters (DMA, USB)
+static inline uint32_t hal_bus_addr(const void* ptr) {
+    return hal_phys_to_bus(hal_phys_addr(ptr));
+}
+
+#endif // HAL_H
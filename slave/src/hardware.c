@@ -1,22 +1,10 @@
 #include "hardware.h"
+#include "dma.h"
+#include "clock.h"
 
 // Cache control registers
-#define CACHE_CONTROL   ((volatile uint32_t*)0x3F002000)
-#define CACHE_FLUSH     ((volatile uint32_t*)0x3F002040)
-
-// DMA control block (must be 32-byte aligned)
-typedef struct __attribute__((aligned(32))) {
-    uint32_t ti;
-    uint32_t source_ad;
-    uint32_t dest_ad;
-    uint32_t txfr_len;
-    uint32_t stride;
-    uint32_t nextconbk;
-    uint32_t reserved[2];
-} dma_control_block_t;
-
-// Static DMA control block
-static dma_control_block_t __attribute__((aligned(32))) dma_cb;
+#define CACHE_CONTROL   HAL_REG(0x3F002000)
+#define CACHE_FLUSH     HAL_REG(0x3F002040)
 
 // Initialize hardware features
 void hardware_init(void) {
@@ -31,6 +19,7 @@ void hardware_init(void) {
 
 // Enable NEON SIMD unit
 void enable_neon(void) {
+#ifdef __BARE_METAL__
     uint32_t cpacr;
     __asm__ volatile (
         "mrc p15, 0, %0, c1, c0, 2\n"
@@ -42,22 +31,18 @@ void enable_neon(void) {
         :
         : "memory"
     );
+#endif
 }
 
 // Enable GPU acceleration
 void enable_gpu(void) {
     // Initialize V3D hardware
-    *((volatile uint32_t*)(V3D_BASE + 0x00)) = 1; // Enable V3D
+    *HAL_REG(V3D_BASE + 0x00) = 1; // Enable V3D
 }
 
-// Enable DMA controller
+// Enable DMA controller: reset the engine channels, completions polled
 void enable_dma(void) {
-    // Reset DMA channel
-    *DMA_CS = (1 << 31);
-    while (*DMA_CS & (1 << 31));
-    
-    // Clear any error flags
-    *DMA_CS = (1 << 2) | (1 << 3);
+    dma_init(DMA_COMPLETE_POLL);
 }
 
 // Setup hardware timer
@@ -69,46 +54,41 @@ void setup_hardware_timer(uint32_t interval_us) {
     *TIMER_C0 = *TIMER_CLO + interval_us;
 }
 
-// Get system time in microseconds
+// Get system time in microseconds, from the generic timer (clock.h)
 uint64_t get_system_time(void) {
-    uint32_t hi = *TIMER_CHI;
-    uint32_t lo = *TIMER_CLO;
-    if (*TIMER_CHI != hi) {
-        // High word changed during read
-        hi = *TIMER_CHI;
-        lo = *TIMER_CLO;
-    }
-    return ((uint64_t)hi << 32) | lo;
+    return clock_now_us();
 }
 
 // Precise microsecond delay
 void delay_microseconds(uint32_t us) {
-    uint32_t start = *TIMER_CLO;
-    while (*TIMER_CLO - start < us);
+    uint64_t start = clock_now_us();
+    while (clock_now_us() - start < us);
 }
 
-// DMA memory copy
+// DMA memory copy; waits for the engine, or copies on the CPU when the
+// engine cannot take the request or does not finish it in time
 void dma_memcpy(void* dest, const void* src, size_t size) {
-    // Setup DMA control block
-    dma_cb.ti = (1 << 0)  |    // SRCREQ
-                (1 << 4)  |    // INC
-                (1 << 6)  |    // DEST_INC
-                (1 << 8)  |    // WAIT_RESP
-                (1 << 9);      // TDMODE
-    
-    dma_cb.source_ad = (uint32_t)src;
-    dma_cb.dest_ad = (uint32_t)dest;
-    dma_cb.txfr_len = size;
-    dma_cb.stride = 0;
-    dma_cb.nextconbk = 0;
-    
-    // Start DMA transfer
-    *DMA_CS = 0;
-    *DMA_CONBLK_AD = (uint32_t)&dma_cb;
-    *DMA_CS = (1 << 0);  // Start
-    
-    // Wait for completion
-    while (*DMA_CS & (1 << 0));
+    dma_segment_t segment = { dest, src, (uint32_t)size };
+    uint32_t ticket = size <= DMA_MAX_SEGMENT ? dma_submit(&segment, 1, 0, 0) : 0;
+    if (!ticket) {
+        __builtin_memcpy(dest, src, size);
+        return;
+    }
+    if (!dma_wait(ticket) && dma_cancel(ticket)) {
+        __builtin_memcpy(dest, src, size);
+    }
+}
+
+// DMA memory fill, synchronous like dma_memcpy
+void dma_memset(void* dest, uint8_t value, size_t size) {
+    uint32_t ticket = size <= DMA_MAX_SEGMENT ? dma_fill(dest, value, (uint32_t)size, 0, 0) : 0;
+    if (!ticket) {
+        __builtin_memset(dest, value, size);
+        return;
+    }
+    if (!dma_wait(ticket) && dma_cancel(ticket)) {
+        __builtin_memset(dest, value, size);
+    }
 }
 
 // NEON optimized memory copy
@@ -118,16 +98,31 @@ void neon_copy_block(void* dest, const void* src, size_t size) {
     
     // Process 16 bytes at a time using NEON
     size_t blocks = size / 16;
-    __asm__ volatile (
-        "1:\n"
-        "vld1.8 {d0-d1}, [%[src]]!\n"
-        "vst1.8 {d0-d1}, [%[dest]]!\n"
-        "subs %[count], %[count], #1\n"
-        "bne 1b\n"
-        : [dest] "+r" (d), [src] "+r" (s), [count] "+r" (blocks)
-        :
-        : "d0", "d1", "memory"
-    );
+#ifdef __BARE_METAL__
+    if (blocks) {
+        __asm__ volatile (
+            "1:\n"
+            "vld1.8 {d0-d1}, [%[src]]!\n"
+            "vst1.8 {d0-d1}, [%[dest]]!\n"
+            "subs %[count], %[count], #1\n"
+            "bne 1b\n"
+            : [dest] "+r" (d), [src] "+r" (s), [count] "+r" (blocks)
+            :
+            : "d0", "d1", "memory"
+        );
+    }
+#else
+    // Two 64-bit moves stand in for one 128-bit register
+    typedef uint64_t __attribute__((may_alias, aligned(1))) half_t;
+    while (blocks--) {
+        half_t lo = ((const half_t*)s)[0];
+        half_t hi = ((const half_t*)s)[1];
+        ((half_t*)d)[0] = lo;
+        ((half_t*)d)[1] = hi;
+        d += 16;
+        s += 16;
+    }
+#endif
     
     // Handle remaining bytes
     size_t remaining = size % 16;
@@ -142,23 +137,43 @@ void neon_process_input(void* output, const void* input, size_t size) {
     const uint8_t* in = (const uint8_t*)input;
     
     size_t blocks = size / 16;
-    __asm__ volatile (
-        "1:\n"
-        "vld1.8 {d0-d1}, [%[in]]!\n"
-        "vqadd.u8 q0, q0, q0\n"     // Saturating add for smoothing
-        "vst1.8 {d0-d1}, [%[out]]!\n"
-        "subs %[count], %[count], #1\n"
-        "bne 1b\n"
-        : [out] "+r" (out), [in] "+r" (in), [count] "+r" (blocks)
-        :
-        : "q0", "memory"
-    );
+#ifdef __BARE_METAL__
+    if (blocks) {
+        __asm__ volatile (
+            "1:\n"
+            "vld1.8 {d0-d1}, [%[in]]!\n"
+            "vqadd.u8 q0, q0, q0\n"     // Saturating add for smoothing
+            "vst1.8 {d0-d1}, [%[out]]!\n"
+            "subs %[count], %[count], #1\n"
+            "bne 1b\n"
+            : [out] "+r" (out), [in] "+r" (in), [count] "+r" (blocks)
+            :
+            : "q0", "memory"
+        );
+    }
+#else
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            uint32_t v = (uint32_t)in[i] * 2;
+            out[i] = v > 0xFF ? 0xFF : (uint8_t)v;
+        }
+        in += 16;
+        out += 16;
+    }
+#endif
 }
 
-// GPU frame processing
-void gpu_process_frame(void* output, const void* input, size_t width, size_t height) {
+// GPU frame processing. Returns the DMA ticket of the blit, which runs
+// while the caller gets on with other work (dma_done/dma_wait), or 0 if
+// the frame was copied on the CPU.
+uint32_t gpu_process_frame(void* output, const void* input, size_t width, size_t height) {
     // TODO: Implement V3D GPU acceleration for frame processing
     // This would involve setting up GPU command lists and shaders
-    // For now, fall back to CPU processing
-    dma_memcpy(output, input, width * height * 4);
+    // For now, fall back to a DMA blit
+    dma_segment_t segment = { output, input, (uint32_t)(width * height * 4) };
+    uint32_t ticket = dma_submit(&segment, 1, 0, 0);
+    if (!ticket) {
+        __builtin_memcpy(output, input, width * height * 4);
+    }
+    return ticket;
 }
@@ -2,6 +2,8 @@
 #define HARDWARE_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
 
 // Raspberry Pi 3B Hardware Acceleration
 #define NEON_AVAILABLE
@@ -19,25 +21,55 @@ typedef float float32x4_t __attribute__ ((vector_size (16)));
 
 // DMA Controller
 #define DMA_BASE        0x3F007000
-#define DMA_CS          ((volatile uint32_t*)(DMA_BASE + 0x00))
-#define DMA_CONBLK_AD   ((volatile uint32_t*)(DMA_BASE + 0x04))
-#define DMA_TI          ((volatile uint32_t*)(DMA_BASE + 0x08))
-#define DMA_SOURCE_AD   ((volatile uint32_t*)(DMA_BASE + 0x0C))
-#define DMA_DEST_AD     ((volatile uint32_t*)(DMA_BASE + 0x10))
-#define DMA_TXFR_LEN    ((volatile uint32_t*)(DMA_BASE + 0x14))
-#define DMA_STRIDE      ((volatile uint32_t*)(DMA_BASE + 0x18))
-#define DMA_NEXTCONBK   ((volatile uint32_t*)(DMA_BASE + 0x1C))
-#define DMA_DEBUG       ((volatile uint32_t*)(DMA_BASE + 0x20))
+#define DMA_CS          HAL_REG(DMA_BASE + 0x00)
+#define DMA_CONBLK_AD   HAL_REG(DMA_BASE + 0x04)
+#define DMA_TI          HAL_REG(DMA_BASE + 0x08)
+#define DMA_SOURCE_AD   HAL_REG(DMA_BASE + 0x0C)
+#define DMA_DEST_AD     HAL_REG(DMA_BASE + 0x10)
+#define DMA_TXFR_LEN    HAL_REG(DMA_BASE + 0x14)
+#define DMA_STRIDE      HAL_REG(DMA_BASE + 0x18)
+#define DMA_NEXTCONBK   HAL_REG(DMA_BASE + 0x1C)
+#define DMA_DEBUG       HAL_REG(DMA_BASE + 0x20)
+
+// Channels 0-14 repeat channel 0's registers every 0x100
+#define DMA_CHANNEL_BASE(n)     (DMA_BASE + (n) * 0x100)
+#define DMA_CHANNEL_CS(n)       HAL_REG(DMA_CHANNEL_BASE(n) + 0x00)
+#define DMA_CHANNEL_CONBLK(n)   HAL_REG(DMA_CHANNEL_BASE(n) + 0x04)
+#define DMA_ENABLE              HAL_REG(DMA_BASE + 0xFF0)
+
+// CS bits
+#define DMA_CS_ACTIVE   (1 << 0)
+#define DMA_CS_END      (1 << 1)
+#define DMA_CS_INT      (1 << 2)
+#define DMA_CS_ERROR    (1 << 8)
+#define DMA_CS_PRIORITY(n)          ((uint32_t)(n) << 16)
+#define DMA_CS_PANIC_PRIORITY(n)    ((uint32_t)(n) << 20)
+#define DMA_CS_WAIT_WRITES          (1 << 28)
+#define DMA_CS_RESET    (1U << 31)
+
+// TI bits
+#define DMA_TI_INTEN        (1 << 0)
+#define DMA_TI_WAIT_RESP    (1 << 3)
+#define DMA_TI_DEST_INC     (1 << 4)
+#define DMA_TI_DEST_WIDTH   (1 << 5)    // 128-bit writes
+#define DMA_TI_DEST_DREQ    (1 << 6)
+#define DMA_TI_SRC_INC      (1 << 8)
+#define DMA_TI_SRC_WIDTH    (1 << 9)    // 128-bit reads
+#define DMA_TI_BURST(n)     ((uint32_t)(n) << 12)
+#define DMA_TI_PERMAP(n)    ((uint32_t)(n) << 16)
+
+// Peripheral DREQ lines
+#define DMA_DREQ_UART_TX    12
 
 // Hardware Timer
 #define TIMER_BASE      0x3F003000
-#define TIMER_CS        ((volatile uint32_t*)(TIMER_BASE + 0x00))
-#define TIMER_CLO       ((volatile uint32_t*)(TIMER_BASE + 0x04))
-#define TIMER_CHI       ((volatile uint32_t*)(TIMER_BASE + 0x08))
-#define TIMER_C0        ((volatile uint32_t*)(TIMER_BASE + 0x0C))
-#define TIMER_C1        ((volatile uint32_t*)(TIMER_BASE + 0x10))
-#define TIMER_C2        ((volatile uint32_t*)(TIMER_BASE + 0x14))
-#define TIMER_C3        ((volatile uint32_t*)(TIMER_BASE + 0x18))
+#define TIMER_CS        HAL_REG(TIMER_BASE + 0x00)
+#define TIMER_CLO       HAL_REG(TIMER_BASE + 0x04)
+#define TIMER_CHI       HAL_REG(TIMER_BASE + 0x08)
+#define TIMER_C0        HAL_REG(TIMER_BASE + 0x0C)
+#define TIMER_C1        HAL_REG(TIMER_BASE + 0x10)
+#define TIMER_C2        HAL_REG(TIMER_BASE + 0x14)
+#define TIMER_C3        HAL_REG(TIMER_BASE + 0x18)
 
 // Function Prototypes
 void hardware_init(void);
@@ -48,7 +80,7 @@ void setup_hardware_timer(uint32_t interval_us);
 uint64_t get_system_time(void);
 void delay_microseconds(uint32_t us);
 
-// DMA Functions
+// DMA Functions (synchronous; dma.h has the asynchronous engine)
 void dma_memcpy(void* dest, const void* src, size_t size);
 void dma_memset(void* dest, uint8_t value, size_t size);
 
@@ -59,7 +91,7 @@ void neon_interpolate(void* output, const void* prev, const void* next, float fa
 
 // GPU Acceleration
 void gpu_init(void);
-void gpu_process_frame(void* output, const void* input, size_t width, size_t height);
+uint32_t gpu_process_frame(void* output, const void* input, size_t width, size_t height);
 void gpu_buffer_flip(void);
 
 #endif // HARDWARE_H
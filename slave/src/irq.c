@@ -0,0 +1,139 @@
+#include "irq.h"
+#include "smp.h"
+
+// Handler table indexed by interrupt number
+static irq_handler_t handlers[IRQ_COUNT];
+
+
+#ifdef __BARE_METAL__
+// IRQ mode stack per core
+#define IRQ_STACK_SIZE 2048
+static uint8_t __attribute__((aligned(16))) irq_stacks[4][IRQ_STACK_SIZE];
+
+// IRQ exception entry: save state, dispatch, return to the interrupted code
+__attribute__((interrupt("IRQ"))) void irq_entry(void) {
+    irq_dispatch();
+}
+
+// Exception vector table, installed through VBAR
+__asm__(
+    ".section .text\n"
+    ".balign 32\n"
+    "irq_vector_table:\n"
+    "    b .\n"            // Reset
+    "    b .\n"            // Undefined instruction
+    "    b .\n"            // Supervisor call
+    "    b .\n"            // Prefetch abort
+    "    b .\n"            // Data abort
+    "    b .\n"            // Reserved
+    "    b irq_entry\n"    // IRQ
+    "    b .\n"            // FIQ
+);
+extern uint32_t irq_vector_table[];
+#endif
+
+// Initialize interrupt controller and the boot core's exception vectors
+void irq_init(void) {
+    irq_cpu_disable();
+    
+    *IRQ_DISABLE_1 = 0xFFFFFFFF;
+    *IRQ_DISABLE_2 = 0xFFFFFFFF;
+    for (uint32_t core = 0; core < 4; core++) {
+        *ARM_LOCAL_TIMER_CNTL(core) = 0;
+    }
+    
+    for (uint32_t i = 0; i < IRQ_COUNT; i++) {
+        handlers[i] = 0;
+    }
+    
+    irq_init_cpu();
+}
+
+// Install exception vectors and an IRQ stack on the calling core.
+// VBAR and the banked IRQ stack pointer are per-core.
+void irq_init_cpu(void) {
+#ifdef __BARE_METAL__
+    uint32_t core = smp_core_id();
+    
+    // Point VBAR at our table and give IRQ mode its own stack
+    __asm__ volatile(
+        "mcr p15, 0, %0, c12, c0, 0\n"
+        "cps #0x12\n"
+        "mov sp, %1\n"
+        "cps #0x13\n"
+        "isb\n"
+        :
+        : "r" (irq_vector_table), "r" (irq_stacks[core] + IRQ_STACK_SIZE)
+        : "memory"
+    );
+#endif
+}
+
+// Send GPU interrupts to one core (ARM local routing register)
+void irq_route_to_core(uint32_t core) {
+    *ARM_LOCAL_GPU_INT_ROUTE = core & 3;
+}
+
+// Register handler for a GPU interrupt
+void irq_register(uint32_t irq, irq_handler_t handler) {
+    if (irq < IRQ_COUNT) {
+        handlers[irq] = handler;
+    }
+}
+
+// Unmask a GPU interrupt
+void irq_enable(uint32_t irq) {
+    if (irq < 32) {
+        *IRQ_ENABLE_1 = 1U << irq;
+    } else if (irq < IRQ_GPU_COUNT) {
+        *IRQ_ENABLE_2 = 1U << (irq - 32);
+    }
+}
+
+// Mask a GPU interrupt
+void irq_disable(uint32_t irq) {
+    if (irq < 32) {
+        *IRQ_DISABLE_1 = 1U << irq;
+    } else if (irq < IRQ_GPU_COUNT) {
+        *IRQ_DISABLE_2 = 1U << (irq - 32);
+    }
+}
+
+// Unmask a core-local interrupt on one core. Any core may write another's
+// control register.
+void irq_local_enable(uint32_t core, uint32_t irq) {
+    if (irq >= IRQ_LOCAL && irq < IRQ_COUNT) {
+        *ARM_LOCAL_TIMER_CNTL(core & 3) |= 1U << (irq - IRQ_LOCAL);
+    }
+}
+
+void irq_local_disable(uint32_t core, uint32_t irq) {
+    if (irq >= IRQ_LOCAL && irq < IRQ_COUNT) {
+        *ARM_LOCAL_TIMER_CNTL(core & 3) &= ~(1U << (irq - IRQ_LOCAL));
+    }
+}
+
+// Run handlers for every pending interrupt, this core's timers first
+void irq_dispatch(void) {
+    uint32_t local = *ARM_LOCAL_IRQ_SOURCE(smp_core_id()) & ((1U << IRQ_LOCAL_COUNT) - 1);
+    while (local) {
+        uint32_t bit = __builtin_ctz(local);
+        local &= local - 1;
+        if (handlers[IRQ_LOCAL + bit]) {
+            handlers[IRQ_LOCAL + bit]();
+        }
+    }
+    
+    uint32_t pending[2] = { *IRQ_PENDING_1, *IRQ_PENDING_2 };
+    
+    for (uint32_t bank = 0; bank < 2; bank++) {
+        while (pending[bank]) {
+            uint32_t bit = __builtin_ctz(pending[bank]);
+            pending[bank] &= pending[bank] - 1;
+            irq_handler_t handler = handlers[bank * 32 + bit];
+            if (handler) {
+                handler();
+            }
+        }
+    }
+}
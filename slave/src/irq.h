@@ -0,0 +1,61 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// BCM2837 ARM interrupt controller
+#define IRQ_BASE            (MMIO_BASE + 0xB000)
+#define IRQ_BASIC_PENDING   HAL_REG(IRQ_BASE + 0x200)
+#define IRQ_PENDING_1       HAL_REG(IRQ_BASE + 0x204)
+#define IRQ_PENDING_2       HAL_REG(IRQ_BASE + 0x208)
+#define IRQ_ENABLE_1        HAL_REG(IRQ_BASE + 0x210)
+#define IRQ_ENABLE_2        HAL_REG(IRQ_BASE + 0x214)
+#define IRQ_DISABLE_1       HAL_REG(IRQ_BASE + 0x21C)
+#define IRQ_DISABLE_2       HAL_REG(IRQ_BASE + 0x220)
+
+// ARM local peripherals (per-core timers, mailboxes, interrupt routing)
+#define ARM_LOCAL_BASE          0x40000000
+#define ARM_LOCAL_GPU_INT_ROUTE HAL_REG(ARM_LOCAL_BASE + 0x0C)
+#define ARM_LOCAL_TIMER_CNTL(n) HAL_REG(ARM_LOCAL_BASE + 0x40 + (n) * 4)
+#define ARM_LOCAL_IRQ_SOURCE(n) HAL_REG(ARM_LOCAL_BASE + 0x60 + (n) * 4)
+
+// GPU peripheral interrupt numbers
+#define IRQ_SYSTEM_TIMER_1  1
+#define IRQ_SYSTEM_TIMER_3  3
+#define IRQ_USB             9
+#define IRQ_DMA0            16
+#define IRQ_GPU_COUNT       64
+
+// Core-local interrupt numbers: the generic timers, after the GPU ones.
+// Bit n of a core's local timer control and source registers is IRQ_LOCAL + n.
+#define IRQ_LOCAL           64
+#define IRQ_LOCAL_CNTPS     64          // Secure physical timer
+#define IRQ_LOCAL_CNTPNS    65          // Non-secure physical timer
+#define IRQ_LOCAL_COUNT     4
+#define IRQ_COUNT           (IRQ_LOCAL + IRQ_LOCAL_COUNT)
+
+typedef void (*irq_handler_t)(void);
+
+// Function Prototypes
+void irq_init(void);
+void irq_init_cpu(void);
+void irq_route_to_core(uint32_t core);
+void irq_register(uint32_t irq, irq_handler_t handler);
+void irq_enable(uint32_t irq);
+void irq_disable(uint32_t irq);
+void irq_local_enable(uint32_t core, uint32_t irq);
+void irq_local_disable(uint32_t core, uint32_t irq);
+void irq_dispatch(void);
+
+// CPU interrupt mask
+#ifdef __BARE_METAL__
+static inline void irq_cpu_enable(void) { __asm__ volatile("cpsie i" ::: "memory"); }
+static inline void irq_cpu_disable(void) { __asm__ volatile("cpsid i" ::: "memory"); }
+#else
+void sim_cpu_irq(int enable);
+static inline void irq_cpu_enable(void) { sim_cpu_irq(1); }
+static inline void irq_cpu_disable(void) { sim_cpu_irq(0); }
+#endif
+
+#endif // IRQ_H
@@ -0,0 +1,82 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+// Fixed-size log-linear latency histogram (HDR-style).
+// Values below 32 us get exact buckets; above that each power of two is
+// split into 16 linear sub-buckets, so any recorded value is reported within
+// 1/16 (about 6%). Recording is a count-leading-zeros and an increment;
+// percentile queries walk the buckets.
+
+#define LATENCY_HIST_SUB_BITS   4
+#define LATENCY_HIST_SUB_COUNT  (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS   24                          // Clamp at ~16.7 s
+#define LATENCY_HIST_MAX_US     ((1U << LATENCY_HIST_MAX_BITS) - 1)
+#define LATENCY_HIST_BUCKETS    ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_COUNT)
+
+typedef struct {
+    uint32_t count;                          // Samples recorded
+    uint32_t max_us;                         // Largest sample (exact)
+    uint32_t buckets[LATENCY_HIST_BUCKETS];
+} latency_hist_t;
+
+static inline void latency_hist_reset(latency_hist_t* hist) {
+    __builtin_memset(hist, 0, sizeof(*hist));
+}
+
+// Bucket holding a value
+static inline uint32_t latency_hist_index(uint32_t value_us) {
+    if (value_us > LATENCY_HIST_MAX_US) {
+        value_us = LATENCY_HIST_MAX_US;
+    }
+    if (value_us < LATENCY_HIST_SUB_COUNT) {
+        return value_us;
+    }
+    uint32_t shift = (31 - __builtin_clz(value_us)) - LATENCY_HIST_SUB_BITS;
+    return (shift + 1) * LATENCY_HIST_SUB_COUNT + (value_us >> shift) - LATENCY_HIST_SUB_COUNT;
+}
+
+// Largest value that lands in a bucket
+static inline uint32_t latency_hist_bucket_max(uint32_t index) {
+    if (index < 2 * LATENCY_HIST_SUB_COUNT) {
+        return index;
+    }
+    uint32_t shift = index / LATENCY_HIST_SUB_COUNT - 1;
+    uint32_t sub = index % LATENCY_HIST_SUB_COUNT + LATENCY_HIST_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void latency_hist_record(latency_hist_t* hist, uint32_t value_us) {
+    hist->buckets[latency_hist_index(value_us)]++;
+    hist->count++;
+    if (value_us > hist->max_us) {
+        hist->max_us = value_us;
+    }
+}
+
+// Value at or below which the given fraction of samples fall, with the
+// fraction in tenths of a percent (500 = p50, 999 = p99.9). 0 if empty.
+static inline uint32_t latency_hist_percentile(const latency_hist_t* hist, uint32_t permille) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    
+    // Rank of the sample we want, rounded up
+    uint32_t rank = (uint32_t)(((uint64_t)hist->count * permille + 999) / 1000);
+    if (rank == 0) {
+        rank = 1;
+    }
+    
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t value = latency_hist_bucket_max(i);
+            return value < hist->max_us ? value : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+#endif // LATENCY_HIST_H
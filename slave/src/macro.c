@@ -0,0 +1,218 @@
+#include "macro.h"
+#include "util.h"
+
+// Fields a macro contributes in one frame
+typedef struct {
+    uint16_t buttons;                   // ps5_buttons_t bit order
+    uint8_t sticks[4];                  // lx, ly, rx, ry
+    uint8_t triggers[2];                // l2, r2
+    const ps5_touch_point_t* touch;     // Recorded touch points, NULL if not driven
+} macro_frame_t;
+
+void macro_mixer_reset(macro_mixer_t* mixer) {
+    __builtin_memset(mixer, 0, sizeof(*mixer));
+}
+
+static macro_player_t* find_player(macro_mixer_t* mixer, const char* name) {
+    for (uint32_t i = 0; i < mixer->count; i++) {
+        if (mixer->players[i].name == name) {
+            return &mixer->players[i];
+        }
+    }
+    return 0;
+}
+
+// Restart a player from its first step
+static void player_start(macro_player_t* player, uint64_t now_us) {
+    player->playing = 1;
+    player->step = 0;
+    player->step_us = now_us;
+    if (!player->steps) {
+        timeline_player_init(&player->timeline, player->timeline.data, player->timeline.size, now_us);
+    }
+}
+
+// Insert a player, keeping players sorted by priority, lowest first, and
+// names unique. Returns the new player, or NULL.
+static macro_player_t* insert_player(macro_mixer_t* mixer, const char* name, uint32_t priority) {
+    if (mixer->count >= MACRO_MAX_PLAYERS) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < mixer->count; i++) {
+        if (str_compare(mixer->players[i].name, name) == 0) {
+            return 0;
+        }
+    }
+    
+    uint32_t slot = mixer->count;
+    while (slot > 0 && mixer->players[slot - 1].priority > priority) {
+        mixer->players[slot] = mixer->players[slot - 1];
+        slot--;
+    }
+    
+    macro_player_t* player = &mixer->players[slot];
+    __builtin_memset(player, 0, sizeof(*player));
+    player->name = name;
+    player->priority = priority;
+    player->loop = MACRO_LOOP;
+    player->blend = MACRO_BLEND_OVERRIDE;
+    mixer->count++;
+    return player;
+}
+
+// Add a packaged timeline. The steps must stay valid until removed.
+int macro_add_steps(macro_mixer_t* mixer, const char* name, uint32_t priority,
+                    const package_macro_step_t* steps, uint32_t step_count, uint64_t now_us) {
+    if (!steps || step_count == 0) {
+        return 0;
+    }
+    macro_player_t* player = insert_player(mixer, name, priority);
+    if (!player) {
+        return 0;
+    }
+    player->steps = steps;
+    player->step_count = step_count;
+    player_start(player, now_us);
+    return 1;
+}
+
+// Add a recorded timeline (timeline.h). The data must stay valid until removed.
+int macro_add_timeline(macro_mixer_t* mixer, const char* name, uint32_t priority,
+                       const uint8_t* data, uint32_t size, uint64_t now_us) {
+    if (!data || size == 0) {
+        return 0;
+    }
+    macro_player_t* player = insert_player(mixer, name, priority);
+    if (!player) {
+        return 0;
+    }
+    player->timeline.data = data;
+    player->timeline.size = size;
+    player_start(player, now_us);
+    return 1;
+}
+
+int macro_remove(macro_mixer_t* mixer, const char* name) {
+    macro_player_t* player = find_player(mixer, name);
+    if (!player) {
+        return 0;
+    }
+    for (uint32_t i = (uint32_t)(player - mixer->players) + 1; i < mixer->count; i++) {
+        mixer->players[i - 1] = mixer->players[i];
+    }
+    mixer->count--;
+    return 1;
+}
+
+// Change how a macro plays; it restarts from its first step
+int macro_set_mode(macro_mixer_t* mixer, const char* name, macro_loop_t loop,
+                   macro_blend_t blend, uint64_t now_us) {
+    macro_player_t* player = find_player(mixer, name);
+    if (!player) {
+        return 0;
+    }
+    player->loop = loop;
+    player->blend = blend;
+    player_start(player, now_us);
+    return 1;
+}
+
+// Move a packaged timeline's playhead; same timing rules as timeline_advance()
+static int steps_advance(macro_player_t* player, uint64_t now_us) {
+    for (uint32_t i = 0; i < 2 && now_us - player->step_us >= player->steps[player->step].delay_us; i++) {
+        player->step_us += player->steps[player->step].delay_us;
+        if (++player->step >= player->step_count) {
+            if (player->loop != MACRO_LOOP) {
+                player->step = player->step_count - 1;
+                return 0;
+            }
+            player->step = 0;
+        }
+    }
+    return 1;
+}
+
+// Advance a player and fetch its frame. Returns 0 if it no longer plays.
+static int player_frame(macro_player_t* player, uint64_t now_us, macro_frame_t* frame) {
+    int running;
+    if (player->steps) {
+        running = steps_advance(player, now_us);
+        const package_macro_step_t* step = &player->steps[player->step];
+        frame->buttons = step->buttons;
+        __builtin_memcpy(frame->sticks, step->sticks, sizeof(frame->sticks));
+        __builtin_memcpy(frame->triggers, step->triggers, sizeof(frame->triggers));
+        frame->touch = 0;
+    } else {
+        running = timeline_advance(&player->timeline, now_us, player->loop == MACRO_LOOP);
+        const ps5_state_t* state = &player->timeline.state;
+        __builtin_memcpy(&frame->buttons, &state->buttons, sizeof(frame->buttons));
+        frame->sticks[0] = state->sticks.lx;
+        frame->sticks[1] = state->sticks.ly;
+        frame->sticks[2] = state->sticks.rx;
+        frame->sticks[3] = state->sticks.ry;
+        frame->triggers[0] = state->triggers.l2;
+        frame->triggers[1] = state->triggers.r2;
+        frame->touch = state->touch;
+    }
+    
+    if (!running && player->loop == MACRO_ONCE) {
+        player->playing = 0;
+    }
+    return player->playing;
+}
+
+static inline uint8_t clamp_u8(int32_t value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+// Blend every playing macro into the state in one pass
+void macro_mix(macro_mixer_t* mixer, ps5_state_t* state, uint64_t now_us) {
+    if (mixer->count == 0) {
+        return;
+    }
+    
+    macro_frame_t out;
+    ps5_touch_point_t touch[2] = { state->touch[0], state->touch[1] };
+    __builtin_memcpy(&out.buttons, &state->buttons, sizeof(out.buttons));
+    __builtin_memcpy(out.sticks, &state->sticks, sizeof(out.sticks));
+    __builtin_memcpy(out.triggers, &state->triggers, sizeof(out.triggers));
+    
+    for (uint32_t i = 0; i < mixer->count; i++) {
+        macro_player_t* player = &mixer->players[i];
+        macro_frame_t in;
+        if (!player->playing || !player_frame(player, now_us, &in)) {
+            continue;
+        }
+        
+        switch (player->blend) {
+            case MACRO_BLEND_OVERRIDE:
+                out.buttons = in.buttons;
+                __builtin_memcpy(out.sticks, in.sticks, sizeof(out.sticks));
+                __builtin_memcpy(out.triggers, in.triggers, sizeof(out.triggers));
+                if (in.touch) {
+                    touch[0] = in.touch[0];
+                    touch[1] = in.touch[1];
+                }
+                break;
+                
+            case MACRO_BLEND_OR:
+                out.buttons |= in.buttons;
+                break;
+                
+            case MACRO_BLEND_ADD:
+                out.buttons |= in.buttons;
+                for (uint32_t axis = 0; axis < 4; axis++) {
+                    out.sticks[axis] = clamp_u8((int32_t)out.sticks[axis] + in.sticks[axis] - 128);
+                }
+                out.triggers[0] = clamp_u8((int32_t)out.triggers[0] + in.triggers[0]);
+                out.triggers[1] = clamp_u8((int32_t)out.triggers[1] + in.triggers[1]);
+                break;
+        }
+    }
+    
+    __builtin_memcpy(&state->buttons, &out.buttons, sizeof(out.buttons));
+    __builtin_memcpy(&state->sticks, out.sticks, sizeof(out.sticks));
+    __builtin_memcpy(&state->triggers, out.triggers, sizeof(out.triggers));
+    state->touch[0] = touch[0];
+    state->touch[1] = touch[1];
+}
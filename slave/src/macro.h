@@ -0,0 +1,65 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+#include "ps5.h"
+#include "package.h"
+#include "timeline.h"
+
+// Macro players
+//
+// Every loaded macro, packaged or recorded, has its own player with its own
+// playhead, loop mode and blend rule. macro_mix() advances all of them in
+// one pass: the input fields are read once, each playing macro is blended
+// in from lowest to highest priority, and the result is written back once.
+
+#define MACRO_MAX_PLAYERS   8
+
+// What happens at the end of the macro
+typedef enum {
+    MACRO_LOOP,             // Start over
+    MACRO_ONCE,             // Stop and leave the input alone
+    MACRO_HOLD              // Stop and keep applying the final step
+} macro_loop_t;
+
+// How a macro combines with the input and lower-priority macros
+typedef enum {
+    MACRO_BLEND_OVERRIDE,   // Replace every field the macro drives
+    MACRO_BLEND_OR,         // OR its buttons in
+    MACRO_BLEND_ADD         // OR buttons, add stick offsets from center and trigger values
+} macro_blend_t;
+
+typedef struct {
+    const char* name;       // Owning script's name; the pointer identifies the player
+    uint32_t priority;
+    macro_loop_t loop;
+    macro_blend_t blend;
+    int playing;
+    
+    // Packaged timeline, played in place
+    const package_macro_step_t* steps;
+    uint32_t step_count;
+    uint32_t step;
+    uint64_t step_us;       // Time the current step began
+    
+    // Recorded timeline, used when steps is NULL
+    timeline_player_t timeline;
+} macro_player_t;
+
+typedef struct {
+    macro_player_t players[MACRO_MAX_PLAYERS];   // Lowest priority first
+    uint32_t count;
+} macro_mixer_t;
+
+// Function Prototypes
+void macro_mixer_reset(macro_mixer_t* mixer);
+int macro_add_steps(macro_mixer_t* mixer, const char* name, uint32_t priority,
+                    const package_macro_step_t* steps, uint32_t step_count, uint64_t now_us);
+int macro_add_timeline(macro_mixer_t* mixer, const char* name, uint32_t priority,
+                       const uint8_t* data, uint32_t size, uint64_t now_us);
+int macro_remove(macro_mixer_t* mixer, const char* name);
+int macro_set_mode(macro_mixer_t* mixer, const char* name, macro_loop_t loop,
+                   macro_blend_t blend, uint64_t now_us);
+void macro_mix(macro_mixer_t* mixer, ps5_state_t* state, uint64_t now_us);
+
+#endif // MACRO_H
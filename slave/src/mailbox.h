@@ -0,0 +1,71 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// Lock-free single-producer/single-consumer message queue between two cores.
+// One mailbox per (sender, receiver) pair keeps every queue SPSC: the sender
+// owns head, the receiver owns tail.
+
+#define MAILBOX_SIZE    32   // Power of two
+#define MAILBOX_MASK    (MAILBOX_SIZE - 1)
+
+// Inter-core message
+typedef struct {
+    uint32_t type;
+    uint32_t arg0;
+    uint32_t arg1;
+    const void* data;   // Must stay valid until the receiver is done with it
+} mailbox_msg_t;
+
+typedef struct {
+    volatile uint32_t head;       // Written by sender only
+    volatile uint32_t tail;       // Written by receiver only
+    volatile uint32_t dropped;    // Messages refused because the mailbox was full
+    mailbox_msg_t slots[MAILBOX_SIZE];
+} mailbox_t;
+
+static inline void mailbox_reset(mailbox_t* mailbox) {
+    mailbox->head = 0;
+    mailbox->tail = 0;
+    mailbox->dropped = 0;
+}
+
+// Sender: post a message. Returns 0 if the mailbox is full.
+static inline int mailbox_post(mailbox_t* mailbox, const mailbox_msg_t* msg) {
+    uint32_t head = mailbox->head;
+    if (head - mailbox->tail >= MAILBOX_SIZE) {
+        mailbox->dropped++;
+        return 0;
+    }
+    
+    mailbox->slots[head & MAILBOX_MASK] = *msg;
+    
+    // Publish the message before the index
+    hal_dmb();
+    mailbox->head = head + 1;
+    return 1;
+}
+
+// Receiver: take the oldest message. Returns 0 if empty.
+static inline int mailbox_fetch(mailbox_t* mailbox, mailbox_msg_t* msg) {
+    uint32_t tail = mailbox->tail;
+    if (mailbox->head == tail) {
+        return 0;
+    }
+    hal_dmb();
+    
+    *msg = mailbox->slots[tail & MAILBOX_MASK];
+    
+    // Finish reading before handing the slot back
+    hal_dmb();
+    mailbox->tail = tail + 1;
+    return 1;
+}
+
+static inline uint32_t mailbox_pending(const mailbox_t* mailbox) {
+    return mailbox->head - mailbox->tail;
+}
+
+#endif // MAILBOX_H
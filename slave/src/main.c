@@ -1,18 +1,27 @@
 #include <stdint.h>
+#include <stdio.h>
 #include "ps5.h"
 #include "usb.h"
 #include "status.h"
 #include "hardware.h"
 #include "optimize.h"
+#include "irq.h"
+#include "smp.h"
+#include "cores.h"
+#include "mmu.h"
+#include "crc32.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "uart.h"
+#include "mem.h"
+#include "clock.h"
 
 // System state and error handling
 typedef struct {
     int hdmi_connected;
     int ps5_connected;
     int controller_connected;
-    ps5_state_t controller_state;
-    ps5_output_t controller_output;
-    performance_stats_t perf_stats;
+    int link_up;                    // Input core forwarding
     uint32_t error_count;
     uint32_t recovery_attempts;
     uint64_t last_error_time;
@@ -44,6 +53,10 @@ static void system_recover(const char* error_msg) {
     state.last_error_time = current_time;
     snprintf(state.error_message, sizeof(state.error_message), "Error: %s, Count: %u, Recovery Attempts: %u", error_msg, state.error_count, state.recovery_attempts);
     
+    // Stop input forwarding before resetting what it uses
+    cores_set_link(0);
+    state.link_up = 0;
+    
     // Reset subsystems
     status_set_error();
     hardware_init();
@@ -74,6 +87,21 @@ static int check_watchdog(void) {
 static int system_init(void) {
     int success = 1;
     
+    // Mask interrupts until the handlers are in place
+    irq_init();
+    
+    // Generic timer timestamps and this core's deadline interrupt
+    clock_init();
+    
+    // Cacheable RAM, device-ordered MMIO, uncached DMA buffers
+    mmu_init();
+    
+    // Script checksums: CRC32 instructions if the core has them
+    crc32_init();
+    
+    // Cycle counter for profiling zones
+    profile_init();
+    
     // Initialize hardware optimizations with verification
     if (!optimize_init()) {
         status_set_error();
@@ -98,15 +126,31 @@ static int system_init(void) {
         success = 0;
     }
     
+    // Time the copy paths while the DMA engine is still idle
+    mem_calibrate();
+    
     // Initialize subsystems with error checking
     if (!status_init() || !usb_init() || !ps5_init()) {
         system_recover("Subsystem initialization failed");
         success = 0;
     }
     
+    // Binary telemetry on UART0, sent from the GUI core; optional
+    telemetry_init(UART_DEFAULT_BAUD);
+    
     // Initialize watchdog
     kick_watchdog();
     
+    // Start taking USB input interrupts
+    irq_cpu_enable();
+    
+    // Release cores 1-3: input forwarding, scripts, GUI/telemetry
+    smp_init();
+    if (!cores_start()) {
+        status_set_error();
+        success = 0;
+    }
+    
     // Initial LED pattern
     status_update(LED_STATE_INIT);
     
@@ -128,13 +172,15 @@ int main(void) {
     }
     
     // System monitoring intervals
-    uint64_t last_perf_check = 0;
     uint64_t last_health_check = 0;
-    const uint32_t PERF_CHECK_INTERVAL = 1000000;  // 1 second
     const uint32_t HEALTH_CHECK_INTERVAL = 500000; // 500ms
     
-    // Main control loop with error handling
+    // Core 0 supervises: connections, health and the status LED. Input
+    // forwarding, scripts and the GUI run on their own cores.
     while (1) {
+        // Give the other roles a turn where they share this core (host builds)
+        smp_service();
+        
         // Kick watchdog
         kick_watchdog();
         
@@ -160,6 +206,7 @@ int main(void) {
         if (!state.hdmi_connected) {
             status_update(LED_STATE_HDMI_WAIT);
             // HDMI detection handled by status module
+            state.hdmi_connected = status_hdmi_connected();
             continue;
         }
         
@@ -183,59 +230,32 @@ int main(void) {
             continue;
         }
         
-        // Process controller input/output
-        if (state.ps5_connected && state.controller_connected) {
-            status_update(LED_STATE_ACTIVE);
-            
-            // Process input with optimizations
-            if (optimize_process_input(&state.controller_state)) {
-                // Process output with optimizations
-                optimize_process_output(&state.controller_output);
-                
-                // Update LED color based on battery level
-                uint8_t battery = ps5_get_battery_level();
-                if (battery < 20) {
-                    ps5_set_led_color(255, 0, 0); // Red for low battery
-                } else if (battery < 50) {
-                    ps5_set_led_color(255, 165, 0); // Orange for medium
-                } else {
-                    ps5_set_led_color(0, 255, 0); // Green for good
-                }
-            }
-            
-            // Check for disconnections
-            if (!usb_detect_device(USB_DEVICE_PS5)) {
-                state.ps5_connected = 0;
-                status_update(LED_STATE_PS5_WAIT);
-            }
-            if (!usb_detect_device(USB_DEVICE_CONTROLLER)) {
-                state.controller_connected = 0;
-                status_update(LED_STATE_CTRL_WAIT);
-            }
+        // Both ends present: the input core forwards
+        status_update(LED_STATE_ACTIVE);
+        if (!state.link_up) {
+            cores_set_link(1);
+            state.link_up = 1;
         }
         
-        // Performance monitoring and tuning
-        uint64_t current_time = get_system_time();
-        if (current_time - last_perf_check >= PERF_CHECK_INTERVAL) {
-            optimize_get_stats(&state.perf_stats);
-            
-            // Auto-tune performance based on metrics
-            optimize_tune_performance();
-            
-            // Check temperature and throttle if needed
-            if (state.perf_stats.temperature > 80) { // 80°C threshold
-                optimize_set_mode(PROCESS_MODE_NORMAL);
-            } else if (state.perf_stats.temperature < 70) {
-                optimize_set_mode(PROCESS_MODE_FAST);
-            }
-            
-            last_perf_check = current_time;
+        // Check for disconnections
+        if (!usb_detect_device(USB_DEVICE_PS5)) {
+            state.ps5_connected = 0;
+            status_update(LED_STATE_PS5_WAIT);
+        }
+        if (!usb_detect_device(USB_DEVICE_CONTROLLER)) {
+            state.controller_connected = 0;
+            status_update(LED_STATE_CTRL_WAIT);
+        }
+        if (state.link_up && (!state.ps5_connected || !state.controller_connected)) {
+            cores_set_link(0);
+            state.link_up = 0;
         }
     }
 
     return 0;
 }
 
+#ifdef __BARE_METAL__
 // Boot code
 __attribute__((section(".text.boot"), naked)) void _start(void) {
     __asm__ __volatile__(
@@ -256,3 +276,4 @@ static const uint32_t vectors[] = {
     0,                  // Reserved
     (uint32_t)_start    // IRQ
 };
+#endif // __BARE_METAL__
@@ -0,0 +1,431 @@
+#include "mem.h"
+#include "hal.h"
+#ifndef MEM_CPU_ONLY
+#include "dma.h"
+#endif
+
+// Unaligned-safe views for the word and 128-bit paths
+typedef uint32_t __attribute__((may_alias, aligned(1))) word_t;
+typedef uint64_t __attribute__((may_alias, aligned(1))) half_t;
+
+#ifdef MEM_CPU_ONLY
+static mem_thresholds_t thresholds = {
+    MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER
+};
+#else
+static mem_thresholds_t thresholds = {
+    MEM_NEON_THRESHOLD, MEM_NEVER, MEM_NEVER, MEM_NEON_THRESHOLD, MEM_NEVER, MEM_NEON_THRESHOLD
+};
+#endif
+
+static const char* const path_names[MEM_PATH_COUNT] = { "bytes", "words", "neon", "dma" };
+
+static int same_word_offset(const void* a, const void* b) {
+    return (((uintptr_t)a ^ (uintptr_t)b) & 3) == 0;
+}
+
+// DMA writes whole cache lines, so nothing else may share them
+static int line_aligned(const void* dest, uint32_t size) {
+    return (((uintptr_t)dest | size) & (HAL_CACHE_LINE - 1)) == 0;
+}
+
+static int disjoint(const void* dest, const void* src, uint32_t size) {
+    return (uintptr_t)dest + size <= (uintptr_t)src || (uintptr_t)src + size <= (uintptr_t)dest;
+}
+
+static void copy_bytes(uint8_t* d, const uint8_t* s, uint32_t size) {
+    while (size--) *d++ = *s++;
+}
+
+// Words once both pointers are aligned; bytes when they never can be
+static void copy_words(uint8_t* d, const uint8_t* s, uint32_t size) {
+    if (same_word_offset(d, s)) {
+        while (size && ((uintptr_t)d & 3)) {
+            *d++ = *s++;
+            size--;
+        }
+        while (size >= 16) {
+            word_t a = ((const word_t*)s)[0];
+            word_t b = ((const word_t*)s)[1];
+            word_t c = ((const word_t*)s)[2];
+            word_t e = ((const word_t*)s)[3];
+            ((word_t*)d)[0] = a;
+            ((word_t*)d)[1] = b;
+            ((word_t*)d)[2] = c;
+            ((word_t*)d)[3] = e;
+            d += 16;
+            s += 16;
+            size -= 16;
+        }
+        while (size >= 4) {
+            *(word_t*)d = *(const word_t*)s;
+            d += 4;
+            s += 4;
+            size -= 4;
+        }
+    }
+    copy_bytes(d, s, size);
+}
+
+static void set_words(uint8_t* d, uint8_t value, uint32_t size) {
+    uint32_t pattern = value * 0x01010101u;
+    while (size && ((uintptr_t)d & 3)) {
+        *d++ = value;
+        size--;
+    }
+    while (size >= 16) {
+        ((word_t*)d)[0] = pattern;
+        ((word_t*)d)[1] = pattern;
+        ((word_t*)d)[2] = pattern;
+        ((word_t*)d)[3] = pattern;
+        d += 16;
+        size -= 16;
+    }
+    while (size >= 4) {
+        *(word_t*)d = pattern;
+        d += 4;
+        size -= 4;
+    }
+    while (size--) *d++ = value;
+}
+
+static int compare_bytes(const uint8_t* a, const uint8_t* b, uint32_t size) {
+    while (size--) {
+        if (*a != *b) return *a - *b;
+        a++;
+        b++;
+    }
+    return 0;
+}
+
+// Skip equal words; the bytes of the first differing word give the sign
+static int compare_words(const uint8_t* a, const uint8_t* b, uint32_t size) {
+    if (same_word_offset(a, b)) {
+        while (size && ((uintptr_t)a & 3)) {
+            if (*a != *b) return *a - *b;
+            a++;
+            b++;
+            size--;
+        }
+        while (size >= 4 && *(const word_t*)a == *(const word_t*)b) {
+            a += 4;
+            b += 4;
+            size -= 4;
+        }
+    }
+    return compare_bytes(a, b, size);
+}
+
+#ifndef MEM_CPU_ONLY
+static void set_neon(uint8_t* d, uint8_t value, uint32_t size) {
+    uint32_t blocks = size / 16;
+#ifdef __BARE_METAL__
+    if (blocks) {
+        __asm__ volatile (
+            "vdup.8 q0, %[value]\n"
+            "1:\n"
+            "vst1.8 {d0-d1}, [%[dest]]!\n"
+            "subs %[count], %[count], #1\n"
+            "bne 1b\n"
+            : [dest] "+r" (d), [count] "+r" (blocks)
+            : [value] "r" (value)
+            : "q0", "memory"
+        );
+    }
+#else
+    // Two 64-bit stores stand in for one 128-bit register
+    uint64_t pattern = value * 0x0101010101010101ull;
+    while (blocks--) {
+        ((half_t*)d)[0] = pattern;
+        ((half_t*)d)[1] = pattern;
+        d += 16;
+    }
+#endif
+    set_words(d, value, size % 16);
+}
+
+// 16 bytes at a time until a block differs
+static int compare_neon(const uint8_t* a, const uint8_t* b, uint32_t size) {
+    while (size >= 16) {
+#ifdef __BARE_METAL__
+        uint32_t lo, hi;
+        __asm__ volatile (
+            "vld1.8 {d0-d1}, [%[a]]\n"
+            "vld1.8 {d2-d3}, [%[b]]\n"
+            "veor q0, q0, q1\n"
+            "vorr d0, d0, d1\n"
+            "vmov %[lo], %[hi], d0\n"
+            : [lo] "=r" (lo), [hi] "=r" (hi)
+            : [a] "r" (a), [b] "r" (b)
+            : "q0", "q1"
+        );
+        int differs = (lo | hi) != 0;
+#else
+        int differs = ((const half_t*)a)[0] != ((const half_t*)b)[0] ||
+                      ((const half_t*)a)[1] != ((const half_t*)b)[1];
+#endif
+        if (differs) {
+            return compare_bytes(a, b, 16);
+        }
+        a += 16;
+        b += 16;
+        size -= 16;
+    }
+    return compare_bytes(a, b, size);
+}
+
+// Copy or fill on the engine and wait; 0 if it could not take the request
+static int copy_dma(void* dest, const void* src, uint32_t size) {
+    dma_segment_t segment = { dest, src, size };
+    uint32_t ticket = dma_submit(&segment, 1, 0, 0);
+    return ticket && dma_wait(ticket);
+}
+
+static int set_dma(void* dest, uint8_t value, uint32_t size) {
+    uint32_t ticket = dma_fill(dest, value, size, 0, 0);
+    return ticket && dma_wait(ticket);
+}
+#endif // MEM_CPU_ONLY
+
+mem_path_t mem_copy_path(const void* dest, const void* src, uint32_t size) {
+    if (size >= thresholds.copy_dma && line_aligned(dest, size) && disjoint(dest, src, size)) {
+        return MEM_PATH_DMA;
+    }
+    if (size >= thresholds.copy_neon) {
+        return MEM_PATH_NEON;
+    }
+    return same_word_offset(dest, src) && size >= 4 ? MEM_PATH_WORDS : MEM_PATH_BYTES;
+}
+
+mem_path_t mem_set_path(const void* dest, uint32_t size) {
+    if (size >= thresholds.set_dma && line_aligned(dest, size)) {
+        return MEM_PATH_DMA;
+    }
+    if (size >= thresholds.set_neon) {
+        return MEM_PATH_NEON;
+    }
+    return size >= 4 ? MEM_PATH_WORDS : MEM_PATH_BYTES;
+}
+
+// Copy forward, so overlapping moves towards lower addresses are safe
+void mem_copy(void* dest, const void* src, uint32_t size) {
+    switch (mem_copy_path(dest, src, size)) {
+#ifndef MEM_CPU_ONLY
+        case MEM_PATH_DMA:
+            if (copy_dma(dest, src, size)) {
+                return;
+            }
+            neon_copy_block(dest, src, size);
+            return;
+        case MEM_PATH_NEON:
+            neon_copy_block(dest, src, size);
+            return;
+#endif
+        default:
+            copy_words((uint8_t*)dest, (const uint8_t*)src, size);
+            return;
+    }
+}
+
+void mem_set(void* dest, uint8_t value, uint32_t size) {
+    switch (mem_set_path(dest, size)) {
+#ifndef MEM_CPU_ONLY
+        case MEM_PATH_DMA:
+            if (set_dma(dest, value, size)) {
+                return;
+            }
+            set_neon((uint8_t*)dest, value, size);
+            return;
+        case MEM_PATH_NEON:
+            set_neon((uint8_t*)dest, value, size);
+            return;
+#endif
+        default:
+            set_words((uint8_t*)dest, value, size);
+            return;
+    }
+}
+
+// Sign of the first differing byte, as memcmp
+int mem_compare(const void* s1, const void* s2, uint32_t size) {
+#ifndef MEM_CPU_ONLY
+    if (size >= thresholds.compare_neon) {
+        return compare_neon((const uint8_t*)s1, (const uint8_t*)s2, size);
+    }
+#endif
+    return compare_words((const uint8_t*)s1, (const uint8_t*)s2, size);
+}
+
+// Returns the DMA ticket, or 0 when the copy was done before returning
+// (done has then been called too)
+uint32_t mem_copy_async(void* dest, const void* src, uint32_t size, mem_done_t done, void* user) {
+#ifndef MEM_CPU_ONLY
+    if (size >= thresholds.copy_async && line_aligned(dest, size) && disjoint(dest, src, size)) {
+        dma_segment_t segment = { dest, src, size };
+        uint32_t ticket = dma_submit(&segment, 1, done, user);
+        if (ticket) {
+            return ticket;
+        }
+    }
+#endif
+    mem_copy(dest, src, size);
+    if (done) {
+        done(0, 1, user);
+    }
+    return 0;
+}
+
+void mem_get_thresholds(mem_thresholds_t* out) {
+    if (out) {
+        *out = thresholds;
+    }
+}
+
+void mem_set_thresholds(const mem_thresholds_t* in) {
+    if (in) {
+        thresholds = *in;
+    }
+}
+
+const char* mem_path_name(mem_path_t path) {
+    return path < MEM_PATH_COUNT ? path_names[path] : "unknown";
+}
+
+#ifdef MEM_CPU_ONLY
+void mem_calibrate(void) {
+}
+#else
+
+// Calibration: each path moves MEM_CALIBRATE_MAX bytes in pieces of every
+// power-of-two size, best of a few runs
+#define CALIBRATE_SIZES     11      // MEM_CALIBRATE_MIN .. MEM_CALIBRATE_MAX
+#define CALIBRATE_RUNS      3
+
+static uint8_t HAL_BULK_BUFFER calibrate_src[MEM_CALIBRATE_MAX];
+static uint8_t HAL_BULK_BUFFER calibrate_dst[MEM_CALIBRATE_MAX];
+
+typedef enum {
+    RUN_COPY_WORDS,
+    RUN_COPY_NEON,
+    RUN_COPY_DMA,
+    RUN_COPY_SUBMIT,
+    RUN_SET_WORDS,
+    RUN_SET_NEON,
+    RUN_SET_DMA,
+    RUN_COMPARE_WORDS,
+    RUN_COMPARE_NEON,
+    RUN_COUNT
+} calibrate_run_t;
+
+// Cycles for one piece, or MEM_NEVER if the path could not run
+static uint32_t run_once(calibrate_run_t run, uint32_t size, volatile int* sink) {
+    uint32_t start = hal_cycles();
+    switch (run) {
+        case RUN_COPY_WORDS:
+            copy_words(calibrate_dst, calibrate_src, size);
+            break;
+        case RUN_COPY_NEON:
+            neon_copy_block(calibrate_dst, calibrate_src, size);
+            break;
+        case RUN_COPY_DMA:
+            if (!copy_dma(calibrate_dst, calibrate_src, size)) {
+                return MEM_NEVER;
+            }
+            break;
+        case RUN_COPY_SUBMIT: {
+            // What the caller pays; the transfer finishes off the clock
+            dma_segment_t segment = { calibrate_dst, calibrate_src, size };
+            uint32_t ticket = dma_submit(&segment, 1, 0, 0);
+            uint32_t cycles = hal_cycles() - start;
+            return ticket && dma_wait(ticket) ? cycles : MEM_NEVER;
+        }
+        case RUN_SET_WORDS:
+            set_words(calibrate_dst, 0x5A, size);
+            break;
+        case RUN_SET_NEON:
+            set_neon(calibrate_dst, 0x5A, size);
+            break;
+        case RUN_SET_DMA:
+            if (!set_dma(calibrate_dst, 0x5A, size)) {
+                return MEM_NEVER;
+            }
+            break;
+        case RUN_COMPARE_WORDS:
+            *sink += compare_words(calibrate_dst, calibrate_src, size);
+            break;
+        case RUN_COMPARE_NEON:
+            *sink += compare_neon(calibrate_dst, calibrate_src, size);
+            break;
+        default:
+            break;
+    }
+    return hal_cycles() - start;
+}
+
+static uint32_t measure(calibrate_run_t run, uint32_t size) {
+    volatile int sink = 0;
+    uint32_t best = MEM_NEVER;
+
+    // Compares scan equal buffers to the end
+    if (run == RUN_COMPARE_WORDS || run == RUN_COMPARE_NEON) {
+        copy_words(calibrate_dst, calibrate_src, MEM_CALIBRATE_MAX);
+    }
+    for (uint32_t n = 0; n < CALIBRATE_RUNS; n++) {
+        uint32_t total = 0;
+        for (uint32_t offset = 0; offset < MEM_CALIBRATE_MAX; offset += size) {
+            uint32_t cycles = run_once(run, size, &sink);
+            if (cycles == MEM_NEVER) {
+                return MEM_NEVER;
+            }
+            total += cycles;
+        }
+        if (total < best) {
+            best = total;
+        }
+    }
+    return best;
+}
+
+// Smallest size from which the candidate beats the incumbent at every
+// larger size
+static uint32_t crossover(const uint32_t* candidate, const uint32_t* incumbent) {
+    uint32_t threshold = MEM_NEVER;
+    for (int i = CALIBRATE_SIZES - 1; i >= 0; i--) {
+        if (candidate[i] >= incumbent[i]) {
+            break;
+        }
+        threshold = MEM_CALIBRATE_MIN << i;
+    }
+    return threshold;
+}
+
+// Time every path and set the thresholds. Needs the DMA engine idle;
+// without it the DMA thresholds stay at MEM_NEVER.
+void mem_calibrate(void) {
+    static uint32_t cycles[RUN_COUNT][CALIBRATE_SIZES];
+    uint32_t best_copy[CALIBRATE_SIZES];
+    uint32_t best_set[CALIBRATE_SIZES];
+
+    for (uint32_t i = 0; i < MEM_CALIBRATE_MAX; i++) {
+        calibrate_src[i] = (uint8_t)(i * 31 + 7);
+    }
+    for (uint32_t run = 0; run < RUN_COUNT; run++) {
+        for (uint32_t i = 0; i < CALIBRATE_SIZES; i++) {
+            cycles[run][i] = measure((calibrate_run_t)run, MEM_CALIBRATE_MIN << i);
+        }
+    }
+
+    for (uint32_t i = 0; i < CALIBRATE_SIZES; i++) {
+        best_copy[i] = cycles[RUN_COPY_WORDS][i] < cycles[RUN_COPY_NEON][i] ?
+                       cycles[RUN_COPY_WORDS][i] : cycles[RUN_COPY_NEON][i];
+        best_set[i] = cycles[RUN_SET_WORDS][i] < cycles[RUN_SET_NEON][i] ?
+                      cycles[RUN_SET_WORDS][i] : cycles[RUN_SET_NEON][i];
+    }
+    thresholds.copy_neon = crossover(cycles[RUN_COPY_NEON], cycles[RUN_COPY_WORDS]);
+    thresholds.copy_dma = crossover(cycles[RUN_COPY_DMA], best_copy);
+    thresholds.copy_async = crossover(cycles[RUN_COPY_SUBMIT], best_copy);
+    thresholds.set_neon = crossover(cycles[RUN_SET_NEON], cycles[RUN_SET_WORDS]);
+    thresholds.set_dma = crossover(cycles[RUN_SET_DMA], best_set);
+    thresholds.compare_neon = crossover(cycles[RUN_COMPARE_NEON], cycles[RUN_COMPARE_WORDS]);
+}
+#endif // MEM_CPU_ONLY
@@ -0,0 +1,59 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdint.h>
+
+// Size-adaptive copy, set and compare
+//
+// Every call picks a path from its size and alignment: bytes when the
+// pointers can never be word-aligned together, 32-bit words for small
+// sizes, NEON from the NEON threshold up, and the DMA engine (dma.h) from
+// the DMA threshold up when the destination is whole cache lines. The
+// thresholds start out CPU-only and mem_calibrate() sets them at boot from
+// a microbenchmark of each path, as the smallest size from which the
+// faster path keeps winning. DMA is never used before the engine is up or
+// when it is full.
+//
+// mem_copy_async() hands large copies to the engine and returns its ticket
+// (dma_done/dma_wait); smaller ones are done on the spot.
+//
+// Host tools built without the firmware (MEM_CPU_ONLY) get the CPU paths.
+
+#define MEM_NEVER               0xFFFFFFFF
+#define MEM_NEON_THRESHOLD      128         // Until calibrated
+#define MEM_CALIBRATE_MIN       16
+#define MEM_CALIBRATE_MAX       16384
+
+typedef enum {
+    MEM_PATH_BYTES,
+    MEM_PATH_WORDS,
+    MEM_PATH_NEON,
+    MEM_PATH_DMA,
+    MEM_PATH_COUNT
+} mem_path_t;
+
+// Smallest size for each path, or MEM_NEVER
+typedef struct {
+    uint32_t copy_neon;
+    uint32_t copy_dma;          // Submit and wait
+    uint32_t copy_async;        // Submit only (mem_copy_async)
+    uint32_t set_neon;
+    uint32_t set_dma;
+    uint32_t compare_neon;
+} mem_thresholds_t;
+
+typedef void (*mem_done_t)(uint32_t ticket, int ok, void* user);
+
+// Function Prototypes
+void mem_copy(void* dest, const void* src, uint32_t size);
+void mem_set(void* dest, uint8_t value, uint32_t size);
+int mem_compare(const void* s1, const void* s2, uint32_t size);
+uint32_t mem_copy_async(void* dest, const void* src, uint32_t size, mem_done_t done, void* user);
+mem_path_t mem_copy_path(const void* dest, const void* src, uint32_t size);
+mem_path_t mem_set_path(const void* dest, uint32_t size);
+void mem_calibrate(void);
+void mem_get_thresholds(mem_thresholds_t* thresholds);
+void mem_set_thresholds(const mem_thresholds_t* thresholds);
+const char* mem_path_name(mem_path_t path);
+
+#endif // MEM_H
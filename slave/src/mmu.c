@@ -0,0 +1,132 @@
+#include "mmu.h"
+
+// First-level translation table (16 KB, 16 KB aligned)
+static uint32_t __attribute__((aligned(16384))) translation_table[MMU_NUM_SECTIONS];
+static int tables_built;
+static volatile int mmu_on;
+
+#ifdef __BARE_METAL__
+// Clean the whole data cache by set/way (L1 4-way 128 sets, L2 16-way 512 sets)
+static void dcache_clean_all(void) {
+    static const uint32_t ways[2] = {4, 16};
+    static const uint32_t sets[2] = {128, 512};
+    
+    for (uint32_t level = 0; level < 2; level++) {
+        uint32_t way_shift = __builtin_clz(ways[level] - 1);
+        for (uint32_t way = 0; way < ways[level]; way++) {
+            for (uint32_t set = 0; set < sets[level]; set++) {
+                uint32_t sw = (way << way_shift) | (set << 6) | (level << 1);
+                __asm__ volatile("mcr p15, 0, %0, c7, c10, 2" : : "r" (sw));  // DCCSW
+            }
+        }
+    }
+    __asm__ volatile("dsb" ::: "memory");
+}
+#endif
+
+// Fill the translation table with the flat memory map
+void mmu_build_tables(void) {
+    for (uint32_t i = 0; i < MMU_NUM_SECTIONS; i++) {
+        uint32_t base = i << MMU_SECTION_SHIFT;
+        uint32_t attr;
+        
+        if (base >= MMU_DMA_BASE && base < MMU_DMA_BASE + MMU_DMA_SIZE) {
+            attr = MMU_NORMAL_NC;
+        } else if (base < MMU_RAM_END) {
+            attr = MMU_NORMAL_WB;
+        } else if (base < MMU_PERIPH_END || (base >= MMU_LOCAL_BASE && base < MMU_LOCAL_END)) {
+            attr = MMU_DEVICE;
+        } else {
+            attr = 0;  // Translation fault
+        }
+        
+        translation_table[i] = attr ? (base | attr | MMU_DESC_DOMAIN(0)) : 0;
+    }
+    tables_built = 1;
+}
+
+const uint32_t* mmu_tables(void) {
+    return translation_table;
+}
+
+// Memory type the table gives an address
+mmu_mem_type_t mmu_mem_type(uintptr_t addr) {
+    uint32_t desc = translation_table[(uint32_t)addr >> MMU_SECTION_SHIFT];
+    
+    if ((desc & 3) != MMU_DESC_SECTION) {
+        return MMU_MEM_FAULT;
+    }
+    if (!(desc & MMU_DESC_TEX(7)) && (desc & MMU_DESC_B) && !(desc & MMU_DESC_C)) {
+        return MMU_MEM_DEVICE;
+    }
+    if (desc & MMU_DESC_C) {
+        return MMU_MEM_NORMAL;
+    }
+    return MMU_MEM_NONCACHED;
+}
+
+// Turn on translation and caches on the calling core. The boot core builds
+// the tables first; secondary cores share them.
+void mmu_enable_cpu(void) {
+#ifdef __BARE_METAL__
+    uint32_t reg;
+    uint32_t lo, hi;
+    
+    // Join the coherency domain before any cacheable access (CPUECTLR.SMPEN)
+    __asm__ volatile("mrrc p15, 1, %0, %1, c15" : "=r" (lo), "=r" (hi));
+    lo |= (1 << 6);
+    __asm__ volatile("mcrr p15, 1, %0, %1, c15" : : "r" (lo), "r" (hi));
+    __asm__ volatile("isb");
+    
+    // Domain 0 client, TTBR0 only, table walks inner/outer write-back shareable
+    __asm__ volatile("mcr p15, 0, %0, c3, c0, 0" : : "r" (0x55555555));
+    __asm__ volatile("mcr p15, 0, %0, c2, c0, 2" : : "r" (0));
+    reg = (uint32_t)(uintptr_t)translation_table | 0x4A;
+    __asm__ volatile("mcr p15, 0, %0, c2, c0, 0" : : "r" (reg));
+    
+    // Invalidate TLBs, I-cache and branch predictor
+    __asm__ volatile("mcr p15, 0, %0, c8, c7, 0" : : "r" (0));
+    __asm__ volatile("mcr p15, 0, %0, c7, c5, 0" : : "r" (0));
+    __asm__ volatile("mcr p15, 0, %0, c7, c5, 6" : : "r" (0));
+    __asm__ volatile("dsb\n isb" ::: "memory");
+    
+    // SCTLR: MMU, D-cache, branch prediction, I-cache
+    __asm__ volatile("mrc p15, 0, %0, c1, c0, 0" : "=r" (reg));
+    reg |= (1 << 0) | (1 << 2) | (1 << 11) | (1 << 12);
+    __asm__ volatile("mcr p15, 0, %0, c1, c0, 0" : : "r" (reg) : "memory");
+    __asm__ volatile("isb" ::: "memory");
+#endif
+    mmu_on = 1;
+}
+
+// Build the tables and enable the MMU on the boot core
+int mmu_init(void) {
+    if (!tables_built) {
+        mmu_build_tables();
+    }
+    hal_dsb();
+    mmu_enable_cpu();
+    return 1;
+}
+
+// Back to flat, uncached strongly-ordered access (benchmarking only)
+void mmu_disable(void) {
+#ifdef __BARE_METAL__
+    uint32_t reg;
+    
+    // Write back dirty lines before the D-cache stops being looked up
+    dcache_clean_all();
+    
+    __asm__ volatile("mrc p15, 0, %0, c1, c0, 0" : "=r" (reg));
+    reg &= ~((1 << 0) | (1 << 2));
+    __asm__ volatile("mcr p15, 0, %0, c1, c0, 0" : : "r" (reg) : "memory");
+    __asm__ volatile("isb" ::: "memory");
+    __asm__ volatile("mcr p15, 0, %0, c8, c7, 0" : : "r" (0));
+    __asm__ volatile("dsb\n isb" ::: "memory");
+#endif
+    mmu_on = 0;
+}
+
+int mmu_enabled(void) {
+    return mmu_on;
+}
@@ -0,0 +1,55 @@
+#ifndef MMU_H
+#define MMU_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// ARMv7 short-descriptor translation: one level of 1 MB sections, flat map
+#define MMU_SECTION_SHIFT   20
+#define MMU_SECTION_SIZE    (1U << MMU_SECTION_SHIFT)
+#define MMU_NUM_SECTIONS    4096
+
+// Section descriptor fields
+#define MMU_DESC_SECTION    (2 << 0)
+#define MMU_DESC_B          (1 << 2)
+#define MMU_DESC_C          (1 << 3)
+#define MMU_DESC_XN         (1 << 4)
+#define MMU_DESC_DOMAIN(d)  (((d) & 0xF) << 5)
+#define MMU_DESC_AP_RW      (3 << 10)
+#define MMU_DESC_TEX(x)     (((x) & 0x7) << 12)
+#define MMU_DESC_S          (1 << 16)
+
+// Memory types
+#define MMU_NORMAL_WB       (MMU_DESC_SECTION | MMU_DESC_AP_RW | MMU_DESC_TEX(1) | \
+                             MMU_DESC_C | MMU_DESC_B | MMU_DESC_S)   // Write-back, write-allocate
+#define MMU_NORMAL_NC       (MMU_DESC_SECTION | MMU_DESC_AP_RW | MMU_DESC_TEX(1) | \
+                             MMU_DESC_S)                             // Non-cacheable
+#define MMU_DEVICE          (MMU_DESC_SECTION | MMU_DESC_AP_RW | MMU_DESC_B | \
+                             MMU_DESC_XN)                            // Shareable device
+
+// Memory map
+#define MMU_RAM_END         0x3F000000   // ARM RAM below the peripheral window
+#define MMU_PERIPH_BASE     0x3F000000
+#define MMU_PERIPH_END      0x40000000
+#define MMU_LOCAL_BASE      0x40000000   // ARM local peripherals
+#define MMU_LOCAL_END       0x40100000
+#define MMU_DMA_BASE        0x00200000   // Non-cacheable DMA buffers (.dma_buffers)
+#define MMU_DMA_SIZE        MMU_SECTION_SIZE
+
+typedef enum {
+    MMU_MEM_FAULT,       // Unmapped
+    MMU_MEM_NORMAL,      // Cacheable RAM
+    MMU_MEM_NONCACHED,   // DMA buffers
+    MMU_MEM_DEVICE       // Peripherals
+} mmu_mem_type_t;
+
+// Function Prototypes
+void mmu_build_tables(void);
+const uint32_t* mmu_tables(void);
+mmu_mem_type_t mmu_mem_type(uintptr_t addr);
+int mmu_init(void);
+void mmu_enable_cpu(void);
+void mmu_disable(void);
+int mmu_enabled(void);
+
+#endif // MMU_H
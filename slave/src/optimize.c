@@ -1,6 +1,9 @@
 #include "optimize.h"
 #include "status.h"
 #include "script.h"
+#include "latency_hist.h"
+#include "profile.h"
+#include "clock.h"
 
 // Performance tuning parameters
 #define MIN_BUFFER_SIZE_MS    1
@@ -13,9 +16,20 @@
 
 // Memory-mapped CPU control registers
 #define CPU_CONTROL_BASE     0x3F100000
-#define CPU_FREQ_REG        ((volatile uint32_t*)(CPU_CONTROL_BASE + 0x08))
-#define CPU_THROTTLE_REG    ((volatile uint32_t*)(CPU_CONTROL_BASE + 0x0C))
-#define CPU_TEMP_REG        ((volatile uint32_t*)(CPU_CONTROL_BASE + 0x10))
+#define CPU_FREQ_REG        HAL_REG(CPU_CONTROL_BASE + 0x08)
+#define CPU_THROTTLE_REG    HAL_REG(CPU_CONTROL_BASE + 0x0C)
+#define CPU_TEMP_REG        HAL_REG(CPU_CONTROL_BASE + 0x10)
+
+// One tuning window. The input core records into the live window; on the
+// GUI core's request it retires it and starts the other, so the tuner only
+// ever reads a window nothing is writing.
+typedef struct {
+    latency_hist_t latency[LATENCY_STAGE_COUNT];
+    uint32_t frames_processed;
+    uint32_t frames_dropped;
+    uint32_t buffer_overruns;
+    uint32_t buffer_underruns;
+} optimize_window_t;
 
 // Static configuration
 static struct {
@@ -25,6 +39,9 @@ static struct {
     uint32_t output_buffer_ms;
     uint32_t cpu_freq;
     performance_stats_t stats;
+    optimize_window_t windows[2];
+    volatile uint32_t live;            // Window being recorded
+    int input_pending;                 // Forwarded report awaiting its output
 } config = {
     .mode = PROCESS_MODE_NORMAL,
     .features = OPT_NEON_ENABLED | OPT_DMA_ENABLED | OPT_CACHE_ENABLED,
@@ -55,6 +72,11 @@ int optimize_init(void) {
     // Lock memory to prevent paging
     optimize_lock_memory();
     
+    // Start with empty windows
+    __builtin_memset(config.windows, 0, sizeof(config.windows));
+    config.live = 0;
+    config.input_pending = 0;
+    
     return 1; // Return success
 }
 
@@ -98,6 +120,25 @@ void optimize_set_mode(process_mode_t mode) {
     }
 }
 
+// Enable optimization features
+void optimize_enable_features(uint32_t features) {
+    if (features & OPT_NEON_ENABLED) {
+        enable_neon();
+    }
+    if (features & OPT_GPU_ENABLED) {
+        enable_gpu();
+    }
+    if (features & OPT_DMA_ENABLED) {
+        enable_dma();
+    }
+    config.features |= features;
+}
+
+// Disable optimization features
+void optimize_disable_features(uint32_t features) {
+    config.features &= ~features;
+}
+
 // Input validation bounds
 #define MAX_ANALOG_VALUE 255
 #define MIN_ANALOG_VALUE 0
@@ -153,69 +194,85 @@ static int validate_input_state(ps5_state_t* state) {
     return 1;
 }
 
-// Process input with optimizations and scripting support
+// Process input with optimizations and scripting support. The newest
+// captured report is taken first; validation and the scripts then work
+// on that report, which is what gets forwarded.
 int optimize_process_input(ps5_state_t* state) {
-    uint64_t start_time = get_system_time();
-    int result = 0;
-    
-    // Fast-path input validation with early return
-    if (!validate_input_state(state)) {
-        config.stats.input_errors++;
-        config.stats.frames_dropped++;
-        config.stats.error_count++;
-        return 0;
-    }
-    
-    // Process scripts first for lowest latency
-    script_process_input(state);
-    
-    // Prefetch next input buffer while script processing is happening
-    if (config.features & OPT_CACHE_ENABLED) {
-        optimize_prefetch_data(state, sizeof(ps5_state_t));
-    }
-    
-    // Process input based on mode with optimized paths
+    optimize_window_t* window = &config.windows[config.live];
+    uint64_t stage_start = clock_frame_us();
+    uint64_t stage_end;
+    
+    // Process input based on mode with optimized paths. Each path takes the
+    // newest captured report; a count above one means older reports were
+    // superseded before we got to them.
+    int reports = 0;
+    PROFILE_BEGIN(PROFILE_ZONE_USB_READ);
     switch (config.mode) {
-        case PROCESS_MODE_SAFE:
-            // Basic processing with bounds checking
-            if (validate_input_state(state)) {
-                result = ps5_process_input(state);
-            }
-            break;
-            
         case PROCESS_MODE_FAST:
             // Ultra-low latency path: Direct processing, no buffering
-            result = ps5_process_input(state);
+            reports = ps5_process_input(state);
             break;
             
         case PROCESS_MODE_ACCURATE:
             // High precision path with optimized NEON acceleration
-            if (config.features & OPT_NEON_ENABLED) {
+            reports = ps5_process_input(state);
+            if (reports && (config.features & OPT_NEON_ENABLED)) {
                 static ps5_state_t prev_state;
-                ps5_process_input(state);
                 neon_process_input(state, &prev_state, sizeof(ps5_state_t));
                 prev_state = *state;
-                result = 1;
-            } else {
-                result = ps5_process_input(state);
             }
             break;
             
         default:
-            // Optimized standard processing
-            result = ps5_process_input(state);
+            // Safe and standard processing; every mode is bounds checked below
+            reports = ps5_process_input(state);
             break;
     }
+    PROFILE_END(PROFILE_ZONE_USB_READ);
     
-    // Update statistics
-    config.stats.input_latency_us = (uint32_t)(get_system_time() - start_time);
-    if (result) {
-        config.stats.frames_processed++;
-    } else {
-        config.stats.frames_dropped++;
+    // Update statistics. No new report is not a drop: the ring was simply empty.
+    window->buffer_overruns += ps5_take_input_overruns();
+    if (reports == 0) {
+        return 0;
     }
+    window->frames_dropped += (uint32_t)(reports - 1);
+    stage_end = clock_now_us();
+    latency_hist_record(&window->latency[LATENCY_STAGE_USB_READ], (uint32_t)(stage_end - stage_start));
+    stage_start = stage_end;
     
-    return result;
+    // Fast-path input validation with early return
+    PROFILE_BEGIN(PROFILE_ZONE_VALIDATE);
+    int valid = validate_input_state(state);
+    PROFILE_END(PROFILE_ZONE_VALIDATE);
+    if (!valid) {
+        config.stats.input_errors++;
+        window->frames_dropped++;
+        config.stats.error_count++;
+        return 0;
+    }
+    stage_end = clock_now_us();
+    latency_hist_record(&window->latency[LATENCY_STAGE_VALIDATE], (uint32_t)(stage_end - stage_start));
+    stage_start = stage_end;
+    
+    // Scripts, combos and macros edit the report in place before it goes on
+    PROFILE_BEGIN(PROFILE_ZONE_SCRIPTS);
+    script_process_input(state);
+    PROFILE_END(PROFILE_ZONE_SCRIPTS);
+    stage_end = clock_now_us();
+    latency_hist_record(&window->latency[LATENCY_STAGE_SCRIPTS], (uint32_t)(stage_end - stage_start));
+    
+    // Prefetch next input buffer while script processing is happening
+    if (config.features & OPT_CACHE_ENABLED) {
+        optimize_prefetch_data(state, sizeof(ps5_state_t));
+    }
+    
+    config.input_pending = 1;
+    
+    // Report age from transfer completion to forwarding
+    config.stats.input_latency_us = (uint32_t)(stage_end - ps5_get_input_timestamp());
+    window->frames_processed++;
+    
+    return 1;
 }
 
 // Output validation bounds
@@ -258,18 +315,22 @@ static int validate_output_state(const ps5_output_t* output) {
 
 // Process output with optimizations
 int optimize_process_output(const ps5_output_t* output) {
-    uint64_t start_time = get_system_time();
+    optimize_window_t* window = &config.windows[config.live];
+    uint64_t start_time = clock_now_us();
+    uint64_t end_time;
     int result = 0;
     
     // Output validation
     if (!validate_output_state(output)) {
         config.stats.output_errors++;
-        config.stats.frames_dropped++;
+        window->frames_dropped++;
         config.stats.error_count++;
         return 0;
     }
+    uint64_t write_start = clock_now_us();
     
     // Process output based on mode
+    PROFILE_BEGIN(PROFILE_ZONE_USB_WRITE);
     switch (config.mode) {
         case PROCESS_MODE_SAFE:
             // Basic processing with validation
@@ -279,13 +340,9 @@ int optimize_process_output(const ps5_output_t* output) {
             break;
             
         case PROCESS_MODE_FAST:
-            // Direct output with DMA if available
-            if (config.features & OPT_DMA_ENABLED) {
-                dma_memcpy((void*)output, output, sizeof(ps5_output_t));
-                result = ps5_send_output(output);
-            } else {
-                result = ps5_send_output(output);
-            }
+            // Direct output; a report this small costs more to hand to DMA
+            // than to send
+            result = ps5_send_output(output);
             break;
             
         default:
@@ -293,22 +350,68 @@ int optimize_process_output(const ps5_output_t* output) {
             result = ps5_send_output(output);
             break;
     }
+    PROFILE_END(PROFILE_ZONE_USB_WRITE);
     
     // Update statistics
-    config.stats.output_latency_us = (uint32_t)(get_system_time() - start_time);
+    end_time = clock_now_us();
+    config.stats.output_latency_us = (uint32_t)(end_time - start_time);
+    latency_hist_record(&window->latency[LATENCY_STAGE_USB_WRITE], (uint32_t)(end_time - write_start));
+    if (config.input_pending) {
+        // Age of the report this output answers
+        latency_hist_record(&window->latency[LATENCY_STAGE_END_TO_END],
+                            (uint32_t)(end_time - ps5_get_input_timestamp()));
+        config.input_pending = 0;
+    }
     if (!result) {
-        config.stats.frames_dropped++;
+        window->frames_dropped++;
     }
     
     return result;
 }
 
 // System voltage register
-#define VOLTAGE_REG ((volatile uint32_t*)(CPU_CONTROL_BASE + 0x14))
+#define VOLTAGE_REG HAL_REG(CPU_CONTROL_BASE + 0x14)
+
+// Summarise a latency histogram
+static void latency_summary(const latency_hist_t* hist, latency_percentiles_t* out) {
+    out->samples = hist->count;
+    out->p50_us = latency_hist_percentile(hist, 500);
+    out->p99_us = latency_hist_percentile(hist, 990);
+    out->p999_us = latency_hist_percentile(hist, 999);
+    out->max_us = hist->max_us;
+}
+
+// Window last retired by the input core
+static inline const optimize_window_t* retired_window(void) {
+    return &config.windows[config.live ^ 1];
+}
+
+// Input core: close the live window and start recording into the other.
+// The closed window is what the stats, the latency histograms and the
+// tuner read until the next call, so the caller must not retire again
+// while they may still be reading it.
+void optimize_retire_window(void) {
+    uint32_t next = config.live ^ 1;
+    optimize_window_t* window = &config.windows[next];
+    for (uint32_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        latency_hist_reset(&window->latency[i]);
+    }
+    window->frames_processed = 0;
+    window->frames_dropped = 0;
+    window->buffer_overruns = 0;
+    window->buffer_underruns = 0;
+    
+    // Reset before it goes live
+    hal_dmb();
+    config.live = next;
+    hal_dmb();
+}
 
-// Get performance statistics
+// Get performance statistics. Window counters and stage latencies cover
+// the window last retired.
 void optimize_get_stats(performance_stats_t* stats) {
     if (stats) {
+        PROFILE_BEGIN(PROFILE_ZONE_STATS);
         static uint64_t start_time = 0;
         uint64_t current_time = get_system_time();
         
@@ -337,11 +440,25 @@ void optimize_get_stats(performance_stats_t* stats) {
         // Update uptime
         config.stats.uptime_ms = (uint32_t)((current_time - start_time) / 1000);
         
-        // Copy stats to output
+        // Copy stats to output, the window counters from the retired window
+        const optimize_window_t* window = retired_window();
         *stats = config.stats;
+        stats->frames_processed = window->frames_processed;
+        stats->frames_dropped = window->frames_dropped;
+        stats->buffer_overruns = window->buffer_overruns;
+        stats->buffer_underruns = window->buffer_underruns;
+        for (uint32_t i = 0; i < LATENCY_STAGE_COUNT; i++) {
+            latency_summary(&window->latency[i], &stats->stage_latency[i]);
+        }
+        PROFILE_END(PROFILE_ZONE_STATS);
     }
 }
 
+// Full histogram behind a stage's percentiles, from the retired window
+const latency_hist_t* optimize_get_latency(latency_stage_t stage) {
+    return &retired_window()->latency[stage < LATENCY_STAGE_COUNT ? stage : LATENCY_STAGE_END_TO_END];
+}
+
 // Performance thresholds
 #define CRITICAL_TEMP_THRESHOLD   85
 #define HIGH_TEMP_THRESHOLD      75
@@ -352,12 +469,17 @@ void optimize_get_stats(performance_stats_t* stats) {
 #define TARGET_LATENCY_US        2000    // 2ms target latency
 #define FREQ_STEP_SIZE          100000000 // 100MHz steps
 
-// Auto-tune performance
+// Auto-tune performance on the retired window
 void optimize_tune_performance(void) {
+    const optimize_window_t* window = retired_window();
+    
+    // Decide on the tail of the window, not the last frame
+    uint32_t latency_p99 = latency_hist_percentile(&window->latency[LATENCY_STAGE_END_TO_END], 990);
+    
     // Calculate error rate
     float error_rate = 0;
-    if (config.stats.frames_processed > 0) {
-        error_rate = (float)config.stats.frames_dropped / config.stats.frames_processed;
+    if (window->frames_processed > 0) {
+        error_rate = (float)window->frames_dropped / window->frames_processed;
     }
     
     // Check temperature first
@@ -373,8 +495,8 @@ void optimize_tune_performance(void) {
     
     // Check various metrics
     if (error_rate > ERROR_RATE_THRESHOLD ||
-        config.stats.total_latency_us > TARGET_LATENCY_US ||
-        config.stats.buffer_overruns > 0) {
+        latency_p99 > TARGET_LATENCY_US ||
+        window->buffer_overruns > 0) {
         need_more_performance = 1;
         can_reduce_performance = 0;
     }
@@ -403,7 +525,7 @@ void optimize_tune_performance(void) {
         }
     } else if (config.stats.cpu_usage < NORMAL_CPU_THRESHOLD && can_reduce_performance == 1) {
         // CPU usage is low, can reduce frequency if latency is good
-        if (config.stats.total_latency_us < TARGET_LATENCY_US / 2 &&
+        if (latency_p99 < TARGET_LATENCY_US / 2 &&
             config.cpu_freq > CPU_FREQ_MIN) {
             config.cpu_freq -= FREQ_STEP_SIZE;
             *CPU_FREQ_REG = config.cpu_freq;
@@ -411,22 +533,17 @@ void optimize_tune_performance(void) {
     }
     
     // Buffer tuning based on latency
-    if (config.stats.buffer_underruns > 0) {
+    if (window->buffer_underruns > 0) {
         if (config.input_buffer_ms < MAX_BUFFER_SIZE_MS) {
             config.input_buffer_ms++;
         }
-    } else if (config.stats.total_latency_us < TARGET_LATENCY_US / 2 &&
+    } else if (latency_p99 < TARGET_LATENCY_US / 2 &&
                can_reduce_performance == 1) {
         if (config.input_buffer_ms > MIN_BUFFER_SIZE_MS) {
             config.input_buffer_ms--;
         }
     }
-    
-    // Reset error counters for next interval
-    config.stats.frames_dropped = 0;
-    config.stats.frames_processed = 0;
-    config.stats.buffer_overruns = 0;
-    config.stats.buffer_underruns = 0;
+
 }
 
 // Verify current processing mode
@@ -441,18 +558,20 @@ int optimize_verify_features(uint32_t features) {
 
 // Verify system stability
 int optimize_verify_stability(void) {
+    const optimize_window_t* window = retired_window();
+    
     // Check temperature
     if (config.stats.temperature > 85) { // Critical temperature threshold
         return 0;
     }
     
     // Check error rates
-    if (config.stats.frames_dropped > config.stats.frames_processed / 10) { // >10% drop rate
+    if (window->frames_dropped > window->frames_processed / 10) { // >10% drop rate
         return 0;
     }
     
     // Check buffer health
-    if (config.stats.buffer_overruns > 5 || config.stats.buffer_underruns > 5) {
+    if (window->buffer_overruns > 5 || window->buffer_underruns > 5) {
         return 0;
     }
     
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "ps5.h"
 #include "hardware.h"
+#include "latency_hist.h"
 
 // Performance Optimization Flags
 #define OPT_NEON_ENABLED      (1 << 0)
@@ -20,14 +21,34 @@ typedef enum {
     PROCESS_MODE_ACCURATE     // Full processing with interpolation
 } process_mode_t;
 
+// Pipeline stages with a latency histogram
+typedef enum {
+    LATENCY_STAGE_VALIDATE,   // Input validation
+    LATENCY_STAGE_SCRIPTS,    // Script processing
+    LATENCY_STAGE_USB_READ,   // Taking the captured report
+    LATENCY_STAGE_USB_WRITE,  // Output report submission
+    LATENCY_STAGE_END_TO_END, // Report capture to output sent
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+// Latency distribution of one stage
+typedef struct {
+    uint32_t samples;              // Samples in the window
+    uint32_t p50_us;               // Median
+    uint32_t p99_us;               // 99th percentile
+    uint32_t p999_us;              // 99.9th percentile
+    uint32_t max_us;               // Worst sample
+} latency_percentiles_t;
+
 // Performance Statistics
 typedef struct {
     // Latency metrics
-    uint32_t input_latency_us;     // Input processing latency
+    uint32_t input_latency_us;     // Input report age when forwarded
     uint32_t output_latency_us;    // Output processing latency
     uint32_t total_latency_us;     // Total round-trip latency
     uint32_t min_latency_us;       // Minimum observed latency
     uint32_t max_latency_us;       // Maximum observed latency
+    latency_percentiles_t stage_latency[LATENCY_STAGE_COUNT]; // Since the last tuning pass
     
     // Frame metrics
     uint32_t frames_processed;     // Number of frames processed
@@ -54,7 +75,7 @@ typedef struct {
 } performance_stats_t;
 
 // Function Prototypes
-void optimize_init(void);
+int optimize_init(void);
 void optimize_set_mode(process_mode_t mode);
 int optimize_verify_mode(process_mode_t mode);
 void optimize_enable_features(uint32_t features);
@@ -63,7 +84,9 @@ int optimize_verify_stability(void);
 void optimize_disable_features(uint32_t features);
 int optimize_process_input(ps5_state_t* state);
 int optimize_process_output(const ps5_output_t* output);
+void optimize_retire_window(void);
 void optimize_get_stats(performance_stats_t* stats);
+const latency_hist_t* optimize_get_latency(latency_stage_t stage);
 void optimize_calibrate(void);
 void optimize_tune_performance(void);
 
@@ -0,0 +1,194 @@
+#include "package.h"
+#include "crc32.h"
+#include "script.h"
+#include "util.h"
+#include "vm.h"
+
+// Whether a fixed-size string field is terminated
+static int field_terminated(const char* field, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        if (!field[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int meta_valid(const package_meta_t* meta) {
+    return meta->type <= SCRIPT_TYPE_COMBO &&
+           field_terminated(meta->name, sizeof(meta->name)) && meta->name[0] &&
+           field_terminated(meta->author, sizeof(meta->author)) &&
+           field_terminated(meta->version, sizeof(meta->version)) &&
+           field_terminated(meta->game, sizeof(meta->game)) &&
+           field_terminated(meta->description, sizeof(meta->description));
+}
+
+// Point into a package's sections, checking the header and every bound.
+// verify adds the checksum and the bytecode, which cost time in
+// proportion to the package. Nothing is copied; the buffer must be 4-byte
+// aligned and outlive the package.
+static int parse(package_t* package, const void* data, uint32_t size, int verify) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    const package_header_t* header = (const package_header_t*)data;
+    
+    if (!package || !data || ((uintptr_t)data & 3) || size < sizeof(package_header_t)) {
+        return 0;
+    }
+    if (header->magic != PACKAGE_MAGIC || header->version != PACKAGE_VERSION ||
+        header->size != size || header->section_count == 0 ||
+        header->section_count > PACKAGE_MAX_SECTIONS) {
+        return 0;
+    }
+    uint32_t table_end = sizeof(package_header_t) + header->section_count * sizeof(package_section_t);
+    if (table_end > size ||
+        (verify && crc32(bytes + sizeof(package_header_t), size - sizeof(package_header_t)) != header->checksum)) {
+        return 0;
+    }
+    
+    mem_set(package, 0, sizeof(*package));
+    package->header = header;
+    
+    const package_section_t* sections = (const package_section_t*)(bytes + sizeof(package_header_t));
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        const package_section_t* section = &sections[i];
+        if ((section->offset & 3) || section->offset < table_end ||
+            section->offset > size || section->size > size - section->offset) {
+            return 0;
+        }
+        const void* body = bytes + section->offset;
+        
+        switch (section->type) {
+            case PACKAGE_SECTION_META:
+                if (package->meta || section->size != sizeof(package_meta_t) ||
+                    !meta_valid((const package_meta_t*)body)) {
+                    return 0;
+                }
+                package->meta = (const package_meta_t*)body;
+                break;
+                
+            case PACKAGE_SECTION_BYTECODE:
+                if (package->code || section->size % sizeof(uint32_t) ||
+                    section->count != section->size / sizeof(uint32_t) ||
+                    (verify && !vm_validate((const uint32_t*)body, section->count))) {
+                    return 0;
+                }
+                package->code = (const uint32_t*)body;
+                package->code_length = section->count;
+                break;
+                
+            case PACKAGE_SECTION_MACRO:
+                if (package->steps || section->count == 0 || section->size % sizeof(package_macro_step_t) ||
+                    section->count != section->size / sizeof(package_macro_step_t)) {
+                    return 0;
+                }
+                package->steps = (const package_macro_step_t*)body;
+                package->step_count = section->count;
+                break;
+                
+            default:
+                // Unknown sections are skipped, so later versions can add some
+                break;
+        }
+    }
+    
+    // Metadata is required, and the script type needs its section
+    if (!package->meta ||
+        (package->meta->type == SCRIPT_TYPE_LUA && !package->code) ||
+        (package->meta->type == SCRIPT_TYPE_MACRO && !package->steps)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Check a package in full: header, bounds, checksum and bytecode. Done
+// once, when a package is stored.
+int package_verify(const void* data, uint32_t size) {
+    package_t package;
+    return parse(&package, data, size, 1);
+}
+
+// Open a package package_verify() has passed, checking only its header
+// and bounds, so loading costs the same whatever its size
+int package_open(package_t* package, const void* data, uint32_t size) {
+    return parse(package, data, size, 0);
+}
+
+// Metadata of a package from its first bytes, before the rest has
+// arrived. The checksum and the other sections are left to package_verify().
+const package_meta_t* package_peek_meta(const void* head, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)head;
+    const package_header_t* header = (const package_header_t*)head;
+    
+    if (!head || ((uintptr_t)head & 3) || length < sizeof(package_header_t) ||
+        header->magic != PACKAGE_MAGIC || header->version != PACKAGE_VERSION ||
+        header->section_count == 0 || header->section_count > PACKAGE_MAX_SECTIONS) {
+        return 0;
+    }
+    uint32_t table_end = sizeof(package_header_t) + header->section_count * sizeof(package_section_t);
+    if (table_end > length) {
+        return 0;
+    }
+    
+    const package_section_t* sections = (const package_section_t*)(bytes + sizeof(package_header_t));
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        const package_section_t* section = &sections[i];
+        if (section->type != PACKAGE_SECTION_META) {
+            continue;
+        }
+        if ((section->offset & 3) || section->offset < table_end || section->size != sizeof(package_meta_t) ||
+            section->offset > length || section->size > length - section->offset) {
+            return 0;
+        }
+        const package_meta_t* meta = (const package_meta_t*)(bytes + section->offset);
+        return meta_valid(meta) ? meta : 0;
+    }
+    return 0;
+}
+
+// Append a section, returning the next free offset
+static uint32_t add_section(uint8_t* out, package_section_t* section, uint32_t offset,
+                            uint32_t type, const void* data, uint32_t size, uint32_t count) {
+    section->type = type;
+    section->offset = offset;
+    section->size = size;
+    section->count = count;
+    mem_copy(out + offset, data, size);
+    return (offset + size + 3) & ~3u;
+}
+
+// Write a package to out. Returns its size, or 0 if it does not fit.
+uint32_t package_build(void* out, uint32_t max_size, const package_meta_t* meta,
+                       const uint32_t* code, uint32_t code_length,
+                       const package_macro_step_t* steps, uint32_t step_count) {
+    uint8_t* bytes = (uint8_t*)out;
+    uint32_t section_count = 1 + (code_length ? 1 : 0) + (step_count ? 1 : 0);
+    uint32_t table_end = sizeof(package_header_t) + section_count * sizeof(package_section_t);
+    uint32_t size = table_end + sizeof(package_meta_t) +
+                    code_length * sizeof(uint32_t) + step_count * sizeof(package_macro_step_t);
+    
+    if (!out || !meta || size > max_size) {
+        return 0;
+    }
+    mem_set(out, 0, size);
+    
+    package_header_t* header = (package_header_t*)out;
+    package_section_t* sections = (package_section_t*)(bytes + sizeof(package_header_t));
+    uint32_t offset = add_section(bytes, &sections[0], table_end, PACKAGE_SECTION_META,
+                                  meta, sizeof(package_meta_t), 1);
+    uint32_t section = 1;
+    if (code_length) {
+        offset = add_section(bytes, &sections[section++], offset, PACKAGE_SECTION_BYTECODE,
+                             code, code_length * sizeof(uint32_t), code_length);
+    }
+    if (step_count) {
+        offset = add_section(bytes, &sections[section++], offset, PACKAGE_SECTION_MACRO,
+                             steps, step_count * sizeof(package_macro_step_t), step_count);
+    }
+    
+    header->magic = PACKAGE_MAGIC;
+    header->version = PACKAGE_VERSION;
+    header->section_count = (uint16_t)section_count;
+    header->size = size;
+    header->checksum = crc32(bytes + sizeof(package_header_t), size - sizeof(package_header_t));
+    return size;
+}
@@ -0,0 +1,84 @@
+#ifndef PACKAGE_H
+#define PACKAGE_H
+
+#include <stdint.h>
+
+// Binary script package
+//
+// A package is loaded by pointing at it: every section is stored in the
+// layout the firmware uses, little-endian and 4-byte aligned, so a
+// validated package runs in place from the script cache. A package is
+// verified once, when it is stored (package_verify); opening it to load
+// only checks the header and bounds (package_open).
+//
+//   package_header_t                   magic, version, size, CRC32
+//   package_section_t[section_count]   offset table
+//   sections                           metadata, bytecode, macro timeline
+//
+// The checksum covers everything after the header. tools/scpk builds
+// packages on the host with package_build().
+
+#define PACKAGE_MAGIC         0x50534843u   // "CHSP"
+#define PACKAGE_VERSION       1
+#define PACKAGE_MAX_SECTIONS  8
+
+// Section types
+typedef enum {
+    PACKAGE_SECTION_META = 1,       // package_meta_t
+    PACKAGE_SECTION_BYTECODE,       // VM instruction words
+    PACKAGE_SECTION_MACRO           // package_macro_step_t timeline
+} package_section_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t section_count;
+    uint32_t size;          // Whole package in bytes
+    uint32_t checksum;      // CRC32 of bytes [sizeof(package_header_t), size)
+} package_header_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;        // From the start of the package, 4-byte aligned
+    uint32_t size;          // Bytes
+    uint32_t count;         // Elements: instructions or steps
+} package_section_t;
+
+// Metadata block; strings are NUL-terminated
+typedef struct {
+    uint32_t type;          // script_type_t
+    uint32_t priority;
+    char name[64];
+    char author[32];
+    char version[16];
+    char game[32];
+    char description[256];
+} package_meta_t;
+
+// Macro timeline step
+typedef struct {
+    uint32_t delay_us;      // Hold time before the next step
+    uint16_t buttons;       // ps5_buttons_t bit order
+    uint8_t sticks[4];      // lx, ly, rx, ry
+    uint8_t triggers[2];    // l2, r2
+} package_macro_step_t;
+
+// Validated package; all pointers refer into the package buffer
+typedef struct {
+    const package_header_t* header;
+    const package_meta_t* meta;
+    const uint32_t* code;
+    uint32_t code_length;
+    const package_macro_step_t* steps;
+    uint32_t step_count;
+} package_t;
+
+// Function Prototypes
+int package_verify(const void* data, uint32_t size);
+int package_open(package_t* package, const void* data, uint32_t size);
+const package_meta_t* package_peek_meta(const void* head, uint32_t length);
+uint32_t package_build(void* out, uint32_t max_size, const package_meta_t* meta,
+                       const uint32_t* code, uint32_t code_length,
+                       const package_macro_step_t* steps, uint32_t step_count);
+
+#endif // PACKAGE_H
@@ -0,0 +1,173 @@
+#include "profile.h"
+#include "smp.h"
+
+// Open zone on a core's stack
+typedef struct {
+    profile_zone_t zone;
+    uint32_t start;             // Cycle counter at entry
+    uint32_t children;          // Inclusive cycles of zones nested inside
+} profile_frame_t;
+
+typedef struct {
+    profile_frame_t stack[PROFILE_MAX_DEPTH];
+    uint32_t depth;
+    profile_zone_stats_t zones[PROFILE_ZONE_COUNT];
+} profile_core_t;
+
+// About 50 KB of histograms: kept out of the image region
+static profile_core_t cores[SMP_MAX_CORES] HAL_BULK_BUFFER;
+
+// Ends that did not match the innermost open zone
+static uint32_t unbalanced;
+
+static const char* const zone_names[PROFILE_ZONE_COUNT] = {
+    "frame", "validate", "scripts", "combos", "macros",
+    "script_vm", "usb_read", "usb_write", "stats"
+};
+
+// Start the cycle counter on the calling core; PMU enables are banked per core
+void profile_init(void) {
+#ifdef __BARE_METAL__
+    uint32_t pmcr;
+    __asm__ volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (pmcr));
+    pmcr |= (1 << 0) | (1 << 2);    // E: enable, C: reset the cycle counter
+    pmcr &= ~(1u << 3);             // D: count every cycle, not every 64th
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (pmcr));
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (1u << 31));  // PMCNTENSET.C
+    hal_isb();
+#endif
+}
+
+void profile_reset(void) {
+    __builtin_memset(cores, 0, sizeof(cores));
+    unbalanced = 0;
+}
+
+void profile_begin(profile_zone_t zone) {
+    profile_core_t* core = &cores[smp_core_id()];
+    if (core->depth >= PROFILE_MAX_DEPTH) {
+        // Too deep: the zone is not timed, and its end will not match
+        core->depth++;
+        return;
+    }
+
+    profile_frame_t* frame = &core->stack[core->depth++];
+    frame->zone = zone;
+    frame->children = 0;
+    frame->start = hal_cycles();
+}
+
+void profile_end(profile_zone_t zone) {
+    uint32_t now = hal_cycles();
+    profile_core_t* core = &cores[smp_core_id()];
+    if (core->depth == 0) {
+        unbalanced++;
+        return;
+    }
+    if (--core->depth >= PROFILE_MAX_DEPTH) {
+        return;
+    }
+
+    profile_frame_t* frame = &core->stack[core->depth];
+    if (frame->zone != zone) {
+        unbalanced++;
+        return;
+    }
+
+    // Unsigned difference survives one counter wrap
+    uint32_t elapsed = now - frame->start;
+    profile_zone_stats_t* stats = &core->zones[zone];
+    stats->count++;
+    stats->cycles += elapsed;
+    stats->self_cycles += elapsed - frame->children;
+    latency_hist_record(&stats->hist, elapsed);
+    if (core->depth > 0) {
+        core->stack[core->depth - 1].children += elapsed;
+    }
+}
+
+int profile_get(uint32_t core, profile_zone_t zone, profile_zone_stats_t* stats) {
+    if (core >= SMP_MAX_CORES || zone >= PROFILE_ZONE_COUNT || !stats) {
+        return 0;
+    }
+    *stats = cores[core].zones[zone];
+    return 1;
+}
+
+uint32_t profile_unbalanced(void) {
+    return unbalanced;
+}
+
+const char* profile_zone_name(profile_zone_t zone) {
+    return zone < PROFILE_ZONE_COUNT ? zone_names[zone] : "unknown";
+}
+
+// Append text, right-aligned to a width
+static uint32_t append_text(char* line, uint32_t pos, const char* text, uint32_t width) {
+    uint32_t length = 0;
+    while (text[length]) {
+        length++;
+    }
+    while (length < width--) {
+        line[pos++] = ' ';
+    }
+    while (*text) {
+        line[pos++] = *text++;
+    }
+    return pos;
+}
+
+static uint32_t append_uint(char* line, uint32_t pos, uint64_t value, uint32_t width) {
+    char digits[21];
+    uint32_t i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do {
+        digits[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return append_text(line, pos, &digits[i], width);
+}
+
+// Text table of every zone that ran, one line per core and zone. Cycle
+// columns are per entry except self%, the zone's own cycles as a share of
+// that core's frame zone (or of all its top-level zones if it has none).
+void profile_dump(profile_write_t write) {
+    static const char header[] =
+        "core zone        count    p50    p99    max   self%\n";
+    char line[96];
+
+    write(header, sizeof(header) - 1);
+    for (uint32_t c = 0; c < SMP_MAX_CORES; c++) {
+        const profile_core_t* core = &cores[c];
+
+        // Denominator for self%
+        uint64_t total = core->zones[PROFILE_ZONE_FRAME].cycles;
+        if (total == 0) {
+            for (uint32_t z = 0; z < PROFILE_ZONE_COUNT; z++) {
+                total += core->zones[z].self_cycles;
+            }
+        }
+
+        for (uint32_t z = 0; z < PROFILE_ZONE_COUNT; z++) {
+            const profile_zone_stats_t* stats = &core->zones[z];
+            if (stats->count == 0) {
+                continue;
+            }
+
+            uint32_t pos = append_uint(line, 0, c, 4);
+            line[pos++] = ' ';
+            uint32_t start = pos;
+            pos = append_text(line, pos, zone_names[z], 0);
+            while (pos < start + 10) {
+                line[pos++] = ' ';
+            }
+            pos = append_uint(line, pos, stats->count, 7);
+            pos = append_uint(line, pos, latency_hist_percentile(&stats->hist, 500), 7);
+            pos = append_uint(line, pos, latency_hist_percentile(&stats->hist, 990), 7);
+            pos = append_uint(line, pos, stats->hist.max_us, 7);
+            pos = append_uint(line, pos, total ? stats->self_cycles * 100 / total : 0, 8);
+            line[pos++] = '\n';
+            write(line, pos);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "latency_hist.h"
+
+// Cycle-accurate profiling zones
+//
+// A zone is a named span of code timed with the Cortex-A53 cycle counter
+// (PMCCNTR). Zones nest: each one accumulates its inclusive cycles, its
+// self cycles (inclusive minus the zones opened inside it) and a histogram
+// of inclusive cycles per entry, so a frame's budget can be attributed
+// stage by stage. Every core keeps its own zone stack and counters.
+//
+// Zones are only built in with PROFILE_ENABLED (cmake -DENABLE_PROFILING=ON,
+// always on for the host builds). Otherwise PROFILE_BEGIN/PROFILE_END
+// compile to nothing and PROFILE_CYCLES() is 0.
+
+typedef enum {
+    PROFILE_ZONE_FRAME,         // One pass of the input core
+    PROFILE_ZONE_VALIDATE,      // Input report validation
+    PROFILE_ZONE_SCRIPTS,       // script_process_input
+    PROFILE_ZONE_COMBOS,        //   Combo automaton
+    PROFILE_ZONE_MACROS,        //   Macro players and blending
+    PROFILE_ZONE_SCRIPT_VM,     //   VM scripts
+    PROFILE_ZONE_USB_READ,      // Taking the newest input report
+    PROFILE_ZONE_USB_WRITE,     // Sending the output report
+    PROFILE_ZONE_STATS,         // optimize_get_stats
+    PROFILE_ZONE_COUNT
+} profile_zone_t;
+
+#define PROFILE_MAX_DEPTH   8
+
+// Counters for one zone on one core
+typedef struct {
+    uint32_t count;             // Completed entries
+    uint64_t cycles;            // Inclusive
+    uint64_t self_cycles;       // Excluding nested zones
+    latency_hist_t hist;        // Inclusive cycles per entry
+} profile_zone_stats_t;
+
+// Receives the text of profile_dump(), a line at a time
+typedef void (*profile_write_t)(const char* text, uint32_t length);
+
+// Function Prototypes
+void profile_init(void);
+void profile_reset(void);
+void profile_begin(profile_zone_t zone);
+void profile_end(profile_zone_t zone);
+int profile_get(uint32_t core, profile_zone_t zone, profile_zone_stats_t* stats);
+uint32_t profile_unbalanced(void);
+const char* profile_zone_name(profile_zone_t zone);
+void profile_dump(profile_write_t write);
+
+static inline uint32_t profile_cycles(void) {
+    return hal_cycles();
+}
+
+#ifdef PROFILE_ENABLED
+#define PROFILE_BEGIN(zone)     profile_begin(zone)
+#define PROFILE_END(zone)       profile_end(zone)
+#define PROFILE_CYCLES()        profile_cycles()
+#else
+#define PROFILE_BEGIN(zone)     ((void)0)
+#define PROFILE_END(zone)       ((void)0)
+#define PROFILE_CYCLES()        0u
+#endif
+
+#endif // PROFILE_H
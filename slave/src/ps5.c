@@ -1,81 +1,215 @@
+#include <stddef.h>
 #include "ps5.h"
 #include "usb.h"
 #include "status.h"
+#include "hardware.h"
+#include "report_ring.h"
+#include "clock.h"
 
 // Raspberry Pi 3B CPU Cache Control
 #define CACHE_LINE_SIZE     64
 #define L1_CACHE_SIZE      32768
 #define L2_CACHE_SIZE      512000
 
-// DMA Buffer for USB transfers (aligned to cache line)
-static __attribute__((aligned(CACHE_LINE_SIZE))) uint8_t usb_buffer[2048];
+// DMA Buffer for USB transfers (non-cacheable DMA section)
+static HAL_DMA_BUFFER uint8_t usb_buffer[2048];
+
+// Input report buffer owned by the interrupt IN stream
+static HAL_DMA_BUFFER uint8_t usb_in_buffer[64];
+
+// Reports captured in the USB interrupt, drained by ps5_process_input()
+static report_ring_t input_ring;
+static uint32_t input_overruns_seen;
+static uint64_t input_timestamp_us;
 
 // Controller state cache
 static ps5_state_t current_state;
 static ps5_output_t current_output;
 
-// Performance optimizations
-static void enable_cache(void) {
-    // Enable L1 cache
-    asm volatile("mrc p15, 0, r0, c1, c0, 0");
-    asm volatile("orr r0, r0, #(1 << 12)"); // Enable I-cache
-    asm volatile("orr r0, r0, #(1 << 2)");  // Enable D-cache
-    asm volatile("mcr p15, 0, r0, c1, c0, 0");
-    
-    // Enable L2 cache
-    asm volatile("mrc p15, 0, r0, c1, c0, 1");
-    asm volatile("orr r0, r0, #(1 << 1)");
-    asm volatile("mcr p15, 0, r0, c1, c0, 1");
-}
+// Output coalescing: setters only edit current_output and mark their
+// category dirty; ps5_flush_output() merges every category whose rate
+// window has elapsed into at most one report per output slot.
+typedef struct {
+    uint8_t offset;          // First field in ps5_output_t
+    uint8_t size;            // Bytes covered
+    uint32_t interval_us;    // Minimum time between updates
+    uint64_t last_sent_us;
+} output_category_t;
+
+static struct {
+    ps5_output_t sent;       // Output state the controller has
+    uint32_t dirty;          // Categories that differ from sent
+    uint64_t last_report_us;
+    int have_report;         // sent/last_report_us are valid
+    output_category_t category[PS5_OUTPUT_CATEGORIES];
+} coalescer = {
+    .category = {
+        [PS5_OUTPUT_LED] = {
+            offsetof(ps5_output_t, led_r), 4, PS5_OUTPUT_LED_INTERVAL_US, 0
+        },
+        [PS5_OUTPUT_HAPTIC] = {
+            offsetof(ps5_output_t, haptic_right_enable), 4, PS5_OUTPUT_HAPTIC_INTERVAL_US, 0
+        },
+        [PS5_OUTPUT_TRIGGER] = {
+            offsetof(ps5_output_t, trigger_right_mode), 4, PS5_OUTPUT_TRIGGER_INTERVAL_US, 0
+        },
+        [PS5_OUTPUT_AUDIO] = {
+            offsetof(ps5_output_t, speaker_volume), 3, PS5_OUTPUT_AUDIO_INTERVAL_US, 0
+        },
+    }
+};
+
+static void ps5_input_irq(const uint8_t* data, uint32_t length);
 
 // Initialize PS5 subsystem
-void ps5_init(void) {
-    // Enable CPU caches for better performance
-    enable_cache();
-    
+int ps5_init(void) {
     // Clear state
     __builtin_memset(&current_state, 0, sizeof(ps5_state_t));
     __builtin_memset(&current_output, 0, sizeof(ps5_output_t));
     
     // Set default output state
-    current_output.led_r = 0;
-    current_output.led_g = 0;
-    current_output.led_b = 64;  // Dim blue by default
-    current_output.speaker_volume = 64;
-    current_output.mic_volume = 64;
+    ps5_output_t defaults = {0};
+    defaults.led_b = 64;  // Dim blue by default
+    defaults.speaker_volume = 64;
+    defaults.mic_volume = 64;
+    
+    // Apply initial settings as one full report
+    coalescer.have_report = 0;
+    coalescer.dirty = 0;
+    ps5_send_output(&defaults);
     
-    // Apply initial settings
-    ps5_send_output(&current_output);
+    // Capture input reports as their transfers complete
+    usb_stop_interrupt_in(USB_DEVICE_CONTROLLER);
+    report_ring_reset(&input_ring);
+    input_overruns_seen = 0;
+    input_timestamp_us = 0;
+    usb_start_interrupt_in(USB_DEVICE_CONTROLLER, 0x84, usb_in_buffer,
+                           sizeof(usb_in_buffer), ps5_input_irq);
+    return 1;
+}
+
+// Input transfer completion (IRQ context): stamp and queue the report
+static void ps5_input_irq(const uint8_t* data, uint32_t length) {
+    if (length < 1 + sizeof(ps5_state_t) || data[0] != PS5_REPORT_INPUT) {
+        return;
+    }
+    report_ring_push(&input_ring, clock_now_us(), data + 1);
 }
 
-// Process controller input with minimal latency
+// Take the newest captured input report without waiting. Older reports
+// still queued are superseded. Returns the number of reports consumed,
+// 0 if nothing new arrived.
 int ps5_process_input(ps5_state_t* state) {
-    static uint32_t last_poll = 0;
-    const uint32_t POLL_INTERVAL = 1000; // 1ms polling
+    input_report_t report;
     
-    uint32_t now = *((volatile uint32_t*)0x3F003004); // System timer
-    if (now - last_poll < POLL_INTERVAL) {
-        return 0;
+    // Restart the stream if a transfer error stopped it
+    if (!usb_interrupt_in_active(USB_DEVICE_CONTROLLER)) {
+        usb_start_interrupt_in(USB_DEVICE_CONTROLLER, 0x84, usb_in_buffer,
+                               sizeof(usb_in_buffer), ps5_input_irq);
     }
-    last_poll = now;
     
-    // Read input report
-    if (!usb_read_endpoint(USB_DEVICE_CONTROLLER, 0x84, usb_buffer, 64)) {
+    uint32_t count = report_ring_pop_latest(&input_ring, &report);
+    if (count == 0) {
         return 0;
     }
     
-    // Process input data
-    __builtin_memcpy(&current_state, usb_buffer + 1, sizeof(ps5_state_t));
+    current_state = report.state;
+    input_timestamp_us = report.timestamp_us;
     
     // Copy to output if requested
     if (state) {
         __builtin_memcpy(state, &current_state, sizeof(ps5_state_t));
     }
     
+    return (int)count;
+}
+
+// Capture time of the report last returned by ps5_process_input()
+uint64_t ps5_get_input_timestamp(void) {
+    return input_timestamp_us;
+}
+
+// Reports lost to a full ring since the last call
+uint32_t ps5_take_input_overruns(void) {
+    uint32_t overruns = input_ring.overruns;
+    uint32_t lost = overruns - input_overruns_seen;
+    input_overruns_seen = overruns;
+    return lost;
+}
+
+// Mark the categories of current_output that differ from what was last sent
+static void output_mark_dirty(void) {
+    const uint8_t* current = (const uint8_t*)&current_output;
+    const uint8_t* sent = (const uint8_t*)&coalescer.sent;
+    
+    for (uint32_t i = 0; i < PS5_OUTPUT_CATEGORIES; i++) {
+        const output_category_t* category = &coalescer.category[i];
+        if (!coalescer.have_report ||
+            __builtin_memcmp(current + category->offset, sent + category->offset,
+                             category->size) != 0) {
+            coalescer.dirty |= 1u << i;
+        } else {
+            coalescer.dirty &= ~(1u << i);
+        }
+    }
+}
+
+// Send one merged report if the output slot is free. Categories still inside
+// their rate window keep their previously sent values and stay dirty.
+// Returns 1 if nothing needs sending or the report went out, 0 on USB error.
+int ps5_flush_output(void) {
+    if (!coalescer.dirty) {
+        return 1;
+    }
+    
+    // Within a frame, the frame's time
+    uint64_t now = clock_frame_us();
+    if (coalescer.have_report && now - coalescer.last_report_us < PS5_OUTPUT_SLOT_US) {
+        return 1;
+    }
+    
+    // Merge ready categories into the last sent state
+    ps5_output_t report = coalescer.sent;
+    uint32_t merged = 0;
+    for (uint32_t i = 0; i < PS5_OUTPUT_CATEGORIES; i++) {
+        output_category_t* category = &coalescer.category[i];
+        if (!(coalescer.dirty & (1u << i))) {
+            continue;
+        }
+        if (coalescer.have_report && now - category->last_sent_us < category->interval_us) {
+            continue;
+        }
+        __builtin_memcpy((uint8_t*)&report + category->offset,
+                         (const uint8_t*)&current_output + category->offset,
+                         category->size);
+        merged |= 1u << i;
+    }
+    if (!merged) {
+        return 1;
+    }
+    
+    // Prepare output report
+    usb_buffer[0] = PS5_REPORT_OUTPUT;
+    __builtin_memcpy(usb_buffer + 1, &report, sizeof(ps5_output_t));
+    
+    // Send output report; on failure everything stays dirty for the next slot
+    if (!usb_write_endpoint(USB_DEVICE_CONTROLLER, 0x05, usb_buffer, 64)) {
+        return 0;
+    }
+    
+    coalescer.sent = report;
+    coalescer.have_report = 1;
+    coalescer.last_report_us = now;
+    coalescer.dirty &= ~merged;
+    for (uint32_t i = 0; i < PS5_OUTPUT_CATEGORIES; i++) {
+        if (merged & (1u << i)) {
+            coalescer.category[i].last_sent_us = now;
+        }
+    }
     return 1;
 }
 
-// Send output report with haptics, LED, etc.
+// Update the whole output state (haptics, LED, etc.) and send what changed
 int ps5_send_output(const ps5_output_t* output) {
     if (!output) {
         return 0;
@@ -83,21 +217,31 @@ int ps5_send_output(const ps5_output_t* output) {
     
     // Cache the output state
     __builtin_memcpy(&current_output, output, sizeof(ps5_output_t));
+    output_mark_dirty();
     
-    // Prepare output report
-    usb_buffer[0] = PS5_REPORT_OUTPUT;
-    __builtin_memcpy(usb_buffer + 1, output, sizeof(ps5_output_t));
-    
-    // Send output report
-    return usb_write_endpoint(USB_DEVICE_CONTROLLER, 0x05, usb_buffer, 64);
+    return ps5_flush_output();
+}
+
+// Copy of the output state as last requested
+void ps5_get_output(ps5_output_t* output) {
+    if (output) {
+        *output = current_output;
+    }
+}
+
+// Set the minimum time between updates of one output category
+void ps5_set_output_rate(ps5_output_category_t category, uint32_t interval_us) {
+    if (category < PS5_OUTPUT_CATEGORIES) {
+        coalescer.category[category].interval_us = interval_us;
+    }
 }
 
 // Handle PS5 events and maintain connection
 void ps5_handle_events(void) {
-    static uint32_t last_check = 0;
+    static uint64_t last_check = 0;
     const uint32_t CHECK_INTERVAL = 1000000; // 1s health check
     
-    uint32_t now = *((volatile uint32_t*)0x3F003004);
+    uint64_t now = clock_now_us();
     if (now - last_check >= CHECK_INTERVAL) {
         last_check = now;
         
@@ -124,7 +268,8 @@ void ps5_enable_low_latency(void) {
     // Disable controller processing features that add latency
     current_output.haptic_left_enable = 0;
     current_output.haptic_right_enable = 0;
-    ps5_send_output(&current_output);
+    output_mark_dirty();
+    ps5_flush_output();
 }
 
 // Get controller battery level
@@ -137,7 +282,8 @@ void ps5_set_led_color(uint8_t r, uint8_t g, uint8_t b) {
     current_output.led_r = r;
     current_output.led_g = g;
     current_output.led_b = b;
-    ps5_send_output(&current_output);
+    output_mark_dirty();
+    ps5_flush_output();
 }
 
 // Set haptic feedback
@@ -146,7 +292,8 @@ void ps5_set_haptic_feedback(uint8_t left, uint8_t right) {
     current_output.haptic_right_enable = right > 0;
     current_output.haptic_left_intensity = left;
     current_output.haptic_right_intensity = right;
-    ps5_send_output(&current_output);
+    output_mark_dirty();
+    ps5_flush_output();
 }
 
 // Set adaptive trigger feedback
@@ -156,7 +303,8 @@ void ps5_set_trigger_feedback(uint8_t left_mode, uint8_t right_mode,
     current_output.trigger_right_mode = right_mode;
     current_output.trigger_left_force = left_force;
     current_output.trigger_right_force = right_force;
-    ps5_send_output(&current_output);
+    output_mark_dirty();
+    ps5_flush_output();
 }
 
 // Set audio settings
@@ -164,5 +312,6 @@ void ps5_set_audio(uint8_t speaker_vol, uint8_t mic_vol, uint8_t enable) {
     current_output.speaker_volume = speaker_vol;
     current_output.mic_volume = mic_vol;
     current_output.audio_enable = enable;
-    ps5_send_output(&current_output);
+    output_mark_dirty();
+    ps5_flush_output();
 }
@@ -96,10 +96,31 @@ typedef struct {
     uint8_t audio_enable;
 } ps5_output_t;
 
+// Output report categories, each rate-limited independently
+typedef enum {
+    PS5_OUTPUT_LED,
+    PS5_OUTPUT_HAPTIC,
+    PS5_OUTPUT_TRIGGER,
+    PS5_OUTPUT_AUDIO,
+    PS5_OUTPUT_CATEGORIES
+} ps5_output_category_t;
+
+// Output report pacing
+#define PS5_OUTPUT_SLOT_US              1000    // At most one report per USB frame
+#define PS5_OUTPUT_LED_INTERVAL_US      20000   // 50 Hz
+#define PS5_OUTPUT_HAPTIC_INTERVAL_US   1000    // Every slot
+#define PS5_OUTPUT_TRIGGER_INTERVAL_US  4000    // 250 Hz
+#define PS5_OUTPUT_AUDIO_INTERVAL_US    50000   // 20 Hz
+
 // Function Prototypes
-void ps5_init(void);
+int ps5_init(void);
 int ps5_process_input(ps5_state_t* state);
+uint64_t ps5_get_input_timestamp(void);
+uint32_t ps5_take_input_overruns(void);
 int ps5_send_output(const ps5_output_t* output);
+int ps5_flush_output(void);
+void ps5_get_output(ps5_output_t* output);
+void ps5_set_output_rate(ps5_output_category_t category, uint32_t interval_us);
 void ps5_handle_events(void);
 int ps5_calibrate_controller(void);
 void ps5_enable_low_latency(void);
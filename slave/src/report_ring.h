@@ -0,0 +1,90 @@
+#ifndef REPORT_RING_H
+#define REPORT_RING_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "ps5.h"
+
+// Single-producer/single-consumer ring of timestamped input reports.
+// The USB interrupt handler pushes, the main loop pops. Each side owns one
+// index, so no locks are needed; barriers order slot data against the index.
+
+#define REPORT_RING_SIZE    16   // Power of two
+#define REPORT_RING_MASK    (REPORT_RING_SIZE - 1)
+
+// Captured input report
+typedef struct {
+    uint64_t timestamp_us;   // Transfer completion time
+    ps5_state_t state;
+} input_report_t;
+
+typedef struct {
+    volatile uint32_t head;       // Written by producer only
+    volatile uint32_t tail;       // Written by consumer only
+    volatile uint32_t overruns;   // Reports dropped because the ring was full
+    input_report_t slots[REPORT_RING_SIZE];
+} report_ring_t;
+
+static inline void report_ring_reset(report_ring_t* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overruns = 0;
+}
+
+// Producer: queue a report. Returns 0 and counts an overrun if full.
+static inline int report_ring_push(report_ring_t* ring, uint64_t timestamp_us,
+                                   const void* state) {
+    uint32_t head = ring->head;
+    if (head - ring->tail >= REPORT_RING_SIZE) {
+        ring->overruns++;
+        return 0;
+    }
+    
+    input_report_t* slot = &ring->slots[head & REPORT_RING_MASK];
+    slot->timestamp_us = timestamp_us;
+    __builtin_memcpy(&slot->state, state, sizeof(ps5_state_t));
+    
+    // Publish the slot before the index
+    hal_dmb();
+    ring->head = head + 1;
+    return 1;
+}
+
+// Consumer: take the oldest report. Returns 0 if empty.
+static inline int report_ring_pop(report_ring_t* ring, input_report_t* report) {
+    uint32_t tail = ring->tail;
+    if (ring->head == tail) {
+        return 0;
+    }
+    hal_dmb();
+    
+    *report = ring->slots[tail & REPORT_RING_MASK];
+    
+    // Finish reading the slot before handing it back
+    hal_dmb();
+    ring->tail = tail + 1;
+    return 1;
+}
+
+// Consumer: take the newest report and discard everything older.
+// Returns the number of reports consumed (0 if empty).
+static inline uint32_t report_ring_pop_latest(report_ring_t* ring, input_report_t* report) {
+    uint32_t head = ring->head;
+    uint32_t count = head - ring->tail;
+    if (count == 0) {
+        return 0;
+    }
+    hal_dmb();
+    
+    *report = ring->slots[(head - 1) & REPORT_RING_MASK];
+    
+    hal_dmb();
+    ring->tail = head;
+    return count;
+}
+
+static inline uint32_t report_ring_count(const report_ring_t* ring) {
+    return ring->head - ring->tail;
+}
+
+#endif // REPORT_RING_H
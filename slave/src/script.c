@@ -1,46 +1,67 @@
 #include "script.h"
 #include "optimize.h"
 #include "status.h"
+#include "util.h"
+#include "combo.h"
+#include "vm.h"
+#include "package.h"
+#include "timeline.h"
+#include "macro.h"
+#include "profile.h"
+#include "clock.h"
+#include "hal.h"
 #include <stddef.h>
 
-#define MAX_SCRIPTS 32
-#define MAX_MACRO_LENGTH 1024
-#define MAX_COMBO_LENGTH 16
+#define MAX_SCRIPTS SCRIPT_MAX_SCRIPTS
+#define MACRO_RECORDERS 4
+#define MACRO_RECORDING_SIZE (40 * 1024)  // About 3 minutes of typical input (timeline.h)
 #define SCRIPT_TIMEOUT_US 500 // 500μs timeout for script execution
 
-// Combo definition
-typedef struct {
-    uint16_t buttons[MAX_COMBO_LENGTH];  // Button sequence
-    uint32_t timing[MAX_COMBO_LENGTH];   // Timing requirements in microseconds
-    uint32_t length;                     // Length of combo
-    ps5_state_t result_state;            // State to apply when combo is detected
-} combo_t;
+// Bytecode budget per frame, shared by all VM scripts. Sized from the
+// VM's measured rate on the Pi (test_vm_throughput) so that a frame's
+// scripts always fit SCRIPT_TIMEOUT_US, whatever they do.
+#define SCRIPT_VM_OPS_PER_US    20
+#define SCRIPT_VM_FRAME_BUDGET  (SCRIPT_TIMEOUT_US * SCRIPT_VM_OPS_PER_US)
+
+// Scheduling. Each VM script gets its own slice of the frame budget, so
+// one runaway script cannot starve the rest. Overruns score two strikes
+// and clean runs take one away; at SCRIPT_DEMOTE_STRIKES a script is
+// demoted: it is scheduled after every undemoted script and only runs
+// every 2^demotion frames. SCRIPT_PROMOTE_RUNS clean runs undo one level.
+#define SCRIPT_VM_SCRIPT_BUDGET (SCRIPT_VM_FRAME_BUDGET / 4)
+#define SCRIPT_DEMOTE_STRIKES   6
+#define SCRIPT_PROMOTE_RUNS     32
+#define SCRIPT_MAX_DEMOTION     4
+
+// Recorded macro timelines, one per recorder slot
+static uint8_t macro_recordings[MACRO_RECORDERS][MACRO_RECORDING_SIZE] HAL_BULK_BUFFER;
 
 // Script storage
 static struct {
     script_context_t contexts[MAX_SCRIPTS];
+    vm_program_t programs[MAX_SCRIPTS];     // Bytecode for SCRIPT_TYPE_LUA contexts
     uint32_t script_count;
     
-    // Macro recording/playback
-    struct {
-        ps5_state_t states[MAX_MACRO_LENGTH];
-        uint32_t timings[MAX_MACRO_LENGTH];  // Time between states in microseconds
-        uint32_t length;
-        uint32_t current_pos;
-        int is_recording;
-        uint64_t last_state_time;
-        char current_macro[64];
-    } macro;
-    
-    // Combo system
+    // Run order: context slots by demotion, then priority
+    uint8_t schedule[MAX_SCRIPTS];
+    int schedule_dirty;
+    uint32_t frame;
+    
+    // Macro players, mixed in one pass per frame
+    macro_mixer_t macros;
+    
+    // Macro recorders; a slot stays taken while its recording is loaded
     struct {
-        combo_t combos[MAX_SCRIPTS];
-        uint32_t combo_count;
-        uint16_t current_buttons[MAX_COMBO_LENGTH];
-        uint32_t current_timings[MAX_COMBO_LENGTH];
-        uint32_t current_length;
-        uint64_t last_button_time;
-    } combo;
+        timeline_writer_t writer;
+        char name[SCRIPT_NAME_MAX];         // Also the recorded macro's context name
+        int recording;
+        int loaded;
+    } recorders[MACRO_RECORDERS];
+    
+    // Combo system, compiled into one automaton and matched while at
+    // least one combo script is loaded
+    combo_matcher_t combo;
+    uint32_t combo_scripts;
     
     // Performance tracking
     struct {
@@ -52,161 +73,386 @@ static struct {
     } stats;
 } script_state = {0};
 
+// Pack the button bitfield into a 16-bit mask for history comparisons
+static inline uint16_t buttons_to_mask(const ps5_buttons_t* buttons) {
+    uint16_t mask;
+    __builtin_memcpy(&mask, buttons, sizeof(mask));
+    return mask;
+}
+
+// Rebuild the run order. Contexts are kept sorted by priority, so a
+// stable pass per demotion level is enough.
+static void build_schedule(void) {
+    uint32_t count = 0;
+    for (uint32_t level = 0; level <= SCRIPT_MAX_DEMOTION; level++) {
+        for (uint32_t i = 0; i < script_state.script_count; i++) {
+            if (script_state.contexts[i].demotion == level) {
+                script_state.schedule[count++] = (uint8_t)i;
+            }
+        }
+    }
+    script_state.schedule_dirty = 0;
+}
+
+// Score a finished run against the script's own budget
+static void account_run(script_context_t* ctx, int overrun) {
+    if (overrun) {
+        ctx->overruns++;
+        ctx->clean_runs = 0;
+        ctx->strikes += 2;
+        script_state.stats.script_overruns++;
+        if (ctx->strikes >= SCRIPT_DEMOTE_STRIKES && ctx->demotion < SCRIPT_MAX_DEMOTION) {
+            ctx->demotion++;
+            ctx->strikes = 0;
+            script_state.schedule_dirty = 1;
+        }
+        return;
+    }
+    
+    if (ctx->strikes > 0) {
+        ctx->strikes--;
+    }
+    if (++ctx->clean_runs >= SCRIPT_PROMOTE_RUNS && ctx->demotion > 0) {
+        ctx->demotion--;
+        ctx->clean_runs = 0;
+        script_state.schedule_dirty = 1;
+    }
+}
+
 // Initialize scripting subsystem
 int script_init(void) {
-    script_state.macro.last_state_time = get_system_time();
-    script_state.combo.last_button_time = get_system_time();
+    combo_matcher_reset(&script_state.combo);
     return 1;
 }
 
 // Process input through scripts with ultra-low latency
 void script_process_input(ps5_state_t* state) {
-    uint64_t start_time = get_system_time();
+    // Within a frame, the frame's time: recordings, combos, macros and
+    // the scripts' deadline all count from when the frame began
+    uint64_t start_time = clock_frame_us();
     
-    // Process scripts in priority order
-    for (uint32_t i = 0; i < script_state.script_count; i++) {
+    // Record the live input before any script changes it
+    for (uint32_t i = 0; i < MACRO_RECORDERS; i++) {
+        if (script_state.recorders[i].recording) {
+            timeline_write(&script_state.recorders[i].writer, state, start_time);
+        }
+    }
+    
+    // Combos: one automaton step per button edge, shared by all combo scripts
+    if (script_state.combo_scripts > 0 && script_state.combo.combo_count > 0) {
+        PROFILE_BEGIN(PROFILE_ZONE_COMBOS);
+        int match = combo_matcher_feed(&script_state.combo, buttons_to_mask(&state->buttons), start_time);
+        if (match >= 0) {
+            *state = script_state.combo.combos[match].result_state;
+            script_state.stats.successful_combos++;
+        }
+        PROFILE_END(PROFILE_ZONE_COMBOS);
+    }
+    
+    // Macros: every player advanced and blended in one pass over the state
+    PROFILE_BEGIN(PROFILE_ZONE_MACROS);
+    macro_mix(&script_state.macros, state, start_time);
+    PROFILE_END(PROFILE_ZONE_MACROS);
+    
+    // VM scripts in schedule order, each within its own budget and the
+    // frame's deadline. Whatever misses the deadline waits for the next frame.
+    if (script_state.schedule_dirty) {
+        build_schedule();
+    }
+    script_state.frame++;
+    uint32_t vm_budget = SCRIPT_VM_FRAME_BUDGET;
+    
+    // One clock read per script: each one's end is the next one's start
+    uint64_t now = clock_now_us();
+    PROFILE_BEGIN(PROFILE_ZONE_SCRIPT_VM);
+    for (uint32_t n = 0; n < script_state.script_count; n++) {
+        uint32_t i = script_state.schedule[n];
         script_context_t* ctx = &script_state.contexts[i];
-        uint64_t script_start = get_system_time();
         
-        // Check timeout to ensure low latency
-        if (get_system_time() - start_time > SCRIPT_TIMEOUT_US) {
-            script_state.stats.script_overruns++;
-            break;
+        // Macros and combos ran once for the whole frame above
+        if (ctx->type != SCRIPT_TYPE_LUA) {
+            ctx->exec_count++;
+            continue;
         }
         
-        switch (ctx->type) {
-            case SCRIPT_TYPE_MACRO:
-                if (script_state.macro.is_recording) {
-                    // Record current state with timing
-                    if (script_state.macro.length < MAX_MACRO_LENGTH) {
-                        uint64_t current_time = get_system_time();
-                        script_state.macro.states[script_state.macro.length] = *state;
-                        script_state.macro.timings[script_state.macro.length] = 
-                            (uint32_t)(current_time - script_state.macro.last_state_time);
-                        script_state.macro.length++;
-                        script_state.macro.last_state_time = current_time;
-                    }
-                } else if (script_state.macro.length > 0) {
-                    // Playback recorded state with timing
-                    *state = script_state.macro.states[script_state.macro.current_pos];
-                    
-                    // Wait for correct timing
-                    uint64_t current_time = get_system_time();
-                    if (current_time - script_state.macro.last_state_time >= 
-                        script_state.macro.timings[script_state.macro.current_pos]) {
-                        script_state.macro.current_pos++;
-                        if (script_state.macro.current_pos >= script_state.macro.length) {
-                            script_state.macro.current_pos = 0;
-                        }
-                        script_state.macro.last_state_time = current_time;
-                    }
-                }
-                break;
-                
-            case SCRIPT_TYPE_COMBO:
-                // Update current button sequence
-                if (state->buttons != script_state.combo.current_buttons[script_state.combo.current_length - 1]) {
-                    uint64_t current_time = get_system_time();
-                    if (script_state.combo.current_length < MAX_COMBO_LENGTH) {
-                        script_state.combo.current_buttons[script_state.combo.current_length] = state->buttons;
-                        script_state.combo.current_timings[script_state.combo.current_length] = 
-                            (uint32_t)(current_time - script_state.combo.last_button_time);
-                        script_state.combo.current_length++;
-                        script_state.combo.last_button_time = current_time;
-                    }
-                    
-                    // Check for matching combos
-                    for (uint32_t j = 0; j < script_state.combo.combo_count; j++) {
-                        combo_t* combo = &script_state.combo.combos[j];
-                        if (script_state.combo.current_length >= combo->length) {
-                            int match = 1;
-                            for (uint32_t k = 0; k < combo->length; k++) {
-                                if (script_state.combo.current_buttons[
-                                    script_state.combo.current_length - combo->length + k] 
-                                    != combo->buttons[k] ||
-                                    script_state.combo.current_timings[k] > combo->timing[k]) {
-                                    match = 0;
-                                    break;
-                                }
-                            }
-                            if (match) {
-                                *state = combo->result_state;
-                                script_state.stats.successful_combos++;
-                                break;
-                            }
-                        }
-                    }
-                }
-                break;
+        // Demoted scripts sit out all but every 2^demotion-th frame
+        if (script_state.frame & ((1u << ctx->demotion) - 1)) {
+            ctx->deferrals++;
+            continue;
+        }
+        
+        if (now - start_time > SCRIPT_TIMEOUT_US || vm_budget == 0) {
+            ctx->deferrals++;
+            continue;
+        }
+        
+        // Cut off by instruction count, not time; an aborted run leaves the state untouched.
+        // Only a run that had its full budget counts against the script.
+        uint32_t grant = ctx->budget_ops < vm_budget ? ctx->budget_ops : vm_budget;
+        uint32_t left = grant;
+        uint32_t cycles_start = PROFILE_CYCLES();
+        vm_status_t status = vm_run(&script_state.programs[i], state, now, &left);
+        ctx->exec_cycles += PROFILE_CYCLES() - cycles_start;
+        vm_budget -= grant - left;
+        if (status != VM_BUDGET || grant == ctx->budget_ops) {
+            account_run(ctx, status == VM_BUDGET);
+        } else {
+            ctx->deferrals++;
         }
         
         // Update script statistics
-        ctx->last_exec_us = get_system_time();
-        ctx->exec_time_us = (uint32_t)(ctx->last_exec_us - script_start);
+        ctx->last_exec_us = clock_now_us();
+        ctx->exec_time_us = (uint32_t)(ctx->last_exec_us - now);
         ctx->exec_count++;
+        now = ctx->last_exec_us;
     }
+    PROFILE_END(PROFILE_ZONE_SCRIPT_VM);
     
     // Update total execution time
-    script_state.stats.total_exec_time_us = (uint32_t)(get_system_time() - start_time);
+    script_state.stats.total_exec_time_us = (uint32_t)(now - start_time);
 }
 
-// Start macro recording
-int script_record_macro(const char* name) {
-    if (script_state.macro.is_recording) {
-        return 0;
+// Insert a context, keeping contexts sorted by priority, highest first.
+// Returns its slot, or -1 if full.
+static int32_t insert_context(const char* name, script_type_t type, uint32_t priority) {
+    if (script_state.script_count >= MAX_SCRIPTS) {
+        return -1;
     }
     
-    script_state.macro.is_recording = 1;
-    script_state.macro.length = 0;
-    script_state.macro.current_pos = 0;
-    script_state.macro.last_state_time = get_system_time();
-    
-    // Copy name with bounds checking
-    size_t name_len = 0;
-    while (name[name_len] && name_len < sizeof(script_state.macro.current_macro) - 1) {
-        script_state.macro.current_macro[name_len] = name[name_len];
-        name_len++;
+    uint32_t slot = script_state.script_count;
+    while (slot > 0 && script_state.contexts[slot - 1].priority < priority) {
+        script_state.contexts[slot] = script_state.contexts[slot - 1];
+        script_state.programs[slot] = script_state.programs[slot - 1];
+        slot--;
     }
-    script_state.macro.current_macro[name_len] = '\0';
     
-    return 1;
+    script_context_t* ctx = &script_state.contexts[slot];
+    __builtin_memset(ctx, 0, sizeof(*ctx));
+    __builtin_memset(&script_state.programs[slot], 0, sizeof(script_state.programs[slot]));
+    ctx->type = type;
+    ctx->name = name;
+    ctx->priority = priority;
+    ctx->budget_ops = SCRIPT_VM_SCRIPT_BUDGET;
+    if (type == SCRIPT_TYPE_COMBO) {
+        script_state.combo_scripts++;
+    }
+    script_state.script_count++;
+    script_state.schedule_dirty = 1;
+    return (int32_t)slot;
 }
 
-// Stop macro recording
-int script_stop_recording(void) {
-    if (!script_state.macro.is_recording) {
+// Load a compiled script (tools/vmc). The code must stay valid until the
+// script is unloaded.
+int script_load_bytecode(const char* name, const uint32_t* code, uint32_t length, uint32_t priority) {
+    vm_program_t program;
+    if (script_state.script_count >= MAX_SCRIPTS || !vm_load(&program, code, length)) {
         return 0;
     }
     
-    script_state.macro.is_recording = 0;
+    int32_t slot = insert_context(name, SCRIPT_TYPE_LUA, priority);
+    script_state.programs[slot] = program;
     return 1;
 }
 
-// Add a new combo
-int script_add_combo(const uint16_t* buttons, const uint32_t* timings, 
-                    uint32_t length, const ps5_state_t* result) {
-    if (script_state.combo.combo_count >= MAX_SCRIPTS || length > MAX_COMBO_LENGTH) {
+// Load a package (package.h) in place: the script runs straight from the
+// buffer, which must stay valid until the script is unloaded. It must have
+// passed package_verify(); only its header and bounds are checked here.
+int script_load_package(const void* data, uint32_t size) {
+    package_t package;
+    if (!package_open(&package, data, size)) {
         return 0;
     }
     
-    combo_t* combo = &script_state.combo.combos[script_state.combo.combo_count];
-    
-    // Copy combo data
-    for (uint32_t i = 0; i < length; i++) {
-        combo->buttons[i] = buttons[i];
-        combo->timing[i] = timings[i];
+    const package_meta_t* meta = package.meta;
+    switch ((script_type_t)meta->type) {
+        case SCRIPT_TYPE_LUA:
+            return script_load_bytecode(meta->name, package.code, package.code_length, meta->priority);
+            
+        case SCRIPT_TYPE_MACRO:
+            // Each macro gets its own player
+            if (script_state.script_count >= MAX_SCRIPTS ||
+                !macro_add_steps(&script_state.macros, meta->name, meta->priority,
+                                 package.steps, package.step_count, get_system_time())) {
+                return 0;
+            }
+            insert_context(meta->name, SCRIPT_TYPE_MACRO, meta->priority);
+            return 1;
+            
+        case SCRIPT_TYPE_COMBO:
+            break;
+    }
+    return 0;
+}
+
+// Load a combo script. The combos added with script_add_combo are matched
+// while at least one is loaded.
+int script_load_combo(const char* name, uint32_t priority) {
+    return insert_context(name, SCRIPT_TYPE_COMBO, priority) >= 0;
+}
+
+// Remove the context in a slot along with its program or macro player
+static void remove_context(uint32_t slot) {
+    const char* name = script_state.contexts[slot].name;
+    if (script_state.contexts[slot].type == SCRIPT_TYPE_MACRO) {
+        macro_remove(&script_state.macros, name);
+        for (uint32_t i = 0; i < MACRO_RECORDERS; i++) {
+            if (name == script_state.recorders[i].name) {
+                script_state.recorders[i].loaded = 0;
+            }
+        }
+    } else if (script_state.contexts[slot].type == SCRIPT_TYPE_COMBO &&
+               --script_state.combo_scripts == 0) {
+        // A combo half entered now must not complete after a reload
+        combo_matcher_restart(&script_state.combo);
+    }
+    for (uint32_t j = slot + 1; j < script_state.script_count; j++) {
+        script_state.contexts[j - 1] = script_state.contexts[j];
+        script_state.programs[j - 1] = script_state.programs[j];
+    }
+    script_state.script_count--;
+    script_state.schedule_dirty = 1;
+}
+
+// Unload a script by name
+int script_unload(const char* name) {
+    for (uint32_t i = 0; i < script_state.script_count; i++) {
+        if (script_state.contexts[i].name && str_compare(script_state.contexts[i].name, name) == 0) {
+            remove_context(i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Set a script's bytecode budget per frame, at most the whole frame's
+int script_set_budget(const char* name, uint32_t ops) {
+    for (uint32_t i = 0; i < script_state.script_count; i++) {
+        if (str_compare(script_state.contexts[i].name, name) == 0) {
+            script_state.contexts[i].budget_ops = ops < SCRIPT_VM_FRAME_BUDGET ? ops : SCRIPT_VM_FRAME_BUDGET;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Copy out a script's context, scheduling state included
+int script_get_context(const char* name, script_context_t* context) {
+    for (uint32_t i = 0; i < script_state.script_count; i++) {
+        if (str_compare(script_state.contexts[i].name, name) == 0) {
+            *context = script_state.contexts[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Copy out every context in priority order, names included, so the
+// copies stay valid once their scripts are unloaded. Returns the count.
+uint32_t script_snapshot(script_snapshot_t* snapshots, uint32_t max_snapshots) {
+    uint32_t count = script_state.script_count < max_snapshots ? script_state.script_count : max_snapshots;
+    for (uint32_t i = 0; i < count; i++) {
+        snapshots[i].context = script_state.contexts[i];
+        snapshots[i].context.name = NULL;
+        str_copy(snapshots[i].name, script_state.contexts[i].name, sizeof(snapshots[i].name));
+    }
+    return count;
+}
+
+// Set how a macro script loops and blends with the input; it restarts
+int script_set_macro_mode(const char* name, macro_loop_t loop, macro_blend_t blend) {
+    for (uint32_t i = 0; i < script_state.script_count; i++) {
+        script_context_t* ctx = &script_state.contexts[i];
+        if (ctx->type == SCRIPT_TYPE_MACRO && str_compare(ctx->name, name) == 0) {
+            return macro_set_mode(&script_state.macros, ctx->name, loop, blend, get_system_time());
+        }
+    }
+    return 0;
+}
+
+// Start recording a macro. Several recorders can run at once; a loaded
+// recording with the same name is replaced.
+int script_record_macro(const char* name) {
+    int32_t free_slot = -1;
+    for (uint32_t i = 0; i < MACRO_RECORDERS; i++) {
+        if (!script_state.recorders[i].recording && !script_state.recorders[i].loaded) {
+            if (free_slot < 0) {
+                free_slot = (int32_t)i;
+            }
+            continue;
+        }
+        if (str_compare(script_state.recorders[i].name, name) != 0) {
+            continue;
+        }
+        if (script_state.recorders[i].recording) {
+            return 0;
+        }
+        for (uint32_t c = 0; c < script_state.script_count; c++) {
+            if (script_state.contexts[c].name == script_state.recorders[i].name) {
+                remove_context(c);
+                break;
+            }
+        }
+        if (free_slot < 0) {
+            free_slot = (int32_t)i;
+        }
+    }
+    if (free_slot < 0) {
+        return 0;
     }
-    combo->length = length;
-    combo->result_state = *result;
     
-    script_state.combo.combo_count++;
+    str_copy(script_state.recorders[free_slot].name, name, sizeof(script_state.recorders[free_slot].name));
+    timeline_writer_init(&script_state.recorders[free_slot].writer, macro_recordings[free_slot],
+                         MACRO_RECORDING_SIZE);
+    script_state.recorders[free_slot].recording = 1;
     return 1;
 }
 
+// Stop a recording, or all of them if name is NULL. Each recording then
+// plays back as a macro script until unloaded.
+int script_stop_recording(const char* name) {
+    uint64_t now = get_system_time();
+    int stopped = 0;
+    int loaded = 1;
+    
+    for (uint32_t i = 0; i < MACRO_RECORDERS; i++) {
+        if (!script_state.recorders[i].recording ||
+            (name && str_compare(script_state.recorders[i].name, name) != 0)) {
+            continue;
+        }
+        script_state.recorders[i].recording = 0;
+        stopped = 1;
+        
+        uint32_t length = timeline_finish(&script_state.recorders[i].writer, now);
+        if (length == 0) {
+            continue;
+        }
+        if (script_state.script_count >= MAX_SCRIPTS ||
+            !macro_add_timeline(&script_state.macros, script_state.recorders[i].name, 0,
+                                macro_recordings[i], length, now)) {
+            loaded = 0;
+            continue;
+        }
+        insert_context(script_state.recorders[i].name, SCRIPT_TYPE_MACRO, 0);
+        script_state.recorders[i].loaded = 1;
+    }
+    return stopped && loaded;
+}
+
+// Add a new combo
+int script_add_combo(const uint16_t* buttons, const uint32_t* timings, 
+                    uint32_t length, const ps5_state_t* result) {
+    return combo_matcher_add(&script_state.combo, buttons, timings, length, result);
+}
+
 // Cleanup scripting system
 void script_cleanup(void) {
     script_state.script_count = 0;
-    script_state.combo.combo_count = 0;
-    script_state.macro.length = 0;
-    script_state.macro.is_recording = 0;
+    script_state.schedule_dirty = 1;
+    script_state.combo_scripts = 0;
+    combo_matcher_reset(&script_state.combo);
+    macro_mixer_reset(&script_state.macros);
+    for (uint32_t i = 0; i < MACRO_RECORDERS; i++) {
+        script_state.recorders[i].recording = 0;
+        script_state.recorders[i].loaded = 0;
+    }
 }
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #include "ps5.h"
+#include "macro.h"
+
+#define SCRIPT_MAX_SCRIPTS  32
+#define SCRIPT_NAME_MAX     64
 
 // Script types
 typedef enum {
@@ -19,19 +23,44 @@ typedef struct {
     uint32_t exec_count;    // Number of times executed
     uint64_t last_exec_us;  // Timestamp of last execution
     uint32_t exec_time_us;  // Average execution time
+    uint64_t exec_cycles;   // Cycles across all runs (profiling builds)
+    
+    // Scheduling (VM scripts)
+    uint32_t budget_ops;    // Bytecode budget per frame
+    uint32_t overruns;      // Runs cut off by that budget
+    uint32_t deferrals;     // Frames skipped for the deadline or a demotion
+    uint32_t demotion;      // Runs after undemoted scripts, every 2^demotion frames
+    uint32_t strikes;       // Overrun score towards the next demotion
+    uint32_t clean_runs;    // Runs since the last overrun
 } script_context_t;
 
+// A context copied out with its name, for readers on other cores. The
+// copy's context.name is NULL; the name is in name.
+typedef struct {
+    script_context_t context;
+    char name[SCRIPT_NAME_MAX];
+} script_snapshot_t;
+
 // Script API functions
 int script_init(void);
 int script_load(const char* filename, script_type_t type);
+int script_load_bytecode(const char* name, const uint32_t* code, uint32_t length, uint32_t priority);
+int script_load_package(const void* data, uint32_t size);
+int script_load_combo(const char* name, uint32_t priority);
 int script_unload(const char* name);
+int script_set_budget(const char* name, uint32_t ops);
+int script_get_context(const char* name, script_context_t* context);
+uint32_t script_snapshot(script_snapshot_t* snapshots, uint32_t max_snapshots);
 int script_enable(const char* name);
 int script_disable(const char* name);
 void script_process_input(ps5_state_t* state);
 void script_process_output(ps5_output_t* output);
 int script_record_macro(const char* name);
-int script_stop_recording(void);
+int script_stop_recording(const char* name);
+int script_set_macro_mode(const char* name, macro_loop_t loop, macro_blend_t blend);
 int script_save_macro(const char* name);
+int script_add_combo(const uint16_t* buttons, const uint32_t* timings,
+                     uint32_t length, const ps5_state_t* result);
 void script_cleanup(void);
 
 #endif // SCRIPT_H
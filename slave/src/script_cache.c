@@ -0,0 +1,383 @@
+#include "script_cache.h"
+#include "hal.h"
+#include "util.h"
+
+#define NO_OBJECT       0xFFFF
+#define KEY_SLOTS       2048    // Power of two, at most half full
+#define MAX_OBJECTS     (SCRIPT_CACHE_SLABS * SCRIPT_CACHE_SLOTS)
+#define NO_CLASS        0xFF
+
+// Cached body. Object id = slab * SCRIPT_CACHE_SLOTS + slot.
+typedef struct {
+    uint32_t key;
+    uint32_t size;
+    uint32_t last_use;
+    uint16_t prev;      // Toward more recent, NO_OBJECT at the head
+    uint16_t next;      // Toward less recent, NO_OBJECT at the tail
+    uint8_t used;
+    uint8_t pinned;
+    uint16_t reserved;
+} cache_object_t;
+
+typedef struct {
+    uint8_t size_class;     // NO_CLASS until claimed
+    uint8_t count;          // Objects in use
+    uint8_t pinned;         // Pinned objects
+    uint8_t reserved;
+} cache_slab_t;
+
+static struct {
+    cache_object_t objects[MAX_OBJECTS];
+    cache_slab_t slabs[SCRIPT_CACHE_SLABS];
+    uint16_t lru_head[SCRIPT_CACHE_CLASSES];    // Most recently used
+    uint16_t lru_tail[SCRIPT_CACHE_CLASSES];    // Least recently used
+    uint16_t index[KEY_SLOTS];                  // Object id + 1, 0 if free
+    uint32_t clock;
+    script_cache_stats_t stats;
+} cache;
+
+static HAL_BULK_BUFFER uint8_t cache_memory[SCRIPT_CACHE_SIZE];
+
+static inline uint32_t class_size(uint32_t size_class) {
+    return SCRIPT_CACHE_MIN_OBJECT << (2 * size_class);
+}
+
+static inline uint32_t class_slots(uint32_t size_class) {
+    return SCRIPT_CACHE_SLOTS >> (2 * size_class);
+}
+
+// Smallest class holding a body of this size
+static uint32_t size_class_of(uint32_t size) {
+    uint32_t size_class = 0;
+    while (class_size(size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+static inline uint8_t* object_memory(uint16_t id) {
+    uint32_t slab = id / SCRIPT_CACHE_SLOTS;
+    uint32_t slot = id % SCRIPT_CACHE_SLOTS;
+    return &cache_memory[slab * SCRIPT_CACHE_SLAB_SIZE + slot * class_size(cache.slabs[slab].size_class)];
+}
+
+static inline uint32_t key_home(uint32_t key) {
+    return (key * 2654435761u) >> (32 - 11);
+}
+
+// Index slot holding a key, or -1
+static int32_t index_slot(uint32_t key) {
+    for (uint32_t slot = key_home(key); ; slot = (slot + 1) & (KEY_SLOTS - 1)) {
+        uint16_t entry = cache.index[slot];
+        if (!entry) {
+            return -1;
+        }
+        if (cache.objects[entry - 1].key == key) {
+            return (int32_t)slot;
+        }
+    }
+}
+
+static void index_insert(uint32_t key, uint16_t id) {
+    uint32_t slot = key_home(key);
+    
+    while (cache.index[slot]) {
+        slot = (slot + 1) & (KEY_SLOTS - 1);
+    }
+    cache.index[slot] = id + 1;
+}
+
+// Free a slot, shifting later members of its probe run back
+static void index_delete(uint32_t slot) {
+    uint32_t hole = slot;
+    
+    for (uint32_t next = (slot + 1) & (KEY_SLOTS - 1); cache.index[next]; next = (next + 1) & (KEY_SLOTS - 1)) {
+        uint32_t home = key_home(cache.objects[cache.index[next] - 1].key);
+        if (((next - home) & (KEY_SLOTS - 1)) >= ((next - hole) & (KEY_SLOTS - 1))) {
+            cache.index[hole] = cache.index[next];
+            hole = next;
+        }
+    }
+    cache.index[hole] = 0;
+}
+
+// Object holding a key, or NO_OBJECT
+static uint16_t find_object(uint32_t key) {
+    int32_t slot = index_slot(key);
+    return slot < 0 ? NO_OBJECT : cache.index[slot] - 1;
+}
+
+static void lru_unlink(uint16_t id) {
+    cache_object_t* object = &cache.objects[id];
+    uint32_t size_class = cache.slabs[id / SCRIPT_CACHE_SLOTS].size_class;
+    
+    if (object->prev != NO_OBJECT) {
+        cache.objects[object->prev].next = object->next;
+    } else {
+        cache.lru_head[size_class] = object->next;
+    }
+    if (object->next != NO_OBJECT) {
+        cache.objects[object->next].prev = object->prev;
+    } else {
+        cache.lru_tail[size_class] = object->prev;
+    }
+}
+
+static void lru_push(uint16_t id) {
+    cache_object_t* object = &cache.objects[id];
+    uint32_t size_class = cache.slabs[id / SCRIPT_CACHE_SLOTS].size_class;
+    
+    object->prev = NO_OBJECT;
+    object->next = cache.lru_head[size_class];
+    if (object->next != NO_OBJECT) {
+        cache.objects[object->next].prev = id;
+    } else {
+        cache.lru_tail[size_class] = id;
+    }
+    cache.lru_head[size_class] = id;
+}
+
+// Mark an object as just used
+static void touch(uint16_t id) {
+    cache.objects[id].last_use = ++cache.clock;
+    if (!cache.objects[id].pinned) {
+        lru_unlink(id);
+        lru_push(id);
+    }
+}
+
+// Drop an object and its body
+static void release_object(uint16_t id) {
+    cache_object_t* object = &cache.objects[id];
+    cache_slab_t* slab = &cache.slabs[id / SCRIPT_CACHE_SLOTS];
+    
+    if (object->pinned) {
+        slab->pinned--;
+        cache.stats.pinned--;
+    } else {
+        lru_unlink(id);
+    }
+    index_delete((uint32_t)index_slot(object->key));
+    object->used = 0;
+    object->pinned = 0;
+    slab->count--;
+    cache.stats.bytes_used -= object->size;
+    cache.stats.bodies--;
+}
+
+// Free slot in a slab, or NO_OBJECT
+static uint16_t slab_free_slot(uint32_t slab) {
+    uint32_t slots = class_slots(cache.slabs[slab].size_class);
+    
+    if (cache.slabs[slab].count >= slots) {
+        return NO_OBJECT;
+    }
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        uint16_t id = (uint16_t)(slab * SCRIPT_CACHE_SLOTS + slot);
+        if (!cache.objects[id].used) {
+            return id;
+        }
+    }
+    return NO_OBJECT;
+}
+
+// Empty the unpinned slab used least recently and give it to a class
+static uint16_t reclaim_slab(uint32_t size_class) {
+    uint32_t victim = SCRIPT_CACHE_SLABS;
+    uint32_t victim_use = UINT32_MAX;
+    
+    for (uint32_t slab = 0; slab < SCRIPT_CACHE_SLABS; slab++) {
+        if (cache.slabs[slab].pinned) {
+            continue;
+        }
+        uint32_t newest = 0;
+        for (uint32_t slot = 0; slot < SCRIPT_CACHE_SLOTS; slot++) {
+            const cache_object_t* object = &cache.objects[slab * SCRIPT_CACHE_SLOTS + slot];
+            if (object->used && object->last_use > newest) {
+                newest = object->last_use;
+            }
+        }
+        if (newest < victim_use) {
+            victim = slab;
+            victim_use = newest;
+        }
+    }
+    if (victim == SCRIPT_CACHE_SLABS) {
+        return NO_OBJECT;
+    }
+    
+    for (uint32_t slot = 0; slot < SCRIPT_CACHE_SLOTS; slot++) {
+        uint16_t id = (uint16_t)(victim * SCRIPT_CACHE_SLOTS + slot);
+        if (cache.objects[id].used) {
+            release_object(id);
+            cache.stats.evictions++;
+        }
+    }
+    if (cache.slabs[victim].size_class != NO_CLASS && cache.slabs[victim].size_class != size_class) {
+        cache.stats.slab_moves++;
+    }
+    cache.slabs[victim].size_class = (uint8_t)size_class;
+    return (uint16_t)(victim * SCRIPT_CACHE_SLOTS);
+}
+
+// Slot for a new body of a class, evicting if needed
+static uint16_t allocate(uint32_t size_class) {
+    // A free slot in the class, or a slab nobody has claimed
+    for (uint32_t slab = 0; slab < SCRIPT_CACHE_SLABS; slab++) {
+        if (cache.slabs[slab].size_class == size_class) {
+            uint16_t id = slab_free_slot(slab);
+            if (id != NO_OBJECT) {
+                return id;
+            }
+        }
+    }
+    for (uint32_t slab = 0; slab < SCRIPT_CACHE_SLABS; slab++) {
+        if (cache.slabs[slab].size_class == NO_CLASS) {
+            cache.slabs[slab].size_class = (uint8_t)size_class;
+            return (uint16_t)(slab * SCRIPT_CACHE_SLOTS);
+        }
+    }
+    
+    // The least recently used body of the class
+    uint16_t id = cache.lru_tail[size_class];
+    if (id != NO_OBJECT) {
+        release_object(id);
+        cache.stats.evictions++;
+        return id;
+    }
+    
+    return reclaim_slab(size_class);
+}
+
+// Empty the cache
+void script_cache_init(void) {
+    mem_set(&cache, 0, sizeof(cache));
+    for (uint32_t slab = 0; slab < SCRIPT_CACHE_SLABS; slab++) {
+        cache.slabs[slab].size_class = NO_CLASS;
+    }
+    for (uint32_t size_class = 0; size_class < SCRIPT_CACHE_CLASSES; size_class++) {
+        cache.lru_head[size_class] = NO_OBJECT;
+        cache.lru_tail[size_class] = NO_OBJECT;
+    }
+}
+
+// Body cached under a key, or NULL. Counts a hit or a miss and marks the
+// body as recently used.
+const void* script_cache_lookup(uint32_t key, uint32_t* size) {
+    uint16_t id = find_object(key);
+    
+    if (id == NO_OBJECT) {
+        cache.stats.misses++;
+        return 0;
+    }
+    cache.stats.hits++;
+    touch(id);
+    if (size) {
+        *size = cache.objects[id].size;
+    }
+    return object_memory(id);
+}
+
+// Copy a body into the cache, replacing any body under the same key.
+// Returns the cached copy, or NULL if no room could be made.
+const void* script_cache_insert(uint32_t key, const void* data, uint32_t size) {
+    if (!data || size == 0 || size > SCRIPT_CACHE_MAX_BODY) {
+        cache.stats.rejected++;
+        return 0;
+    }
+    
+    uint16_t old = find_object(key);
+    int pinned = 0;
+    if (old != NO_OBJECT) {
+        pinned = cache.objects[old].pinned;
+        release_object(old);
+    }
+    
+    uint16_t id = allocate(size_class_of(size));
+    if (id == NO_OBJECT) {
+        cache.stats.rejected++;
+        return 0;
+    }
+    
+    cache_object_t* object = &cache.objects[id];
+    cache_slab_t* slab = &cache.slabs[id / SCRIPT_CACHE_SLOTS];
+    object->key = key;
+    object->size = size;
+    object->last_use = ++cache.clock;
+    object->used = 1;
+    object->pinned = (uint8_t)pinned;
+    slab->count++;
+    if (pinned) {
+        slab->pinned++;
+        cache.stats.pinned++;
+    } else {
+        lru_push(id);
+    }
+    index_insert(key, id);
+    mem_copy(object_memory(id), data, size);
+    
+    cache.stats.inserts++;
+    cache.stats.bodies++;
+    cache.stats.bytes_used += size;
+    return object_memory(id);
+}
+
+// Whether a key is cached, without touching it or the statistics
+int script_cache_contains(uint32_t key) {
+    return find_object(key) != NO_OBJECT;
+}
+
+// Keep a body resident until unpinned
+int script_cache_pin(uint32_t key) {
+    uint16_t id = find_object(key);
+    if (id == NO_OBJECT) {
+        return 0;
+    }
+    
+    cache_object_t* object = &cache.objects[id];
+    if (!object->pinned) {
+        lru_unlink(id);
+        object->pinned = 1;
+        cache.slabs[id / SCRIPT_CACHE_SLOTS].pinned++;
+        cache.stats.pinned++;
+    }
+    return 1;
+}
+
+// Make a body evictable again, as the most recently used of its class
+int script_cache_unpin(uint32_t key) {
+    uint16_t id = find_object(key);
+    if (id == NO_OBJECT) {
+        return 0;
+    }
+    
+    cache_object_t* object = &cache.objects[id];
+    if (object->pinned) {
+        object->pinned = 0;
+        cache.slabs[id / SCRIPT_CACHE_SLOTS].pinned--;
+        cache.stats.pinned--;
+        object->last_use = ++cache.clock;
+        lru_push(id);
+    }
+    return 1;
+}
+
+// Drop a body. A pinned one may be running and stays; returns 0 then.
+int script_cache_remove(uint32_t key) {
+    uint16_t id = find_object(key);
+    if (id == NO_OBJECT) {
+        return 1;
+    }
+    if (cache.objects[id].pinned) {
+        return 0;
+    }
+    release_object(id);
+    return 1;
+}
+
+// Get cache statistics
+void script_cache_get_stats(script_cache_stats_t* stats) {
+    if (stats) {
+        *stats = cache.stats;
+    }
+}
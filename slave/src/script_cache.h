@@ -0,0 +1,46 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include <stdint.h>
+
+// Script body cache
+//
+// A 1 MB buffer carved into 64 KB slabs. Each slab serves one size class
+// and is claimed by a class when first needed. Bodies are keyed by a
+// caller-chosen id. Unpinned bodies sit on a per-class LRU list and are
+// evicted oldest first when their class needs room; if a class has nothing
+// to evict, the slab that was used least recently and holds no pinned
+// bodies is emptied and handed over. Pinned bodies are never evicted.
+
+#define SCRIPT_CACHE_SIZE       (1024 * 1024)
+#define SCRIPT_CACHE_SLAB_SIZE  (64 * 1024)
+#define SCRIPT_CACHE_SLABS      (SCRIPT_CACHE_SIZE / SCRIPT_CACHE_SLAB_SIZE)
+#define SCRIPT_CACHE_CLASSES    4           // 1, 4, 16 and 64 KB
+#define SCRIPT_CACHE_MIN_OBJECT 1024
+#define SCRIPT_CACHE_SLOTS      (SCRIPT_CACHE_SLAB_SIZE / SCRIPT_CACHE_MIN_OBJECT)
+#define SCRIPT_CACHE_MAX_BODY   SCRIPT_CACHE_SLAB_SIZE
+
+// Cache statistics
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t inserts;
+    uint32_t evictions;
+    uint32_t slab_moves;      // Slabs handed to another size class
+    uint32_t rejected;        // Inserts with no evictable room
+    uint32_t bytes_used;      // Body bytes held
+    uint32_t bodies;
+    uint32_t pinned;
+} script_cache_stats_t;
+
+// Function Prototypes
+void script_cache_init(void);
+const void* script_cache_lookup(uint32_t key, uint32_t* size);
+const void* script_cache_insert(uint32_t key, const void* data, uint32_t size);
+int script_cache_contains(uint32_t key);
+int script_cache_pin(uint32_t key);
+int script_cache_unpin(uint32_t key);
+int script_cache_remove(uint32_t key);
+void script_cache_get_stats(script_cache_stats_t* stats);
+
+#endif // SCRIPT_CACHE_H
@@ -1,6 +1,7 @@
 #include "script_gui.h"
 #include "status.h"
 #include "util.h"
+#include <stddef.h>
 
 #define MAX_MENU_ITEMS 16
 #define MAX_MESSAGE_LEN 256
@@ -8,6 +9,7 @@
 #define SCREEN_HEIGHT 240
 #define ITEM_HEIGHT 20
 #define SCROLL_MARGIN 4
+#define VISIBLE_ITEMS (SCREEN_HEIGHT / ITEM_HEIGHT)
 
 // GUI state
 static struct {
@@ -19,9 +21,18 @@ static struct {
     char message[MAX_MESSAGE_LEN];
     uint32_t message_timer;
     struct {
-        script_entry_t* items;
-        uint32_t count;
+        script_view_kind_t kind;
+        char query[64];
+        uint32_t view_id;                      // Bumped whenever another list is shown
+        int shown;
+        script_row_t rows[SCRIPT_PAGE_ROWS];   // Visible page, copied by the script core
+        uint32_t first;                        // View position of rows[0]
+        uint32_t count;                        // Rows loaded
+        int stale;                             // Library changed or list reopened
+        int requested;                         // Request out, not yet answered
+        script_page_request_t request;
     } list;
+    script_row_t details;                      // key 0 when none
     struct {
         char operation[64];
         uint32_t progress;
@@ -55,6 +66,7 @@ int script_gui_init(void) {
     gui.scroll_offset = 0;
     gui.message_timer = 0;
     gui.progress.show = 0;
+    gui.details.key = 0;
     return 1;
 }
 
@@ -88,38 +100,91 @@ static void render_menu_items(const char** items, uint32_t count) {
     }
 }
 
+// The library lives on the script core; this core only ever sees the
+// pages of rows it copies out (script_lib_page), asked for as the list
+// scrolls or the library changes.
+
+// Page the visible rows need, or NULL if they are loaded or a request is
+// out. Send it, then call script_gui_page_requested.
+const script_page_request_t* script_gui_page_request(void) {
+    if (!gui.list.shown || gui.list.requested ||
+        (!gui.list.stale && gui.list.first == gui.scroll_offset)) {
+        return NULL;
+    }
+    
+    gui.list.request.kind = gui.list.kind;
+    str_copy(gui.list.request.query, gui.list.query, sizeof(gui.list.request.query));
+    gui.list.request.view_id = gui.list.view_id;
+    gui.list.request.first = gui.scroll_offset;
+    return &gui.list.request;
+}
+
+// The request is out; it is left alone until answered
+void script_gui_page_requested(void) {
+    gui.list.requested = 1;
+}
+
+// Take the answer to a page request. Pages for a list no longer shown
+// are dropped, and the rows asked for again.
+void script_gui_take_page(const script_page_t* page) {
+    gui.list.requested = 0;
+    if (!page || page->view_id != gui.list.view_id) {
+        return;
+    }
+    
+    gui.list.count = page->count < SCRIPT_PAGE_ROWS ? page->count : SCRIPT_PAGE_ROWS;
+    for (uint32_t i = 0; i < gui.list.count; i++) {
+        gui.list.rows[i] = page->rows[i];
+    }
+    gui.list.first = page->first;
+    gui.list.stale = 0;
+    gui.total_items = page->total;
+
+    // Keep the cursor on the list if it shrank; a moved scroll asks for
+    // its own page
+    if (gui.selected_item >= gui.total_items) {
+        gui.selected_item = gui.total_items ? gui.total_items - 1 : 0;
+    }
+    if (gui.scroll_offset > gui.selected_item) {
+        gui.scroll_offset = gui.selected_item;
+    }
+}
+
+// The rows shown may be out of date
+void script_gui_library_changed(void) {
+    gui.list.stale = 1;
+}
+
+// Row at a list position, NULL if it is not loaded
+static const script_row_t* list_row(uint32_t position) {
+    if (!gui.list.shown || position < gui.list.first || position >= gui.list.first + gui.list.count) {
+        return NULL;
+    }
+    return &gui.list.rows[position - gui.list.first];
+}
+
 // Render script list
 static void render_script_list(void) {
-    if (!gui.list.items || !gui.list.count) return;
+    if (!gui.list.shown) return;
     
     for (uint32_t i = 0; i < gui.list.count; i++) {
-        const script_entry_t* script = &gui.list.items[i];
         uint32_t y = i * ITEM_HEIGHT;
         
-        // Skip if not visible
-        if (y < gui.scroll_offset * ITEM_HEIGHT) continue;
-        if (y >= SCREEN_HEIGHT) break;
-        
-        // Draw script entry
-        y -= gui.scroll_offset * ITEM_HEIGHT;
-        
         // Draw selection highlight
-        if (i == gui.selected_item) {
+        if (gui.list.first + i == gui.selected_item) {
             // TODO: Draw highlight rectangle
         }
         
         // Draw script info
-        // TODO: Draw script name, status, rating etc.
+        // TODO: Draw name, status, rating etc. of gui.list.rows[i]
     }
 }
 
 // Render script details
 static void render_script_details(void) {
-    if (!gui.list.items || gui.selected_item >= gui.list.count) return;
+    if (!gui.details.key) return;
     
-    const script_entry_t* script = &gui.list.items[gui.selected_item];
-    
-    // TODO: Draw script details (name, author, description, etc.)
+    // TODO: Draw script details (name, author, description, etc.) of gui.details
     // TODO: Draw script menu options
 }
 
@@ -198,7 +263,17 @@ void script_gui_handle_input(uint32_t buttons) {
     
     // Handle selection/activation
     if (buttons & BUTTON_A) {
-        event = GUI_EVENT_SELECT;
+        switch (gui.state) {
+            case GUI_STATE_SCRIPT_DETAILS:
+                event = GUI_EVENT_ACTIVATE;
+                break;
+            case GUI_STATE_CATALOG_BROWSE:
+                event = GUI_EVENT_DOWNLOAD;
+                break;
+            default:
+                event = GUI_EVENT_SELECT;
+                break;
+        }
     }
     
     if (buttons & BUTTON_B) {
@@ -235,18 +310,24 @@ void script_gui_show_progress(const char* operation, uint32_t progress) {
     gui.progress.show = 1;
 }
 
-// Show scripts
-void script_gui_show_scripts(script_entry_t* scripts, uint32_t count) {
-    gui.list.items = scripts;
-    gui.list.count = count;
-    gui.total_items = count;
+// Show a library view; rows are paged in from the script core as the
+// list scrolls. The query is only used by search views.
+void script_gui_show_scripts(script_view_kind_t kind, const char* query) {
+    gui.list.kind = kind;
+    str_copy(gui.list.query, query ? query : "", sizeof(gui.list.query));
+    gui.list.view_id++;
+    gui.list.shown = 1;
+    gui.list.count = 0;
+    gui.list.stale = 1;
+    gui.total_items = 0;
     gui.selected_item = 0;
     gui.scroll_offset = 0;
     gui.state = GUI_STATE_SCRIPT_LIST;
 }
 
-// Show script details
-void script_gui_show_script_details(const script_entry_t* script) {
+// Show script details of a row taken from a page
+void script_gui_show_script_details(const script_row_t* script) {
+    gui.details = *script;
     gui.state = GUI_STATE_SCRIPT_DETAILS;
     gui.selected_item = 0;
 }
@@ -259,8 +340,8 @@ void script_gui_show_catalog(void) {
 }
 
 // Show search results
-void script_gui_show_search_results(script_entry_t* results, uint32_t count) {
-    script_gui_show_scripts(results, count);
+void script_gui_show_search_results(const char* query) {
+    script_gui_show_scripts(SCRIPT_VIEW_SEARCH, query);
     gui.state = GUI_STATE_CATALOG_SEARCH;
 }
 
@@ -311,6 +392,13 @@ int script_gui_get_selection(uint32_t* selected_item) {
     return 1;
 }
 
+// Row under the cursor, NULL outside a script list or before its page
+// has arrived
+const script_row_t* script_gui_get_selected(void) {
+    if (gui.state == GUI_STATE_SCRIPT_DETAILS) return gui.details.key ? &gui.details : NULL;
+    return list_row(gui.selected_item);
+}
+
 int script_gui_get_message(char* message, uint32_t max_len) {
     if (!message || max_len == 0) return 0;
     str_copy(message, gui.message, max_len);
@@ -326,8 +414,10 @@ int script_gui_get_progress(char* operation, uint32_t max_len, uint32_t* progres
 
 // Cleanup
 void script_gui_cleanup(void) {
-    gui.list.items = NULL;
+    gui.list.shown = 0;
     gui.list.count = 0;
+    gui.list.requested = 0;
+    gui.details.key = 0;
     gui.callback = NULL;
     gui.message_timer = 0;
     gui.progress.show = 0;
@@ -46,10 +46,16 @@ void script_gui_show_progress(const char* operation, uint32_t progress);
 void script_gui_cleanup(void);
 
 // Script List Functions
-void script_gui_show_scripts(script_entry_t* scripts, uint32_t count);
-void script_gui_show_script_details(const script_entry_t* script);
+void script_gui_show_scripts(script_view_kind_t kind, const char* query);
+void script_gui_show_script_details(const script_row_t* script);
 void script_gui_show_catalog(void);
-void script_gui_show_search_results(script_entry_t* results, uint32_t count);
+void script_gui_show_search_results(const char* query);
+
+// Library pages, answered by the script core
+const script_page_request_t* script_gui_page_request(void);
+void script_gui_page_requested(void);
+void script_gui_take_page(const script_page_t* page);
+void script_gui_library_changed(void);
 
 // Script Editor Functions
 void script_gui_edit_script(const char* script_name);
@@ -63,6 +69,7 @@ void script_gui_update_settings(void);
 // State query functions for testing
 int script_gui_get_state(gui_state_t* state);
 int script_gui_get_selection(uint32_t* selected_item);
+const script_row_t* script_gui_get_selected(void);
 int script_gui_get_message(char* message, uint32_t max_len);
 int script_gui_get_progress(char* operation, uint32_t max_len, uint32_t* progress);
 
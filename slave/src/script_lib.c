@@ -1,43 +1,532 @@
 #include "script_lib.h"
+#include "hal.h"
 #include "status.h"
 #include "util.h"
+#include "trigram_index.h"
+#include "str_arena.h"
+#include "script_cache.h"
+#include "package.h"
+#include "crc32.h"
+#include "fat32.h"
 
 #define MAX_LIBRARY_ENTRIES 1024
 #define MAX_ACTIVE_SCRIPTS 32
+#define PACKAGE_HEAD_SIZE 1024          // Header, section table and metadata
+#define PACKAGE_EXTENSION ".pkg"
 #define CATALOG_TIMEOUT_MS 5000
-#define SCRIPT_CACHE_SIZE (1024 * 1024) // 1MB cache
+#define NAME_INDEX_SIZE 2048              // Power of two, at most half full
 
-// Script library storage
+// Search ranking weights per matching field
+#define SEARCH_WEIGHT_NAME 4
+#define SEARCH_WEIGHT_GAME 2
+#define SEARCH_WEIGHT_DESCRIPTION 1
+
+// Entry flags
+#define ENTRY_ACTIVE    (1 << 0)
+#define ENTRY_LOCAL     (1 << 1)
+#define ENTRY_PRIVATE   (1 << 2)
+#define ENTRY_UNINDEXED (1 << 3)    // Not in the trigram index, scanned instead
+#define ENTRY_PENDING   (1 << 4)    // Load or unload handed to the script engine
+#define ENTRY_VERIFIED  (1 << 5)    // Stored body passed package_verify
+
+// Interned text fields of an entry
+typedef enum {
+    TEXT_NAME,
+    TEXT_AUTHOR,
+    TEXT_VERSION,
+    TEXT_DESCRIPTION,
+    TEXT_GAME,
+    TEXT_PATH,
+    TEXT_FIELDS
+} text_field_t;
+
+// Name index slot: the full hash filters probes without touching the entry
+typedef struct {
+    uint32_t hash;
+    uint16_t entry;     // Entry index + 1, 0 if free
+    uint16_t reserved;
+} name_slot_t;
+
+// Script library storage. Entry fields are kept as parallel arrays so
+// list scans stream through only the fields they test; strings live in
+// the arena and repeated authors, games and versions are stored once.
 static struct {
-    script_entry_t entries[MAX_LIBRARY_ENTRIES];
     uint32_t entry_count;
+    uint32_t name_hash[MAX_LIBRARY_ENTRIES];
+    uint32_t downloads[MAX_LIBRARY_ENTRIES];
+    uint8_t flags[MAX_LIBRARY_ENTRIES];
+    uint8_t rating[MAX_LIBRARY_ENTRIES];
+    uint8_t type[MAX_LIBRARY_ENTRIES];
+    uint32_t size[MAX_LIBRARY_ENTRIES];
+    uint32_t checksum[MAX_LIBRARY_ENTRIES];
+    uint32_t body_key[MAX_LIBRARY_ENTRIES];    // Script cache key, unique per add
+    str_ref_t text[MAX_LIBRARY_ENTRIES][TEXT_FIELDS];
+    name_slot_t name_index[NAME_INDEX_SIZE];   // Open addressing, linear probing
+    uint32_t unindexed_count;
     uint32_t active_count;
+    uint32_t pending_count;                    // Activations awaiting their load
+    uint32_t generation;                       // Bumped when views go stale
+    uint32_t next_body_key;
+    int volume_mounted;                         // SD card FAT32 volume
     char catalog_url[256];
     struct {
         uint32_t downloads;
         uint32_t uploads;
-        uint32_t cache_hits;
-        uint32_t cache_misses;
+        uint32_t checksum_errors;
     } stats;
-    uint8_t script_cache[SCRIPT_CACHE_SIZE];
-    uint32_t cache_used;
 } library = {0};
 
+static str_arena_t strings;
+
+// Whole package being read from the card or built
+static uint32_t package_buffer[SCRIPT_CACHE_MAX_BODY / sizeof(uint32_t)] HAL_BULK_BUFFER;
+
+// Full-text index over name, description and game
+static trigram_index_t text_index;
+static uint16_t search_candidates[MAX_LIBRARY_ENTRIES];
+static uint64_t search_keys[MAX_LIBRARY_ENTRIES];
+static script_handle_t search_handles[MAX_LIBRARY_ENTRIES];
+
+// Matches of the last search, reused while its views page
+static struct {
+    char query[64];
+    uint32_t generation;
+    uint32_t count;
+    uint16_t entries[MAX_LIBRARY_ENTRIES];
+    uint8_t scores[MAX_LIBRARY_ENTRIES];
+} search_cache;
+
+static inline const char* entry_text(uint32_t index, text_field_t field) {
+    return str_arena_get(&strings, library.text[index][field]);
+}
+
+// Clear the name index
+static void name_index_reset(void) {
+    mem_set(library.name_index, 0, sizeof(library.name_index));
+}
+
+// Index slot holding a name, or -1
+static int32_t name_index_slot(const char* name) {
+    uint32_t hash = str_hash(name);
+    
+    for (uint32_t slot = hash & (NAME_INDEX_SIZE - 1); ; slot = (slot + 1) & (NAME_INDEX_SIZE - 1)) {
+        const name_slot_t* s = &library.name_index[slot];
+        if (!s->entry) {
+            return -1;
+        }
+        if (s->hash == hash && str_compare(entry_text(s->entry - 1, TEXT_NAME), name) == 0) {
+            return (int32_t)slot;
+        }
+    }
+}
+
+// Entry holding a name, or -1
+static int32_t name_index_find(const char* name) {
+    int32_t slot = name_index_slot(name);
+    return slot < 0 ? -1 : library.name_index[slot].entry - 1;
+}
+
+static void name_index_insert(uint32_t hash, uint16_t entry) {
+    uint32_t slot = hash & (NAME_INDEX_SIZE - 1);
+    
+    while (library.name_index[slot].entry) {
+        slot = (slot + 1) & (NAME_INDEX_SIZE - 1);
+    }
+    library.name_index[slot].hash = hash;
+    library.name_index[slot].entry = entry + 1;
+}
+
+// Point the slot of an entry at a new index
+static void name_index_repoint(uint16_t from, uint16_t to) {
+    uint32_t slot = library.name_hash[from] & (NAME_INDEX_SIZE - 1);
+    
+    while (library.name_index[slot].entry != from + 1) {
+        slot = (slot + 1) & (NAME_INDEX_SIZE - 1);
+    }
+    library.name_index[slot].entry = to + 1;
+}
+
+// Free a slot, shifting later members of its probe run back so lookups
+// never need tombstones
+static void name_index_delete(uint32_t slot) {
+    uint32_t hole = slot;
+    
+    for (uint32_t next = (slot + 1) & (NAME_INDEX_SIZE - 1); ; next = (next + 1) & (NAME_INDEX_SIZE - 1)) {
+        name_slot_t* s = &library.name_index[next];
+        if (!s->entry) {
+            break;
+        }
+        
+        // Move it into the hole unless its home lies after the hole
+        uint32_t home = s->hash & (NAME_INDEX_SIZE - 1);
+        if (((next - home) & (NAME_INDEX_SIZE - 1)) >= ((next - hole) & (NAME_INDEX_SIZE - 1))) {
+            library.name_index[hole] = *s;
+            hole = next;
+        }
+    }
+    library.name_index[hole].entry = 0;
+}
+
+// Searchable text fields of an entry
+static void text_fields(uint32_t index, const char* fields[3]) {
+    fields[0] = entry_text(index, TEXT_NAME);
+    fields[1] = entry_text(index, TEXT_DESCRIPTION);
+    fields[2] = entry_text(index, TEXT_GAME);
+}
+
+static void text_index_reset(void) {
+    trigram_index_reset(&text_index);
+    library.unindexed_count = 0;
+}
+
+// Index an entry's text. When the posting pool is full the entry is
+// flagged and searched by scanning instead.
+static void text_index_add(uint16_t index) {
+    const char* fields[3];
+    text_fields(index, fields);
+    
+    if (!trigram_index_add(&text_index, index, fields, 3)) {
+        library.flags[index] |= ENTRY_UNINDEXED;
+        library.unindexed_count++;
+    }
+}
+
+static void text_index_remove(uint16_t index) {
+    const char* fields[3];
+    text_fields(index, fields);
+    
+    if (library.flags[index] & ENTRY_UNINDEXED) {
+        library.unindexed_count--;
+    } else {
+        trigram_index_remove(&text_index, index, fields, 3);
+    }
+}
+
+// Relevance of an entry to a query, 0 if it does not match
+static uint32_t search_score(uint32_t index, const char* query) {
+    uint32_t score = 0;
+    
+    if (trigram_text_contains(entry_text(index, TEXT_NAME), query)) score += SEARCH_WEIGHT_NAME;
+    if (trigram_text_contains(entry_text(index, TEXT_GAME), query)) score += SEARCH_WEIGHT_GAME;
+    if (trigram_text_contains(entry_text(index, TEXT_DESCRIPTION), query)) score += SEARCH_WEIGHT_DESCRIPTION;
+    return score;
+}
+
+// Drop an entry's strings
+static void release_text(uint32_t index) {
+    for (uint32_t field = 0; field < TEXT_FIELDS; field++) {
+        str_arena_release(&strings, library.text[index][field]);
+        library.text[index][field] = STR_REF_EMPTY;
+    }
+}
+
+// Move an entry between slots, following it in both indexes
+static void move_entry(uint16_t from, uint16_t to) {
+    name_index_repoint(from, to);
+    if (!(library.flags[from] & ENTRY_UNINDEXED)) {
+        const char* fields[3];
+        text_fields(from, fields);
+        trigram_index_rename(&text_index, from, to, fields, 3);
+    }
+    
+    library.name_hash[to] = library.name_hash[from];
+    library.downloads[to] = library.downloads[from];
+    library.flags[to] = library.flags[from];
+    library.rating[to] = library.rating[from];
+    library.type[to] = library.type[from];
+    library.size[to] = library.size[from];
+    library.checksum[to] = library.checksum[from];
+    library.body_key[to] = library.body_key[from];
+    for (uint32_t field = 0; field < TEXT_FIELDS; field++) {
+        library.text[to][field] = library.text[from][field];
+    }
+}
+
 // Initialize script library
 int script_lib_init(void) {
     library.entry_count = 0;
+    library.generation++;
     library.active_count = 0;
-    library.cache_used = 0;
+    library.pending_count = 0;
+    library.volume_mounted = 0;
+    name_index_reset();
+    text_index_reset();
+    str_arena_reset(&strings);
+    script_cache_init();
+    return 1;
+}
+
+// Add an entry to the library. Names are unique.
+int script_lib_add(const script_entry_t* entry) {
+    if (!entry || library.entry_count >= MAX_LIBRARY_ENTRIES || !entry->meta.name[0] ||
+        name_index_find(entry->meta.name) >= 0) {
+        return 0;
+    }
+    
+    // Intern the strings first; the slot only joins the library once
+    // they all fit, so a compaction only rewrites committed references
+    uint16_t index = (uint16_t)library.entry_count;
+    for (uint32_t field = 0; field < TEXT_FIELDS; field++) {
+        library.text[index][field] = STR_REF_EMPTY;
+    }
+    const char* text[TEXT_FIELDS] = {
+        entry->meta.name, entry->meta.author, entry->meta.version,
+        entry->meta.description, entry->meta.game, entry->path
+    };
+    for (uint32_t field = 0; field < TEXT_FIELDS; field++) {
+        str_ref_t ref = str_arena_intern(&strings, text[field], &library.text[0][0],
+                                         (index + 1) * TEXT_FIELDS);
+        if (ref == STR_REF_NONE) {
+            release_text(index);
+            return 0;
+        }
+        library.text[index][field] = ref;
+    }
+    
+    library.entry_count++;
+    library.name_hash[index] = str_hash(entry->meta.name);
+    library.downloads[index] = entry->meta.downloads;
+    library.flags[index] = (entry->is_local ? ENTRY_LOCAL : 0) | (entry->meta.is_private ? ENTRY_PRIVATE : 0);
+    library.rating[index] = (uint8_t)(entry->meta.rating > 5 ? 5 : entry->meta.rating);
+    library.type[index] = (uint8_t)entry->meta.type;
+    library.size[index] = entry->meta.size;
+    library.checksum[index] = entry->meta.checksum;
+    library.body_key[index] = ++library.next_body_key;
+    name_index_insert(library.name_hash[index], index);
+    text_index_add(index);
+    library.generation++;
+    return 1;
+}
+
+// Remove an entry. The last entry moves into its place. Active and
+// pending entries, and pinned bodies, are refused: the input core may be
+// running the body, so deactivate first.
+int script_lib_remove(const char* script_name) {
+    if (!script_name) return 0;
+    
+    int32_t slot = name_index_slot(script_name);
+    if (slot < 0) {
+        return 0;
+    }
+    
+    uint16_t index = library.name_index[slot].entry - 1;
+    if ((library.flags[index] & (ENTRY_ACTIVE | ENTRY_PENDING)) ||
+        !script_cache_remove(library.body_key[index])) {
+        return 0;
+    }
+    name_index_delete((uint32_t)slot);
+    text_index_remove(index);
+    release_text(index);
+    
+    uint16_t last = (uint16_t)(library.entry_count - 1);
+    if (index != last) {
+        move_entry(last, index);
+    }
+    library.entry_count--;
+    for (uint32_t field = 0; field < TEXT_FIELDS; field++) {
+        library.text[last][field] = STR_REF_EMPTY;
+    }
+    library.generation++;
+    return 1;
+}
+
+// Find an entry by name
+script_handle_t script_lib_find(const char* script_name) {
+    if (!script_name) return SCRIPT_HANDLE_NONE;
+    
+    int32_t index = name_index_find(script_name);
+    return index < 0 ? SCRIPT_HANDLE_NONE : (script_handle_t)index;
+}
+
+// Entry holding a body key, or -1. Keys survive the moves that
+// invalidate handles.
+static int32_t key_index(uint32_t key) {
+    for (uint32_t i = 0; i < library.entry_count; i++) {
+        if (library.body_key[i] == key) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+// Entry holding a key, or SCRIPT_HANDLE_NONE once it has been removed
+script_handle_t script_lib_find_key(uint32_t key) {
+    int32_t index = key ? key_index(key) : -1;
+    return index < 0 ? SCRIPT_HANDLE_NONE : (script_handle_t)index;
+}
+
+// Copy out what a list shows of an entry, with its key
+int script_lib_row(script_handle_t handle, script_row_t* row) {
+    if (handle >= library.entry_count || !row) return 0;
+    
+    row->key = library.body_key[handle];
+    str_copy(row->name, entry_text(handle, TEXT_NAME), sizeof(row->name));
+    str_copy(row->author, entry_text(handle, TEXT_AUTHOR), sizeof(row->author));
+    str_copy(row->description, entry_text(handle, TEXT_DESCRIPTION), sizeof(row->description));
+    row->downloads = library.downloads[handle];
+    row->rating = library.rating[handle];
+    row->is_active = (library.flags[handle] & ENTRY_ACTIVE) != 0;
+    row->is_local = (library.flags[handle] & ENTRY_LOCAL) != 0;
+    return 1;
+}
+
+// Copy out the full entry behind a handle
+int script_lib_get(script_handle_t handle, script_entry_t* entry) {
+    if (handle >= library.entry_count || !entry) return 0;
+    
+    str_copy(entry->meta.name, entry_text(handle, TEXT_NAME), sizeof(entry->meta.name));
+    str_copy(entry->meta.author, entry_text(handle, TEXT_AUTHOR), sizeof(entry->meta.author));
+    str_copy(entry->meta.version, entry_text(handle, TEXT_VERSION), sizeof(entry->meta.version));
+    str_copy(entry->meta.description, entry_text(handle, TEXT_DESCRIPTION), sizeof(entry->meta.description));
+    str_copy(entry->meta.game, entry_text(handle, TEXT_GAME), sizeof(entry->meta.game));
+    str_copy(entry->path, entry_text(handle, TEXT_PATH), sizeof(entry->path));
+    entry->meta.downloads = library.downloads[handle];
+    entry->meta.rating = library.rating[handle];
+    entry->meta.size = library.size[handle];
+    entry->meta.checksum = library.checksum[handle];
+    entry->meta.is_private = (library.flags[handle] & ENTRY_PRIVATE) != 0;
+    entry->meta.type = (script_type_t)library.type[handle];
+    entry->is_active = (library.flags[handle] & ENTRY_ACTIVE) != 0;
+    entry->is_local = (library.flags[handle] & ENTRY_LOCAL) != 0;
     return 1;
 }
 
-// Load scripts from local directory
+// Field accessors. Invalid handles read as empty.
+const char* script_lib_name(script_handle_t handle) {
+    return handle < library.entry_count ? entry_text(handle, TEXT_NAME) : "";
+}
+
+const char* script_lib_author(script_handle_t handle) {
+    return handle < library.entry_count ? entry_text(handle, TEXT_AUTHOR) : "";
+}
+
+const char* script_lib_version(script_handle_t handle) {
+    return handle < library.entry_count ? entry_text(handle, TEXT_VERSION) : "";
+}
+
+const char* script_lib_description(script_handle_t handle) {
+    return handle < library.entry_count ? entry_text(handle, TEXT_DESCRIPTION) : "";
+}
+
+const char* script_lib_game(script_handle_t handle) {
+    return handle < library.entry_count ? entry_text(handle, TEXT_GAME) : "";
+}
+
+uint32_t script_lib_downloads(script_handle_t handle) {
+    return handle < library.entry_count ? library.downloads[handle] : 0;
+}
+
+uint32_t script_lib_rating(script_handle_t handle) {
+    return handle < library.entry_count ? library.rating[handle] : 0;
+}
+
+int script_lib_is_active(script_handle_t handle) {
+    return handle < library.entry_count && (library.flags[handle] & ENTRY_ACTIVE);
+}
+
+int script_lib_is_local(script_handle_t handle) {
+    return handle < library.entry_count && (library.flags[handle] & ENTRY_LOCAL);
+}
+
+// Changes whenever handles or view contents may have moved
+uint32_t script_lib_generation(void) {
+    return library.generation;
+}
+
+// Add the package behind a directory entry. The metadata is parsed from
+// the first piece; both checksums are checked as the rest streams in.
+static int load_local_package(const fat32_dirent_t* file_entry, const char* path) {
+    static uint32_t head[PACKAGE_HEAD_SIZE / sizeof(uint32_t)];
+    static script_entry_t entry;
+    fat32_file_t file;
+    crc32_stream_t body_crc;
+    const uint8_t* data;
+    uint32_t length;
+    
+    if (file_entry->size > SCRIPT_CACHE_MAX_BODY) {
+        return 0;
+    }
+    fat32_open_entry(&file, file_entry);
+    uint32_t head_length = fat32_read(&file, head, sizeof(head));
+    const package_header_t* header = (const package_header_t*)head;
+    const package_meta_t* meta = package_peek_meta(head, head_length);
+    if (!meta || header->size != file_entry->size) {
+        return 0;
+    }
+    
+    crc32_stream_init(&body_crc);
+    crc32_stream_feed(&body_crc, head, head_length);
+    uint32_t package_crc = crc32((const uint8_t*)head + sizeof(package_header_t),
+                                 head_length - sizeof(package_header_t));
+    while ((length = fat32_map(&file, &data, SCRIPT_CACHE_MAX_BODY)) > 0) {
+        crc32_stream_feed(&body_crc, data, length);
+        package_crc = crc32_update(package_crc, data, length);
+    }
+    if (body_crc.length != header->size || package_crc != header->checksum) {
+        library.stats.checksum_errors++;
+        return 0;
+    }
+    
+    mem_set(&entry, 0, sizeof(entry));
+    str_copy(entry.meta.name, meta->name, sizeof(entry.meta.name));
+    str_copy(entry.meta.author, meta->author, sizeof(entry.meta.author));
+    str_copy(entry.meta.version, meta->version, sizeof(entry.meta.version));
+    str_copy(entry.meta.description, meta->description, sizeof(entry.meta.description));
+    str_copy(entry.meta.game, meta->game, sizeof(entry.meta.game));
+    entry.meta.type = (script_type_t)meta->type;
+    entry.meta.size = header->size;
+    entry.meta.checksum = crc32_stream_final(&body_crc);
+    entry.is_local = 1;
+    str_copy(entry.path, path, sizeof(entry.path));
+    return script_lib_add(&entry);
+}
+
+// Whether a file name ends in the package extension, in any case
+static int is_package_name(const char* name) {
+    uint32_t length = str_len(name);
+    uint32_t ext_length = sizeof(PACKAGE_EXTENSION) - 1;
+    if (length <= ext_length) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < ext_length; i++) {
+        char c = name[length - ext_length + i];
+        if ((c >= 'A' && c <= 'Z' ? c + 32 : c) != PACKAGE_EXTENSION[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Load the script packages in a directory of the SD card. Packages that
+// fail their checks or clash with a loaded name are skipped.
 int script_lib_load_local(const char* directory) {
-    // TODO: Scan directory for script files
-    // For each script file:
-    // 1. Read metadata
-    // 2. Validate script
-    // 3. Add to library
+    static char path[256];
+    const fat32_dirent_t* files;
+    uint32_t count;
+    
+    if (!directory) return 0;
+    
+    if (!library.volume_mounted) {
+        library.volume_mounted = fat32_mount();
+    }
+    if (!library.volume_mounted || !fat32_list(directory, &files, &count)) {
+        return 0;
+    }
+    
+    uint32_t dir_length = str_len(directory);
+    while (dir_length > 0 && directory[dir_length - 1] == '/') {
+        dir_length--;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if ((files[i].attr & FAT32_ATTR_DIRECTORY) || !is_package_name(files[i].name) ||
+            dir_length + 1 + str_len(files[i].name) >= sizeof(path)) {
+            continue;
+        }
+        mem_copy(path, directory, dir_length);
+        path[dir_length] = '/';
+        str_copy(path + dir_length + 1, files[i].name, sizeof(path) - dir_length - 1);
+        load_local_package(&files[i], path);
+    }
     return 1;
 }
 
@@ -55,16 +544,11 @@ int script_lib_download(const char* script_name) {
     if (!script_name) return 0;
     
     // Check cache first
-    for (uint32_t i = 0; i < library.entry_count; i++) {
-        if (str_compare(library.entries[i].meta.name, script_name) == 0) {
-            if (library.entries[i].is_local) {
-                library.stats.cache_hits++;
-                return 1;
-            }
-        }
+    int32_t index = name_index_find(script_name);
+    if (index >= 0 && script_cache_lookup(library.body_key[index], 0)) {
+        return 1;
     }
     
-    library.stats.cache_misses++;
     library.stats.downloads++;
     
     // TODO: Implement actual download
@@ -101,110 +585,453 @@ int script_lib_publish(const char* script_name) {
     if (!script_name) return 0;
     
     // Find script in library
-    for (uint32_t i = 0; i < library.entry_count; i++) {
-        if (str_compare(library.entries[i].meta.name, script_name) == 0) {
-            if (library.entries[i].meta.is_private) {
-                // TODO: Implement actual publishing
-                // 1. Verify script
-                // 2. Update metadata
-                // 3. Upload to public catalog
-                library.entries[i].meta.is_private = 0;
-                return 1;
-            }
-            break;
-        }
+    int32_t index = name_index_find(script_name);
+    if (index >= 0 && (library.flags[index] & ENTRY_PRIVATE)) {
+        // TODO: Implement actual publishing
+        // 1. Verify script
+        // 2. Update metadata
+        // 3. Upload to public catalog
+        library.flags[index] &= ~ENTRY_PRIVATE;
+        return 1;
     }
     
     return 0;
 }
 
-// Activate script
-int script_lib_activate(const char* script_name) {
-    if (!script_name || library.active_count >= MAX_ACTIVE_SCRIPTS) return 0;
-    
-    // Find script in library
-    for (uint32_t i = 0; i < library.entry_count; i++) {
-        if (str_compare(library.entries[i].meta.name, script_name) == 0) {
-            if (!library.entries[i].is_active) {
-                library.entries[i].is_active = 1;
-                library.active_count++;
-                return 1;
-            }
-            break;
+// Bring a script body into the cache from local storage or the catalog
+static int load_body(uint32_t index) {
+    if (library.flags[index] & ENTRY_LOCAL) {
+        fat32_file_t file;
+        if (!library.volume_mounted || !fat32_open(&file, entry_text(index, TEXT_PATH))) {
+            return 0;
         }
+        uint32_t size = fat32_read(&file, package_buffer, sizeof(package_buffer));
+        return size == library.size[index] &&
+               script_lib_store_body(entry_text(index, TEXT_NAME), package_buffer, size);
     }
     
+    // Catalog entries have no body until downloaded
     return 0;
 }
 
-// Deactivate script
-int script_lib_deactivate(const char* script_name) {
+// Cache the body of a library script. An active script may be running
+// from its body, so it cannot be replaced. A body must match the checksum
+// its entry carries; entries without one take the body's.
+int script_lib_store_body(const char* script_name, const void* body, uint32_t size) {
+    if (!script_name || !body) return 0;
+    
+    int32_t index = name_index_find(script_name);
+    if (index < 0 || (library.flags[index] & (ENTRY_ACTIVE | ENTRY_PENDING))) {
+        return 0;
+    }
+    
+    uint32_t checksum = crc32(body, size);
+    if (library.checksum[index] && library.checksum[index] != checksum) {
+        library.stats.checksum_errors++;
+        return 0;
+    }
+    if (!script_cache_insert(library.body_key[index], body, size)) {
+        return 0;
+    }
+    library.size[index] = size;
+    library.checksum[index] = checksum;
+    
+    // Checked in full once here, so loading it only has to open it
+    library.flags[index] &= ~ENTRY_VERIFIED;
+    if (package_verify(body, size)) {
+        library.flags[index] |= ENTRY_VERIFIED;
+    }
+    return 1;
+}
+
+// Cached body behind a handle, or NULL
+const void* script_lib_body(script_handle_t handle, uint32_t* size) {
+    if (handle >= library.entry_count) return 0;
+    return script_cache_lookup(library.body_key[handle], size);
+}
+
+// Start activating a script. Returns 0 if it cannot be activated. With a
+// body, returns 1 with the pinned package to load in *body; the entry is
+// pending until script_lib_finish_activate. Without one there is nothing
+// to run: the entry is active at once and *body is NULL.
+int script_lib_begin_activate(const char* script_name, uint32_t* key, const void** body, uint32_t* size) {
+    if (!script_name || library.active_count + library.pending_count >= MAX_ACTIVE_SCRIPTS) return 0;
+    
+    int32_t index = name_index_find(script_name);
+    if (index < 0 || (library.flags[index] & (ENTRY_ACTIVE | ENTRY_PENDING))) {
+        return 0;
+    }
+    
+    // A recently used body is still cached; otherwise fetch it
+    *key = library.body_key[index];
+    *body = script_cache_lookup(*key, size);
+    if (!*body && load_body((uint32_t)index)) {
+        *body = script_cache_lookup(*key, size);
+    }
+    if (*body && !(library.flags[index] & ENTRY_VERIFIED)) {
+        // Not a valid package: nothing could load it
+        return 0;
+    }
+    if (!*body) {
+        library.flags[index] |= ENTRY_ACTIVE;
+        library.active_count++;
+        library.generation++;
+        return 1;
+    }
+    
+    // Packages run in place from the pinned body
+    script_cache_pin(*key);
+    library.flags[index] |= ENTRY_PENDING;
+    library.pending_count++;
+    return 1;
+}
+
+// Record whether the body from script_lib_begin_activate loaded. One that
+// did not is unpinned and the entry left inactive. Returns 1 if active.
+int script_lib_finish_activate(uint32_t key, int loaded) {
+    int32_t index = key_index(key);
+    if (index < 0 || !(library.flags[index] & ENTRY_PENDING)) {
+        return 0;
+    }
+    
+    library.flags[index] &= ~ENTRY_PENDING;
+    library.pending_count--;
+    if (!loaded) {
+        script_cache_unpin(key);
+        return 0;
+    }
+    library.flags[index] |= ENTRY_ACTIVE;
+    library.active_count++;
+    library.generation++;
+    return 1;
+}
+
+// Start deactivating a script. Returns 0 if it is not active. With a
+// package running, returns 1 with the script to unload in *script_run;
+// the entry is pending until script_lib_finish_deactivate, and its body
+// stays pinned until then since the script may be executing from it.
+// Otherwise the entry is inactive at once and *script_run is NULL.
+int script_lib_begin_deactivate(const char* script_name, uint32_t* key, const char** script_run) {
     if (!script_name) return 0;
     
-    // Find script in library
-    for (uint32_t i = 0; i < library.entry_count; i++) {
-        if (str_compare(library.entries[i].meta.name, script_name) == 0) {
-            if (library.entries[i].is_active) {
-                library.entries[i].is_active = 0;
-                library.active_count--;
-                return 1;
+    int32_t index = name_index_find(script_name);
+    if (index < 0 || (library.flags[index] & (ENTRY_ACTIVE | ENTRY_PENDING)) != ENTRY_ACTIVE) {
+        return 0;
+    }
+    
+    package_t package;
+    uint32_t size;
+    *key = library.body_key[index];
+    const void* body = script_cache_lookup(*key, &size);
+    if (body && package_open(&package, body, size)) {
+        *script_run = package.meta->name;
+        library.flags[index] |= ENTRY_PENDING;
+        return 1;
+    }
+    
+    *script_run = 0;
+    library.flags[index] &= ~ENTRY_ACTIVE;
+    library.active_count--;
+    library.generation++;
+    return 1;
+}
+
+// Record whether the script from script_lib_begin_deactivate was
+// unloaded. If so its body is released; if not it stays active.
+// Returns 1 if inactive.
+int script_lib_finish_deactivate(uint32_t key, int unloaded) {
+    int32_t index = key_index(key);
+    if (index < 0 || !(library.flags[index] & ENTRY_PENDING)) {
+        return 0;
+    }
+    if (!unloaded) {
+        library.flags[index] &= ~ENTRY_PENDING;
+        return 0;
+    }
+    
+    script_cache_unpin(key);
+    library.flags[index] &= ~(ENTRY_PENDING | ENTRY_ACTIVE);
+    library.active_count--;
+    library.generation++;
+    return 1;
+}
+
+// Activate a script, loading it on the calling core. Only for callers
+// that own the script engine; cores.c uses the two-step calls above.
+int script_lib_activate(const char* script_name) {
+    uint32_t key;
+    uint32_t size;
+    const void* body;
+    if (!script_lib_begin_activate(script_name, &key, &body, &size)) {
+        return 0;
+    }
+    return !body || script_lib_finish_activate(key, script_load_package(body, size));
+}
+
+// Deactivate a script, unloading it on the calling core
+int script_lib_deactivate(const char* script_name) {
+    uint32_t key;
+    const char* script_run;
+    if (!script_lib_begin_deactivate(script_name, &key, &script_run)) {
+        return 0;
+    }
+    if (script_run) {
+        script_unload(script_run);
+        return script_lib_finish_deactivate(key, 1);
+    }
+    return 1;
+}
+
+// Verified matches of a query, scored. Queries shorter than a trigram
+// scan every entry.
+static void search_matches(const char* query) {
+    if (search_cache.generation == library.generation &&
+        str_compare(search_cache.query, query) == 0) {
+        return;
+    }
+    
+    int indexed = trigram_index_query(&text_index, query, search_candidates, MAX_LIBRARY_ENTRIES);
+    uint32_t count = 0;
+    if (indexed < 0) {
+        for (uint32_t i = 0; i < library.entry_count; i++) {
+            search_candidates[count++] = (uint16_t)i;
+        }
+    } else {
+        count = (uint32_t)indexed;
+        for (uint32_t i = 0; library.unindexed_count && i < library.entry_count; i++) {
+            if (library.flags[i] & ENTRY_UNINDEXED) {
+                search_candidates[count++] = (uint16_t)i;
             }
-            break;
         }
     }
     
-    return 0;
+    search_cache.count = 0;
+    for (uint32_t c = 0; c < count; c++) {
+        uint32_t score = search_score(search_candidates[c], query);
+        if (score) {
+            search_cache.entries[search_cache.count] = search_candidates[c];
+            search_cache.scores[search_cache.count++] = (uint8_t)score;
+        }
+    }
+    str_copy(search_cache.query, query, sizeof(search_cache.query));
+    search_cache.generation = library.generation;
 }
 
-// Search scripts in library
-int script_lib_search(const char* query, script_entry_t* results, uint32_t max_results) {
-    if (!query || !results || max_results == 0) return 0;
+// Entries a view may contain
+static uint32_t view_candidates(const script_view_t* view) {
+    if (view->kind == SCRIPT_VIEW_SEARCH) {
+        search_matches(view->query);
+        return search_cache.count;
+    }
+    return library.entry_count;
+}
+
+// Library index of a candidate
+static inline uint32_t view_candidate(const script_view_t* view, uint32_t c) {
+    return view->kind == SCRIPT_VIEW_SEARCH ? search_cache.entries[c] : c;
+}
+
+// Rank key of a candidate in a view, higher first; 0 if it is not a
+// member. The low bits order ties by library position, so keys are unique.
+static uint64_t view_key(const script_view_t* view, uint32_t c) {
+    uint32_t index = view_candidate(view, c);
+    uint64_t position = MAX_LIBRARY_ENTRIES - index;
     
+    switch (view->kind) {
+        case SCRIPT_VIEW_ACTIVE:
+            return (library.flags[index] & ENTRY_ACTIVE) ? position : 0;
+        case SCRIPT_VIEW_POPULAR:
+            return ((uint64_t)library.downloads[index] << 14) | ((uint64_t)library.rating[index] << 11) | position;
+        case SCRIPT_VIEW_SEARCH:
+            return ((uint64_t)search_cache.scores[c] << 43) | ((uint64_t)library.downloads[index] << 11) | position;
+        default:
+            return position;
+    }
+}
+
+// Highest-ranked members with keys below bound, best first
+static uint32_t view_select(const script_view_t* view, uint32_t candidates, uint64_t bound,
+                            script_handle_t* handles, uint32_t max_handles) {
     uint32_t found = 0;
     
-    // Search local library first
-    for (uint32_t i = 0; i < library.entry_count && found < max_results; i++) {
-        if (str_find(library.entries[i].meta.name, query) ||
-            str_find(library.entries[i].meta.description, query) ||
-            str_find(library.entries[i].meta.game, query)) {
-            results[found++] = library.entries[i];
+    for (uint32_t c = 0; c < candidates; c++) {
+        uint64_t key = view_key(view, c);
+        if (!key || key >= bound || (found == max_handles && key <= search_keys[found - 1])) {
+            continue;
+        }
+        
+        // Insert, dropping the last entry when full
+        uint32_t pos = found < max_handles ? found++ : found - 1;
+        while (pos > 0 && search_keys[pos - 1] < key) {
+            handles[pos] = handles[pos - 1];
+            search_keys[pos] = search_keys[pos - 1];
+            pos--;
+        }
+        handles[pos] = (script_handle_t)view_candidate(view, c);
+        search_keys[pos] = key;
+    }
+    return found;
+}
+
+// Count a view's members and rewind its cursor
+static void view_refresh(script_view_t* view) {
+    view->generation = library.generation;
+    view->cursor = 0;
+    view->cursor_key = UINT64_MAX;
+    
+    if (view->kind == SCRIPT_VIEW_ACTIVE) {
+        view->count = library.active_count;
+    } else if (view->kind == SCRIPT_VIEW_SEARCH) {
+        view->count = view_candidates(view);
+    } else {
+        view->count = library.entry_count;
+    }
+}
+
+// Open a view of the library. Nothing is copied; pages of handles are
+// ranked on demand.
+int script_lib_view_open(script_view_t* view, script_view_kind_t kind, const char* query) {
+    if (!view) return 0;
+    
+    view->kind = kind;
+    view->query[0] = '\0';
+    if (kind == SCRIPT_VIEW_SEARCH) {
+        if (!query || str_len(query) >= sizeof(view->query)) {
+            return 0;
+        }
+        str_copy(view->query, query, sizeof(view->query));
+    }
+    view_refresh(view);
+    return 1;
+}
+
+// Entries in a view
+uint32_t script_lib_view_count(script_view_t* view) {
+    if (!view) return 0;
+    if (view->generation != library.generation) {
+        view_refresh(view);
+    }
+    return view->count;
+}
+
+// Handles at positions first .. first + max_handles - 1 of a view. Paging
+// forward resumes from the end of the previous page, so scrolling costs
+// one pass over the candidates per page however deep the list goes.
+int script_lib_view_page(script_view_t* view, uint32_t first, script_handle_t* handles, uint32_t max_handles) {
+    if (!view || !handles || max_handles == 0) return 0;
+    if (view->generation != library.generation) {
+        view_refresh(view);
+    }
+    if (first >= view->count) return 0;
+    if (max_handles > MAX_LIBRARY_ENTRIES) max_handles = MAX_LIBRARY_ENTRIES;
+    
+    uint32_t position = 0;
+    uint64_t bound = UINT64_MAX;
+    if (view->cursor && first >= view->cursor) {
+        position = view->cursor;
+        bound = view->cursor_key;
+    }
+    
+    // Skip ahead to the requested position
+    uint32_t candidates = view_candidates(view);
+    while (position < first) {
+        uint32_t skip = first - position;
+        uint32_t got = view_select(view, candidates, bound, search_handles,
+                                   skip < MAX_LIBRARY_ENTRIES ? skip : MAX_LIBRARY_ENTRIES);
+        if (!got) {
+            return 0;
         }
+        bound = search_keys[got - 1];
+        position += got;
     }
     
+    uint32_t found = view_select(view, candidates, bound, handles, max_handles);
+    if (found) {
+        view->cursor = first + found;
+        view->cursor_key = search_keys[found - 1];
+    }
+    return found;
+}
+
+// Answer a page request from another core: rows copied out of the view
+// it names, which is reopened when the request is for another list. The
+// page stays valid until the pager's next call.
+const script_page_t* script_lib_page(script_pager_t* pager, const script_page_request_t* request) {
+    script_handle_t handles[SCRIPT_PAGE_ROWS];
+    script_page_t* page = &pager->page;
+    
+    if (!pager->open || pager->view_id != request->view_id) {
+        pager->open = script_lib_view_open(&pager->view, request->kind, request->query);
+        pager->view_id = request->view_id;
+    }
+    
+    page->view_id = request->view_id;
+    page->first = request->first;
+    page->count = 0;
+    page->total = 0;
+    if (pager->open) {
+        uint32_t found = (uint32_t)script_lib_view_page(&pager->view, request->first, handles, SCRIPT_PAGE_ROWS);
+        for (uint32_t i = 0; i < found; i++) {
+            page->count += (uint32_t)script_lib_row(handles[i], &page->rows[page->count]);
+        }
+        page->total = script_lib_view_count(&pager->view);
+    }
+    return page;
+}
+
+// Rank entries matching a query, best first. Matching is case-insensitive;
+// name matches outrank game matches, which outrank description matches,
+// and ties go to the most downloaded entry.
+int script_lib_query(const char* query, script_handle_t* handles, uint32_t max_handles) {
+    script_view_t view;
+    
+    if (!script_lib_view_open(&view, SCRIPT_VIEW_SEARCH, query)) return 0;
+    
     // TODO: Search remote catalog if needed
     // 1. Connect to catalog
     // 2. Send search query
     // 3. Add results to output
     
+    return script_lib_view_page(&view, 0, handles, max_handles);
+}
+
+// Copy the first page of a view into entries
+static int view_copy(script_view_t* view, script_entry_t* results, uint32_t max_results) {
+    int found = script_lib_view_page(view, 0, search_handles, max_results);
+    
+    for (int i = 0; i < found; i++) {
+        script_lib_get(search_handles[i], &results[i]);
+    }
     return found;
 }
 
-// Get popular scripts from catalog
+// Search scripts in library, copying ranked results
+int script_lib_search(const char* query, script_entry_t* results, uint32_t max_results) {
+    script_view_t view;
+    
+    if (!results || !script_lib_view_open(&view, SCRIPT_VIEW_SEARCH, query)) return 0;
+    return view_copy(&view, results, max_results);
+}
+
+// Get popular scripts, by downloads then rating
 int script_lib_get_popular(script_entry_t* results, uint32_t max_results) {
-    if (!results || max_results == 0) return 0;
+    script_view_t view;
     
-    // TODO: Implement catalog query
-    // 1. Connect to catalog
-    // 2. Request popular scripts
-    // 3. Sort by downloads/rating
-    // 4. Return top results
+    if (!results || max_results == 0) return 0;
     
-    return 0;
+    // TODO: Merge in catalog popularity once the catalog is connected
+    script_lib_view_open(&view, SCRIPT_VIEW_POPULAR, 0);
+    return view_copy(&view, results, max_results);
 }
 
 // Get active scripts
 int script_lib_get_active(script_entry_t* results, uint32_t max_results) {
-    if (!results || max_results == 0) return 0;
-    
-    uint32_t found = 0;
+    script_view_t view;
     
-    for (uint32_t i = 0; i < library.entry_count && found < max_results; i++) {
-        if (library.entries[i].is_active) {
-            results[found++] = library.entries[i];
-        }
-    }
+    if (!results || max_results == 0) return 0;
     
-    return found;
+    script_lib_view_open(&view, SCRIPT_VIEW_ACTIVE, 0);
+    return view_copy(&view, results, max_results);
 }
 
 // Browse catalog by category
@@ -302,33 +1129,80 @@ int script_test(const char* script_name) {
     return 0;
 }
 
-// Package script for distribution
+// Package script for distribution. The cached body, raw bytecode or a
+// macro timeline according to meta->type, is replaced by a package
+// carrying the metadata.
 int script_package(const char* script_name, const script_meta_t* meta) {
+    static package_meta_t package_meta;
+    
     if (!script_name || !meta) return 0;
     
-    // TODO: Implement script packaging
-    // 1. Validate script
-    // 2. Create package with metadata
-    // 3. Generate checksum
+    int32_t index = name_index_find(script_name);
+    uint32_t size;
+    const void* body = index >= 0 ? script_cache_lookup(library.body_key[index], &size) : 0;
+    if (!body || (library.flags[index] & (ENTRY_ACTIVE | ENTRY_PENDING)) || meta->type == SCRIPT_TYPE_COMBO) {
+        return 0;
+    }
+    
+    mem_set(&package_meta, 0, sizeof(package_meta));
+    package_meta.type = meta->type;
+    str_copy(package_meta.name, meta->name, sizeof(package_meta.name));
+    str_copy(package_meta.author, meta->author, sizeof(package_meta.author));
+    str_copy(package_meta.version, meta->version, sizeof(package_meta.version));
+    str_copy(package_meta.game, meta->game, sizeof(package_meta.game));
+    str_copy(package_meta.description, meta->description, sizeof(package_meta.description));
     
-    return 0;
+    uint32_t package_size;
+    if (meta->type == SCRIPT_TYPE_LUA) {
+        package_size = package_build(package_buffer, sizeof(package_buffer), &package_meta,
+                                     (const uint32_t*)body, size / sizeof(uint32_t), 0, 0);
+    } else {
+        package_size = package_build(package_buffer, sizeof(package_buffer), &package_meta, 0, 0,
+                                     (const package_macro_step_t*)body, size / sizeof(package_macro_step_t));
+    }
+    
+    // Build checks nothing; the package must verify like any other
+    if (!package_size || !package_verify(package_buffer, package_size) ||
+        !script_cache_insert(library.body_key[index], package_buffer, package_size)) {
+        return 0;
+    }
+    library.size[index] = package_size;
+    library.checksum[index] = crc32(package_buffer, package_size);
+    library.flags[index] |= ENTRY_VERIFIED;
+    return 1;
 }
 
-// Validate script
+// Validate the package stored at a path
 int script_validate(const char* script_path) {
     if (!script_path) return 0;
     
-    // TODO: Implement script validation
-    // 1. Check syntax
-    // 2. Verify dependencies
-    // 3. Run security checks
+    // The library entry stored at this path
+    uint32_t index;
+    for (index = 0; index < library.entry_count; index++) {
+        if (str_compare(entry_text(index, TEXT_PATH), script_path) == 0) {
+            break;
+        }
+    }
+    if (index == library.entry_count) {
+        return 0;
+    }
     
-    return 0;
+    // Uncached bodies are read from the card, and verified as they are stored
+    const void* body = script_cache_lookup(library.body_key[index], NULL);
+    if (!body && load_body(index)) {
+        body = script_cache_lookup(library.body_key[index], NULL);
+    }
+    return body && (library.flags[index] & ENTRY_VERIFIED);
 }
 
 // Cleanup
 void script_lib_cleanup(void) {
     library.entry_count = 0;
+    library.generation++;
     library.active_count = 0;
-    library.cache_used = 0;
+    library.pending_count = 0;
+    name_index_reset();
+    text_index_reset();
+    str_arena_reset(&strings);
+    script_cache_init();
 }
@@ -27,15 +27,104 @@ typedef struct {
     char path[256];
 } script_entry_t;
 
+// Library entry handle: valid until the library is next modified
+typedef uint16_t script_handle_t;
+
+#define SCRIPT_HANDLE_NONE 0xFFFF
+
+// Library views: ranked lists of handles, paged on demand
+typedef enum {
+    SCRIPT_VIEW_ALL,        // Library order
+    SCRIPT_VIEW_ACTIVE,     // Active entries, library order
+    SCRIPT_VIEW_POPULAR,    // Downloads, then rating
+    SCRIPT_VIEW_SEARCH      // Relevance, then downloads
+} script_view_kind_t;
+
+typedef struct {
+    script_view_kind_t kind;
+    char query[64];
+    uint32_t count;         // Entries in the view
+    uint32_t generation;    // Library generation the view was counted at
+    uint32_t cursor;        // Position after the last page read
+    uint64_t cursor_key;    // Rank key of the entry before the cursor
+} script_view_t;
+
+// The library belongs to the script core. Other cores see it as pages of
+// rows: copies of the fields a list shows, with the entry's key, which
+// names it for as long as it exists (script_lib_find_key).
+#define SCRIPT_PAGE_ROWS 12
+
+typedef struct {
+    uint32_t key;
+    char name[64];
+    char author[32];
+    char description[256];
+    uint32_t downloads;
+    uint32_t rating;
+    uint8_t is_active;
+    uint8_t is_local;
+} script_row_t;
+
+// A page asked for by another core; left untouched until answered
+typedef struct {
+    script_view_kind_t kind;
+    char query[64];
+    uint32_t view_id;       // Changes whenever another list is shown
+    uint32_t first;
+} script_page_request_t;
+
+typedef struct {
+    uint32_t view_id;
+    uint32_t first;
+    uint32_t count;         // Rows filled
+    uint32_t total;         // Entries in the view
+    script_row_t rows[SCRIPT_PAGE_ROWS];
+} script_page_t;
+
+// Serving side of the pages: the view being paged and the last answer
+typedef struct {
+    script_view_t view;
+    uint32_t view_id;
+    int open;
+    script_page_t page;
+} script_pager_t;
+
 // Script library functions
 int script_lib_init(void);
 int script_lib_load_local(const char* directory);
 int script_lib_connect_catalog(const char* server_url);
+int script_lib_add(const script_entry_t* entry);
+int script_lib_remove(const char* script_name);
+script_handle_t script_lib_find(const char* script_name);
+script_handle_t script_lib_find_key(uint32_t key);
+int script_lib_row(script_handle_t handle, script_row_t* row);
+int script_lib_get(script_handle_t handle, script_entry_t* entry);
+const char* script_lib_name(script_handle_t handle);
+const char* script_lib_author(script_handle_t handle);
+const char* script_lib_version(script_handle_t handle);
+const char* script_lib_description(script_handle_t handle);
+const char* script_lib_game(script_handle_t handle);
+uint32_t script_lib_downloads(script_handle_t handle);
+uint32_t script_lib_rating(script_handle_t handle);
+int script_lib_is_active(script_handle_t handle);
+int script_lib_is_local(script_handle_t handle);
+uint32_t script_lib_generation(void);
 int script_lib_download(const char* script_name);
 int script_lib_upload(const char* script_path, const script_meta_t* meta);
 int script_lib_publish(const char* script_name);
 int script_lib_activate(const char* script_name);
 int script_lib_deactivate(const char* script_name);
+int script_lib_begin_activate(const char* script_name, uint32_t* key, const void** body, uint32_t* size);
+int script_lib_finish_activate(uint32_t key, int loaded);
+int script_lib_begin_deactivate(const char* script_name, uint32_t* key, const char** script_run);
+int script_lib_finish_deactivate(uint32_t key, int unloaded);
+int script_lib_store_body(const char* script_name, const void* body, uint32_t size);
+const void* script_lib_body(script_handle_t handle, uint32_t* size);
+int script_lib_view_open(script_view_t* view, script_view_kind_t kind, const char* query);
+uint32_t script_lib_view_count(script_view_t* view);
+int script_lib_view_page(script_view_t* view, uint32_t first, script_handle_t* handles, uint32_t max_handles);
+const script_page_t* script_lib_page(script_pager_t* pager, const script_page_request_t* request);
+int script_lib_query(const char* query, script_handle_t* handles, uint32_t max_handles);
 int script_lib_search(const char* query, script_entry_t* results, uint32_t max_results);
 int script_lib_get_popular(script_entry_t* results, uint32_t max_results);
 int script_lib_get_active(script_entry_t* results, uint32_t max_results);
@@ -0,0 +1,180 @@
+#include "smp.h"
+#include "hardware.h"
+#include "mmu.h"
+#include "profile.h"
+
+// Per-core bring-up state
+typedef struct {
+    smp_init_t init;
+    smp_step_t step;
+    volatile int running;
+} smp_core_t;
+
+static smp_core_t cores[SMP_MAX_CORES];
+
+// mailboxes[from][to]
+static mailbox_t mailboxes[SMP_MAX_CORES][SMP_MAX_CORES];
+
+#ifdef __BARE_METAL__
+// Secondary core stacks, one per core (core 0 uses the boot stack)
+uint8_t __attribute__((aligned(16))) smp_stacks[SMP_MAX_CORES][SMP_STACK_SIZE];
+
+static inline void smp_wait_event(void) { __asm__ volatile("wfe" ::: "memory"); }
+static inline void smp_send_event(void) { hal_dsb(); __asm__ volatile("sev" ::: "memory"); }
+
+// Secondary core C entry: never returns
+void smp_secondary_main(void) {
+    uint32_t core = smp_core_id();
+    smp_core_t* self = &cores[core];
+    
+    // Coprocessor access is banked per core
+    mmu_enable_cpu();
+    enable_neon();
+    profile_init();
+    
+    if (self->init) {
+        self->init();
+    }
+    self->running = 1;
+    smp_send_event();
+    
+    while (1) {
+        if (!self->step()) {
+            smp_wait_event();
+        }
+    }
+}
+
+// Secondary core entry from the boot stub: pick this core's stack
+__attribute__((naked)) static void smp_secondary_entry(void) {
+    __asm__ volatile(
+        "mrc p15, 0, r0, c0, c0, 5\n"
+        "and r0, r0, #3\n"
+        "add r0, r0, #1\n"
+        "ldr r1, =smp_stacks\n"
+        "mov r2, #16384\n"         // SMP_STACK_SIZE
+        "mla sp, r0, r2, r1\n"
+        "b smp_secondary_main\n"
+    );
+}
+
+uint32_t smp_core_id(void) {
+    uint32_t mpidr;
+    __asm__ volatile("mrc p15, 0, %0, c0, c0, 5" : "=r" (mpidr));
+    return mpidr & 3;
+}
+#else
+// Host builds run the secondary cores cooperatively from smp_service()
+static uint32_t current_core;
+
+static inline void smp_send_event(void) { }
+
+uint32_t smp_core_id(void) {
+    return current_core;
+}
+#endif
+
+// Reset mailboxes. Safe to call again once cores are running only on host.
+void smp_init(void) {
+#ifdef __BARE_METAL__
+    for (uint32_t core = 1; core < SMP_MAX_CORES; core++) {
+        if (cores[core].running) {
+            return;
+        }
+    }
+#else
+    for (uint32_t core = 0; core < SMP_MAX_CORES; core++) {
+        cores[core].init = 0;
+        cores[core].step = 0;
+        cores[core].running = 0;
+    }
+    current_core = 0;
+#endif
+    
+    for (uint32_t from = 0; from < SMP_MAX_CORES; from++) {
+        for (uint32_t to = 0; to < SMP_MAX_CORES; to++) {
+            mailbox_reset(&mailboxes[from][to]);
+        }
+    }
+}
+
+// Release a secondary core from the boot stub and give it a role.
+// Returns once the core has run init, 0 on timeout or bad arguments.
+int smp_start_core(uint32_t core, smp_init_t init, smp_step_t step) {
+    if (core == 0 || core >= SMP_MAX_CORES || !step) {
+        return 0;
+    }
+    if (cores[core].running) {
+        return cores[core].step == step;
+    }
+    
+    cores[core].init = init;
+    cores[core].step = step;
+    
+#ifdef __BARE_METAL__
+    hal_dsb();
+    *SMP_MAILBOX3_SET(core) = (uint32_t)(uintptr_t)smp_secondary_entry;
+    smp_send_event();
+    
+    uint32_t start = *TIMER_CLO;
+    while (!cores[core].running) {
+        if (*TIMER_CLO - start >= 100000) {
+            return 0;
+        }
+    }
+#else
+    current_core = core;
+    if (init) {
+        init();
+    }
+    current_core = 0;
+    cores[core].running = 1;
+#endif
+    return 1;
+}
+
+int smp_core_running(uint32_t core) {
+    return core < SMP_MAX_CORES && (core == 0 || cores[core].running);
+}
+
+// Post a message from the calling core
+int smp_send(uint32_t to, const mailbox_msg_t* msg) {
+    if (to >= SMP_MAX_CORES || !msg) {
+        return 0;
+    }
+    if (!mailbox_post(&mailboxes[smp_core_id()][to], msg)) {
+        return 0;
+    }
+    smp_send_event();
+    return 1;
+}
+
+// Take the oldest message addressed to the calling core
+int smp_receive(uint32_t from, mailbox_msg_t* msg) {
+    if (from >= SMP_MAX_CORES || !msg) {
+        return 0;
+    }
+    return mailbox_fetch(&mailboxes[from][smp_core_id()], msg);
+}
+
+// Messages refused because a mailbox was full
+uint32_t smp_dropped(uint32_t from, uint32_t to) {
+    if (from >= SMP_MAX_CORES || to >= SMP_MAX_CORES) {
+        return 0;
+    }
+    return mailboxes[from][to].dropped;
+}
+
+// Give the secondary cores a turn. Each core runs on its own on the Pi;
+// host builds have one thread and interleave the roles here instead.
+void smp_service(void) {
+#ifndef __BARE_METAL__
+    for (uint32_t core = 1; core < SMP_MAX_CORES; core++) {
+        if (cores[core].running) {
+            current_core = core;
+            cores[core].step();
+        }
+    }
+    current_core = 0;
+#endif
+}
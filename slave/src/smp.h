@@ -0,0 +1,40 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "mailbox.h"
+
+// Cortex-A53 cluster
+#define SMP_MAX_CORES       4
+#define SMP_STACK_SIZE      16384
+
+// Core roles
+#define SMP_CORE_MAIN       0   // Connection management, health, status LED
+#define SMP_CORE_INPUT      1   // USB interrupt and input forwarding
+#define SMP_CORE_SCRIPTS    2   // Script and library jobs
+#define SMP_CORE_GUI        3   // GUI rendering, telemetry and tuning
+
+// ARM local mailbox 3: the boot stub parks secondary cores until their
+// set register holds an entry address
+#define SMP_MAILBOX3_SET(n) HAL_REG(0x4000008C + (n) * 0x10)
+#define SMP_MAILBOX3_CLR(n) HAL_REG(0x400000CC + (n) * 0x10)
+
+// Core setup, run once on the core before its loop
+typedef void (*smp_init_t)(void);
+
+// One pass of a core's work loop. Returns nonzero if it did anything;
+// an idle core sleeps until the next event.
+typedef int (*smp_step_t)(void);
+
+// Function Prototypes
+void smp_init(void);
+int smp_start_core(uint32_t core, smp_init_t init, smp_step_t step);
+int smp_core_running(uint32_t core);
+uint32_t smp_core_id(void);
+int smp_send(uint32_t to, const mailbox_msg_t* msg);
+int smp_receive(uint32_t from, mailbox_msg_t* msg);
+uint32_t smp_dropped(uint32_t from, uint32_t to);
+void smp_service(void);
+
+#endif // SMP_H
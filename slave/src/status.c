@@ -1,150 +1,162 @@
 #include "status.h"
+#include "hardware.h"
 
 // Hardware registers for GPIO
-#define MMIO_BASE       0x3F000000UL
 #define GPIO_BASE       (MMIO_BASE + 0x200000)
-#define GPIO_GPFSEL4    ((volatile uint32_t*)(GPIO_BASE + 0x10))
-#define GPIO_GPSET1     ((volatile uint32_t*)(GPIO_BASE + 0x20))
-#define GPIO_GPCLR1     ((volatile uint32_t*)(GPIO_BASE + 0x2C))
+#define GPIO_GPFSEL4    HAL_REG(GPIO_BASE + 0x10)
+#define GPIO_GPSET1     HAL_REG(GPIO_BASE + 0x20)
+#define GPIO_GPCLR1     HAL_REG(GPIO_BASE + 0x2C)
 
 // HDMI registers
 #define HDMI_BASE       (MMIO_BASE + 0x902000)
-#define HDMI_STATUS     ((volatile uint32_t*)(HDMI_BASE + 0x004))
-
-static volatile uint32_t current_time = 0;
+#define HDMI_STATUS     HAL_REG(HDMI_BASE + 0x004)
+
+// One step of a blink pattern: LED level held for a duration (0 = hold forever)
+typedef struct {
+    uint8_t level;
+    uint32_t duration_us;
+} led_phase_t;
+
+// Pattern tables
+static const led_phase_t phases_single[] = {
+    {1, LED_BLINK_ON}, {0, LED_PATTERN_GAP}
+};
+static const led_phase_t phases_double[] = {
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF + LED_PATTERN_GAP}
+};
+static const led_phase_t phases_triple[] = {
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF + LED_PATTERN_GAP}
+};
+static const led_phase_t phases_quad[] = {
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF},
+    {1, LED_BLINK_ON}, {0, LED_BLINK_OFF + LED_PATTERN_GAP}
+};
+static const led_phase_t phases_steady[] = {
+    {1, 0}
+};
+static const led_phase_t phases_error[] = {
+    {1, LED_ERROR_SPEED}, {0, LED_ERROR_SPEED}
+};
+
+// Pulse on-time is ramped per cycle; the table holds the starting values
+static led_phase_t phases_pulse[] = {
+    {1, LED_PULSE_MIN}, {0, LED_PULSE_MIN}
+};
+
+#define PHASES(p) { p, sizeof(p) / sizeof(p[0]) }
+
+static const struct {
+    const led_phase_t* phases;
+    uint32_t count;
+} patterns[] = {
+    [LED_STATE_INIT]      = PHASES(phases_single),
+    [LED_STATE_HDMI_WAIT] = PHASES(phases_double),
+    [LED_STATE_PS5_WAIT]  = PHASES(phases_triple),
+    [LED_STATE_CTRL_WAIT] = PHASES(phases_quad),
+    [LED_STATE_READY]     = PHASES(phases_steady),
+    [LED_STATE_ERROR]     = PHASES(phases_error),
+    [LED_STATE_ACTIVE]    = PHASES(phases_pulse)
+};
+
+// Pattern engine state
 static led_state_t current_state = LED_STATE_INIT;
 static uint32_t pattern_position = 0;
-
-// Simple delay function
-static inline void delay(uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        __asm__ __volatile__("nop");
-        current_time++;
+static uint32_t phase_start = 0;
+static uint8_t led_level = 0;
+static int pulse_increasing = 1;
+
+// LED control: only touch GPIO on a level change
+static void led_set(uint8_t level) {
+    if (level == led_level) return;
+    led_level = level;
+    if (level) {
+        *GPIO_GPSET1 = 1UL << 15;  // GPIO 47
+    } else {
+        *GPIO_GPCLR1 = 1UL << 15;  // GPIO 47
     }
 }
 
-// LED control functions
-static void led_on(void) {
-    *GPIO_GPSET1 = 1UL << 15;  // GPIO 47
+// Restart the current pattern from its first phase
+static void pattern_start(uint32_t now) {
+    pattern_position = 0;
+    phase_start = now;
+    led_set(patterns[current_state].phases[0].level);
 }
 
-static void led_off(void) {
-    *GPIO_GPCLR1 = 1UL << 15;  // GPIO 47
+// Ramp the pulse on-time once per cycle
+static void pulse_step(void) {
+    uint32_t pulse_time = phases_pulse[0].duration_us;
+    
+    if (pulse_increasing) {
+        pulse_time += 10000;
+        if (pulse_time >= LED_PULSE_MAX) {
+            pulse_increasing = 0;
+        }
+    } else {
+        pulse_time -= 10000;
+        if (pulse_time <= LED_PULSE_MIN) {
+            pulse_increasing = 1;
+        }
+    }
+    phases_pulse[0].duration_us = pulse_time;
 }
 
 // Initialize GPIO for status LED
-void status_init(void) {
+int status_init(void) {
     // Configure GPIO 47 as output
     *GPIO_GPFSEL4 = (*GPIO_GPFSEL4 & ~(7UL << 21)) | (1UL << 21);
+    
+    led_level = 0xFF;  // Force the first write
+    current_state = LED_STATE_INIT;
+    pattern_start(*TIMER_CLO);
+    return 1;
 }
 
 // Check HDMI connection status
-static int hdmi_connected(void) {
+int status_hdmi_connected(void) {
     return (*HDMI_STATUS & 0x1) != 0;
 }
 
-// Pattern implementations
-static void pattern_single(void) {
-    led_on();
-    delay(LED_BLINK_ON);
-    led_off();
-    delay(LED_PATTERN_GAP);
-}
-
-static void pattern_double(void) {
-    for (int i = 0; i < 2; i++) {
-        led_on();
-        delay(LED_BLINK_ON);
-        led_off();
-        delay(LED_BLINK_OFF);
-    }
-    delay(LED_PATTERN_GAP);
-}
-
-static void pattern_triple(void) {
-    for (int i = 0; i < 3; i++) {
-        led_on();
-        delay(LED_BLINK_ON);
-        led_off();
-        delay(LED_BLINK_OFF);
-    }
-    delay(LED_PATTERN_GAP);
-}
-
-static void pattern_quad(void) {
-    for (int i = 0; i < 4; i++) {
-        led_on();
-        delay(LED_BLINK_ON);
-        led_off();
-        delay(LED_BLINK_OFF);
+// Advance the LED pattern. Never blocks: one timer read and a compare
+// unless a phase boundary has been reached.
+void status_update(led_state_t state) {
+    uint32_t now = *TIMER_CLO;
+    
+    if (state != current_state) {
+        current_state = state;
+        pattern_start(now);
+        return;
     }
-    delay(LED_PATTERN_GAP);
-}
-
-static void pattern_steady(void) {
-    led_on();
-}
-
-static void pattern_error(void) {
-    led_on();
-    delay(LED_ERROR_SPEED);
-    led_off();
-    delay(LED_ERROR_SPEED);
-}
-
-static void pattern_pulse(void) {
-    // Pulse LED smoothly
-    static uint32_t pulse_time = LED_PULSE_MIN;
-    static int increasing = 1;
     
-    led_on();
-    delay(pulse_time);
-    led_off();
-    delay(LED_PULSE_MIN);
+    const led_phase_t* phase = &patterns[state].phases[pattern_position];
+    if (phase->duration_us == 0 || now - phase_start < phase->duration_us) {
+        return;
+    }
     
-    if (increasing) {
-        pulse_time += 10000;
-        if (pulse_time >= LED_PULSE_MAX) {
-            increasing = 0;
-        }
-    } else {
-        pulse_time -= 10000;
-        if (pulse_time <= LED_PULSE_MIN) {
-            increasing = 1;
-        }
+    phase_start += phase->duration_us;
+    if (now - phase_start >= phase->duration_us) {
+        // Fell more than a phase behind, resync instead of replaying
+        phase_start = now;
     }
-}
-
-// Update LED pattern based on state
-void status_update(led_state_t state) {
-    current_state = state;
     
-    switch (state) {
-        case LED_STATE_INIT:
-            pattern_single();
-            break;
-        case LED_STATE_HDMI_WAIT:
-            pattern_double();
-            break;
-        case LED_STATE_PS5_WAIT:
-            pattern_triple();
-            break;
-        case LED_STATE_CTRL_WAIT:
-            pattern_quad();
-            break;
-        case LED_STATE_READY:
-            pattern_steady();
-            break;
-        case LED_STATE_ERROR:
-            pattern_error();
-            break;
-        case LED_STATE_ACTIVE:
-            pattern_pulse();
-            break;
+    if (++pattern_position >= patterns[state].count) {
+        pattern_position = 0;
+        if (state == LED_STATE_ACTIVE) {
+            pulse_step();
+        }
     }
+    led_set(patterns[state].phases[pattern_position].level);
 }
 
 // Set error state
 void status_set_error(void) {
-    current_state = LED_STATE_ERROR;
+    if (current_state != LED_STATE_ERROR) {
+        current_state = LED_STATE_ERROR;
+        pattern_start(*TIMER_CLO);
+    }
 }
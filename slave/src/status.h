@@ -23,8 +23,9 @@ typedef enum {
 #define LED_PULSE_MAX        200000   // Maximum brightness time
 
 // Function Prototypes
-void status_init(void);
+int status_init(void);
 void status_update(led_state_t state);
 void status_set_error(void);
+int status_hdmi_connected(void);
 
 #endif // STATUS_H
@@ -0,0 +1,142 @@
+#include "str_arena.h"
+#include "util.h"
+
+static inline str_record_t* record(str_arena_t* arena, str_ref_t ref) {
+    return (str_record_t*)&arena->data[ref];
+}
+
+// Table slot holding a text, or the free slot where it belongs
+static uint32_t table_slot(str_arena_t* arena, const char* text, uint32_t hash) {
+    uint32_t slot = hash & (STR_ARENA_SLOTS - 1);
+    
+    while (arena->table[slot]) {
+        str_ref_t ref = arena->table[slot];
+        if (record(arena, ref)->hash == hash && str_compare(str_arena_get(arena, ref), text) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (STR_ARENA_SLOTS - 1);
+    }
+    return slot;
+}
+
+// Free a table slot, shifting later members of its probe run back
+static void table_delete(str_arena_t* arena, uint32_t slot) {
+    uint32_t hole = slot;
+    
+    for (uint32_t next = (slot + 1) & (STR_ARENA_SLOTS - 1); arena->table[next];
+         next = (next + 1) & (STR_ARENA_SLOTS - 1)) {
+        uint32_t home = record(arena, arena->table[next])->hash & (STR_ARENA_SLOTS - 1);
+        if (((next - home) & (STR_ARENA_SLOTS - 1)) >= ((next - hole) & (STR_ARENA_SLOTS - 1))) {
+            arena->table[hole] = arena->table[next];
+            hole = next;
+        }
+    }
+    arena->table[hole] = 0;
+}
+
+// Empty the arena. Offset 0 stays reserved for the empty string.
+void str_arena_reset(str_arena_t* arena) {
+    mem_set(arena->table, 0, sizeof(arena->table));
+    arena->data[0] = 0;
+    arena->used = sizeof(str_record_t);
+    arena->live = 0;
+    arena->records = 0;
+}
+
+// Reference to a shared copy of a text, or STR_REF_NONE if it does not fit.
+// refs lists every reference the caller holds, in case the arena has to be
+// compacted to make room.
+str_ref_t str_arena_intern(str_arena_t* arena, const char* text, str_ref_t* refs, uint32_t ref_count) {
+    if (!*text) {
+        return STR_REF_EMPTY;
+    }
+    
+    uint32_t hash = str_hash(text);
+    uint32_t slot = table_slot(arena, text, hash);
+    if (arena->table[slot]) {
+        str_record_t* existing = record(arena, arena->table[slot]);
+        if (existing->refs == UINT16_MAX) {
+            return STR_REF_NONE;
+        }
+        existing->refs++;
+        return arena->table[slot];
+    }
+    
+    uint32_t size = (sizeof(str_record_t) + str_len(text) + 1 + 3) & ~3u;
+    if (size > UINT16_MAX) {
+        return STR_REF_NONE;
+    }
+    if (arena->used + size > STR_ARENA_SIZE) {
+        if (arena->live + sizeof(str_record_t) + size > STR_ARENA_SIZE) {
+            return STR_REF_NONE;
+        }
+        str_arena_compact(arena, refs, ref_count);
+        slot = table_slot(arena, text, hash);
+    }
+    
+    // Keep the table at most three quarters full
+    if (arena->records >= STR_ARENA_SLOTS * 3 / 4) {
+        return STR_REF_NONE;
+    }
+    
+    str_ref_t ref = arena->used;
+    str_record_t* rec = record(arena, ref);
+    rec->hash = hash;
+    rec->refs = 1;
+    rec->size = (uint16_t)size;
+    str_copy((char*)(rec + 1), text, size - sizeof(str_record_t));
+    arena->used += size;
+    arena->live += size;
+    arena->records++;
+    arena->table[slot] = ref;
+    return ref;
+}
+
+// Drop one reference
+void str_arena_release(str_arena_t* arena, str_ref_t ref) {
+    if (ref == STR_REF_EMPTY) {
+        return;
+    }
+    
+    str_record_t* rec = record(arena, ref);
+    if (--rec->refs == 0) {
+        table_delete(arena, table_slot(arena, str_arena_get(arena, ref), rec->hash));
+        arena->live -= rec->size;
+        arena->records--;
+    }
+}
+
+// Slide live records down over released ones and rewrite refs
+void str_arena_compact(str_arena_t* arena, str_ref_t* refs, uint32_t ref_count) {
+    // Forwarding offsets go in the hash field until the move is done
+    uint32_t to = sizeof(str_record_t);
+    for (uint32_t from = sizeof(str_record_t); from < arena->used; from += record(arena, from)->size) {
+        str_record_t* rec = record(arena, from);
+        if (rec->refs) {
+            rec->hash = to;
+            to += rec->size;
+        }
+    }
+    
+    for (uint32_t i = 0; i < ref_count; i++) {
+        if (refs[i] != STR_REF_EMPTY) {
+            refs[i] = record(arena, refs[i])->hash;
+        }
+    }
+    
+    mem_set(arena->table, 0, sizeof(arena->table));
+    uint32_t from = sizeof(str_record_t);
+    while (from < arena->used) {
+        str_record_t* rec = record(arena, from);
+        uint32_t size = rec->size;
+        if (rec->refs) {
+            str_ref_t ref = rec->hash;
+            mem_copy(&arena->data[ref], rec, size);
+            rec = record(arena, ref);
+            rec->hash = str_hash(str_arena_get(arena, ref));
+            arena->table[table_slot(arena, str_arena_get(arena, ref), rec->hash)] = ref;
+        }
+        from += size;
+    }
+    arena->used = to;
+}
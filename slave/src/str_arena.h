@@ -0,0 +1,48 @@
+#ifndef STR_ARENA_H
+#define STR_ARENA_H
+
+#include <stdint.h>
+
+// Interned string arena
+//
+// Strings are stored once in a bump-allocated buffer and shared by
+// reference count; a hash table finds an existing copy before a new one is
+// made. Released strings are reclaimed by sliding the live ones down when
+// the arena fills, which rewrites the caller's references in place.
+
+#define STR_ARENA_SIZE    (160 * 1024)
+#define STR_ARENA_SLOTS   8192          // Power of two, intern table
+
+// Offset of a string record; 0 is the empty string
+typedef uint32_t str_ref_t;
+
+#define STR_REF_EMPTY     0
+#define STR_REF_NONE      0xFFFFFFFFu   // Allocation failed
+
+// Record header, followed by the text and its terminator
+typedef struct {
+    uint32_t hash;      // str_hash of the text
+    uint16_t refs;      // 0 once released
+    uint16_t size;      // Record bytes including header, multiple of 4
+} str_record_t;
+
+typedef struct {
+    uint8_t data[STR_ARENA_SIZE];
+    uint32_t used;                        // Bump offset
+    uint32_t live;                        // Bytes in referenced records
+    uint32_t records;                     // Referenced records
+    str_ref_t table[STR_ARENA_SLOTS];     // Open addressing, 0 = free
+} str_arena_t;
+
+// Function Prototypes
+void str_arena_reset(str_arena_t* arena);
+str_ref_t str_arena_intern(str_arena_t* arena, const char* text, str_ref_t* refs, uint32_t ref_count);
+void str_arena_release(str_arena_t* arena, str_ref_t ref);
+void str_arena_compact(str_arena_t* arena, str_ref_t* refs, uint32_t ref_count);
+
+// Text of a reference
+static inline const char* str_arena_get(const str_arena_t* arena, str_ref_t ref) {
+    return (const char*)&arena->data[ref + (ref ? sizeof(str_record_t) : 0)];
+}
+
+#endif // STR_ARENA_H
@@ -0,0 +1,264 @@
+#include "telemetry.h"
+#include "uart.h"
+#include "crc32.h"
+#include "usb.h"
+#include "profile.h"
+#include "smp.h"
+#include "dma.h"
+
+// Ring drained by the DMA engine; a power of two
+#define TELEMETRY_RING_SIZE     16384
+
+// Channel 5 is free of the boot firmware's reservations and of the
+// memory-to-memory engine (dma.c)
+#define TELEMETRY_DMA_CHANNEL   5
+#define TELEMETRY_DMA_CS        DMA_CHANNEL_CS(TELEMETRY_DMA_CHANNEL)
+#define TELEMETRY_DMA_CONBLK    DMA_CHANNEL_CONBLK(TELEMETRY_DMA_CHANNEL)
+
+// Byte-wide writes to the UART data register, one per TX DREQ
+#define TELEMETRY_DMA_TI        (DMA_TI_SRC_INC | DMA_TI_DEST_DREQ | DMA_TI_WAIT_RESP | \
+                                 DMA_TI_PERMAP(DMA_DREQ_UART_TX))
+
+// Ring and control blocks are read by the engine from the non-cacheable
+// section, so no cache maintenance is needed
+static uint8_t HAL_DMA_BUFFER ring[TELEMETRY_RING_SIZE];
+static dma_cb_t HAL_DMA_BUFFER control_blocks[2];   // Second one for the wrap
+
+static struct {
+    int ready;
+    uint32_t head;              // Next byte written (free-running)
+    uint32_t tail;              // Oldest byte not yet sent
+    uint32_t in_flight_end;     // End of the DMA transfer in progress
+    int busy;                   // Transfer in progress
+    uint32_t seq;
+    telemetry_counters_t counters;
+} tx;
+
+// Bucket list for latency records
+static telemetry_bucket_t bucket_buffer[LATENCY_HIST_BUCKETS];
+
+// Bring up the UART and the DMA channel feeding it
+int telemetry_init(uint32_t baud) {
+    __builtin_memset(&tx, 0, sizeof(tx));
+    if (!uart_init(baud)) {
+        return 0;
+    }
+
+    *DMA_ENABLE |= 1u << TELEMETRY_DMA_CHANNEL;
+    *TELEMETRY_DMA_CS = DMA_CS_RESET;
+    while (*TELEMETRY_DMA_CS & DMA_CS_RESET) {
+        // Channel reset
+    }
+    *TELEMETRY_DMA_CS = DMA_CS_END | DMA_CS_INT;
+    uart_dma_enable(1);
+
+    tx.ready = 1;
+    return 1;
+}
+
+// Copy into the ring, wrapping at the end
+static void ring_put(const void* data, uint32_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t offset = tx.head & (TELEMETRY_RING_SIZE - 1);
+    uint32_t first = TELEMETRY_RING_SIZE - offset;
+    if (first > size) {
+        first = size;
+    }
+    __builtin_memcpy(&ring[offset], bytes, first);
+    __builtin_memcpy(ring, bytes + first, size - first);
+    tx.head += size;
+}
+
+// Frame a record from a fixed part and an optional tail, or drop it
+static int send_record(telemetry_record_type_t type, const void* body, uint32_t body_length,
+                       const void* tail, uint32_t tail_length) {
+    uint32_t length = body_length + tail_length;
+    uint32_t seq = tx.seq++;
+    uint32_t frame = sizeof(telemetry_header_t) + length + sizeof(uint32_t);
+
+    if (!tx.ready || length > TELEMETRY_MAX_PAYLOAD ||
+        frame > TELEMETRY_RING_SIZE - (tx.head - tx.tail)) {
+        tx.counters.records_dropped++;
+        return 0;
+    }
+
+    telemetry_header_t header = {
+        TELEMETRY_SYNC, (uint8_t)type, (uint16_t)length, seq, (uint32_t)get_system_time()
+    };
+    uint32_t crc = crc32_update(0, &header, sizeof(header));
+    crc = crc32_update(crc, body, body_length);
+    ring_put(&header, sizeof(header));
+    ring_put(body, body_length);
+    if (tail_length) {
+        crc = crc32_update(crc, tail, tail_length);
+        ring_put(tail, tail_length);
+    }
+    ring_put(&crc, sizeof(crc));
+    tx.counters.records_sent++;
+    return 1;
+}
+
+int telemetry_send(telemetry_record_type_t type, const void* payload, uint32_t length) {
+    return send_record(type, payload, length, 0, 0);
+}
+
+// Point a control block at part of the ring
+static void fill_cb(dma_cb_t* cb, uint32_t offset, uint32_t length) {
+    cb->ti = TELEMETRY_DMA_TI;
+    cb->source_ad = hal_bus_addr(&ring[offset]);
+    cb->dest_ad = UART0_DR_BUS;
+    cb->txfr_len = length;
+    cb->stride = 0;
+    cb->nextconbk = 0;
+}
+
+// Retire a finished transfer and start the next one. Call often: it is a
+// register read when the channel is busy. Returns 1 while bytes are queued.
+int telemetry_pump(void) {
+    if (!tx.ready) {
+        return 0;
+    }
+
+    if (tx.busy) {
+        if (*TELEMETRY_DMA_CS & DMA_CS_ACTIVE) {
+            return 1;
+        }
+        tx.tail = tx.in_flight_end;
+        tx.busy = 0;
+    }
+
+    uint32_t pending = tx.head - tx.tail;
+    if (pending == 0) {
+        return 0;
+    }
+
+    // Everything queued, as one block or two if it wraps
+    uint32_t offset = tx.tail & (TELEMETRY_RING_SIZE - 1);
+    uint32_t first = TELEMETRY_RING_SIZE - offset;
+    if (first >= pending) {
+        fill_cb(&control_blocks[0], offset, pending);
+    } else {
+        fill_cb(&control_blocks[0], offset, first);
+        fill_cb(&control_blocks[1], 0, pending - first);
+        control_blocks[0].nextconbk = hal_bus_addr(&control_blocks[1]);
+    }
+    hal_dsb();
+
+    *TELEMETRY_DMA_CS = DMA_CS_END;
+    *TELEMETRY_DMA_CONBLK = hal_bus_addr(&control_blocks[0]);
+    *TELEMETRY_DMA_CS = DMA_CS_ACTIVE;
+
+    tx.in_flight_end = tx.head;
+    tx.busy = 1;
+    tx.counters.bytes_sent += pending;
+    tx.counters.transfers++;
+    return 1;
+}
+
+void telemetry_get_counters(telemetry_counters_t* counters) {
+    if (counters) {
+        *counters = tx.counters;
+    }
+}
+
+// Text record; fits profile_write_t, so profile_dump(telemetry_text) works
+void telemetry_text(const char* text, uint32_t length) {
+    send_record(TELEMETRY_REC_TEXT, text, length, 0, 0);
+}
+
+// Length of a name as sent
+static uint32_t name_length(const char* name) {
+    uint32_t length = 0;
+    while (name && name[length] && length < TELEMETRY_NAME_MAX) {
+        length++;
+    }
+    return length;
+}
+
+static void send_latency(latency_stage_t stage) {
+    const latency_hist_t* hist = optimize_get_latency(stage);
+    telemetry_latency_t record = { (uint8_t)stage, 0, 0, hist->count, hist->max_us };
+
+    for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        if (hist->buckets[i]) {
+            bucket_buffer[record.bucket_count].index = (uint16_t)i;
+            bucket_buffer[record.bucket_count].count = hist->buckets[i];
+            record.bucket_count++;
+        }
+    }
+    send_record(TELEMETRY_REC_LATENCY, &record, sizeof(record),
+                bucket_buffer, record.bucket_count * sizeof(telemetry_bucket_t));
+}
+
+// Stats snapshot, stage latency histograms, one record per script and the
+// USB counters. The scripts are a snapshot taken where they run
+// (script_snapshot), never the live contexts.
+void telemetry_send_pipeline(const performance_stats_t* stats, const script_snapshot_t* scripts,
+                             uint32_t script_count) {
+    telemetry_stats_t record = {
+        .frames_processed = stats->frames_processed,
+        .frames_dropped = stats->frames_dropped,
+        .input_errors = stats->input_errors,
+        .output_errors = stats->output_errors,
+        .buffer_overruns = stats->buffer_overruns,
+        .input_latency_us = stats->input_latency_us,
+        .output_latency_us = stats->output_latency_us,
+        .temperature = stats->temperature,
+        .voltage_mv = stats->voltage_mv,
+        .cpu_permille = (uint32_t)(stats->cpu_usage * 10.0f),
+        .uptime_ms = stats->uptime_ms,
+        .records_dropped = tx.counters.records_dropped
+    };
+    send_record(TELEMETRY_REC_STATS, &record, sizeof(record), 0, 0);
+
+    for (uint32_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        send_latency((latency_stage_t)stage);
+    }
+
+    for (uint32_t i = 0; i < script_count; i++) {
+        const script_context_t* ctx = &scripts[i].context;
+        telemetry_script_t script = {
+            .type = (uint8_t)ctx->type,
+            .demotion = (uint8_t)ctx->demotion,
+            .priority = ctx->priority,
+            .exec_count = ctx->exec_count,
+            .exec_time_us = ctx->exec_time_us,
+            .budget_ops = ctx->budget_ops,
+            .overruns = ctx->overruns,
+            .deferrals = ctx->deferrals,
+            .exec_cycles = ctx->exec_cycles
+        };
+        send_record(TELEMETRY_REC_SCRIPT, &script, sizeof(script), scripts[i].name, name_length(scripts[i].name));
+    }
+
+    usb_stats_t usb;
+    usb_get_stats(&usb);
+    telemetry_usb_t usb_record = {
+        usb.in_reports, usb.in_naks, usb.in_errors, usb.out_transfers, usb.out_failures
+    };
+    send_record(TELEMETRY_REC_USB, &usb_record, sizeof(usb_record), 0, 0);
+}
+
+// Every profiling zone that ran, on every core
+void telemetry_send_profile(void) {
+    for (uint32_t core = 0; core < SMP_MAX_CORES; core++) {
+        for (uint32_t zone = 0; zone < PROFILE_ZONE_COUNT; zone++) {
+            profile_zone_stats_t stats;
+            if (!profile_get(core, (profile_zone_t)zone, &stats) || stats.count == 0) {
+                continue;
+            }
+            telemetry_profile_t record = {
+                .core = (uint8_t)core,
+                .zone = (uint8_t)zone,
+                .count = stats.count,
+                .cycles = stats.cycles,
+                .self_cycles = stats.self_cycles,
+                .p50_cycles = latency_hist_percentile(&stats.hist, 500),
+                .p99_cycles = latency_hist_percentile(&stats.hist, 990),
+                .max_cycles = stats.hist.max_us
+            };
+            const char* name = profile_zone_name((profile_zone_t)zone);
+            send_record(TELEMETRY_REC_PROFILE, &record, sizeof(record), name, name_length(name));
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "optimize.h"
+#include "script.h"
+
+// Binary telemetry stream over UART0
+//
+// Records are framed and queued in a ring in the DMA section; a DMA
+// channel paced by the UART's TX DREQ drains it, so sending a record costs
+// a copy and a CRC and never waits for the line. A record that does not
+// fit is dropped and counted, and the gap shows in the sequence numbers.
+// Records may only be sent from one core at a time (the GUI core).
+//
+// Wire format, little-endian:
+//   telemetry_header_t, payload (header.length bytes), CRC-32 (crc32.h)
+//   over header and payload.
+// tools/tlm decodes a captured stream to CSV or JSON.
+
+#define TELEMETRY_SYNC          0xA5
+#define TELEMETRY_MAX_PAYLOAD   4096
+#define TELEMETRY_NAME_MAX      63      // Trailing names are cut to this
+
+typedef enum {
+    TELEMETRY_REC_STATS = 1,    // telemetry_stats_t
+    TELEMETRY_REC_LATENCY,      // telemetry_latency_t + bucket_count telemetry_bucket_t
+    TELEMETRY_REC_SCRIPT,       // telemetry_script_t + name
+    TELEMETRY_REC_USB,          // telemetry_usb_t
+    TELEMETRY_REC_PROFILE,      // telemetry_profile_t + zone name
+    TELEMETRY_REC_TEXT,         // Text, no terminator
+    TELEMETRY_REC_COUNT
+} telemetry_record_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t sync;               // TELEMETRY_SYNC
+    uint8_t type;               // telemetry_record_type_t
+    uint16_t length;            // Payload bytes
+    uint32_t seq;               // Per record, including dropped ones
+    uint32_t time_us;           // System timer, low 32 bits
+} telemetry_header_t;
+
+// Pipeline counters from performance_stats_t
+typedef struct __attribute__((packed)) {
+    uint32_t frames_processed;
+    uint32_t frames_dropped;
+    uint32_t input_errors;
+    uint32_t output_errors;
+    uint32_t buffer_overruns;
+    uint32_t input_latency_us;
+    uint32_t output_latency_us;
+    uint32_t temperature;
+    uint32_t voltage_mv;
+    uint32_t cpu_permille;
+    uint32_t uptime_ms;
+    uint32_t records_dropped;   // Telemetry records lost to a full ring
+} telemetry_stats_t;
+
+// Latency histogram (latency_hist.h), non-empty buckets only
+typedef struct __attribute__((packed)) {
+    uint8_t stage;              // latency_stage_t
+    uint8_t reserved;
+    uint16_t bucket_count;
+    uint32_t samples;
+    uint32_t max_us;
+} telemetry_latency_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t index;
+    uint32_t count;
+} telemetry_bucket_t;
+
+// One loaded script
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // script_type_t
+    uint8_t demotion;
+    uint16_t reserved;
+    uint32_t priority;
+    uint32_t exec_count;
+    uint32_t exec_time_us;      // Last run
+    uint32_t budget_ops;
+    uint32_t overruns;
+    uint32_t deferrals;
+    uint64_t exec_cycles;
+} telemetry_script_t;
+
+// USB transfer counters (usb_stats_t)
+typedef struct __attribute__((packed)) {
+    uint32_t in_reports;
+    uint32_t in_naks;
+    uint32_t in_errors;
+    uint32_t out_transfers;
+    uint32_t out_failures;
+} telemetry_usb_t;
+
+// One profiling zone on one core (profile.h)
+typedef struct __attribute__((packed)) {
+    uint8_t core;
+    uint8_t zone;               // profile_zone_t
+    uint16_t reserved;
+    uint32_t count;
+    uint64_t cycles;
+    uint64_t self_cycles;
+    uint32_t p50_cycles;
+    uint32_t p99_cycles;
+    uint32_t max_cycles;
+} telemetry_profile_t;
+
+// Sender counters
+typedef struct {
+    uint32_t records_sent;      // Queued for the UART
+    uint32_t records_dropped;   // Ring full
+    uint32_t bytes_sent;        // Handed to the DMA engine
+    uint32_t transfers;         // DMA transfers started
+} telemetry_counters_t;
+
+// Function Prototypes
+int telemetry_init(uint32_t baud);
+int telemetry_send(telemetry_record_type_t type, const void* payload, uint32_t length);
+int telemetry_pump(void);
+void telemetry_get_counters(telemetry_counters_t* counters);
+void telemetry_text(const char* text, uint32_t length);
+void telemetry_send_pipeline(const performance_stats_t* stats, const script_snapshot_t* scripts,
+                             uint32_t script_count);
+void telemetry_send_profile(void);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,209 @@
+#include "timeline.h"
+
+// Largest step: delay, mask, buttons, four sticks, two triggers and two
+// touch points
+#define STEP_MAX    (5 + 1 + 2 + 4 + 2 + 2 * (1 + 3 + 3))
+// Closing step: delay and an empty mask, always kept free
+#define END_MAX     (5 + 1)
+// Longest hold a single step carries; longer gaps get empty steps
+#define DELAY_MAX   0x7FFFFFFFUL
+
+static uint32_t put_varint(uint8_t* out, uint32_t value) {
+    uint32_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+static uint32_t get_varint(const uint8_t* data, uint32_t* position) {
+    uint32_t value = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = data[(*position)++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 35);
+    return value;
+}
+
+static inline uint16_t buttons_mask(const ps5_buttons_t* buttons) {
+    uint16_t mask;
+    __builtin_memcpy(&mask, buttons, sizeof(mask));
+    return mask;
+}
+
+static inline int touch_equal(const ps5_touch_point_t* a, const ps5_touch_point_t* b) {
+    return a->active == b->active && a->id == b->id && a->x == b->x && a->y == b->y;
+}
+
+// Fields of next that differ from last
+static uint32_t diff_mask(const ps5_state_t* last, const ps5_state_t* next) {
+    uint32_t mask = 0;
+    if (buttons_mask(&last->buttons) != buttons_mask(&next->buttons)) mask |= TIMELINE_BUTTONS;
+    if (last->sticks.lx != next->sticks.lx) mask |= TIMELINE_LX;
+    if (last->sticks.ly != next->sticks.ly) mask |= TIMELINE_LY;
+    if (last->sticks.rx != next->sticks.rx) mask |= TIMELINE_RX;
+    if (last->sticks.ry != next->sticks.ry) mask |= TIMELINE_RY;
+    if (last->triggers.l2 != next->triggers.l2) mask |= TIMELINE_L2;
+    if (last->triggers.r2 != next->triggers.r2) mask |= TIMELINE_R2;
+    if (!touch_equal(&last->touch[0], &next->touch[0]) ||
+        !touch_equal(&last->touch[1], &next->touch[1])) mask |= TIMELINE_TOUCH;
+    return mask;
+}
+
+// Append one step unless it would eat into the closing step's space
+static int emit_step(timeline_writer_t* writer, uint32_t delay, uint32_t mask, const ps5_state_t* state) {
+    uint8_t step[STEP_MAX];
+    uint32_t length = put_varint(step, delay);
+    step[length++] = (uint8_t)mask;
+    
+    if (mask & TIMELINE_BUTTONS) {
+        uint16_t buttons = buttons_mask(&state->buttons);
+        step[length++] = (uint8_t)buttons;
+        step[length++] = (uint8_t)(buttons >> 8);
+    }
+    if (mask & TIMELINE_LX) step[length++] = state->sticks.lx;
+    if (mask & TIMELINE_LY) step[length++] = state->sticks.ly;
+    if (mask & TIMELINE_RX) step[length++] = state->sticks.rx;
+    if (mask & TIMELINE_RY) step[length++] = state->sticks.ry;
+    if (mask & TIMELINE_L2) step[length++] = state->triggers.l2;
+    if (mask & TIMELINE_R2) step[length++] = state->triggers.r2;
+    if (mask & TIMELINE_TOUCH) {
+        for (uint32_t i = 0; i < 2; i++) {
+            step[length++] = (uint8_t)(state->touch[i].active | (state->touch[i].id << 1));
+            length += put_varint(step + length, state->touch[i].x);
+            length += put_varint(step + length, state->touch[i].y);
+        }
+    }
+    
+    if (writer->size + length + END_MAX > writer->capacity) {
+        return 0;
+    }
+    __builtin_memcpy(writer->data + writer->size, step, length);
+    writer->size += length;
+    writer->steps++;
+    writer->last_step_us += delay;
+    if (mask) {
+        writer->last = *state;
+    }
+    return 1;
+}
+
+void timeline_writer_init(timeline_writer_t* writer, uint8_t* buffer, uint32_t capacity) {
+    __builtin_memset(writer, 0, sizeof(*writer));
+    writer->data = buffer;
+    writer->capacity = capacity;
+}
+
+// Add a sample. The first sample is time zero. Returns 0 once the buffer
+// is full; the recording then ends at that sample.
+int timeline_write(timeline_writer_t* writer, const ps5_state_t* state, uint64_t now_us) {
+    if (writer->full) {
+        return 0;
+    }
+    if (!writer->started) {
+        writer->started = 1;
+        writer->last_step_us = now_us;
+    }
+    
+    if (now_us < writer->last_step_us) {
+        now_us = writer->last_step_us;
+    }
+    
+    // Holds longer than one step can carry are split with empty steps
+    uint32_t mask = diff_mask(&writer->last, state);
+    int ok = 1;
+    while (ok && now_us - writer->last_step_us > DELAY_MAX) {
+        ok = emit_step(writer, DELAY_MAX, 0, state);
+    }
+    if (ok && mask) {
+        ok = emit_step(writer, (uint32_t)(now_us - writer->last_step_us), mask, state);
+    }
+    if (!ok) {
+        writer->full = 1;
+        writer->end_us = now_us;
+    }
+    return ok;
+}
+
+// Close the recording; returns its size in bytes, 0 if it has no samples
+uint32_t timeline_finish(timeline_writer_t* writer, uint64_t now_us) {
+    if (!writer->started) {
+        return 0;
+    }
+    
+    uint64_t end_us = writer->full ? writer->end_us : now_us;
+    uint64_t hold = end_us - writer->last_step_us;
+    writer->size += put_varint(writer->data + writer->size, hold > DELAY_MAX ? DELAY_MAX : (uint32_t)hold);
+    writer->data[writer->size++] = 0;
+    writer->steps++;
+    writer->full = 1;
+    return writer->size;
+}
+
+void timeline_player_init(timeline_player_t* player, const uint8_t* data, uint32_t size, uint64_t now_us) {
+    __builtin_memset(player, 0, sizeof(*player));
+    player->data = data;
+    player->size = size;
+    player->step_us = now_us;
+    if (size) {
+        player->delay = get_varint(data, &player->position);
+    }
+}
+
+// Decode the fields of the next step into the player state
+static void apply_step(timeline_player_t* player) {
+    const uint8_t* data = player->data;
+    ps5_state_t* state = &player->state;
+    uint32_t mask = data[player->position++];
+    
+    if (mask & TIMELINE_BUTTONS) {
+        uint16_t buttons = (uint16_t)(data[player->position] | (data[player->position + 1] << 8));
+        __builtin_memcpy(&state->buttons, &buttons, sizeof(buttons));
+        player->position += 2;
+    }
+    if (mask & TIMELINE_LX) state->sticks.lx = data[player->position++];
+    if (mask & TIMELINE_LY) state->sticks.ly = data[player->position++];
+    if (mask & TIMELINE_RX) state->sticks.rx = data[player->position++];
+    if (mask & TIMELINE_RY) state->sticks.ry = data[player->position++];
+    if (mask & TIMELINE_L2) state->triggers.l2 = data[player->position++];
+    if (mask & TIMELINE_R2) state->triggers.r2 = data[player->position++];
+    if (mask & TIMELINE_TOUCH) {
+        for (uint32_t i = 0; i < 2; i++) {
+            uint8_t head = data[player->position++];
+            state->touch[i].active = head & 1;
+            state->touch[i].id = head >> 1;
+            state->touch[i].x = (uint16_t)get_varint(data, &player->position);
+            state->touch[i].y = (uint16_t)get_varint(data, &player->position);
+        }
+    }
+}
+
+// Move the playhead to now_us; the decoded state is in player->state.
+// Steps are timed from when the previous one was due, not when it was
+// played, so playback does not drift; a late frame catches up at most two
+// steps. A looping timeline wraps to the empty state it started from,
+// otherwise it stops on its final state. Returns 0 once stopped.
+int timeline_advance(timeline_player_t* player, uint64_t now_us, int loop) {
+    if (player->position >= player->size) {
+        return 0;
+    }
+    
+    for (uint32_t i = 0; i < 2 && now_us - player->step_us >= player->delay; i++) {
+        player->step_us += player->delay;
+        apply_step(player);
+        if (player->position >= player->size) {
+            if (!loop) {
+                return 0;
+            }
+            __builtin_memset(&player->state, 0, sizeof(player->state));
+            player->position = 0;
+        }
+        player->delay = get_varint(player->data, &player->position);
+    }
+    return 1;
+}
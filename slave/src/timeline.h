@@ -0,0 +1,59 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include "ps5.h"
+
+// Delta-compressed input timeline
+//
+// Recorded macros are a byte stream of steps. A step is the varint delay in
+// microseconds since the previous step, a mask of the fields that changed,
+// and the new value of each of those fields:
+//   buttons    2 bytes, ps5_buttons_t bit order
+//   lx..r2     1 byte each
+//   touch      per point: active | id << 1, varint x, varint y
+// Samples equal to the last step cost nothing; their time is carried into
+// the next step's delay. The stream closes with an empty step holding the
+// final state until the end of the recording.
+// Motion and battery fields are not recorded and pass through live.
+
+#define TIMELINE_BUTTONS    (1 << 0)
+#define TIMELINE_LX         (1 << 1)
+#define TIMELINE_LY         (1 << 2)
+#define TIMELINE_RX         (1 << 3)
+#define TIMELINE_RY         (1 << 4)
+#define TIMELINE_L2         (1 << 5)
+#define TIMELINE_R2         (1 << 6)
+#define TIMELINE_TOUCH      (1 << 7)
+
+// Recorder over a caller-owned buffer
+typedef struct {
+    uint8_t* data;
+    uint32_t capacity;
+    uint32_t size;              // Bytes written
+    uint32_t steps;             // Steps written
+    ps5_state_t last;           // State after the last step
+    uint64_t last_step_us;      // Time of the last step
+    uint64_t end_us;            // Time the buffer filled up
+    int started;
+    int full;                   // Out of space; later samples are dropped
+} timeline_writer_t;
+
+// Player; decodes one step at a time
+typedef struct {
+    const uint8_t* data;
+    uint32_t size;
+    uint32_t position;          // Fields of the next step
+    uint32_t delay;             // Delay of the next step
+    uint64_t step_us;           // Time the current step began
+    ps5_state_t state;          // Decoded state
+} timeline_player_t;
+
+// Function Prototypes
+void timeline_writer_init(timeline_writer_t* writer, uint8_t* buffer, uint32_t capacity);
+int timeline_write(timeline_writer_t* writer, const ps5_state_t* state, uint64_t now_us);
+uint32_t timeline_finish(timeline_writer_t* writer, uint64_t now_us);
+void timeline_player_init(timeline_player_t* player, const uint8_t* data, uint32_t size, uint64_t now_us);
+int timeline_advance(timeline_player_t* player, uint64_t now_us, int loop);
+
+#endif // TIMELINE_H
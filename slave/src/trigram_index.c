@@ -0,0 +1,236 @@
+#include "trigram_index.h"
+
+// Distinct buckets of one item's text, for add/remove/rename
+#define ITEM_MAX_BUCKETS 512
+
+static inline uint8_t fold(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? (uint8_t)(ch | 0x20) : (uint8_t)ch;
+}
+
+static inline uint32_t trigram_bucket(const char* text) {
+    uint32_t gram = ((uint32_t)fold(text[0]) << 16) | ((uint32_t)fold(text[1]) << 8) | fold(text[2]);
+    return (gram * 2654435761u) >> (32 - 12);
+}
+
+// Collect the distinct buckets of a set of fields. Returns the count.
+static uint32_t collect_buckets(const char* const* fields, uint32_t field_count, uint16_t* buckets) {
+    static uint32_t seen[TRIGRAM_BUCKETS / 32];
+    uint32_t count = 0;
+    
+    for (uint32_t f = 0; f < field_count; f++) {
+        const char* text = fields[f];
+        if (!text) {
+            continue;
+        }
+        for (; text[0] && text[1] && text[2]; text++) {
+            uint32_t bucket = trigram_bucket(text);
+            if (!(seen[bucket / 32] & (1u << (bucket % 32))) && count < ITEM_MAX_BUCKETS) {
+                seen[bucket / 32] |= 1u << (bucket % 32);
+                buckets[count++] = (uint16_t)bucket;
+            }
+        }
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        seen[buckets[i] / 32] = 0;
+    }
+    return count;
+}
+
+// Empty the index
+void trigram_index_reset(trigram_index_t* index) {
+    for (uint32_t i = 0; i < TRIGRAM_BUCKETS; i++) {
+        index->heads[i] = 0;
+    }
+    for (uint32_t i = 0; i < TRIGRAM_POOL_BLOCKS; i++) {
+        index->pool[i].next = (uint16_t)(i + 2 <= TRIGRAM_POOL_BLOCKS ? i + 2 : 0);
+        index->pool[i].count = 0;
+    }
+    index->free_list = 1;
+    index->free_blocks = TRIGRAM_POOL_BLOCKS;
+    for (uint32_t i = 0; i < TRIGRAM_MAX_IDS; i++) {
+        index->hits[i] = 0;
+    }
+}
+
+// Index an item. Returns 0, leaving the index unchanged, if the pool could
+// run out; the caller must then treat the item as unindexed.
+int trigram_index_add(trigram_index_t* index, uint16_t id, const char* const* fields, uint32_t field_count) {
+    static uint16_t buckets[ITEM_MAX_BUCKETS];
+    uint32_t count = collect_buckets(fields, field_count, buckets);
+    
+    if (id >= TRIGRAM_MAX_IDS) {
+        return 0;
+    }
+    
+    // Blocks needed: one per bucket whose head block is missing or full
+    uint32_t needed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t head = index->heads[buckets[i]];
+        needed += !head || index->pool[head - 1].count == TRIGRAM_BLOCK_IDS;
+    }
+    if (needed > index->free_blocks) {
+        return 0;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t* head = &index->heads[buckets[i]];
+        trigram_block_t* block = *head ? &index->pool[*head - 1] : 0;
+        
+        // New ids go into the head block; full blocks stay behind it
+        if (!block || block->count == TRIGRAM_BLOCK_IDS) {
+            uint16_t fresh = index->free_list;
+            index->free_list = index->pool[fresh - 1].next;
+            index->free_blocks--;
+            block = &index->pool[fresh - 1];
+            block->next = *head;
+            block->count = 0;
+            *head = fresh;
+        }
+        block->ids[block->count++] = id;
+    }
+    return 1;
+}
+
+// Drop an item, given the same text it was added with
+void trigram_index_remove(trigram_index_t* index, uint16_t id, const char* const* fields, uint32_t field_count) {
+    static uint16_t buckets[ITEM_MAX_BUCKETS];
+    uint32_t count = collect_buckets(fields, field_count, buckets);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t* head = &index->heads[buckets[i]];
+        if (!*head) {
+            continue;
+        }
+        trigram_block_t* first = &index->pool[*head - 1];
+        
+        // Fill the hole with the last id of the head block
+        for (uint16_t b = *head; b; b = index->pool[b - 1].next) {
+            trigram_block_t* block = &index->pool[b - 1];
+            uint32_t j;
+            for (j = 0; j < block->count && block->ids[j] != id; j++);
+            if (j < block->count) {
+                block->ids[j] = first->ids[--first->count];
+                if (first->count == 0) {
+                    *head = first->next;
+                    first->next = index->free_list;
+                    index->free_list = (uint16_t)(first - index->pool + 1);
+                    index->free_blocks++;
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Change an item's id in place
+void trigram_index_rename(trigram_index_t* index, uint16_t from, uint16_t to,
+                          const char* const* fields, uint32_t field_count) {
+    static uint16_t buckets[ITEM_MAX_BUCKETS];
+    uint32_t count = collect_buckets(fields, field_count, buckets);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint16_t b = index->heads[buckets[i]]; b; b = index->pool[b - 1].next) {
+            trigram_block_t* block = &index->pool[b - 1];
+            uint32_t j;
+            for (j = 0; j < block->count && block->ids[j] != from; j++);
+            if (j < block->count) {
+                block->ids[j] = to;
+                break;
+            }
+        }
+    }
+}
+
+// Items whose text may contain the query: those present in the posting
+// list of every query trigram. Returns the candidate count, or -1 if the
+// query is shorter than a trigram and the caller has to scan.
+int trigram_index_query(trigram_index_t* index, const char* query, uint16_t* ids, uint32_t max_ids) {
+    uint16_t buckets[TRIGRAM_MAX_QUERY];
+    uint32_t count = 0;
+    
+    // Distinct query buckets; a long query only needs a sample of them
+    for (const char* q = query; q[0] && q[1] && q[2] && count < TRIGRAM_MAX_QUERY; q++) {
+        uint16_t bucket = (uint16_t)trigram_bucket(q);
+        uint32_t i;
+        for (i = 0; i < count && buckets[i] != bucket; i++);
+        if (i == count) {
+            buckets[count++] = bucket;
+        }
+    }
+    if (count == 0) {
+        return -1;
+    }
+    
+    // Rarest list first: only its ids can survive, so it seeds the counts
+    uint32_t shortest = 0, shortest_len = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len = 0;
+        for (uint16_t b = index->heads[buckets[i]]; b; b = index->pool[b - 1].next) {
+            len += index->pool[b - 1].count;
+        }
+        if (len < shortest_len) {
+            shortest = i;
+            shortest_len = len;
+        }
+    }
+    if (shortest_len == 0) {
+        return 0;
+    }
+    uint16_t swap = buckets[0];
+    buckets[0] = buckets[shortest];
+    buckets[shortest] = swap;
+    
+    for (uint16_t b = index->heads[buckets[0]]; b; b = index->pool[b - 1].next) {
+        const trigram_block_t* block = &index->pool[b - 1];
+        for (uint32_t j = 0; j < block->count; j++) {
+            index->hits[block->ids[j]] = 1;
+        }
+    }
+    
+    // Each further list promotes ids that were in all lists so far
+    for (uint32_t i = 1; i < count; i++) {
+        for (uint16_t b = index->heads[buckets[i]]; b; b = index->pool[b - 1].next) {
+            const trigram_block_t* block = &index->pool[b - 1];
+            for (uint32_t j = 0; j < block->count; j++) {
+                uint8_t* hit = &index->hits[block->ids[j]];
+                if (*hit == i) {
+                    *hit = (uint8_t)(i + 1);
+                }
+            }
+        }
+    }
+    
+    // Collect survivors and clear the scratch counts
+    uint32_t found = 0;
+    for (uint16_t b = index->heads[buckets[0]]; b; b = index->pool[b - 1].next) {
+        const trigram_block_t* block = &index->pool[b - 1];
+        for (uint32_t j = 0; j < block->count; j++) {
+            uint16_t id = block->ids[j];
+            if (index->hits[id] == count && found < max_ids) {
+                ids[found++] = id;
+            }
+            index->hits[id] = 0;
+        }
+    }
+    return (int)found;
+}
+
+// Case-insensitive substring test
+int trigram_text_contains(const char* text, const char* query) {
+    if (!*query) {
+        return 1;
+    }
+    for (; *text; text++) {
+        const char* t = text;
+        const char* q = query;
+        while (*t && *q && fold(*t) == fold(*q)) {
+            t++;
+            q++;
+        }
+        if (!*q) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <stdint.h>
+
+// Incremental trigram inverted index
+//
+// Every case-folded three-character window of an item's text fields is
+// hashed to one of TRIGRAM_BUCKETS posting lists holding item ids. Lists
+// are chains of fixed blocks from a shared pool, so memory is fixed.
+// Bucket collisions only add false candidates; callers verify matches
+// against the text.
+
+#define TRIGRAM_BUCKETS       4096    // Power of two
+#define TRIGRAM_MAX_IDS       1024
+#define TRIGRAM_BLOCK_IDS     14
+#define TRIGRAM_POOL_BLOCKS   8192    // 256 KB, ~110K postings
+#define TRIGRAM_MAX_QUERY     16      // Distinct query trigrams used
+
+// Posting block: 32 bytes
+typedef struct {
+    uint16_t next;                        // Block index + 1, 0 = end
+    uint16_t count;
+    uint16_t ids[TRIGRAM_BLOCK_IDS];
+} trigram_block_t;
+
+typedef struct {
+    uint16_t heads[TRIGRAM_BUCKETS];      // Block index + 1, 0 = empty list
+    trigram_block_t pool[TRIGRAM_POOL_BLOCKS];
+    uint16_t free_list;                   // Block index + 1
+    uint32_t free_blocks;
+    uint8_t hits[TRIGRAM_MAX_IDS];        // Query scratch
+} trigram_index_t;
+
+// Function Prototypes
+void trigram_index_reset(trigram_index_t* index);
+int trigram_index_add(trigram_index_t* index, uint16_t id, const char* const* fields, uint32_t field_count);
+void trigram_index_remove(trigram_index_t* index, uint16_t id, const char* const* fields, uint32_t field_count);
+void trigram_index_rename(trigram_index_t* index, uint16_t from, uint16_t to,
+                          const char* const* fields, uint32_t field_count);
+int trigram_index_query(trigram_index_t* index, const char* query, uint16_t* ids, uint32_t max_ids);
+
+// Case-insensitive substring test used to verify candidates
+int trigram_text_contains(const char* text, const char* query);
+
+#endif // TRIGRAM_INDEX_H
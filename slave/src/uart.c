@@ -0,0 +1,78 @@
+#include "uart.h"
+
+// UART0 pins 14-15
+#define GPIO_BASE           (MMIO_BASE + 0x200000)
+#define GPIO_GPFSEL1        HAL_REG(GPIO_BASE + 0x04)
+#define GPIO_ALT0           4
+
+static struct {
+    int ready;
+    uint32_t baud;          // Actual rate after divisor rounding
+} uart;
+
+// Bring up UART0 at the given rate, 8N1 with FIFOs, transmit only
+int uart_init(uint32_t baud) {
+    // Divisor in 1/64ths: UARTCLK / (16 * baud), rounded
+    uint32_t divisor = baud ? (4 * UART_CLOCK + baud / 2) / baud : 0;
+    if (divisor < 64 || divisor >= (0x10000 << 6)) {
+        return 0;
+    }
+
+    // Disable, let the last character out, then drop the FIFO
+    *UART0_CR = 0;
+    while (*UART0_FR & UART_FR_BUSY) {
+        // Transmitting
+    }
+    *UART0_LCRH = 0;
+
+    // GPIO 14/15 to ALT0 (TXD0/RXD0)
+    uint32_t fsel = *GPIO_GPFSEL1;
+    fsel &= ~((7u << 12) | (7u << 15));
+    fsel |= (GPIO_ALT0 << 12) | (GPIO_ALT0 << 15);
+    *GPIO_GPFSEL1 = fsel;
+
+    *UART0_ICR = 0x7FF;
+    *UART0_IMSC = 0;
+    *UART0_IBRD = divisor >> 6;
+    *UART0_FBRD = divisor & 63;
+    *UART0_LCRH = UART_LCRH_WLEN8 | UART_LCRH_FEN;
+    *UART0_DMACR = 0;
+    *UART0_CR = UART_CR_UARTEN | UART_CR_TXE;
+
+    uart.baud = 4 * UART_CLOCK / divisor;
+    uart.ready = 1;
+    return 1;
+}
+
+uint32_t uart_baud(void) {
+    return uart.ready ? uart.baud : 0;
+}
+
+// Polled transmit: waits for FIFO space, not for the line
+void uart_write(const void* data, uint32_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (!uart.ready) {
+        return;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        while (*UART0_FR & UART_FR_TXFF) {
+            // FIFO full
+        }
+        *UART0_DR = bytes[i];
+    }
+}
+
+// Wait until everything written has left the shift register
+void uart_flush(void) {
+    if (!uart.ready) {
+        return;
+    }
+    while (!(*UART0_FR & UART_FR_TXFE) || (*UART0_FR & UART_FR_BUSY)) {
+        // Draining
+    }
+}
+
+// Raise the TX DREQ whenever the FIFO wants data
+void uart_dma_enable(int enable) {
+    *UART0_DMACR = enable ? UART_DMACR_TXDMAE : 0;
+}
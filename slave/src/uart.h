@@ -0,0 +1,55 @@
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// PL011 UART0 on GPIO 14 (TXD) and 15 (RXD)
+//
+// Transmit only. uart_write() feeds the FIFO by polling; uart_dma_enable()
+// hands the transmit side to a DMA channel paced by the UART's TX DREQ
+// (see telemetry.c). UARTCLK is the 48 MHz the boot firmware sets up when
+// config.txt has init_uart_clock=48000000.
+
+#define UART0_BASE          (MMIO_BASE + 0x201000)
+#define UART0_DR            HAL_REG(UART0_BASE + 0x00)
+#define UART0_FR            HAL_REG(UART0_BASE + 0x18)
+#define UART0_IBRD          HAL_REG(UART0_BASE + 0x24)
+#define UART0_FBRD          HAL_REG(UART0_BASE + 0x28)
+#define UART0_LCRH          HAL_REG(UART0_BASE + 0x2C)
+#define UART0_CR            HAL_REG(UART0_BASE + 0x30)
+#define UART0_IFLS          HAL_REG(UART0_BASE + 0x34)
+#define UART0_IMSC          HAL_REG(UART0_BASE + 0x38)
+#define UART0_ICR           HAL_REG(UART0_BASE + 0x44)
+#define UART0_DMACR         HAL_REG(UART0_BASE + 0x48)
+
+// Data register as seen by the DMA engine (peripheral bus address)
+#define UART0_DR_BUS        0x7E201000
+
+// FR bits
+#define UART_FR_BUSY        (1 << 3)
+#define UART_FR_TXFF        (1 << 5)
+#define UART_FR_TXFE        (1 << 7)
+
+// LCRH bits
+#define UART_LCRH_FEN       (1 << 4)
+#define UART_LCRH_WLEN8     (3 << 5)
+
+// CR bits
+#define UART_CR_UARTEN      (1 << 0)
+#define UART_CR_TXE         (1 << 8)
+
+// DMACR bits
+#define UART_DMACR_TXDMAE   (1 << 1)
+
+#define UART_CLOCK          48000000
+#define UART_DEFAULT_BAUD   921600
+
+// Function Prototypes
+int uart_init(uint32_t baud);
+uint32_t uart_baud(void);
+void uart_write(const void* data, uint32_t size);
+void uart_flush(void);
+void uart_dma_enable(int enable);
+
+#endif // UART_H
@@ -1,5 +1,8 @@
 #include "usb.h"
 #include "status.h"
+#include "hardware.h"
+#include "irq.h"
+#include "clock.h"
 
 // USB Controller States
 typedef enum {
@@ -14,6 +17,27 @@ static usb_state_t usb_state = USB_STATE_RESET;
 #define PS5_PORT        1  // PS5 console on first port
 #define CONTROLLER_PORT 2  // Controller on second port
 
+// Transfer parameters
+#define USB_MAX_PACKET_SIZE     64
+#define USB_TRANSFER_TIMEOUT_US 1000
+
+// Per-device interrupt endpoint polling interval (ms)
+static uint32_t polling_interval_ms[2] = {1, 1};
+
+// Interrupt-driven IN pipe, one per device on channel 2n
+typedef struct {
+    void* buffer;
+    uint32_t size;
+    uint8_t endpoint;
+    usb_in_callback_t callback;
+    volatile int active;       // Channel armed and owned by the IRQ handler
+    volatile uint32_t errors;  // Transfers that stopped the stream
+} usb_stream_t;
+
+static usb_stream_t streams[2];
+
+static usb_stats_t counters;
+
 // USB Reset Sequence
 static void usb_core_reset(void) {
     // Assert core soft reset
@@ -31,7 +55,12 @@ static void usb_core_reset(void) {
 }
 
 // Initialize USB Controller
-void usb_init(void) {
+int usb_init(void) {
+    // Release channels left running by a previous init
+    usb_stop_interrupt_in(USB_DEVICE_PS5);
+    usb_stop_interrupt_in(USB_DEVICE_CONTROLLER);
+    __builtin_memset(&counters, 0, sizeof(counters));
+    
     // Power up USB controller
     *USB_PCGCCTL = 0;
     
@@ -51,12 +80,17 @@ void usb_init(void) {
                 (1 << 0);          // FS/LS PHY clock select
     
     // Enable port power on both ports
-    volatile uint32_t* port1 = (volatile uint32_t*)(USB_HOST_BASE + 0x040);
-    volatile uint32_t* port2 = (volatile uint32_t*)(USB_HOST_BASE + 0x060);
-    *port1 |= (1 << 12);  // Port 1 power on
-    *port2 |= (1 << 12);  // Port 2 power on
+    *USB_HPRT_PORT(PS5_PORT) |= (1 << 12);         // Port 1 power on
+    *USB_HPRT_PORT(CONTROLLER_PORT) |= (1 << 12);  // Port 2 power on
+    
+    // Route host channel interrupts to the ARM
+    *USB_HAINTMSK = 0;
+    *USB_GINTMSK = GINTSTS_HCHINT;
+    irq_register(IRQ_USB, usb_irq_handler);
+    irq_enable(IRQ_USB);
     
     usb_state = USB_STATE_INIT;
+    return 1;
 }
 
 // Check device VID/PID
@@ -67,8 +101,7 @@ static int check_device_id(int port, uint16_t expected_vid, uint16_t expected_pi
     // 3. Compare VID/PID
     // For now, we'll simulate detection based on port connection
     
-    volatile uint32_t* port_reg = (volatile uint32_t*)(USB_HOST_BASE + 0x040 + (port * 0x20));
-    uint32_t port_status = *port_reg;
+    uint32_t port_status = *USB_HPRT_PORT(port);
     
     // Check if device connected and enabled
     return (port_status & (1 << 1)) && (port_status & (1 << 3));
@@ -116,3 +149,194 @@ void usb_handle_controller(void) {
         }
     }
 }
+
+// Map a device type to its root port (used as the device address until
+// enumeration is implemented)
+static uint32_t device_port(usb_device_type_t device_type) {
+    return device_type == USB_DEVICE_PS5 ? PS5_PORT : CONTROLLER_PORT;
+}
+
+// Program a host channel and enable it. The channel halts on its own when
+// the transfer completes, NAKs or fails.
+static void usb_channel_start(uint32_t channel, usb_device_type_t device_type,
+                              uint8_t endpoint, void* buffer, uint32_t size) {
+    int is_in = (endpoint & USB_ENDPOINT_IN) != 0;
+    
+    // Clear stale interrupt status (write-1-to-clear)
+    *USB_HCINT(channel) = 0xFFFFFFFF;
+    
+    uint32_t packets = (size + USB_MAX_PACKET_SIZE - 1) / USB_MAX_PACKET_SIZE;
+    *USB_HCTSIZ(channel) = HCTSIZ_XFERSIZE(size) | HCTSIZ_PKTCNT(packets);
+    *USB_HCDMA(channel) = hal_bus_addr(buffer);
+    hal_dsb();
+    
+    *USB_HCCHAR(channel) = HCCHAR_MPS(USB_MAX_PACKET_SIZE) |
+                           HCCHAR_EPNUM(endpoint & 0x0F) |
+                           (is_in ? HCCHAR_EPDIR_IN : 0) |
+                           HCCHAR_EPTYPE_INTR |
+                           HCCHAR_DEVADDR(device_port(device_type)) |
+                           HCCHAR_CHENA;
+}
+
+// Run a single interrupt transfer on a host channel and wait for it to halt.
+// Returns the number of bytes transferred, 0 on NAK/error/timeout.
+static int usb_channel_transfer(uint32_t channel, usb_device_type_t device_type,
+                                uint8_t endpoint, void* buffer, uint32_t size) {
+    if (usb_state < USB_STATE_INIT || size == 0) {
+        return 0;
+    }
+    
+    // Channel must be idle
+    if (*USB_HCCHAR(channel) & HCCHAR_CHENA) {
+        return 0;
+    }
+    
+    usb_channel_start(channel, device_type, endpoint, buffer, size);
+    
+    // Wait for the channel to halt
+    uint64_t start = clock_now_us();
+    uint32_t status;
+    while (!((status = *USB_HCINT(channel)) & HCINT_CHHLTD)) {
+        if (clock_now_us() - start >= USB_TRANSFER_TIMEOUT_US) {
+            *USB_HCCHAR(channel) |= HCCHAR_CHDIS;
+            return 0;
+        }
+    }
+    *USB_HCINT(channel) = 0xFFFFFFFF;
+    
+    if (!(status & HCINT_XFERCOMPL)) {
+        return 0;
+    }
+    
+    uint32_t remaining = HCTSIZ_XFERSIZE(*USB_HCTSIZ(channel));
+    return (int)(size - remaining);
+}
+
+// Read from an IN endpoint. Channel 2n is reserved for device n's IN pipe.
+int usb_read_endpoint(usb_device_type_t device_type, uint8_t endpoint, void* buffer, uint32_t size) {
+    if (!buffer) {
+        return 0;
+    }
+    return usb_channel_transfer(device_type * 2, device_type,
+                                endpoint | USB_ENDPOINT_IN, buffer, size);
+}
+
+// Write to an OUT endpoint. Channel 2n+1 is reserved for device n's OUT pipe.
+int usb_write_endpoint(usb_device_type_t device_type, uint8_t endpoint, const void* buffer, uint32_t size) {
+    if (!buffer) {
+        return 0;
+    }
+    if (usb_channel_transfer(device_type * 2 + 1, device_type,
+                             endpoint & ~USB_ENDPOINT_IN, (void*)buffer, size) > 0) {
+        counters.out_transfers++;
+        return 1;
+    }
+    counters.out_failures++;
+    return 0;
+}
+
+// Set interrupt endpoint polling interval
+void usb_set_polling_interval(usb_device_type_t device_type, uint32_t interval_ms) {
+    if (device_type > USB_DEVICE_CONTROLLER || interval_ms == 0) {
+        return;
+    }
+    polling_interval_ms[device_type] = interval_ms;
+}
+
+// Start streaming an interrupt IN endpoint. The channel is re-armed from the
+// USB interrupt after every report, and callback runs in IRQ context with
+// the received data. A transfer error stops the stream.
+int usb_start_interrupt_in(usb_device_type_t device_type, uint8_t endpoint,
+                           void* buffer, uint32_t size, usb_in_callback_t callback) {
+    if (usb_state < USB_STATE_INIT || device_type > USB_DEVICE_CONTROLLER ||
+        !buffer || size == 0 || !callback) {
+        return 0;
+    }
+    
+    usb_stream_t* stream = &streams[device_type];
+    uint32_t channel = device_type * 2;
+    
+    if (stream->active || (*USB_HCCHAR(channel) & HCCHAR_CHENA)) {
+        return 0;
+    }
+    
+    stream->buffer = buffer;
+    stream->size = size;
+    stream->endpoint = endpoint | USB_ENDPOINT_IN;
+    stream->callback = callback;
+    stream->active = 1;
+    
+    *USB_HCINTMSK(channel) = HCINT_CHHLTD;
+    *USB_HAINTMSK |= 1u << channel;
+    usb_channel_start(channel, device_type, stream->endpoint, buffer, size);
+    return 1;
+}
+
+// Stop an interrupt IN stream and release its channel
+void usb_stop_interrupt_in(usb_device_type_t device_type) {
+    if (device_type > USB_DEVICE_CONTROLLER) {
+        return;
+    }
+    
+    uint32_t channel = device_type * 2;
+    streams[device_type].active = 0;
+    
+    *USB_HAINTMSK &= ~(1u << channel);
+    *USB_HCINTMSK(channel) = 0;
+    if (*USB_HCCHAR(channel) & HCCHAR_CHENA) {
+        *USB_HCCHAR(channel) |= HCCHAR_CHDIS;
+    }
+    *USB_HCINT(channel) = 0xFFFFFFFF;
+}
+
+// Check whether an interrupt IN stream is running
+int usb_interrupt_in_active(usb_device_type_t device_type) {
+    if (device_type > USB_DEVICE_CONTROLLER) {
+        return 0;
+    }
+    return streams[device_type].active;
+}
+
+// USB core interrupt: deliver completed IN reports and re-arm the channels
+void usb_irq_handler(void) {
+    uint32_t haint = *USB_HAINT;
+    
+    for (uint32_t device = 0; device < 2; device++) {
+        usb_stream_t* stream = &streams[device];
+        uint32_t channel = device * 2;
+        
+        if (!stream->active || !(haint & (1u << channel))) {
+            continue;
+        }
+        
+        uint32_t status = *USB_HCINT(channel);
+        *USB_HCINT(channel) = 0xFFFFFFFF;
+        
+        if (status & HCINT_XFERCOMPL) {
+            uint32_t remaining = HCTSIZ_XFERSIZE(*USB_HCTSIZ(channel));
+            counters.in_reports++;
+            stream->callback(stream->buffer, stream->size - remaining);
+        } else if (status & (HCINT_AHBERR | HCINT_STALL | HCINT_XACTERR)) {
+            // Leave the channel halted; the owner restarts the stream
+            stream->active = 0;
+            stream->errors++;
+            counters.in_errors++;
+            *USB_HAINTMSK &= ~(1u << channel);
+            continue;
+        }
+        
+        if (status & HCINT_NAK) {
+            counters.in_naks++;
+        }
+        
+        // Completed or NAKed: queue the next poll
+        usb_channel_start(channel, (usb_device_type_t)device, stream->endpoint,
+                          stream->buffer, stream->size);
+    }
+}
+
+void usb_get_stats(usb_stats_t* stats) {
+    if (stats) {
+        *stats = counters;
+    }
+}
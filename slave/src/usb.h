@@ -2,6 +2,7 @@
 #define USB_H
 
 #include <stdint.h>
+#include "hal.h"
 
 // USB Controller Registers
 #define USB_BASE            0x3F980000
@@ -10,18 +11,55 @@
 #define USB_POWER_BASE      (USB_BASE + 0xE00)
 
 // USB Core Registers
-#define USB_GAHBCFG         ((volatile uint32_t*)(USB_CORE_BASE + 0x008))
-#define USB_GUSBCFG         ((volatile uint32_t*)(USB_CORE_BASE + 0x00C))
-#define USB_GRSTCTL         ((volatile uint32_t*)(USB_CORE_BASE + 0x010))
-#define USB_GINTSTS         ((volatile uint32_t*)(USB_CORE_BASE + 0x014))
-#define USB_GINTMSK         ((volatile uint32_t*)(USB_CORE_BASE + 0x018))
+#define USB_GAHBCFG         HAL_REG(USB_CORE_BASE + 0x008)
+#define USB_GUSBCFG         HAL_REG(USB_CORE_BASE + 0x00C)
+#define USB_GRSTCTL         HAL_REG(USB_CORE_BASE + 0x010)
+#define USB_GINTSTS         HAL_REG(USB_CORE_BASE + 0x014)
+#define USB_GINTMSK         HAL_REG(USB_CORE_BASE + 0x018)
+
+// GINTSTS/GINTMSK bits
+#define GINTSTS_HCHINT      (1 << 25)
 
 // USB Host Registers
-#define USB_HCFG            ((volatile uint32_t*)(USB_HOST_BASE + 0x000))
-#define USB_HPRT            ((volatile uint32_t*)(USB_HOST_BASE + 0x040))
+#define USB_HCFG            HAL_REG(USB_HOST_BASE + 0x000)
+#define USB_HAINT           HAL_REG(USB_HOST_BASE + 0x014)
+#define USB_HAINTMSK        HAL_REG(USB_HOST_BASE + 0x018)
+#define USB_HPRT            HAL_REG(USB_HOST_BASE + 0x040)
+#define USB_HPRT_PORT(n)    HAL_REG(USB_HOST_BASE + 0x040 + ((n) - 1) * 0x20)
+
+// USB Host Channel Registers (DWC2, 0x20 stride per channel)
+#define USB_HC_BASE(n)      (USB_HOST_BASE + 0x100 + (n) * 0x20)
+#define USB_HCCHAR(n)       HAL_REG(USB_HC_BASE(n) + 0x00)
+#define USB_HCSPLT(n)       HAL_REG(USB_HC_BASE(n) + 0x04)
+#define USB_HCINT(n)        HAL_REG(USB_HC_BASE(n) + 0x08)
+#define USB_HCINTMSK(n)     HAL_REG(USB_HC_BASE(n) + 0x0C)
+#define USB_HCTSIZ(n)       HAL_REG(USB_HC_BASE(n) + 0x10)
+#define USB_HCDMA(n)        HAL_REG(USB_HC_BASE(n) + 0x14)
+#define USB_NUM_CHANNELS    8
+
+// HCCHAR fields
+#define HCCHAR_MPS(x)       ((x) & 0x7FF)
+#define HCCHAR_EPNUM(x)     (((x) & 0xF) << 11)
+#define HCCHAR_EPDIR_IN     (1 << 15)
+#define HCCHAR_EPTYPE_INTR  (3 << 18)
+#define HCCHAR_DEVADDR(x)   (((x) & 0x7F) << 22)
+#define HCCHAR_CHDIS        (1 << 30)
+#define HCCHAR_CHENA        (1U << 31)
+
+// HCINT bits
+#define HCINT_XFERCOMPL     (1 << 0)
+#define HCINT_CHHLTD        (1 << 1)
+#define HCINT_AHBERR        (1 << 2)
+#define HCINT_STALL         (1 << 3)
+#define HCINT_NAK           (1 << 4)
+#define HCINT_XACTERR       (1 << 7)
+
+// HCTSIZ fields
+#define HCTSIZ_XFERSIZE(x)  ((x) & 0x7FFFF)
+#define HCTSIZ_PKTCNT(x)    (((x) & 0x3FF) << 19)
 
 // USB Power Registers
-#define USB_PCGCCTL         ((volatile uint32_t*)(USB_POWER_BASE + 0x000))
+#define USB_PCGCCTL         HAL_REG(USB_POWER_BASE + 0x000)
 
 // Device Types
 typedef enum {
@@ -37,9 +75,35 @@ typedef enum {
 #define PS5_CONTROLLER_VID  0x054C
 #define PS5_CONTROLLER_PID  0x0CE6
 
+// Endpoint direction bit in endpoint addresses (e.g. 0x84 = EP4 IN)
+#define USB_ENDPOINT_IN     0x80
+
+// Transfer counters since usb_init()
+typedef struct {
+    uint32_t in_reports;        // Interrupt IN transfers that returned data
+    uint32_t in_naks;           // Interrupt IN polls with nothing to return
+    uint32_t in_errors;         // Transfers that stopped an IN stream
+    uint32_t out_transfers;     // OUT transfers completed
+    uint32_t out_failures;      // OUT transfers that NAKed, failed or timed out
+} usb_stats_t;
+
+// Interrupt IN completion callback (runs in IRQ context)
+typedef void (*usb_in_callback_t)(const uint8_t* data, uint32_t length);
+
 // Function Prototypes
-void usb_init(void);
+int usb_init(void);
 int usb_detect_device(usb_device_type_t device_type);
 void usb_handle_controller(void);
+int usb_read_endpoint(usb_device_type_t device_type, uint8_t endpoint, void* buffer, uint32_t size);
+int usb_write_endpoint(usb_device_type_t device_type, uint8_t endpoint, const void* buffer, uint32_t size);
+void usb_set_polling_interval(usb_device_type_t device_type, uint32_t interval_ms);
+
+// Interrupt-driven IN pipes
+int usb_start_interrupt_in(usb_device_type_t device_type, uint8_t endpoint,
+                           void* buffer, uint32_t size, usb_in_callback_t callback);
+void usb_stop_interrupt_in(usb_device_type_t device_type);
+int usb_interrupt_in_active(usb_device_type_t device_type);
+void usb_irq_handler(void);
+void usb_get_stats(usb_stats_t* stats);
 
 #endif // USB_H
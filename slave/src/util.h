@@ -2,6 +2,7 @@
 #define UTIL_H
 
 #include <stdint.h>
+#include "mem.h"             // mem_copy, mem_set, mem_compare
 
 // String utilities
 static inline uint32_t str_len(const char* str) {
@@ -26,6 +27,16 @@ static inline int str_compare(const char* s1, const char* s2) {
     return *s1 - *s2;
 }
 
+// FNV-1a hash of a string
+static inline uint32_t str_hash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 static inline const char* str_find(const char* haystack, const char* needle) {
     if (!*needle) return haystack;
     
@@ -41,27 +52,4 @@ static inline const char* str_find(const char* haystack, const char* needle) {
     return 0;
 }
 
-// Memory utilities
-static inline void mem_copy(void* dest, const void* src, uint32_t size) {
-    uint8_t* d = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
-    while (size--) *d++ = *s++;
-}
-
-static inline void mem_set(void* dest, uint8_t value, uint32_t size) {
-    uint8_t* d = (uint8_t*)dest;
-    while (size--) *d++ = value;
-}
-
-static inline int mem_compare(const void* s1, const void* s2, uint32_t size) {
-    const uint8_t* p1 = (const uint8_t*)s1;
-    const uint8_t* p2 = (const uint8_t*)s2;
-    while (size--) {
-        if (*p1 != *p2) return *p1 - *p2;
-        p1++;
-        p2++;
-    }
-    return 0;
-}
-
 #endif // UTIL_H
@@ -0,0 +1,232 @@
+#include "vm.h"
+
+// Operand kinds used by validation
+#define OPND_NONE   0
+#define OPND_REG    1
+#define OPND_FIELD  2
+#define OPND_GLOBAL 3
+#define OPND_BUTTON 4
+#define OPND_IMM    5   // b:c hold an immediate
+
+// Operand layout per opcode: a, b, c
+static const uint8_t op_operands[VM_OP_COUNT][3] = {
+    [VM_HALT]   = {OPND_NONE,   OPND_NONE,   OPND_NONE},
+    [VM_LOADI]  = {OPND_REG,    OPND_IMM,    OPND_IMM},
+    [VM_LOADHI] = {OPND_REG,    OPND_IMM,    OPND_IMM},
+    [VM_MOV]    = {OPND_REG,    OPND_REG,    OPND_NONE},
+    [VM_ADD]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_SUB]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_MUL]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_DIV]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_MOD]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_AND]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_OR]     = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_XOR]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_SHL]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_SHR]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_EQ]     = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_NE]     = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_LT]     = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_LE]     = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_MIN]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_MAX]    = {OPND_REG,    OPND_REG,    OPND_REG},
+    [VM_NEG]    = {OPND_REG,    OPND_REG,    OPND_NONE},
+    [VM_NOT]    = {OPND_REG,    OPND_REG,    OPND_NONE},
+    [VM_BOOL]   = {OPND_REG,    OPND_REG,    OPND_NONE},
+    [VM_JMP]    = {OPND_NONE,   OPND_IMM,    OPND_IMM},
+    [VM_JZ]     = {OPND_REG,    OPND_IMM,    OPND_IMM},
+    [VM_JNZ]    = {OPND_REG,    OPND_IMM,    OPND_IMM},
+    [VM_GETF]   = {OPND_REG,    OPND_FIELD,  OPND_NONE},
+    [VM_SETF]   = {OPND_FIELD,  OPND_REG,    OPND_NONE},
+    [VM_GETG]   = {OPND_REG,    OPND_GLOBAL, OPND_NONE},
+    [VM_SETG]   = {OPND_GLOBAL, OPND_REG,    OPND_NONE},
+    [VM_BTN]    = {OPND_REG,    OPND_BUTTON, OPND_NONE},
+    [VM_SETBTN] = {OPND_BUTTON, OPND_REG,    OPND_NONE},
+    [VM_TIME]   = {OPND_REG,    OPND_NONE,   OPND_NONE},
+};
+
+static int operand_valid(uint8_t kind, uint32_t value) {
+    switch (kind) {
+        case OPND_REG:    return value < VM_REGISTERS;
+        case OPND_FIELD:  return value < VM_FIELD_COUNT;
+        case OPND_GLOBAL: return value < VM_GLOBALS;
+        case OPND_BUTTON: return value < VM_BUTTON_COUNT;
+        default:          return 1;
+    }
+}
+
+// Check every instruction once at load so the interpreter needs no bounds
+// checks: operands in range, jumps inside the program, and no way to run
+// off the end.
+int vm_validate(const uint32_t* code, uint32_t length) {
+    if (!code || length == 0 || length > VM_MAX_CODE) {
+        return 0;
+    }
+    
+    for (uint32_t pc = 0; pc < length; pc++) {
+        uint32_t insn = code[pc];
+        uint32_t op = VM_OP_OF(insn);
+        if (op >= VM_OP_COUNT) {
+            return 0;
+        }
+        if (!operand_valid(op_operands[op][0], VM_A_OF(insn)) ||
+            !operand_valid(op_operands[op][1], VM_B_OF(insn)) ||
+            !operand_valid(op_operands[op][2], VM_C_OF(insn))) {
+            return 0;
+        }
+        if (op == VM_JMP || op == VM_JZ || op == VM_JNZ) {
+            int32_t target = (int32_t)pc + 1 + VM_IMM_OF(insn);
+            if (target < 0 || target >= (int32_t)length) {
+                return 0;
+            }
+        }
+    }
+    
+    uint32_t last = VM_OP_OF(code[length - 1]);
+    return last == VM_HALT || last == VM_JMP;
+}
+
+// Validate and attach code to a program
+int vm_load(vm_program_t* program, const uint32_t* code, uint32_t length) {
+    __builtin_memset(program, 0, sizeof(*program));
+    if (!vm_validate(code, length)) {
+        return 0;
+    }
+    program->code = code;
+    program->length = length;
+    return 1;
+}
+
+static int32_t clamp_field(int32_t value, int32_t lo, int32_t hi) {
+    return value < lo ? lo : (value > hi ? hi : value);
+}
+
+static int32_t get_field(const ps5_state_t* state, uint32_t field) {
+    switch (field) {
+        case VM_FIELD_BUTTONS: {
+            uint16_t mask;
+            __builtin_memcpy(&mask, &state->buttons, sizeof(mask));
+            return mask;
+        }
+        case VM_FIELD_LX:          return state->sticks.lx;
+        case VM_FIELD_LY:          return state->sticks.ly;
+        case VM_FIELD_RX:          return state->sticks.rx;
+        case VM_FIELD_RY:          return state->sticks.ry;
+        case VM_FIELD_L2:          return state->triggers.l2;
+        case VM_FIELD_R2:          return state->triggers.r2;
+        case VM_FIELD_ACCEL_X:     return state->motion.accel_x;
+        case VM_FIELD_ACCEL_Y:     return state->motion.accel_y;
+        case VM_FIELD_ACCEL_Z:     return state->motion.accel_z;
+        case VM_FIELD_GYRO_X:      return state->motion.gyro_x;
+        case VM_FIELD_GYRO_Y:      return state->motion.gyro_y;
+        case VM_FIELD_GYRO_Z:      return state->motion.gyro_z;
+        case VM_FIELD_BATTERY:     return state->battery_level;
+        case VM_FIELD_TEMPERATURE: return state->temperature;
+        default:                   return 0;
+    }
+}
+
+static void set_field(ps5_state_t* state, uint32_t field, int32_t value) {
+    switch (field) {
+        case VM_FIELD_BUTTONS: {
+            uint16_t mask = (uint16_t)(value & ((1 << VM_BUTTON_COUNT) - 1));
+            __builtin_memcpy(&state->buttons, &mask, sizeof(mask));
+            break;
+        }
+        case VM_FIELD_LX:          state->sticks.lx = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_LY:          state->sticks.ly = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_RX:          state->sticks.rx = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_RY:          state->sticks.ry = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_L2:          state->triggers.l2 = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_R2:          state->triggers.r2 = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_ACCEL_X:     state->motion.accel_x = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_ACCEL_Y:     state->motion.accel_y = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_ACCEL_Z:     state->motion.accel_z = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_GYRO_X:      state->motion.gyro_x = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_GYRO_Y:      state->motion.gyro_y = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_GYRO_Z:      state->motion.gyro_z = (int16_t)clamp_field(value, -32768, 32767); break;
+        case VM_FIELD_BATTERY:     state->battery_level = (uint8_t)clamp_field(value, 0, 255); break;
+        case VM_FIELD_TEMPERATURE: state->temperature = (uint8_t)clamp_field(value, 0, 255); break;
+        default:                   break;
+    }
+}
+
+// Run a program to completion or until *budget instructions have executed.
+// The budget is shared by every script in a frame, so it is decremented by
+// the instructions used.
+vm_status_t vm_run(vm_program_t* program, ps5_state_t* state, uint64_t now_us, uint32_t* budget) {
+    if (!program->code) {
+        return VM_INVALID;
+    }
+    
+    const uint32_t* code = program->code;
+    int32_t r[VM_REGISTERS] = {0};
+    int32_t globals[VM_GLOBALS];
+    ps5_state_t work = *state;
+    uint32_t left = *budget;
+    uint32_t pc = 0;
+    
+    __builtin_memcpy(globals, program->globals, sizeof(globals));
+    program->runs++;
+    
+    while (left) {
+        uint32_t insn = code[pc++];
+        uint32_t a = VM_A_OF(insn);
+        uint32_t b = VM_B_OF(insn);
+        uint32_t c = VM_C_OF(insn);
+        left--;
+        
+        switch (VM_OP_OF(insn)) {
+            case VM_HALT:
+                *state = work;
+                __builtin_memcpy(program->globals, globals, sizeof(globals));
+                program->ops_executed += *budget - left;
+                *budget = left;
+                return VM_OK;
+            case VM_LOADI:  r[a] = VM_IMM_OF(insn); break;
+            case VM_LOADHI: r[a] = (int32_t)(((uint32_t)r[a] & 0xFFFF) | ((insn & 0xFFFF) << 16)); break;
+            case VM_MOV:    r[a] = r[b]; break;
+            case VM_ADD:    r[a] = (int32_t)((uint32_t)r[b] + (uint32_t)r[c]); break;
+            case VM_SUB:    r[a] = (int32_t)((uint32_t)r[b] - (uint32_t)r[c]); break;
+            case VM_MUL:    r[a] = (int32_t)((uint32_t)r[b] * (uint32_t)r[c]); break;
+            case VM_DIV:    r[a] = (r[c] == 0 || (r[c] == -1 && r[b] == INT32_MIN)) ? 0 : r[b] / r[c]; break;
+            case VM_MOD:    r[a] = (r[c] == 0 || r[c] == -1) ? 0 : r[b] % r[c]; break;
+            case VM_AND:    r[a] = r[b] & r[c]; break;
+            case VM_OR:     r[a] = r[b] | r[c]; break;
+            case VM_XOR:    r[a] = r[b] ^ r[c]; break;
+            case VM_SHL:    r[a] = (int32_t)((uint32_t)r[b] << (r[c] & 31)); break;
+            case VM_SHR:    r[a] = r[b] >> (r[c] & 31); break;
+            case VM_EQ:     r[a] = r[b] == r[c]; break;
+            case VM_NE:     r[a] = r[b] != r[c]; break;
+            case VM_LT:     r[a] = r[b] < r[c]; break;
+            case VM_LE:     r[a] = r[b] <= r[c]; break;
+            case VM_MIN:    r[a] = r[b] < r[c] ? r[b] : r[c]; break;
+            case VM_MAX:    r[a] = r[b] > r[c] ? r[b] : r[c]; break;
+            case VM_NEG:    r[a] = (int32_t)(0u - (uint32_t)r[b]); break;
+            case VM_NOT:    r[a] = !r[b]; break;
+            case VM_BOOL:   r[a] = r[b] != 0; break;
+            case VM_JMP:    pc += VM_IMM_OF(insn); break;
+            case VM_JZ:     if (r[a] == 0) pc += VM_IMM_OF(insn); break;
+            case VM_JNZ:    if (r[a] != 0) pc += VM_IMM_OF(insn); break;
+            case VM_GETF:   r[a] = get_field(&work, b); break;
+            case VM_SETF:   set_field(&work, a, r[b]); break;
+            case VM_GETG:   r[a] = globals[b]; break;
+            case VM_SETG:   globals[a] = r[b]; break;
+            case VM_BTN:    r[a] = (get_field(&work, VM_FIELD_BUTTONS) >> b) & 1; break;
+            case VM_SETBTN: {
+                int32_t mask = get_field(&work, VM_FIELD_BUTTONS);
+                mask = r[b] ? (mask | (1 << a)) : (mask & ~(1 << a));
+                set_field(&work, VM_FIELD_BUTTONS, mask);
+                break;
+            }
+            case VM_TIME:   r[a] = (int32_t)(now_us / 1000); break;
+            default:        break;
+        }
+    }
+    
+    // Out of budget: drop this frame's state and global writes
+    program->ops_executed += *budget;
+    program->budget_exhausted++;
+    *budget = 0;
+    return VM_BUDGET;
+}
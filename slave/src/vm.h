@@ -0,0 +1,117 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+#include "ps5.h"
+
+// Script bytecode VM
+//
+// A small register machine that runs precompiled SCRIPT_TYPE_LUA scripts
+// (see tools/vm_compile.h) against the live controller state. It never
+// allocates: a program is caller-owned code plus a fixed block of
+// persistent globals. Execution is bounded by an instruction budget rather
+// than a clock, so a script overrunning its share of the frame is cut off at
+// the same instruction every time. State and global writes go to copies
+// that are committed only when the script halts.
+//
+// Instruction word: op[31:24] a[23:16] b[15:8] c[7:0], or op/a plus a
+// signed 16-bit immediate in b:c.
+
+#define VM_REGISTERS    16
+#define VM_GLOBALS      16
+#define VM_MAX_CODE     4096     // Words per program
+
+// Opcodes
+typedef enum {
+    VM_HALT,        // Commit state and stop
+    VM_LOADI,       // a = sext(imm)
+    VM_LOADHI,      // a = (a & 0xFFFF) | imm << 16
+    VM_MOV,         // a = b
+    VM_ADD,         // a = b + c
+    VM_SUB,         // a = b - c
+    VM_MUL,         // a = b * c
+    VM_DIV,         // a = b / c (0 if c is 0)
+    VM_MOD,         // a = b % c (0 if c is 0)
+    VM_AND,         // a = b & c
+    VM_OR,          // a = b | c
+    VM_XOR,         // a = b ^ c
+    VM_SHL,         // a = b << (c & 31)
+    VM_SHR,         // a = b >> (c & 31), arithmetic
+    VM_EQ,          // a = b == c
+    VM_NE,          // a = b != c
+    VM_LT,          // a = b < c
+    VM_LE,          // a = b <= c
+    VM_MIN,         // a = min(b, c)
+    VM_MAX,         // a = max(b, c)
+    VM_NEG,         // a = -b
+    VM_NOT,         // a = !b
+    VM_BOOL,        // a = b != 0
+    VM_JMP,         // pc += imm
+    VM_JZ,          // if a == 0: pc += imm
+    VM_JNZ,         // if a != 0: pc += imm
+    VM_GETF,        // a = state field b
+    VM_SETF,        // state field a = b (clamped to the field's range)
+    VM_GETG,        // a = global b
+    VM_SETG,        // global a = b
+    VM_BTN,         // a = button bit b
+    VM_SETBTN,      // button bit a = (b != 0)
+    VM_TIME,        // a = time in ms
+    VM_OP_COUNT
+} vm_op_t;
+
+// State fields reachable from scripts
+typedef enum {
+    VM_FIELD_BUTTONS,
+    VM_FIELD_LX,
+    VM_FIELD_LY,
+    VM_FIELD_RX,
+    VM_FIELD_RY,
+    VM_FIELD_L2,
+    VM_FIELD_R2,
+    VM_FIELD_ACCEL_X,
+    VM_FIELD_ACCEL_Y,
+    VM_FIELD_ACCEL_Z,
+    VM_FIELD_GYRO_X,
+    VM_FIELD_GYRO_Y,
+    VM_FIELD_GYRO_Z,
+    VM_FIELD_BATTERY,
+    VM_FIELD_TEMPERATURE,
+    VM_FIELD_COUNT
+} vm_field_t;
+
+#define VM_BUTTON_COUNT 15
+
+// Encoding
+#define VM_ENC(op, a, b, c)     (((uint32_t)(op) << 24) | ((uint32_t)((a) & 0xFF) << 16) | \
+                                 ((uint32_t)((b) & 0xFF) << 8) | (uint32_t)((c) & 0xFF))
+#define VM_ENC_I(op, a, imm)    (((uint32_t)(op) << 24) | ((uint32_t)((a) & 0xFF) << 16) | \
+                                 ((uint32_t)(imm) & 0xFFFF))
+#define VM_OP_OF(insn)          ((insn) >> 24)
+#define VM_A_OF(insn)           (((insn) >> 16) & 0xFF)
+#define VM_B_OF(insn)           (((insn) >> 8) & 0xFF)
+#define VM_C_OF(insn)           ((insn) & 0xFF)
+#define VM_IMM_OF(insn)         ((int32_t)(int16_t)((insn) & 0xFFFF))
+
+// Run results
+typedef enum {
+    VM_OK,          // Halted, state committed
+    VM_BUDGET,      // Instruction budget exhausted, state untouched
+    VM_INVALID      // No program loaded
+} vm_status_t;
+
+// Loaded program
+typedef struct {
+    const uint32_t* code;          // Caller-owned, validated by vm_load()
+    uint32_t length;
+    int32_t globals[VM_GLOBALS];   // Persist across frames
+    uint32_t runs;
+    uint32_t budget_exhausted;
+    uint64_t ops_executed;
+} vm_program_t;
+
+// Function Prototypes
+int vm_validate(const uint32_t* code, uint32_t length);
+int vm_load(vm_program_t* program, const uint32_t* code, uint32_t length);
+vm_status_t vm_run(vm_program_t* program, ps5_state_t* state, uint64_t now_us, uint32_t* budget);
+
+#endif // VM_H
@@ -1,5 +1,12 @@
+#include <stdio.h>
 #include "test_framework.h"
 #include "test_script_gui.h"
+#include "test_sim.h"
+#include "test_smp.h"
+#include "test_mmu.h"
+#include "test_script.h"
+#include "test_storage.h"
+#include "test_telemetry.h"
 #include "../src/input.h"
 #include "../src/util.h"
 
@@ -12,8 +19,13 @@
 // Print test results
 static void print_test_results(const test_result_t* result) {
     if (result->passed) {
-        printf(COLOR_GREEN "PASS" COLOR_RESET " %s (%u us)\n", 
+        printf(COLOR_GREEN "PASS" COLOR_RESET " %s (%u us)", 
                result->name, result->duration_us);
+        if (result->latency_us) {
+            printf(" latency p50 %u / p99 %u / p99.9 %u us",
+                   result->latency_p50_us, result->latency_us, result->latency_p999_us);
+        }
+        printf("\n");
     } else {
         printf(COLOR_RED "FAIL" COLOR_RESET " %s: %s\n", 
                result->name, result->message);
@@ -28,7 +40,34 @@ static void print_summary(uint32_t passed, uint32_t failed, uint32_t skipped) {
     printf(COLOR_YELLOW "Skipped: %u" COLOR_RESET "\n", skipped);
 }
 
-int main(void) {
+// Map --type=<name> to a test type, -1 for all
+static int parse_test_type(int argc, char** argv) {
+    static const struct {
+        const char* name;
+        test_type_t type;
+    } types[] = {
+        {"unit", TEST_TYPE_UNIT},
+        {"integration", TEST_TYPE_INTEGRATION},
+        {"system", TEST_TYPE_SYSTEM},
+        {"gui", TEST_TYPE_GUI},
+        {"performance", TEST_TYPE_PERFORMANCE}
+    };
+    
+    for (int i = 1; i < argc; i++) {
+        if (str_compare(argv[i], "--type=all") == 0) {
+            return -1;
+        }
+        for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+            if (str_find(argv[i], "--type=") == argv[i] &&
+                str_compare(argv[i] + 7, types[t].name) == 0) {
+                return types[t].type;
+            }
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char** argv) {
     printf("Running ControlHub Slave Tests...\n\n");
     
     // Initialize test framework
@@ -36,13 +75,20 @@ int main(void) {
     
     // Register all test categories
     register_gui_tests();
-    register_usb_tests();
-    register_hardware_tests();
+    register_sim_tests();
+    register_smp_tests();
+    register_mmu_tests();
     register_script_tests();
-    register_performance_tests();
+    register_storage_tests();
+    register_telemetry_tests();
     
-    // Run all tests
-    test_run_all();
+    // Run selected tests
+    int type = parse_test_type(argc, argv);
+    if (type < 0) {
+        test_run_all();
+    } else {
+        test_run_type((test_type_t)type);
+    }
     
     // Print results
     const test_result_t* results;
@@ -0,0 +1,1110 @@
+#include "sim.h"
+#include "../src/hal.h"
+#include "../src/hardware.h"
+#include "../src/usb.h"
+#include "../src/irq.h"
+#include "../src/emmc.h"
+#include "../src/uart.h"
+#include "../src/smp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Register file size (open addressing, power of two)
+#define SIM_SLOTS           1024
+
+// Bus address translation window: slot index in the top bits, offset below
+#define SIM_BUS_SLOTS       256
+#define SIM_BUS_SHIFT       20
+#define SIM_BUS_OFFSET_MASK ((1U << SIM_BUS_SHIFT) - 1)
+
+// Peripheral addresses private to other modules
+#define SIM_GPIO_GPSET1     (MMIO_BASE + 0x200020)
+#define SIM_GPIO_GPCLR1     (MMIO_BASE + 0x20002C)
+#define SIM_GPIO_GPLEV1     (MMIO_BASE + 0x200038)
+#define SIM_HDMI_STATUS     (MMIO_BASE + 0x902004)
+#define SIM_CPU_FREQ        0x3F100008
+#define SIM_CPU_THROTTLE    0x3F10000C
+#define SIM_CPU_TEMP        0x3F100010
+#define SIM_CPU_VOLTAGE     0x3F100014
+
+// Generic timer: 64 ticks per microsecond, so microsecond timestamps
+// convert exactly. The compare interrupt is the non-secure one.
+#define SIM_CNTFRQ          64000000
+#define SIM_CNTP_LINE       (1u << (IRQ_LOCAL_CNTPNS - IRQ_LOCAL))
+
+// DMA bits
+#define SIM_DMA_CS_ACTIVE   (1 << 0)
+#define SIM_DMA_CS_END      (1 << 1)
+#define SIM_DMA_CS_INT      (1 << 2)
+#define SIM_DMA_CS_RESET    (1U << 31)
+#define SIM_DMA_TI_INTEN    (1 << 0)
+#define SIM_DMA_TI_DEST_DREQ (1 << 6)
+#define SIM_DMA_TI_SRC_INC  (1 << 8)
+#define SIM_DMA_TI_PERMAP(ti) (((ti) >> 16) & 0x1F)
+#define SIM_DMA_MAX_CHAIN   1024
+#define SIM_DMA_CHANNELS    15
+#define SIM_DMA_IRQ_LINES   13          // Channels 0-12 have their own line
+#define SIM_DMA_BYTES_PER_US 400        // Memory-to-memory copies
+
+// UART model
+#define SIM_DREQ_UART_TX    12
+#define SIM_UART_DR_IDLE    0xFFFFFFFF  // DR between writes
+#define SIM_UART_CAPTURE    65536       // Bytes kept for sim_uart_take()
+
+// SD card model
+#define SIM_EMMC_CTO_ERR    (1 << 16)   // Command timeout
+#define SIM_EMMC_DEND_ERR   (1 << 22)   // Data end bit error
+#define SIM_EMMC_CMD_IDLE   0xFFFFFFFF  // CMDTM between commands
+#define SIM_SD_RCA          0x45670000
+#define SIM_SD_POWER_POLLS  2           // ACMD41 calls before the card is ready
+#define SIM_SD_ACCESS_US    100         // Read command to first block
+#define SIM_SD_BLOCK_US     41          // 512 bytes on a 4-bit 25 MHz bus
+
+typedef enum {
+    SIM_SD_IDLE,
+    SIM_SD_READY,
+    SIM_SD_IDENT,
+    SIM_SD_STANDBY,
+    SIM_SD_TRANSFER
+} sim_sd_state_t;
+
+// Controller endpoints
+#define SIM_CTRL_EP_IN      4
+#define SIM_REPORT_SIZE     64
+
+// One simulated register
+typedef struct {
+    uintptr_t addr;
+    uint32_t value;       // What software reads and writes
+    uint32_t published;   // Last value the model wrote, to detect writes
+    int used;
+} sim_slot_t;
+
+// DMA control block as laid out in memory
+typedef struct {
+    uint32_t ti;
+    uint32_t source_ad;
+    uint32_t dest_ad;
+    uint32_t txfr_len;
+    uint32_t stride;
+    uint32_t nextconbk;
+    uint32_t reserved[2];
+} sim_dma_cb_t;
+
+static struct {
+    sim_slot_t slots[SIM_SLOTS];
+
+    // Clock
+    sim_clock_mode_t clock_mode;
+    uint64_t virtual_us;
+    uint32_t tick_us;
+    uint64_t host_start_ns;
+    uint64_t run_limit_us;
+
+    // Environment
+    int attached[3];
+    int hdmi;
+    uint32_t temperature;
+    uint32_t cpu_load;
+    uint32_t voltage_mv;
+    int dma_stalled;
+
+    // Controller
+    ps5_state_t ctrl_state;
+    uint32_t report_interval_us;
+    uint64_t next_report_us;
+    uint64_t report_time_us;
+    int report_ready;
+    uint32_t report_seq;
+    uint8_t last_output[SIM_REPORT_SIZE];
+    int has_output;
+
+    // SD card
+    sim_sd_state_t sd_state;
+    int sd_app_command;
+    uint32_t sd_power_polls;
+    uint32_t sd_lba;                        // Block being read
+    uint32_t sd_blocks_left;
+    uint32_t sd_word;                       // Next word of the block
+    uint32_t sd_block[EMMC_BLOCK_SIZE / 4];
+
+    // Running DMA chains finish at this time (0 = idle)
+    uint64_t dma_done_us[SIM_DMA_CHANNELS];
+
+    // UART transmit capture
+    uint8_t uart_capture[SIM_UART_CAPTURE];
+    uint32_t uart_captured;
+
+    // Per-core physical timers
+    uint64_t cntp_cval[SMP_MAX_CORES];
+    uint32_t cntp_ctl[SMP_MAX_CORES];
+
+    // Interrupts
+    uint32_t irq_enabled[2];
+    int cpu_irq;
+    int in_irq;
+
+    // Bus address translation
+    const void* bus_map[SIM_BUS_SLOTS];
+    uint32_t bus_next;
+
+    // Registers with side effects
+    sim_slot_t* timer_clo;
+    sim_slot_t* timer_chi;
+    sim_slot_t* dma_cs[SIM_DMA_CHANNELS];
+    sim_slot_t* dma_conblk[SIM_DMA_CHANNELS];
+    sim_slot_t* gahbcfg;
+    sim_slot_t* grstctl;
+    sim_slot_t* gintsts;
+    sim_slot_t* gintmsk;
+    sim_slot_t* haint;
+    sim_slot_t* haintmsk;
+    sim_slot_t* hprt[3];
+    sim_slot_t* hcchar[USB_NUM_CHANNELS];
+    sim_slot_t* hcint[USB_NUM_CHANNELS];
+    sim_slot_t* hcintmsk[USB_NUM_CHANNELS];
+    sim_slot_t* hctsiz[USB_NUM_CHANNELS];
+    sim_slot_t* hcdma[USB_NUM_CHANNELS];
+    sim_slot_t* gpset1;
+    sim_slot_t* gpclr1;
+    sim_slot_t* gplev1;
+    sim_slot_t* hdmi_status;
+    sim_slot_t* cpu_freq;
+    sim_slot_t* cpu_throttle;
+    sim_slot_t* cpu_temp;
+    sim_slot_t* cpu_voltage;
+    sim_slot_t* irq_pending[2];
+    sim_slot_t* irq_enable[2];
+    sim_slot_t* irq_disable[2];
+    sim_slot_t* local_timer_cntl[SMP_MAX_CORES];
+    sim_slot_t* local_irq_source[SMP_MAX_CORES];
+    sim_slot_t* emmc_blksizecnt;
+    sim_slot_t* emmc_arg1;
+    sim_slot_t* emmc_cmdtm;
+    sim_slot_t* emmc_resp[4];
+    sim_slot_t* emmc_data;
+    sim_slot_t* emmc_control1;
+    sim_slot_t* emmc_interrupt;
+    sim_slot_t* uart_dr;
+    sim_slot_t* uart_fr;
+    sim_slot_t* uart_ibrd;
+    sim_slot_t* uart_fbrd;
+    sim_slot_t* uart_cr;
+    sim_slot_t* uart_dmacr;
+
+    sim_stats_t stats;
+} sim;
+
+// Disk image behind the SD card; survives sim_reset() like a card in its slot
+static FILE* sd_image;
+static uint32_t sd_image_blocks;
+
+// File or pty receiving UART output; also survives sim_reset()
+static FILE* uart_sink;
+
+// Register file lookup
+static sim_slot_t* slot_lookup(uintptr_t addr) {
+    uint32_t index = (uint32_t)((addr >> 2) * 2654435761u) & (SIM_SLOTS - 1);
+    for (uint32_t probe = 0; probe < SIM_SLOTS; probe++) {
+        sim_slot_t* slot = &sim.slots[(index + probe) & (SIM_SLOTS - 1)];
+        if (!slot->used) {
+            slot->used = 1;
+            slot->addr = addr;
+            return slot;
+        }
+        if (slot->addr == addr) {
+            return slot;
+        }
+    }
+    fprintf(stderr, "sim: register file full at 0x%08lx\n", (unsigned long)addr);
+    abort();
+}
+
+static uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t now_us(void) {
+    if (sim.clock_mode == SIM_CLOCK_HOST) {
+        return (host_now_ns() - sim.host_start_ns) / 1000;
+    }
+    return sim.virtual_us;
+}
+
+// Generic timer count on the same clock
+static uint64_t now_ticks(void) {
+    if (sim.clock_mode == SIM_CLOCK_HOST) {
+        return (host_now_ns() - sim.host_start_ns) * (SIM_CNTFRQ / 1000000) / 1000;
+    }
+    return sim.virtual_us * (SIM_CNTFRQ / 1000000);
+}
+
+// Controller report generation
+static void controller_generate(uint64_t now) {
+    if (sim.report_interval_us == 0 || now < sim.next_report_us) {
+        return;
+    }
+
+    if (sim.report_ready) {
+        sim.stats.reports_missed++;
+    }
+
+    // Sweep the sticks and tap cross so every report differs
+    uint32_t seq = sim.report_seq++;
+    sim.ctrl_state.sticks.lx = (uint8_t)seq;
+    sim.ctrl_state.sticks.ly = (uint8_t)(255 - seq);
+    sim.ctrl_state.sticks.rx = 128;
+    sim.ctrl_state.sticks.ry = 128;
+    sim.ctrl_state.buttons.cross = (seq >> 4) & 1;
+    sim.ctrl_state.triggers.r2 = (uint8_t)(seq * 3);
+
+    sim.report_ready = 1;
+    sim.report_time_us = sim.next_report_us;
+    sim.stats.reports_generated++;
+
+    // Skip intervals the firmware slept through
+    sim.next_report_us += sim.report_interval_us;
+    if (sim.next_report_us <= now) {
+        uint64_t behind = (now - sim.next_report_us) / sim.report_interval_us + 1;
+        sim.stats.reports_missed += (uint32_t)behind;
+        sim.next_report_us += behind * sim.report_interval_us;
+    }
+}
+
+// Finish a channel transfer: set status, remaining size and interrupt flags
+static void channel_halt(uint32_t ch, uint32_t status, uint32_t remaining) {
+    sim.hcint[ch]->value |= status | HCINT_CHHLTD;
+    sim.hcint[ch]->published = sim.hcint[ch]->value;
+    sim.hctsiz[ch]->value = (sim.hctsiz[ch]->value & ~0x7FFFFu) | HCTSIZ_XFERSIZE(remaining);
+    sim.hcchar[ch]->value &= ~(HCCHAR_CHENA | HCCHAR_CHDIS);
+}
+
+// Execute a host channel transfer against the attached devices
+static void channel_run(uint32_t ch) {
+    uint32_t hcchar = sim.hcchar[ch]->value;
+    uint32_t devaddr = (hcchar >> 22) & 0x7F;
+    uint32_t epnum = (hcchar >> 11) & 0xF;
+    int is_in = (hcchar & HCCHAR_EPDIR_IN) != 0;
+    uint32_t size = sim.hctsiz[ch]->value & 0x7FFFF;
+    uint8_t* data = (uint8_t*)sim_bus_to_virt(sim.hcdma[ch]->value);
+
+    if (hcchar & HCCHAR_CHDIS) {
+        channel_halt(ch, 0, size);
+        return;
+    }
+
+    if (devaddr > 2 || !sim.attached[devaddr] || !data) {
+        channel_halt(ch, HCINT_XACTERR, size);
+        return;
+    }
+
+    uint64_t now = now_us();
+
+    if (devaddr == SIM_PORT_CONTROLLER && is_in && epnum == SIM_CTRL_EP_IN) {
+        controller_generate(now);
+        if (!sim.report_ready) {
+            // A channel with halt interrupts unmasked is being serviced from
+            // the IRQ: keep it armed, as if the core retried the NAKs itself
+            if (sim.hcintmsk[ch]->value) {
+                return;
+            }
+            sim.stats.in_naks++;
+            channel_halt(ch, HCINT_NAK, size);
+            return;
+        }
+
+        uint8_t report[SIM_REPORT_SIZE] = {0};
+        report[0] = PS5_REPORT_INPUT;
+        memcpy(report + 1, &sim.ctrl_state, sizeof(ps5_state_t));
+        uint32_t len = size < SIM_REPORT_SIZE ? size : SIM_REPORT_SIZE;
+        memcpy(data, report, len);
+
+        uint32_t age = (uint32_t)(now > sim.report_time_us ? now - sim.report_time_us : 0);
+        sim.stats.report_age_total_us += age;
+        if (age > sim.stats.report_age_max_us) {
+            sim.stats.report_age_max_us = age;
+        }
+        sim.stats.reports_delivered++;
+        sim.report_ready = 0;
+        channel_halt(ch, HCINT_XFERCOMPL, size - len);
+        return;
+    }
+
+    if (!is_in) {
+        if (devaddr == SIM_PORT_CONTROLLER) {
+            uint32_t len = size < SIM_REPORT_SIZE ? size : SIM_REPORT_SIZE;
+            memcpy(sim.last_output, data, len);
+            sim.has_output = 1;
+            sim.stats.out_reports++;
+        } else {
+            sim.stats.ps5_reports++;
+        }
+        channel_halt(ch, HCINT_XFERCOMPL, 0);
+        return;
+    }
+
+    // Nothing to return on other IN endpoints
+    sim.stats.in_naks++;
+    channel_halt(ch, HCINT_NAK, size);
+}
+
+// Line rate from the PL011 divisors, 0 if not programmed
+static uint32_t uart_baud_rate(void) {
+    uint32_t divisor = sim.uart_ibrd->value * 64 + (sim.uart_fbrd->value & 63);
+    return divisor ? (uint32_t)(4ull * UART_CLOCK / divisor) : 0;
+}
+
+// Bytes leaving the UART: captured for tests and copied to the sink
+static void uart_output(const uint8_t* data, uint32_t size) {
+    if ((sim.uart_cr->value & (UART_CR_UARTEN | UART_CR_TXE)) != (UART_CR_UARTEN | UART_CR_TXE)) {
+        return;
+    }
+    uint32_t room = SIM_UART_CAPTURE - sim.uart_captured;
+    uint32_t kept = size < room ? size : room;
+    memcpy(&sim.uart_capture[sim.uart_captured], data, kept);
+    sim.uart_captured += kept;
+    sim.stats.uart_bytes += size;
+    if (uart_sink) {
+        fwrite(data, 1, size, uart_sink);
+        fflush(uart_sink);
+    }
+}
+
+// Execute a DMA control block chain: copies, fills and bytes for the UART
+// when its TX DREQ paces the transfer. Returns the CS bits to raise.
+static uint32_t dma_execute(uint32_t ch) {
+    uint32_t cb_addr = sim.dma_conblk[ch]->value;
+    uint32_t status = SIM_DMA_CS_END;
+
+    for (uint32_t n = 0; cb_addr && n < SIM_DMA_MAX_CHAIN; n++) {
+        sim_dma_cb_t* cb = (sim_dma_cb_t*)sim_bus_to_virt(cb_addr);
+        if (!cb) break;
+
+        uint8_t* dest = (uint8_t*)sim_bus_to_virt(cb->dest_ad);
+        const uint8_t* src = (const uint8_t*)sim_bus_to_virt(cb->source_ad);
+        if ((cb->ti & SIM_DMA_TI_DEST_DREQ) && SIM_DMA_TI_PERMAP(cb->ti) == SIM_DREQ_UART_TX) {
+            if (src && cb->dest_ad == UART0_DR_BUS && (sim.uart_dmacr->value & UART_DMACR_TXDMAE)) {
+                uart_output(src, cb->txfr_len);
+            }
+        } else if (dest && src) {
+            if (cb->ti & SIM_DMA_TI_SRC_INC) {
+                memmove(dest, src, cb->txfr_len);
+            } else {
+                memset(dest, *src, cb->txfr_len);
+            }
+        }
+        if (cb->ti & SIM_DMA_TI_INTEN) {
+            status |= SIM_DMA_CS_INT;
+        }
+        sim.stats.dma_transfers++;
+        cb_addr = cb->nextconbk;
+    }
+    return status;
+}
+
+// Start a chain. It runs for as long as the copies take at memory speed,
+// plus 10 bits per byte (8N1) for transfers paced by the UART's TX DREQ;
+// its effects land when it finishes.
+static void dma_start(uint32_t ch) {
+    uint32_t cb_addr = sim.dma_conblk[ch]->value;
+    uint64_t memory_bytes = 0;
+    uint64_t paced_bytes = 0;
+
+    for (uint32_t n = 0; cb_addr && n < SIM_DMA_MAX_CHAIN; n++) {
+        sim_dma_cb_t* cb = (sim_dma_cb_t*)sim_bus_to_virt(cb_addr);
+        if (!cb) break;
+        if ((cb->ti & SIM_DMA_TI_DEST_DREQ) && SIM_DMA_TI_PERMAP(cb->ti) == SIM_DREQ_UART_TX) {
+            paced_bytes += cb->txfr_len;
+        } else {
+            memory_bytes += cb->txfr_len;
+        }
+        cb_addr = cb->nextconbk;
+    }
+
+    uint64_t duration = (memory_bytes + SIM_DMA_BYTES_PER_US - 1) / SIM_DMA_BYTES_PER_US;
+    uint32_t baud = uart_baud_rate();
+    if (paced_bytes && baud) {
+        duration += (paced_bytes * 10 * 1000000 + baud - 1) / baud;
+    }
+    if (duration == 0 && !sim.dma_stalled) {
+        sim.dma_conblk[ch]->value = 0;
+        sim.dma_cs[ch]->published |= dma_execute(ch);
+        return;
+    }
+    sim.dma_done_us[ch] = now_us() + duration;
+    sim.dma_cs[ch]->published |= SIM_DMA_CS_ACTIVE;
+}
+
+// Raise EMMC interrupt status bits
+static void emmc_raise(uint32_t bits) {
+    sim.emmc_interrupt->published |= bits;
+    sim.emmc_interrupt->value = sim.emmc_interrupt->published;
+}
+
+// Load the next block of a read from the image
+static void sd_load_block(void) {
+    if (fseek(sd_image, (long)sim.sd_lba * EMMC_BLOCK_SIZE, SEEK_SET) != 0 ||
+        fread(sim.sd_block, EMMC_BLOCK_SIZE, 1, sd_image) != 1) {
+        sim.sd_blocks_left = 0;
+        emmc_raise(EMMC_INT_ERR | SIM_EMMC_DEND_ERR);
+        return;
+    }
+    sim.sd_word = 0;
+    if (sim.clock_mode == SIM_CLOCK_VIRTUAL) {
+        sim.virtual_us += SIM_SD_BLOCK_US;
+    }
+    emmc_raise(EMMC_INT_READ_RDY);
+}
+
+// The firmware read a word from EMMC_DATA
+static void sd_data_read(void) {
+    if (!sim.sd_blocks_left) {
+        sim.emmc_data->value = 0;
+        return;
+    }
+    sim.emmc_data->value = sim.sd_block[sim.sd_word++];
+    if (sim.sd_word == EMMC_BLOCK_SIZE / 4) {
+        sim.stats.sd_blocks_read++;
+        sim.sd_lba++;
+        if (--sim.sd_blocks_left) {
+            sd_load_block();
+        } else {
+            emmc_raise(EMMC_INT_DATA_DONE);
+        }
+    }
+}
+
+// Execute a command written to CMDTM against the card
+static void sd_command(uint32_t cmdtm, uint32_t arg) {
+    uint32_t index = cmdtm >> 24;
+    uint32_t response = cmdtm & CMDTM_RSP_48_BUSY;
+    int app = sim.sd_app_command;
+    uint32_t r1 = (uint32_t)sim.sd_state << 9;
+    int legal = 1;
+
+    sim.sd_app_command = 0;
+    sim.stats.sd_commands++;
+
+    // No card: commands with a response time out
+    if (!sd_image) {
+        emmc_raise(response == CMDTM_RSP_NONE ? EMMC_INT_CMD_DONE : EMMC_INT_ERR | SIM_EMMC_CTO_ERR);
+        return;
+    }
+
+    for (uint32_t i = 0; i < 4; i++) {
+        sim.emmc_resp[i]->value = 0;
+    }
+    if (app && index == 41) {
+        // SD_SEND_OP_COND: busy for a few polls, then ready with high capacity
+        uint32_t ocr = 0x00FF8000;
+        if (++sim.sd_power_polls >= SIM_SD_POWER_POLLS) {
+            ocr |= (1U << 31) | (arg & (1U << 30));
+            sim.sd_state = SIM_SD_READY;
+        }
+        sim.emmc_resp[0]->value = ocr;
+    } else if (app && index == 6) {
+        // SET_BUS_WIDTH
+        sim.emmc_resp[0]->value = r1;
+    } else {
+        switch (index) {
+            case 0:
+                sim.sd_state = SIM_SD_IDLE;
+                sim.sd_power_polls = 0;
+                break;
+            case 2:
+                if (sim.sd_state != SIM_SD_READY) { legal = 0; break; }
+                sim.emmc_resp[0]->value = 0x43484231;   // CID
+                sim.sd_state = SIM_SD_IDENT;
+                break;
+            case 3:
+                if (sim.sd_state != SIM_SD_IDENT) { legal = 0; break; }
+                sim.emmc_resp[0]->value = SIM_SD_RCA;
+                sim.sd_state = SIM_SD_STANDBY;
+                break;
+            case 7:
+                if (arg != SIM_SD_RCA) { legal = 0; break; }
+                sim.sd_state = SIM_SD_TRANSFER;
+                sim.emmc_resp[0]->value = r1;
+                break;
+            case 8:
+                sim.emmc_resp[0]->value = arg & 0xFFF;
+                break;
+            case 16:
+            case 55:
+                sim.sd_app_command = index == 55;
+                sim.emmc_resp[0]->value = r1;
+                break;
+            case 17:
+            case 18: {
+                uint32_t blocks = index == 17 ? 1 : sim.emmc_blksizecnt->value >> 16;
+                if (sim.sd_state != SIM_SD_TRANSFER || !(cmdtm & CMDTM_ISDATA) || !blocks) {
+                    legal = 0;
+                    break;
+                }
+                sim.emmc_resp[0]->value = r1;
+                emmc_raise(EMMC_INT_CMD_DONE);
+                if ((uint64_t)arg + blocks > sd_image_blocks) {
+                    emmc_raise(EMMC_INT_ERR | SIM_EMMC_DEND_ERR);
+                    return;
+                }
+                if (sim.clock_mode == SIM_CLOCK_VIRTUAL) {
+                    sim.virtual_us += SIM_SD_ACCESS_US;
+                }
+                sim.sd_lba = arg;
+                sim.sd_blocks_left = blocks;
+                sd_load_block();
+                return;
+            }
+            default:
+                legal = 0;
+                break;
+        }
+    }
+
+    // Illegal commands get no response
+    emmc_raise(legal ? EMMC_INT_CMD_DONE : EMMC_INT_ERR | SIM_EMMC_CTO_ERR);
+}
+
+// Apply pending software writes and refresh model-owned registers
+static void sim_step(void) {
+    // Core soft reset completes immediately, AHB always idle
+    sim.grstctl->value = (sim.grstctl->value & ~1u) | (1u << 31);
+
+    // DMA channels: paced transfers finish, then any new writes
+    for (uint32_t ch = 0; ch < SIM_DMA_CHANNELS; ch++) {
+        sim_slot_t* cs = sim.dma_cs[ch];
+        if (sim.dma_done_us[ch] && !sim.dma_stalled && now_us() >= sim.dma_done_us[ch]) {
+            sim.dma_done_us[ch] = 0;
+            uint32_t status = dma_execute(ch);
+            sim.dma_conblk[ch]->value = 0;
+            cs->published = (cs->published & ~SIM_DMA_CS_ACTIVE) | status;
+            cs->value = cs->published;
+        }
+        if (cs->value != cs->published) {
+            uint32_t w = cs->value;
+            if (w & SIM_DMA_CS_RESET) {
+                cs->published = 0;
+                sim.dma_done_us[ch] = 0;
+            } else {
+                cs->published &= ~(w & (SIM_DMA_CS_END | SIM_DMA_CS_INT));
+                if ((w & SIM_DMA_CS_ACTIVE) && !sim.dma_done_us[ch]) {
+                    dma_start(ch);
+                }
+            }
+            cs->value = cs->published;
+        }
+    }
+
+    // UART: polled writes go out at once, the FIFO never fills
+    if (sim.uart_dr->value != SIM_UART_DR_IDLE) {
+        uint8_t byte = (uint8_t)sim.uart_dr->value;
+        sim.uart_dr->value = SIM_UART_DR_IDLE;
+        uart_output(&byte, 1);
+    }
+    sim.uart_fr->value = UART_FR_TXFE;
+
+    // EMMC: self-clearing reset, instant clock, write-1-to-clear status, then
+    // any command written since the last step
+    if (sim.emmc_control1->value & EMMC_SRST_HC) {
+        sim.emmc_control1->value = 0;
+        sim.sd_blocks_left = 0;
+    }
+    if (sim.emmc_control1->value & EMMC_CLK_INTLEN) {
+        sim.emmc_control1->value |= EMMC_CLK_STABLE;
+    }
+    if (sim.emmc_interrupt->value != sim.emmc_interrupt->published) {
+        sim.emmc_interrupt->value = sim.emmc_interrupt->published & ~sim.emmc_interrupt->value;
+        sim.emmc_interrupt->published = sim.emmc_interrupt->value;
+    }
+    if (sim.emmc_cmdtm->value != SIM_EMMC_CMD_IDLE) {
+        uint32_t cmdtm = sim.emmc_cmdtm->value;
+        sim.emmc_cmdtm->value = SIM_EMMC_CMD_IDLE;
+        sd_command(cmdtm, sim.emmc_arg1->value);
+    }
+
+    // USB host channels: write-1-to-clear status, then start enabled channels
+    for (uint32_t ch = 0; ch < USB_NUM_CHANNELS; ch++) {
+        sim_slot_t* hcint = sim.hcint[ch];
+        if (hcint->value != hcint->published) {
+            hcint->value = hcint->published & ~hcint->value;
+            hcint->published = hcint->value;
+        }
+        if (sim.hcchar[ch]->value & HCCHAR_CHENA) {
+            channel_run(ch);
+        }
+    }
+
+    // Host interrupt tree: HCINT & HCINTMSK -> HAINT -> GINTSTS.HCHINT
+    uint32_t haint = 0;
+    for (uint32_t ch = 0; ch < USB_NUM_CHANNELS; ch++) {
+        if (sim.hcint[ch]->value & sim.hcintmsk[ch]->value) {
+            haint |= 1u << ch;
+        }
+    }
+    sim.haint->value = haint;
+    if (haint & sim.haintmsk->value) {
+        sim.gintsts->value |= GINTSTS_HCHINT;
+    } else {
+        sim.gintsts->value &= ~GINTSTS_HCHINT;
+    }
+
+    // ARM interrupt controller: enable/disable are write-1-to-set/clear
+    for (uint32_t bank = 0; bank < 2; bank++) {
+        sim.irq_enabled[bank] |= sim.irq_enable[bank]->value;
+        sim.irq_enabled[bank] &= ~sim.irq_disable[bank]->value;
+        sim.irq_enable[bank]->value = 0;
+        sim.irq_disable[bank]->value = 0;
+    }
+    uint32_t usb_line = (sim.gahbcfg->value & 1) &&
+                        (sim.gintsts->value & sim.gintmsk->value);
+    uint32_t lines = usb_line ? 1u << IRQ_USB : 0;
+    for (uint32_t ch = 0; ch < SIM_DMA_IRQ_LINES; ch++) {
+        if (sim.dma_cs[ch]->published & SIM_DMA_CS_INT) {
+            lines |= 1u << (IRQ_DMA0 + ch);
+        }
+    }
+    sim.irq_pending[0]->value = lines & sim.irq_enabled[0];
+    sim.irq_pending[1]->value = 0;
+
+    // Local interrupt controller: each core's timer, once its compare value
+    // is reached, if enabled and not masked
+    uint64_t ticks = now_ticks();
+    for (uint32_t core = 0; core < SMP_MAX_CORES; core++) {
+        uint32_t ctl = sim.cntp_ctl[core];
+        int fired = (ctl & HAL_TIMER_ENABLE) && !(ctl & HAL_TIMER_IMASK) &&
+                    ticks >= sim.cntp_cval[core];
+        sim.local_irq_source[core]->value = fired ? sim.local_timer_cntl[core]->value & SIM_CNTP_LINE : 0;
+    }
+
+    // Root ports: connect/enable follow attach state once powered
+    for (uint32_t port = 1; port <= 2; port++) {
+        uint32_t v = sim.hprt[port]->value & ~0xFu;
+        if (sim.attached[port] && (v & (1 << 12))) {
+            v |= 0xF;
+        }
+        sim.hprt[port]->value = v;
+    }
+
+    // Status LED
+    if (sim.gpset1->value) {
+        uint32_t rising = sim.gpset1->value & ~sim.gplev1->value;
+        sim.stats.led_toggles += __builtin_popcount(rising);
+        sim.gplev1->value |= sim.gpset1->value;
+        sim.gpset1->value = 0;
+    }
+    if (sim.gpclr1->value) {
+        uint32_t falling = sim.gpclr1->value & sim.gplev1->value;
+        sim.stats.led_toggles += __builtin_popcount(falling);
+        sim.gplev1->value &= ~sim.gpclr1->value;
+        sim.gpclr1->value = 0;
+    }
+
+    sim.hdmi_status->value = sim.hdmi ? 1 : 0;
+    sim.cpu_temp->value = sim.temperature;
+    sim.cpu_throttle->value = sim.cpu_load * 255 / 100;
+    sim.cpu_voltage->value = (sim.voltage_mv * 4096 / 1000) & 0xFFF;
+}
+
+// Refresh the free-running system timer
+static void timer_refresh(void) {
+    if (sim.clock_mode == SIM_CLOCK_VIRTUAL) {
+        sim.virtual_us += sim.tick_us;
+    }
+    uint64_t now = now_us();
+
+    if (sim.run_limit_us && now >= sim.run_limit_us) {
+        sim_print_stats();
+        exit(0);
+    }
+
+    sim.timer_clo->value = (uint32_t)now;
+    sim.timer_chi->value = (uint32_t)(now >> 32);
+}
+
+// Take a pending interrupt. Interrupts are recognised at register access
+// boundaries, and the handler runs with further interrupts masked.
+static void irq_deliver(void) {
+    if (!sim.cpu_irq || sim.in_irq) {
+        return;
+    }
+    if (!sim.irq_pending[0]->value && !sim.irq_pending[1]->value &&
+        !sim.local_irq_source[smp_core_id()]->value) {
+        return;
+    }
+    sim.in_irq = 1;
+    sim.stats.irqs_taken++;
+    irq_dispatch();
+    sim.in_irq = 0;
+}
+
+// HAL entry point: every register access goes through here
+volatile uint32_t* sim_reg(uintptr_t addr) {
+    sim.stats.mmio_accesses++;
+    sim_step();
+
+    if (addr == TIMER_BASE + 0x04 || addr == TIMER_BASE + 0x08) {
+        sim.stats.timer_reads++;
+        timer_refresh();
+    } else if (addr == EMMC_BASE + 0x20) {
+        sd_data_read();
+    }
+
+    irq_deliver();
+
+    return &slot_lookup(addr)->value;
+}
+
+// CNTPCT read: time passes as for a system timer read, without the bus
+uint64_t sim_counter(void) {
+    sim.stats.counter_reads++;
+    sim_step();
+    timer_refresh();
+    irq_deliver();
+    return now_ticks();
+}
+
+uint32_t sim_counter_freq(void) {
+    return SIM_CNTFRQ;
+}
+
+// CNTP_CVAL and CNTP_CTL of the core running
+void sim_timer_compare(uint64_t cval) {
+    sim.cntp_cval[smp_core_id()] = cval;
+    sim_step();
+    irq_deliver();
+}
+
+void sim_timer_control(uint32_t ctl) {
+    sim.cntp_ctl[smp_core_id()] = ctl & (HAL_TIMER_ENABLE | HAL_TIMER_IMASK);
+    sim_step();
+    irq_deliver();
+}
+
+// CPSR I bit
+void sim_cpu_irq(int enable) {
+    sim.cpu_irq = enable;
+    if (enable) {
+        sim_step();
+        irq_deliver();
+    }
+}
+
+// Hand out a 32-bit ARM physical address for a host pointer. Slots sit
+// below the peripheral window, like RAM on the Pi.
+uint32_t sim_phys_addr(const void* ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < SIM_BUS_SLOTS; i++) {
+        if (sim.bus_map[i] == ptr) {
+            return (i + 1) << SIM_BUS_SHIFT;
+        }
+    }
+    uint32_t slot = sim.bus_next;
+    sim.bus_next = (sim.bus_next + 1) % SIM_BUS_SLOTS;
+    sim.bus_map[slot] = ptr;
+    return (slot + 1) << SIM_BUS_SHIFT;
+}
+
+// What a bus master sees at a bus address. Memory is only reachable
+// through the SDRAM alias; a bare physical address reaches nothing, as a
+// transfer handed an untranslated pointer would on the Pi.
+void* sim_bus_to_virt(uint32_t bus_addr) {
+    if ((bus_addr & HAL_BUS_SDRAM) != HAL_BUS_SDRAM) {
+        return NULL;
+    }
+    uint32_t phys = bus_addr & ~(uint32_t)HAL_BUS_SDRAM;
+    uint32_t slot = phys >> SIM_BUS_SHIFT;
+    if (slot == 0 || slot > SIM_BUS_SLOTS || !sim.bus_map[slot - 1]) {
+        return NULL;
+    }
+    return (uint8_t*)sim.bus_map[slot - 1] + (phys & SIM_BUS_OFFSET_MASK);
+}
+
+// Reset the whole machine to power-on defaults
+void sim_reset(void) {
+    // The clock keeps running across resets so callers timing a reset see it
+    uint64_t virtual_us = sim.virtual_us;
+
+    memset(&sim, 0, sizeof(sim));
+
+    sim.virtual_us = virtual_us;
+    sim.clock_mode = SIM_CLOCK_VIRTUAL;
+    sim.tick_us = 1;
+    sim.host_start_ns = host_now_ns();
+    sim.attached[SIM_PORT_PS5] = 1;
+    sim.attached[SIM_PORT_CONTROLLER] = 1;
+    sim.hdmi = 1;
+    sim.temperature = 45;
+    sim.cpu_load = 20;
+    sim.voltage_mv = 1200;
+    sim.report_interval_us = 1000;
+    sim.next_report_us = virtual_us + 1000;
+    sim.ctrl_state.battery_level = 80;
+    sim.ctrl_state.temperature = 30;
+    sim.ctrl_state.sticks.lx = sim.ctrl_state.sticks.ly = 128;
+    sim.ctrl_state.sticks.rx = sim.ctrl_state.sticks.ry = 128;
+
+    sim.timer_clo = slot_lookup(TIMER_BASE + 0x04);
+    sim.timer_chi = slot_lookup(TIMER_BASE + 0x08);
+    for (uint32_t ch = 0; ch < SIM_DMA_CHANNELS; ch++) {
+        sim.dma_cs[ch] = slot_lookup(DMA_CHANNEL_BASE(ch) + 0x00);
+        sim.dma_conblk[ch] = slot_lookup(DMA_CHANNEL_BASE(ch) + 0x04);
+    }
+    sim.gahbcfg = slot_lookup(USB_CORE_BASE + 0x008);
+    sim.grstctl = slot_lookup(USB_CORE_BASE + 0x010);
+    sim.gintsts = slot_lookup(USB_CORE_BASE + 0x014);
+    sim.gintmsk = slot_lookup(USB_CORE_BASE + 0x018);
+    sim.haint = slot_lookup(USB_HOST_BASE + 0x014);
+    sim.haintmsk = slot_lookup(USB_HOST_BASE + 0x018);
+    for (uint32_t port = 1; port <= 2; port++) {
+        sim.hprt[port] = slot_lookup(USB_HOST_BASE + 0x040 + (port - 1) * 0x20);
+    }
+    for (uint32_t ch = 0; ch < USB_NUM_CHANNELS; ch++) {
+        sim.hcchar[ch] = slot_lookup(USB_HC_BASE(ch) + 0x00);
+        sim.hcint[ch] = slot_lookup(USB_HC_BASE(ch) + 0x08);
+        sim.hcintmsk[ch] = slot_lookup(USB_HC_BASE(ch) + 0x0C);
+        sim.hctsiz[ch] = slot_lookup(USB_HC_BASE(ch) + 0x10);
+        sim.hcdma[ch] = slot_lookup(USB_HC_BASE(ch) + 0x14);
+    }
+    sim.gpset1 = slot_lookup(SIM_GPIO_GPSET1);
+    sim.gpclr1 = slot_lookup(SIM_GPIO_GPCLR1);
+    sim.gplev1 = slot_lookup(SIM_GPIO_GPLEV1);
+    sim.hdmi_status = slot_lookup(SIM_HDMI_STATUS);
+    sim.cpu_freq = slot_lookup(SIM_CPU_FREQ);
+    sim.cpu_throttle = slot_lookup(SIM_CPU_THROTTLE);
+    sim.cpu_temp = slot_lookup(SIM_CPU_TEMP);
+    sim.cpu_voltage = slot_lookup(SIM_CPU_VOLTAGE);
+    sim.irq_pending[0] = slot_lookup(IRQ_BASE + 0x204);
+    sim.irq_pending[1] = slot_lookup(IRQ_BASE + 0x208);
+    sim.irq_enable[0] = slot_lookup(IRQ_BASE + 0x210);
+    sim.irq_enable[1] = slot_lookup(IRQ_BASE + 0x214);
+    sim.irq_disable[0] = slot_lookup(IRQ_BASE + 0x21C);
+    sim.irq_disable[1] = slot_lookup(IRQ_BASE + 0x220);
+    for (uint32_t core = 0; core < SMP_MAX_CORES; core++) {
+        sim.local_timer_cntl[core] = slot_lookup(ARM_LOCAL_BASE + 0x40 + core * 4);
+        sim.local_irq_source[core] = slot_lookup(ARM_LOCAL_BASE + 0x60 + core * 4);
+    }
+    sim.emmc_blksizecnt = slot_lookup(EMMC_BASE + 0x04);
+    sim.emmc_arg1 = slot_lookup(EMMC_BASE + 0x08);
+    sim.emmc_cmdtm = slot_lookup(EMMC_BASE + 0x0C);
+    for (uint32_t i = 0; i < 4; i++) {
+        sim.emmc_resp[i] = slot_lookup(EMMC_BASE + 0x10 + i * 4);
+    }
+    sim.emmc_data = slot_lookup(EMMC_BASE + 0x20);
+    sim.emmc_control1 = slot_lookup(EMMC_BASE + 0x2C);
+    sim.emmc_interrupt = slot_lookup(EMMC_BASE + 0x30);
+    sim.uart_dr = slot_lookup(UART0_BASE + 0x00);
+    sim.uart_fr = slot_lookup(UART0_BASE + 0x18);
+    sim.uart_ibrd = slot_lookup(UART0_BASE + 0x24);
+    sim.uart_fbrd = slot_lookup(UART0_BASE + 0x28);
+    sim.uart_cr = slot_lookup(UART0_BASE + 0x30);
+    sim.uart_dmacr = slot_lookup(UART0_BASE + 0x48);
+
+    // CMDTM reads back all-ones between commands, so that any write, even
+    // CMD0's zero, is seen. UART DR does the same for a zero byte.
+    sim.emmc_cmdtm->value = SIM_EMMC_CMD_IDLE;
+    sim.uart_dr->value = SIM_UART_DR_IDLE;
+    sim.uart_fr->value = UART_FR_TXFE;
+
+    sim.grstctl->value = 1u << 31;
+}
+
+// Configure from the environment before main() runs
+__attribute__((constructor))
+static void sim_startup(void) {
+    const char* env;
+
+    sim_reset();
+
+    env = getenv("SIM_CLOCK");
+    if (env && strcmp(env, "host") == 0) {
+        sim_set_clock_mode(SIM_CLOCK_HOST);
+    }
+    env = getenv("SIM_RUN_US");
+    if (env) {
+        sim_set_run_limit_us(strtoull(env, NULL, 10));
+    }
+    env = getenv("SIM_SD_IMAGE");
+    if (env && !sim_sd_attach_image(env)) {
+        fprintf(stderr, "sim: cannot open SD image %s\n", env);
+    }
+    env = getenv("SIM_UART");
+    if (env && !sim_uart_attach(env)) {
+        fprintf(stderr, "sim: cannot open UART output %s\n", env);
+    }
+    env = getenv("SIM_REPORT_US");
+    if (env) {
+        sim_controller_set_report_interval((uint32_t)strtoul(env, NULL, 10));
+    }
+}
+
+void sim_set_clock_mode(sim_clock_mode_t mode) {
+    sim.clock_mode = mode;
+    sim.host_start_ns = host_now_ns() - sim.virtual_us * 1000;
+}
+
+void sim_set_tick_us(uint32_t tick_us) {
+    sim.tick_us = tick_us;
+}
+
+void sim_set_run_limit_us(uint64_t limit_us) {
+    sim.run_limit_us = limit_us;
+}
+
+uint64_t sim_time_us(void) {
+    return now_us();
+}
+
+// Cycle counter stand-in: host time in ns, whatever the clock mode, so
+// profiling zones measure the code rather than the virtual clock
+uint32_t sim_cycles(void) {
+    return (uint32_t)host_now_ns();
+}
+
+// Let time pass; interrupts raised in the meantime are taken on return
+void sim_advance_us(uint64_t us) {
+    if (sim.clock_mode == SIM_CLOCK_VIRTUAL) {
+        sim.virtual_us += us;
+    }
+    sim_step();
+    irq_deliver();
+}
+
+void sim_attach_device(uint32_t port, int attached) {
+    if (port >= 1 && port <= 2) {
+        sim.attached[port] = attached;
+    }
+}
+
+void sim_set_hdmi(int connected) {
+    sim.hdmi = connected;
+}
+
+void sim_set_temperature(uint32_t celsius) {
+    sim.temperature = celsius;
+}
+
+void sim_set_cpu_load(uint32_t load_percent) {
+    sim.cpu_load = load_percent > 100 ? 100 : load_percent;
+}
+
+// A stalled engine takes chains but never finishes them
+void sim_set_dma_stall(int stalled) {
+    sim.dma_stalled = stalled;
+}
+
+// The voltage register holds a 12-bit fraction of 1 V
+void sim_set_voltage_mv(uint32_t millivolts) {
+    sim.voltage_mv = millivolts > 999 ? 999 : millivolts;
+}
+
+// 0 disables automatic generation; reports then come from sim_controller_set_state()
+void sim_controller_set_report_interval(uint32_t interval_us) {
+    sim.report_interval_us = interval_us;
+    sim.next_report_us = now_us() + interval_us;
+}
+
+// Queue a specific controller state as the next input report
+void sim_controller_set_state(const ps5_state_t* state) {
+    if (!state) return;
+    if (sim.report_ready) {
+        sim.stats.reports_missed++;
+    }
+    sim.ctrl_state = *state;
+    sim.report_ready = 1;
+    sim.report_time_us = now_us();
+    sim.stats.reports_generated++;
+}
+
+// Last OUT report received by the controller
+int sim_controller_get_output(uint8_t* buffer, uint32_t size) {
+    if (!buffer || !sim.has_output) return 0;
+    uint32_t len = size < SIM_REPORT_SIZE ? size : SIM_REPORT_SIZE;
+    memcpy(buffer, sim.last_output, len);
+    return (int)len;
+}
+
+// Put a disk image in the SD slot; NULL empties the slot
+int sim_sd_attach_image(const char* path) {
+    if (sd_image) {
+        fclose(sd_image);
+        sd_image = NULL;
+        sd_image_blocks = 0;
+    }
+    if (!path) {
+        return 1;
+    }
+
+    sd_image = fopen(path, "rb");
+    if (!sd_image || fseek(sd_image, 0, SEEK_END) != 0) {
+        sim_sd_attach_image(NULL);
+        return 0;
+    }
+    sd_image_blocks = (uint32_t)(ftell(sd_image) / EMMC_BLOCK_SIZE);
+    return 1;
+}
+
+// Send UART output to a file or pty as well; NULL detaches it
+int sim_uart_attach(const char* path) {
+    if (uart_sink) {
+        fclose(uart_sink);
+        uart_sink = NULL;
+    }
+    if (!path) {
+        return 1;
+    }
+    uart_sink = fopen(path, "wb");
+    return uart_sink != NULL;
+}
+
+// Take the bytes sent since the last call, up to size
+uint32_t sim_uart_take(uint8_t* buffer, uint32_t size) {
+    sim_step();
+    uint32_t taken = size < sim.uart_captured ? size : sim.uart_captured;
+    memcpy(buffer, sim.uart_capture, taken);
+    memmove(sim.uart_capture, &sim.uart_capture[taken], sim.uart_captured - taken);
+    sim.uart_captured -= taken;
+    return taken;
+}
+
+int sim_gpio_get(uint32_t pin) {
+    sim_step();
+    if (pin < 32 || pin >= 64) return 0;
+    return (sim.gplev1->value >> (pin - 32)) & 1;
+}
+
+uint32_t sim_cpu_freq(void) {
+    return sim.cpu_freq->value;
+}
+
+void sim_get_stats(sim_stats_t* stats) {
+    if (stats) {
+        *stats = sim.stats;
+    }
+}
+
+void sim_print_stats(void) {
+    uint32_t avg_age = sim.stats.reports_delivered ?
+        (uint32_t)(sim.stats.report_age_total_us / sim.stats.reports_delivered) : 0;
+
+    printf("sim: %llu us simulated, %llu MMIO accesses\n",
+           (unsigned long long)now_us(), (unsigned long long)sim.stats.mmio_accesses);
+    printf("sim: reports generated %u, delivered %u, missed %u, NAKs %u\n",
+           sim.stats.reports_generated, sim.stats.reports_delivered,
+           sim.stats.reports_missed, sim.stats.in_naks);
+    printf("sim: report age avg %u us, max %u us\n", avg_age, sim.stats.report_age_max_us);
+    printf("sim: controller OUT %u, console OUT %u, DMA %u, LED edges %u, IRQs %u\n",
+           sim.stats.out_reports, sim.stats.ps5_reports,
+           sim.stats.dma_transfers, sim.stats.led_toggles, sim.stats.irqs_taken);
+    if (sim.stats.sd_commands) {
+        printf("sim: SD commands %u, blocks read %u\n", sim.stats.sd_commands, sim.stats.sd_blocks_read);
+    }
+    if (sim.stats.uart_bytes) {
+        printf("sim: UART bytes %u\n", sim.stats.uart_bytes);
+    }
+}
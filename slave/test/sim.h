@@ -0,0 +1,95 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "../src/ps5.h"
+
+// Register-level BCM2837 simulator for host builds
+//
+// Backs HAL_REG() with a sparse register file and models the peripherals the
+// firmware touches: system timer, the per-core generic timers (CNTPCT and
+// the CNTP compare interrupt through the ARM local interrupt controller),
+// DMA channels 0-14 (copies run at memory speed and land when the chain
+// finishes), DWC2 root ports and host channels, GPIO 47 (status LED), HDMI
+// hot-plug and the CPU thermal/voltage block, the ARM interrupt controller
+// for the USB and DMA lines, an SD card on the EMMC controller backed by a
+// disk image, and UART0, whose TX DREQ paces DMA at the programmed baud
+// rate. A virtual PS5 console sits on port 1 and a controller producing
+// input reports sits on port 2.
+//
+// Environment variables read at startup:
+//   SIM_CLOCK=host|virtual   Time source (default virtual)
+//   SIM_RUN_US=<us>          Exit after this much simulated time
+//   SIM_REPORT_US=<us>       Controller report interval (default 1000)
+//   SIM_SD_IMAGE=<path>      Disk image in the SD slot
+//   SIM_UART=<path>          File or pty receiving UART0 output
+
+// Root port numbers
+#define SIM_PORT_PS5          1
+#define SIM_PORT_CONTROLLER   2
+
+// Time sources
+typedef enum {
+    SIM_CLOCK_VIRTUAL,   // Advances a fixed tick per timer or counter read
+    SIM_CLOCK_HOST       // Tracks CLOCK_MONOTONIC
+} sim_clock_mode_t;
+
+// Simulator counters
+typedef struct {
+    uint64_t mmio_accesses;       // HAL_REG() evaluations
+    uint32_t reports_generated;   // Controller input reports produced
+    uint32_t reports_delivered;   // Input reports read by the firmware
+    uint32_t reports_missed;      // Reports overwritten before being read
+    uint32_t in_naks;             // IN transfers with no report ready
+    uint32_t out_reports;         // OUT transfers to the controller
+    uint32_t ps5_reports;         // OUT transfers to the console
+    uint32_t dma_transfers;       // DMA control blocks executed
+    uint32_t led_toggles;         // Status LED edges
+    uint32_t irqs_taken;          // Interrupts dispatched to the firmware
+    uint64_t report_age_total_us; // Sum of report age at delivery
+    uint32_t report_age_max_us;   // Worst report age at delivery
+    uint32_t sd_commands;         // Commands sent to the SD card
+    uint32_t sd_blocks_read;      // 512-byte blocks read from the card
+    uint32_t uart_bytes;          // Bytes sent on UART0
+    uint64_t timer_reads;         // System timer CLO/CHI reads
+    uint64_t counter_reads;       // Generic timer CNTPCT reads
+} sim_stats_t;
+
+// Setup
+void sim_reset(void);
+void sim_set_clock_mode(sim_clock_mode_t mode);
+void sim_set_tick_us(uint32_t tick_us);
+void sim_set_run_limit_us(uint64_t limit_us);
+
+// Time
+uint64_t sim_time_us(void);
+void sim_advance_us(uint64_t us);
+
+// Environment
+void sim_attach_device(uint32_t port, int attached);
+void sim_set_hdmi(int connected);
+void sim_set_temperature(uint32_t celsius);
+void sim_set_cpu_load(uint32_t load_percent);
+void sim_set_voltage_mv(uint32_t millivolts);
+void sim_set_dma_stall(int stalled);
+int sim_sd_attach_image(const char* path);
+int sim_uart_attach(const char* path);
+
+// Controller model
+void sim_controller_set_report_interval(uint32_t interval_us);
+void sim_controller_set_state(const ps5_state_t* state);
+int sim_controller_get_output(uint8_t* buffer, uint32_t size);
+
+// UART0 transmit side
+uint32_t sim_uart_take(uint8_t* buffer, uint32_t size);
+
+// Inspection
+int sim_gpio_get(uint32_t pin);
+uint32_t sim_cpu_freq(void);
+void sim_get_stats(sim_stats_t* stats);
+void sim_print_stats(void);
+
+// Bus address translation used by the DMA and USB models
+void* sim_bus_to_virt(uint32_t bus_addr);
+
+#endif // SIM_H
@@ -1,6 +1,8 @@
 #ifndef TEST_CONFIG_H
 #define TEST_CONFIG_H
 
+#include <stdint.h>
+
 // Test Thresholds and Parameters
 #define TEST_LATENCY_THRESHOLD_US        1000    // 1ms maximum input latency
 #define TEST_FRAME_TIME_THRESHOLD_US     16667   // 60fps minimum (16.67ms)
@@ -52,7 +54,7 @@ typedef enum {
     TEST_CAT_STABILITY,     // Long-term stability
     TEST_CAT_FEATURES,      // Feature verification
     TEST_CAT_STRESS        // Stress testing
-} test_category_t;
+} test_config_category_t;
 
 // Test Priority
 typedef enum {
@@ -65,7 +67,7 @@ typedef enum {
 // Test Configuration Structure
 typedef struct {
     const char* name;           // Test name
-    test_category_t category;   // Test category
+    test_config_category_t category; // Test category
     test_priority_t priority;   // Test priority
     uint32_t duration_ms;       // Test duration
     uint32_t iterations;        // Test iterations
@@ -1,6 +1,7 @@
 #include "test_framework.h"
 #include "test_script_gui.h"
 #include "../src/util.h"
+#include "../src/hardware.h"
 
 // Test registry
 static struct {
@@ -27,6 +28,9 @@ static struct {
         const char* current_test;
         int test_failed;
         char failure_message[256];
+        uint32_t latency_p50_us;
+        uint32_t latency_p99_us;
+        uint32_t latency_p999_us;
     } state;
 } test_framework = {0};
 
@@ -59,6 +63,9 @@ static void run_test(uint32_t test_index) {
     // Setup test
     test_framework.state.current_test = test_framework.tests[test_index].name;
     test_framework.state.test_failed = 0;
+    test_framework.state.latency_p50_us = 0;
+    test_framework.state.latency_p99_us = 0;
+    test_framework.state.latency_p999_us = 0;
     test_framework.state.start_time = get_system_time();
     
     // Run test with timeout
@@ -75,6 +82,9 @@ static void run_test(uint32_t test_index) {
         result->type = test_framework.tests[test_index].type;
         result->passed = !test_framework.state.test_failed;
         result->duration_us = duration;
+        result->latency_us = test_framework.state.latency_p99_us;
+        result->latency_p50_us = test_framework.state.latency_p50_us;
+        result->latency_p999_us = test_framework.state.latency_p999_us;
         if (test_framework.state.test_failed) {
             str_copy(result->message, test_framework.state.failure_message, sizeof(result->message));
             test_framework.results.failed_count++;
@@ -140,6 +150,13 @@ void test_set_timeout(uint32_t timeout_ms) {
     test_framework.state.timeout_ms = timeout_ms;
 }
 
+// Record the latency distribution measured by the current test
+void test_record_latency(uint32_t p50_us, uint32_t p99_us, uint32_t p999_us) {
+    test_framework.state.latency_p50_us = p50_us;
+    test_framework.state.latency_p99_us = p99_us;
+    test_framework.state.latency_p999_us = p999_us;
+}
+
 // Get test results
 void test_get_results(const test_result_t** results, uint32_t* count,
                      uint32_t* passed, uint32_t* failed, uint32_t* skipped) {
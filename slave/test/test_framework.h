@@ -2,6 +2,8 @@
 #define TEST_FRAMEWORK_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include "../src/script_gui.h"
 
 // Define maximum limits for tests and results
 #define MAX_TESTS 256
@@ -36,6 +38,16 @@ typedef struct {
     int passed;
     uint32_t duration_us;
     char message[256];
+    
+    // Metrics recorded by performance and system tests
+    uint32_t latency_us;           // p99 when percentiles are recorded
+    uint32_t latency_p50_us;
+    uint32_t latency_p999_us;
+    uint32_t max_temp;
+    uint32_t power_draw_mA;
+    float cpu_usage;
+    float memory_usage;
+    uint32_t failed;
 } test_result_t;
 
 // Test Function Type
@@ -52,6 +64,7 @@ void test_assert(int condition, const char* message);
 void test_fail(const char* message);
 void test_skip(const char* message);
 void test_set_timeout(uint32_t timeout_ms);
+void test_record_latency(uint32_t p50_us, uint32_t p99_us, uint32_t p999_us);
 
 // Get test results
 void test_get_results(const test_result_t** results, uint32_t* count,
@@ -62,8 +75,9 @@ void test_get_results(const test_result_t** results, uint32_t* count,
 #define TEST_FAIL(message) test_fail(message)
 #define TEST_SKIP(message) test_skip(message)
 
-// Test Registration Macro
+// Test Registration Macros
 #define TEST_ADD(func) test_add(#func, TEST_GUI, TEST_TYPE_GUI, func)
+#define TEST_ADD_TYPE(func, category, type) test_add(#func, category, type, func)
 
 // GUI Test Helpers
 void test_gui_init(void);
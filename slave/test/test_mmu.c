@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <time.h>
+#include "test_framework.h"
+#include "test_mmu.h"
+#include "sim.h"
+#include "../src/mmu.h"
+#include "../src/irq.h"
+#include "../src/usb.h"
+#include "../src/ps5.h"
+#include "../src/optimize.h"
+
+#define BENCH_FRAMES 2000
+
+// Test the memory map encoded in the translation table
+static void test_mmu_tables(void) {
+    mmu_build_tables();
+    const uint32_t* tt = mmu_tables();
+
+    // Flat map: every valid section translates to itself
+    int flat = 1;
+    for (uint32_t i = 0; i < MMU_NUM_SECTIONS; i++) {
+        if (tt[i] && (tt[i] >> MMU_SECTION_SHIFT) != i) {
+            flat = 0;
+        }
+    }
+    TEST_ASSERT(flat);
+
+    TEST_ASSERT(mmu_mem_type(0x00008000) == MMU_MEM_NORMAL);
+    TEST_ASSERT(mmu_mem_type(0x3EFFFFFF) == MMU_MEM_NORMAL);
+    TEST_ASSERT(mmu_mem_type(MMU_DMA_BASE) == MMU_MEM_NONCACHED);
+    TEST_ASSERT(mmu_mem_type(MMU_DMA_BASE + MMU_DMA_SIZE - 1) == MMU_MEM_NONCACHED);
+    TEST_ASSERT(mmu_mem_type(MMU_DMA_BASE + MMU_DMA_SIZE) == MMU_MEM_NORMAL);
+    TEST_ASSERT(mmu_mem_type(MMIO_BASE) == MMU_MEM_DEVICE);
+    TEST_ASSERT(mmu_mem_type(0x3FFFFFFF) == MMU_MEM_DEVICE);
+    TEST_ASSERT(mmu_mem_type(0x40000000) == MMU_MEM_DEVICE);
+    TEST_ASSERT(mmu_mem_type(0x40100000) == MMU_MEM_FAULT);
+    TEST_ASSERT(mmu_mem_type(0xFFFFFFFF) == MMU_MEM_FAULT);
+
+    // Peripherals never execute; RAM is shareable write-back
+    TEST_ASSERT(tt[MMIO_BASE >> MMU_SECTION_SHIFT] & MMU_DESC_XN);
+    TEST_ASSERT(!(tt[0] & MMU_DESC_XN));
+    TEST_ASSERT(tt[0] & MMU_DESC_S);
+}
+
+// Host monotonic clock in nanoseconds
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Run the input -> output hot loop and return the mean cost per frame
+static uint64_t bench_hot_loop(void) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+    uint64_t elapsed = 0;
+
+    for (uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+        sim_advance_us(1000);
+        uint64_t start = bench_now_ns();
+        if (optimize_process_input(&state)) {
+            output.led_r = state.battery_level;
+            optimize_process_output(&output);
+        }
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed / BENCH_FRAMES;
+}
+
+// Compare the hot loop with flat uncached memory and with the MMU map.
+// The simulator has no cache model, so on the host both figures are the
+// same code path; the difference only shows on the Pi.
+static void test_mmu_hot_loop(void) {
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_ACCURATE);
+
+    mmu_disable();
+    TEST_ASSERT(!mmu_enabled());
+    uint64_t uncached_ns = bench_hot_loop();
+
+    TEST_ASSERT(mmu_init());
+    TEST_ASSERT(mmu_enabled());
+    uint64_t cached_ns = bench_hot_loop();
+
+    printf("  hot loop: %llu ns/frame MMU off, %llu ns/frame MMU on\n",
+           (unsigned long long)uncached_ns, (unsigned long long)cached_ns);
+    TEST_ASSERT(uncached_ns > 0 && cached_ns > 0);
+#ifdef __BARE_METAL__
+    TEST_ASSERT(cached_ns < uncached_ns);
+#endif
+}
+
+// Register all MMU tests
+void register_mmu_tests(void) {
+    TEST_ADD_TYPE(test_mmu_tables, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_mmu_hot_loop, TEST_LATENCY, TEST_TYPE_PERFORMANCE);
+}
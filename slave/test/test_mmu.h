@@ -0,0 +1,7 @@
+#ifndef TEST_MMU_H
+#define TEST_MMU_H
+
+// Function to register MMU and cache tests
+void register_mmu_tests(void);
+
+#endif // TEST_MMU_H
@@ -0,0 +1,1465 @@
+#include <stdio.h>
+#include <time.h>
+#include "test_framework.h"
+#include "test_script.h"
+#include "sim.h"
+#include "../src/combo.h"
+#include "../src/script.h"
+#include "../src/hardware.h"
+#include "../src/vm.h"
+#include "../src/util.h"
+#include "../src/script_lib.h"
+#include "../src/str_arena.h"
+#include "../src/script_cache.h"
+#include "../src/package.h"
+#include "../src/crc32.h"
+#include "../src/timeline.h"
+#include "../tools/vm_compile.h"
+
+// Button masks (ps5_buttons_t bit order)
+#define BTN_CROSS     (1 << 0)
+#define BTN_CIRCLE    (1 << 1)
+#define BTN_TRIANGLE  (1 << 2)
+#define BTN_SQUARE    (1 << 3)
+#define BTN_L1        (1 << 4)
+#define BTN_R1        (1 << 5)
+
+#define BENCH_EDGES   200000
+#define BENCH_VM_OPS  20000000
+#define LIB_ENTRIES   1024
+#define BENCH_LOOKUPS 1000000
+#define BENCH_SEARCHES 2000
+#define BENCH_CRC_ROUNDS 256
+#define FRAME_US      16667
+#define MACRO_TEST_SAMPLES  20000
+#define MACRO_TEST_BYTES    65536
+#define MACRO_BENCH_SECONDS 180
+#define MACRO_BENCH_BYTES   (40 * 1024)
+#define BENCH_MACRO_FRAMES  20000
+#define SCRIPT_TEST_MAX_DEMOTION 4
+
+static combo_matcher_t matcher;
+
+// Feed a sequence of masks 10 ms apart and return the last result
+static int feed_sequence(const uint16_t* masks, uint32_t count, uint64_t* now) {
+    int match = -1;
+    for (uint32_t i = 0; i < count; i++) {
+        *now += 10000;
+        match = combo_matcher_feed(&matcher, masks[i], *now);
+    }
+    return match;
+}
+
+// Test matching, overlap between combos and timing guards
+static void test_combo_match(void) {
+    static const uint16_t hadouken[] = { BTN_CROSS, BTN_CIRCLE, BTN_SQUARE };
+    static const uint16_t shoryu[] = { BTN_CIRCLE, BTN_SQUARE };
+    static const uint16_t tight[] = { BTN_L1, BTN_R1 };
+    static const uint32_t tight_timing[] = { 0, 5000 };
+    ps5_state_t result = {0};
+    uint64_t now = 0;
+
+    combo_matcher_reset(&matcher);
+    TEST_ASSERT(combo_matcher_add(&matcher, hadouken, NULL, 3, &result));
+    TEST_ASSERT(combo_matcher_add(&matcher, shoryu, NULL, 2, &result));
+    TEST_ASSERT(combo_matcher_add(&matcher, tight, tight_timing, 2, &result));
+    TEST_ASSERT(!combo_matcher_add(&matcher, hadouken, NULL, 0, &result));
+
+    // The longest combo wins; its suffix matches on its own
+    TEST_ASSERT(feed_sequence(hadouken, 3, &now) == 0);
+    TEST_ASSERT(feed_sequence(shoryu, 2, &now) == 1);
+
+    // A foreign mask in between breaks the sequence
+    static const uint16_t broken[] = { BTN_CROSS, BTN_TRIANGLE, BTN_CIRCLE };
+    TEST_ASSERT(feed_sequence(broken, 3, &now) == -1);
+
+    // Held buttons are not edges
+    now += 10000;
+    TEST_ASSERT(combo_matcher_feed(&matcher, BTN_SQUARE, now) == 1);
+    TEST_ASSERT(combo_matcher_feed(&matcher, BTN_SQUARE, now + 10000) == -1);
+
+    // Timing guard: 10 ms apart is too slow, 2 ms is fine
+    TEST_ASSERT(feed_sequence(tight, 2, &now) == -1);
+    TEST_ASSERT(combo_matcher_feed(&matcher, BTN_L1, now + 10000) == -1);
+    TEST_ASSERT(combo_matcher_feed(&matcher, BTN_R1, now + 12000) == 2);
+}
+
+// Test the automaton through the script engine
+static void test_combo_script(void) {
+    static const uint16_t sequence[] = { BTN_CROSS, 0, BTN_CROSS };
+    ps5_state_t result = {0};
+    ps5_state_t state = {0};
+    uint16_t mask;
+
+    sim_reset();
+    script_init();
+    result.sticks.lx = 200;
+    TEST_ASSERT(script_add_combo(sequence, NULL, 3, &result));
+
+    // Matched only while a combo script is loaded
+    uint32_t fired = 0;
+    for (uint32_t pass = 0; pass < 3; pass++) {
+        if (pass == 1) {
+            TEST_ASSERT(script_load_combo("combos", 0));
+        } else if (pass == 2) {
+            TEST_ASSERT(script_unload("combos"));
+        }
+        for (uint32_t i = 0; i < 3; i++) {
+            mask = sequence[i];
+            __builtin_memcpy(&state.buttons, &mask, sizeof(mask));
+            state.sticks.lx = 128;
+            script_process_input(&state);
+            if (state.sticks.lx == 200) {
+                fired += 1 << (pass * 4);
+            }
+        }
+    }
+    TEST_ASSERT(fired == 1 << 4);
+
+    // A combo cut short by the unload does not complete after a reload
+    TEST_ASSERT(script_load_combo("combos", 0));
+    for (uint32_t i = 0; i < 2; i++) {
+        mask = sequence[i];
+        __builtin_memcpy(&state.buttons, &mask, sizeof(mask));
+        script_process_input(&state);
+    }
+    TEST_ASSERT(script_unload("combos"));
+    TEST_ASSERT(script_load_combo("combos", 0));
+    mask = sequence[2];
+    __builtin_memcpy(&state.buttons, &mask, sizeof(mask));
+    state.sticks.lx = 128;
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.lx == 128);
+    script_cleanup();
+}
+
+// Host monotonic clock in nanoseconds
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Mean cost of one button edge with the given number of combos loaded
+static uint64_t bench_combo_edges(uint32_t combos) {
+    uint16_t buttons[8];
+    ps5_state_t result = {0};
+
+    combo_matcher_reset(&matcher);
+    for (uint32_t c = 0; c < combos; c++) {
+        for (uint32_t step = 0; step < 8; step++) {
+            buttons[step] = (uint16_t)(1 << ((c + step * 3) % 12));
+        }
+        TEST_ASSERT(combo_matcher_add(&matcher, buttons, NULL, 6 + c % 3, &result));
+    }
+
+    uint32_t seed = 1;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_EDGES; i++) {
+        seed = seed * 1103515245 + 12345;
+        combo_matcher_feed(&matcher, (uint16_t)(1 << ((seed >> 16) % 12)), i * 1000ull);
+    }
+    return (bench_now_ns() - start) * 1000 / BENCH_EDGES;
+}
+
+// Per-edge cost stays flat as the combo count grows
+static void test_combo_scaling(void) {
+    uint64_t one_ps = bench_combo_edges(1);
+    uint64_t many_ps = bench_combo_edges(COMBO_MAX_COMBOS);
+
+    printf("  combo edge: %llu ps with 1 combo, %llu ps with %u combos\n",
+           (unsigned long long)one_ps, (unsigned long long)many_ps, COMBO_MAX_COMBOS);
+    TEST_ASSERT(many_ps < one_ps * 3);
+}
+
+// Compile a script into code, asserting success
+static uint32_t compile_script(const char* source, uint32_t* code) {
+    char error[128];
+    uint32_t length = 0;
+    int ok = vm_compile(source, code, VM_MAX_CODE, &length, error, sizeof(error));
+    if (!ok) {
+        printf("  compile error: %s\n", error);
+    }
+    TEST_ASSERT(ok);
+    return length;
+}
+
+// Test compiled scripts against the controller state
+static void test_vm_scripts(void) {
+    static uint32_t code[VM_MAX_CODE];
+    static const char* source =
+        "-- Anti-deadzone on the left stick, rapid fire on R2 while square is held\n"
+        "local dx = state.lx - 128\n"
+        "if abs(dx) > 4 and abs(dx) < 40 then\n"
+        "    if dx > 0 then state.lx = 168 else state.lx = 88 end\n"
+        "end\n"
+        "g.frames = g.frames + 1\n"
+        "if button.square then\n"
+        "    button.square = 0\n"
+        "    state.r2 = clamp((g.frames % 2) * 300, 0, 255)\n"
+        "elseif state.l2 >= 200 then\n"
+        "    state.r2 = 100000\n"
+        "else\n"
+        "    local n = 0\n"
+        "    local i = 0\n"
+        "    while i < 10 do n = n + i i = i + 1 end\n"
+        "    state.ry = n - (1 << 2) - ~0 + 0x10\n"
+        "end\n";
+    vm_program_t program;
+    ps5_state_t state = {0};
+    uint32_t budget;
+
+    uint32_t length = compile_script(source, code);
+    TEST_ASSERT(vm_load(&program, code, length));
+
+    // Small deflection is pushed out, square is turned into R2 pulses
+    state.sticks.lx = 140;
+    state.buttons.square = 1;
+    budget = 1000;
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_OK);
+    TEST_ASSERT(budget > 0 && budget < 1000);
+    TEST_ASSERT(state.sticks.lx == 168);
+    TEST_ASSERT(!state.buttons.square);
+    TEST_ASSERT(state.triggers.r2 == 255);
+    TEST_ASSERT(program.globals[0] == 1);
+
+    // Globals persist: the next frame's pulse is off
+    state.buttons.square = 1;
+    budget = 1000;
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_OK);
+    TEST_ASSERT(state.triggers.r2 == 0);
+
+    // Field writes clamp; the else branch runs the loop
+    state.buttons.square = 0;
+    state.triggers.l2 = 250;
+    budget = 1000;
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_OK);
+    TEST_ASSERT(state.triggers.r2 == 255);
+    state.triggers.l2 = 0;
+    budget = 1000;
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_OK);
+    TEST_ASSERT(state.sticks.ry == 45 - 4 + 1 + 16);
+}
+
+// Test the instruction budget: deterministic cut-off, no partial writes
+static void test_vm_budget(void) {
+    static uint32_t spin[VM_MAX_CODE];
+    static uint32_t mark[VM_MAX_CODE];
+    vm_program_t program;
+    ps5_state_t state = {0};
+    uint32_t budget = 5000;
+
+    uint32_t length = compile_script("state.lx = 1 g.x = 7 while 1 do end", spin);
+    TEST_ASSERT(vm_load(&program, spin, length));
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_BUDGET);
+    TEST_ASSERT(budget == 0);
+    TEST_ASSERT(state.sticks.lx == 0);
+    TEST_ASSERT(program.globals[0] == 0);
+    TEST_ASSERT(program.ops_executed == 5000 && program.budget_exhausted == 1);
+
+    // Through the script engine: the spinning script uses up its own
+    // budget and no more, so a lower-priority script still runs
+    uint32_t mark_length = compile_script("state.rx = 42", mark);
+    sim_reset();
+    script_init();
+    TEST_ASSERT(script_load_bytecode("mark", mark, mark_length, 1));
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.rx == 42);
+
+    state.sticks.rx = 0;
+    TEST_ASSERT(script_load_bytecode("spin", spin, length, 10));
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.rx == 42 && state.sticks.lx == 0);
+    TEST_ASSERT(script_unload("spin"));
+    TEST_ASSERT(!script_unload("spin"));
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.rx == 42);
+    TEST_ASSERT(script_unload("mark"));
+    script_cleanup();
+}
+
+// Test load-time validation and compile errors
+static void test_vm_validate(void) {
+    static uint32_t code[VM_MAX_CODE];
+    char error[128];
+    uint32_t length;
+
+    const uint32_t good[] = { VM_ENC_I(VM_LOADI, 0, 5), VM_ENC(VM_HALT, 0, 0, 0) };
+    const uint32_t bad_reg[] = { VM_ENC(VM_MOV, 16, 0, 0), VM_ENC(VM_HALT, 0, 0, 0) };
+    const uint32_t bad_jump[] = { VM_ENC_I(VM_JMP, 0, 5), VM_ENC(VM_HALT, 0, 0, 0) };
+    const uint32_t bad_field[] = { VM_ENC(VM_GETF, 0, VM_FIELD_COUNT, 0), VM_ENC(VM_HALT, 0, 0, 0) };
+    const uint32_t runs_off[] = { VM_ENC_I(VM_LOADI, 0, 5) };
+    const uint32_t bad_op[] = { VM_ENC(VM_OP_COUNT, 0, 0, 0), VM_ENC(VM_HALT, 0, 0, 0) };
+    TEST_ASSERT(vm_validate(good, 2));
+    TEST_ASSERT(!vm_validate(bad_reg, 2));
+    TEST_ASSERT(!vm_validate(bad_jump, 2));
+    TEST_ASSERT(!vm_validate(bad_field, 2));
+    TEST_ASSERT(!vm_validate(runs_off, 1));
+    TEST_ASSERT(!vm_validate(bad_op, 2));
+
+    TEST_ASSERT(!vm_compile("local x = 1\nx = y", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    TEST_ASSERT(str_compare(error, "line 2: unknown variable y") == 0);
+    TEST_ASSERT(!vm_compile("state.speed = 1", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    TEST_ASSERT(!vm_compile("if 1 then", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    TEST_ASSERT(!vm_compile("state.lx = 1 end", code, VM_MAX_CODE, &length, error, sizeof(error)));
+
+    // Constants wider than 16 bits take two words
+    TEST_ASSERT(vm_compile("g.big = 100000 g.neg = -70000", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    vm_program_t program;
+    ps5_state_t state = {0};
+    uint32_t budget = 100;
+    TEST_ASSERT(vm_load(&program, code, length));
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_OK);
+    TEST_ASSERT(program.globals[0] == 100000 && program.globals[1] == -70000);
+}
+
+// Interpreter throughput on the host
+static void test_vm_throughput(void) {
+    static uint32_t code[VM_MAX_CODE];
+    vm_program_t program;
+    ps5_state_t state = {0};
+
+    uint32_t length = compile_script(
+        "local i = 0 local acc = 0\n"
+        "while 1 do\n"
+        "    acc = acc + state.lx * i\n"
+        "    if acc > 100000 then acc = acc - 100000 end\n"
+        "    i = i + 1\n"
+        "end\n", code);
+    TEST_ASSERT(vm_load(&program, code, length));
+
+    uint32_t budget = BENCH_VM_OPS;
+    uint64_t start = bench_now_ns();
+    TEST_ASSERT(vm_run(&program, &state, 0, &budget) == VM_BUDGET);
+    uint64_t elapsed_ns = bench_now_ns() - start;
+
+    uint64_t ops_per_us = (uint64_t)BENCH_VM_OPS * 1000 / (elapsed_ns ? elapsed_ns : 1);
+    printf("  vm: %llu ops/us (%u ops in %llu us)\n", (unsigned long long)ops_per_us,
+           BENCH_VM_OPS, (unsigned long long)(elapsed_ns / 1000));
+    TEST_ASSERT(ops_per_us > 0);
+}
+
+// Fill the library with entries named script-0 .. script-(count-1)
+static void fill_library(uint32_t count) {
+    static script_entry_t entry;
+
+    script_lib_init();
+    entry.meta.description[0] = 0;
+    entry.meta.game[0] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(entry.meta.name, sizeof(entry.meta.name), "script-%u", i);
+        entry.meta.downloads = i;
+        entry.is_local = i & 1;
+        TEST_ASSERT(script_lib_add(&entry));
+    }
+}
+
+// Copy out the entry holding a name
+static int lookup(const char* name, script_entry_t* entry) {
+    return script_lib_get(script_lib_find(name), entry);
+}
+
+// Name behind a handle
+static const char* handle_name(script_handle_t handle) {
+    static script_entry_t entry;
+    return script_lib_get(handle, &entry) ? entry.meta.name : "";
+}
+
+// Test the name index through add, remove and the name-based calls
+static void test_lib_index(void) {
+    static script_entry_t entry;
+    char name[64];
+
+    fill_library(LIB_ENTRIES);
+    TEST_ASSERT(lookup("script-7", &entry));
+    TEST_ASSERT(!script_lib_add(&entry));
+
+    // Every name resolves to its own entry
+    int found = 1;
+    for (uint32_t i = 0; i < LIB_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "script-%u", i);
+        if (!lookup(name, &entry) || entry.meta.downloads != i) {
+            found = 0;
+        }
+    }
+    TEST_ASSERT(found);
+    TEST_ASSERT(script_lib_find("script-1024") == SCRIPT_HANDLE_NONE);
+
+    // Remove every third entry; the rest stay reachable after the moves
+    TEST_ASSERT(script_lib_activate("script-3"));
+    TEST_ASSERT(script_lib_activate("script-4"));
+    TEST_ASSERT(!script_lib_remove("script-3"));
+    TEST_ASSERT(script_lib_deactivate("script-3"));
+    for (uint32_t i = 0; i < LIB_ENTRIES; i += 3) {
+        snprintf(name, sizeof(name), "script-%u", i);
+        TEST_ASSERT(script_lib_remove(name));
+    }
+    TEST_ASSERT(!script_lib_remove("script-0"));
+    found = 1;
+    for (uint32_t i = 0; i < LIB_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "script-%u", i);
+        int present = lookup(name, &entry);
+        if ((i % 3 == 0) == present || (present && entry.meta.downloads != i)) {
+            found = 0;
+        }
+    }
+    TEST_ASSERT(found);
+
+    // Active state follows the entry through a move
+    script_entry_t active[4];
+    TEST_ASSERT(script_lib_get_active(active, 4) == 1);
+    TEST_ASSERT(str_compare(active[0].meta.name, "script-4") == 0);
+    TEST_ASSERT(!script_lib_activate("script-4"));
+    TEST_ASSERT(script_lib_deactivate("script-4"));
+    TEST_ASSERT(!script_lib_deactivate("script-3"));
+
+    // Freed slots are reused
+    snprintf(entry.meta.name, sizeof(entry.meta.name), "script-0");
+    TEST_ASSERT(script_lib_add(&entry));
+    TEST_ASSERT(script_lib_find("script-0") != SCRIPT_HANDLE_NONE);
+    script_lib_cleanup();
+    TEST_ASSERT(script_lib_find("script-0") == SCRIPT_HANDLE_NONE);
+}
+
+// Name lookup cost with a full library
+static void test_lib_lookup(void) {
+    char names[16][64];
+
+    fill_library(LIB_ENTRIES);
+    for (uint32_t i = 0; i < 16; i++) {
+        snprintf(names[i], sizeof(names[i]), "script-%u", (i * 997) % LIB_ENTRIES);
+    }
+
+    uint32_t hits = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+        hits += script_lib_find(names[i & 15]) != SCRIPT_HANDLE_NONE;
+    }
+    uint64_t elapsed_ns = bench_now_ns() - start;
+
+    printf("  library: %llu ns per name lookup with %u entries\n",
+           (unsigned long long)(elapsed_ns / BENCH_LOOKUPS), LIB_ENTRIES);
+    TEST_ASSERT(hits == BENCH_LOOKUPS);
+    script_lib_cleanup();
+}
+
+static void add_script(const char* name, const char* game, const char* description, uint32_t downloads) {
+    static script_entry_t entry;
+
+    snprintf(entry.meta.name, sizeof(entry.meta.name), "%s", name);
+    snprintf(entry.meta.game, sizeof(entry.meta.game), "%s", game);
+    snprintf(entry.meta.description, sizeof(entry.meta.description), "%s", description);
+    entry.meta.downloads = downloads;
+    TEST_ASSERT(script_lib_add(&entry));
+}
+
+// Test full-text search matching, ranking and index maintenance
+static void test_lib_search(void) {
+    script_handle_t handles[8];
+
+    script_lib_init();
+    add_script("rapid-fire", "Any", "Repeats R2 while held", 10);
+    add_script("anti-recoil", "Warzone", "Pulls the right stick down while firing", 50);
+    add_script("warzone-slide", "Warzone", "Slide cancel macro", 5);
+    add_script("drift-fix", "Any", "Stick deadzone for worn controllers", 7);
+    add_script("fifa-skills", "FIFA 24", "Skill move combos for rapid dribbling", 30);
+
+    // Ranked by field, then downloads; case-insensitive
+    TEST_ASSERT(script_lib_query("RAPID", handles, 8) == 2);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "rapid-fire") == 0);
+    TEST_ASSERT(str_compare(handle_name(handles[1]), "fifa-skills") == 0);
+    TEST_ASSERT(script_lib_query("warzone", handles, 8) == 2);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "warzone-slide") == 0);
+    TEST_ASSERT(script_lib_query("stick", handles, 8) == 2);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "anti-recoil") == 0);
+    TEST_ASSERT(script_lib_query("stick", handles, 1) == 1);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "anti-recoil") == 0);
+
+    // Every query trigram present, but not as a substring
+    TEST_ASSERT(script_lib_query("firerapid", handles, 8) == 0);
+    TEST_ASSERT(script_lib_query("nothing like it", handles, 8) == 0);
+
+    // Queries shorter than a trigram scan
+    TEST_ASSERT(script_lib_query("R2", handles, 8) == 1);
+    TEST_ASSERT(script_lib_query("", handles, 8) == 5);
+
+    // Removal and the move of the last entry keep the index in step
+    TEST_ASSERT(script_lib_remove("rapid-fire"));
+    TEST_ASSERT(script_lib_query("rapid", handles, 8) == 1);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "fifa-skills") == 0);
+    TEST_ASSERT(script_lib_query("dribbling", handles, 8) == 1);
+    TEST_ASSERT(script_lib_remove("fifa-skills"));
+    TEST_ASSERT(script_lib_query("dribbling", handles, 8) == 0);
+    TEST_ASSERT(script_lib_query("deadzone", handles, 8) == 1);
+
+    // The copying search returns the same ranking
+    script_entry_t results[2];
+    TEST_ASSERT(script_lib_search("warzone", results, 2) == 2);
+    TEST_ASSERT(str_compare(results[0].meta.name, "warzone-slide") == 0);
+    TEST_ASSERT(str_compare(results[1].meta.name, "anti-recoil") == 0);
+    script_lib_cleanup();
+    TEST_ASSERT(script_lib_query("warzone", handles, 8) == 0);
+}
+
+// Test string interning, reclamation and the entry round trip
+static void test_lib_strings(void) {
+    static str_arena_t arena;
+    static script_entry_t entry;
+    static script_entry_t copy;
+    str_ref_t refs[3];
+
+    // Equal texts share a record until the last reference goes
+    str_arena_reset(&arena);
+    refs[0] = str_arena_intern(&arena, "Warzone", refs, 0);
+    refs[1] = str_arena_intern(&arena, "Warzone", refs, 1);
+    refs[2] = str_arena_intern(&arena, "Apex", refs, 2);
+    TEST_ASSERT(refs[0] == refs[1] && refs[0] != refs[2]);
+    TEST_ASSERT(str_arena_intern(&arena, "", refs, 3) == STR_REF_EMPTY);
+    str_arena_release(&arena, refs[0]);
+    TEST_ASSERT(str_compare(str_arena_get(&arena, refs[1]), "Warzone") == 0);
+    str_arena_release(&arena, refs[1]);
+
+    // Compaction slides live records down and rewrites references
+    refs[0] = STR_REF_EMPTY;
+    refs[1] = STR_REF_EMPTY;
+    str_arena_compact(&arena, refs, 3);
+    TEST_ASSERT(str_compare(str_arena_get(&arena, refs[2]), "Apex") == 0);
+    TEST_ASSERT(arena.used == sizeof(str_record_t) + arena.live);
+    TEST_ASSERT(str_arena_intern(&arena, "Apex", refs, 3) == refs[2]);
+
+    // Every field survives the trip through the library
+    script_lib_init();
+    snprintf(entry.meta.name, sizeof(entry.meta.name), "anti-recoil");
+    snprintf(entry.meta.author, sizeof(entry.meta.author), "brodi");
+    snprintf(entry.meta.version, sizeof(entry.meta.version), "1.2.0");
+    snprintf(entry.meta.description, sizeof(entry.meta.description), "Pulls the right stick down");
+    snprintf(entry.meta.game, sizeof(entry.meta.game), "Warzone");
+    snprintf(entry.path, sizeof(entry.path), "/scripts/anti-recoil.bin");
+    entry.meta.downloads = 42;
+    entry.meta.rating = 4;
+    entry.meta.size = 1234;
+    entry.meta.checksum = 0xDEADBEEF;
+    entry.meta.is_private = 1;
+    entry.meta.type = SCRIPT_TYPE_LUA;
+    entry.is_local = 1;
+    entry.is_active = 1;
+    TEST_ASSERT(script_lib_add(&entry));
+    TEST_ASSERT(lookup("anti-recoil", &copy));
+    TEST_ASSERT(str_compare(copy.meta.author, "brodi") == 0);
+    TEST_ASSERT(str_compare(copy.meta.version, "1.2.0") == 0);
+    TEST_ASSERT(str_compare(copy.meta.description, entry.meta.description) == 0);
+    TEST_ASSERT(str_compare(copy.meta.game, "Warzone") == 0);
+    TEST_ASSERT(str_compare(copy.path, entry.path) == 0);
+    TEST_ASSERT(copy.meta.downloads == 42 && copy.meta.rating == 4);
+    TEST_ASSERT(copy.meta.size == 1234 && copy.meta.checksum == 0xDEADBEEF);
+    TEST_ASSERT(copy.meta.is_private && copy.meta.type == SCRIPT_TYPE_LUA);
+    TEST_ASSERT(copy.is_local && !copy.is_active);
+    TEST_ASSERT(script_lib_publish("anti-recoil"));
+    TEST_ASSERT(lookup("anti-recoil", &copy) && !copy.meta.is_private);
+
+    // Churn unique descriptions through a full library; released strings
+    // are reclaimed so adds keep succeeding
+    int added = 1;
+    for (uint32_t round = 0; round < 8; round++) {
+        for (uint32_t i = 0; i < LIB_ENTRIES - 1; i++) {
+            snprintf(entry.meta.name, sizeof(entry.meta.name), "script-%u", i);
+            snprintf(entry.meta.description, sizeof(entry.meta.description),
+                     "Round %u of the churn test, entry %u, padded out to a realistic length", round, i);
+            snprintf(entry.path, sizeof(entry.path), "/scripts/script-%u-%u.bin", round, i);
+            entry.meta.downloads = round;
+            if (round) {
+                script_lib_remove(entry.meta.name);
+            }
+            added &= script_lib_add(&entry);
+        }
+    }
+    TEST_ASSERT(added);
+    TEST_ASSERT(lookup("script-500", &copy) && copy.meta.downloads == 7);
+    TEST_ASSERT(str_compare(copy.path, "/scripts/script-7-500.bin") == 0);
+    TEST_ASSERT(lookup("anti-recoil", &copy) && str_compare(copy.meta.game, "Warzone") == 0);
+
+    script_handle_t handles[4];
+    TEST_ASSERT(script_lib_query("round 7 of the churn test, entry 123,", handles, 4) == 1);
+    TEST_ASSERT(str_compare(handle_name(handles[0]), "script-123") == 0);
+    script_lib_cleanup();
+}
+
+// Test paged views against the ranked query and the copying calls
+static void test_lib_views(void) {
+    static script_handle_t all[LIB_ENTRIES];
+    script_handle_t page[12];
+    script_view_t view;
+
+    // Popular order is downloads descending; fill_library uses downloads = i
+    fill_library(LIB_ENTRIES);
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_POPULAR, NULL));
+    TEST_ASSERT(script_lib_view_count(&view) == LIB_ENTRIES);
+    int ordered = 1;
+    for (uint32_t first = 0; first < LIB_ENTRIES; first += 12) {
+        int got = script_lib_view_page(&view, first, page, 12);
+        for (int i = 0; i < got; i++) {
+            ordered &= script_lib_downloads(page[i]) == LIB_ENTRIES - 1 - first - i;
+        }
+    }
+    TEST_ASSERT(ordered);
+    TEST_ASSERT(script_lib_view_page(&view, LIB_ENTRIES, page, 12) == 0);
+
+    // Random access and paging backwards agree with forward paging
+    TEST_ASSERT(script_lib_view_page(&view, 500, page, 1) == 1);
+    TEST_ASSERT(script_lib_downloads(page[0]) == LIB_ENTRIES - 501);
+    TEST_ASSERT(script_lib_view_page(&view, 3, page, 2) == 2);
+    TEST_ASSERT(script_lib_downloads(page[1]) == LIB_ENTRIES - 5);
+
+    // Search pages concatenate to the full ranking
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_SEARCH, "script-1"));
+    uint32_t total = (uint32_t)script_lib_query("script-1", all, LIB_ENTRIES);
+    TEST_ASSERT(total == 1 + 10 + 100 + 24 && script_lib_view_count(&view) == total);
+    int same = 1;
+    for (uint32_t first = 0; first < total; first += 12) {
+        int got = script_lib_view_page(&view, first, page, 12);
+        for (int i = 0; i < got; i++) {
+            same &= page[i] == all[first + i];
+        }
+    }
+    TEST_ASSERT(same);
+
+    // Views follow library changes
+    script_entry_t active[2];
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_ACTIVE, NULL));
+    TEST_ASSERT(script_lib_view_count(&view) == 0);
+    TEST_ASSERT(script_lib_activate("script-9"));
+    TEST_ASSERT(script_lib_activate("script-2"));
+    TEST_ASSERT(script_lib_view_count(&view) == 2);
+    TEST_ASSERT(script_lib_view_page(&view, 0, page, 12) == 2);
+    TEST_ASSERT(str_compare(script_lib_name(page[0]), "script-2") == 0);
+    TEST_ASSERT(script_lib_is_active(page[1]) && script_lib_is_local(page[1]));
+    TEST_ASSERT(script_lib_get_active(active, 2) == 2);
+    TEST_ASSERT(str_compare(active[1].meta.name, "script-9") == 0);
+    TEST_ASSERT(script_lib_get_popular(active, 1) == 1);
+    TEST_ASSERT(active[0].meta.downloads == LIB_ENTRIES - 1);
+
+    // Accessors read empty for stale handles
+    TEST_ASSERT(*script_lib_name(SCRIPT_HANDLE_NONE) == '\0');
+    TEST_ASSERT(script_lib_downloads(LIB_ENTRIES) == 0);
+    script_lib_cleanup();
+}
+
+// Test size classes, LRU eviction, pinning and slab reuse in the body cache
+static void test_script_cache(void) {
+    static uint8_t body[SCRIPT_CACHE_MAX_BODY];
+    static uint32_t code[VM_MAX_CODE];
+    static uint32_t package[1024];
+    static package_meta_t meta;
+    script_cache_stats_t stats;
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < sizeof(body); i++) {
+        body[i] = (uint8_t)(i * 7);
+    }
+
+    // Bodies come back intact and lookups are counted
+    script_cache_init();
+    TEST_ASSERT(script_cache_insert(1, body, 100) != NULL);
+    TEST_ASSERT(script_cache_insert(2, body, 5000) != NULL);
+    const uint8_t* cached = script_cache_lookup(2, &size);
+    TEST_ASSERT(cached && size == 5000 && mem_compare(cached, body, size) == 0);
+    TEST_ASSERT(script_cache_lookup(3, &size) == NULL);
+    TEST_ASSERT(!script_cache_insert(3, body, SCRIPT_CACHE_MAX_BODY + 1));
+    script_cache_get_stats(&stats);
+    TEST_ASSERT(stats.hits == 1 && stats.misses == 1 && stats.bodies == 2);
+    TEST_ASSERT(stats.bytes_used == 5100 && stats.rejected == 1);
+
+    // Sixteen 64 KB bodies fill the cache; the least recently used goes
+    script_cache_init();
+    for (uint32_t key = 1; key <= SCRIPT_CACHE_SLABS; key++) {
+        TEST_ASSERT(script_cache_insert(key, body, SCRIPT_CACHE_MAX_BODY) != NULL);
+    }
+    TEST_ASSERT(script_cache_lookup(1, NULL) != NULL);
+    TEST_ASSERT(script_cache_pin(2));
+    TEST_ASSERT(script_cache_insert(100, body, SCRIPT_CACHE_MAX_BODY) != NULL);
+    TEST_ASSERT(script_cache_contains(1) && script_cache_contains(2) && !script_cache_contains(3));
+
+    // Pinned bodies outlive any amount of churn
+    for (uint32_t key = 200; key < 240; key++) {
+        TEST_ASSERT(script_cache_insert(key, body, SCRIPT_CACHE_MAX_BODY) != NULL);
+    }
+    TEST_ASSERT(script_cache_contains(2) && !script_cache_contains(1));
+    cached = script_cache_lookup(2, &size);
+    TEST_ASSERT(cached && mem_compare(cached, body, size) == 0);
+
+    // Small bodies take over the least recently used unpinned slab
+    TEST_ASSERT(script_cache_insert(300, body, 1000) != NULL);
+    TEST_ASSERT(script_cache_insert(301, body, 1000) != NULL);
+    script_cache_get_stats(&stats);
+    TEST_ASSERT(stats.slab_moves == 1 && stats.pinned == 1);
+    TEST_ASSERT(stats.bodies == SCRIPT_CACHE_SLABS - 1 + 2);
+
+    // With everything pinned there is no room
+    script_cache_init();
+    for (uint32_t key = 1; key <= SCRIPT_CACHE_SLABS; key++) {
+        script_cache_insert(key, body, SCRIPT_CACHE_MAX_BODY);
+        script_cache_pin(key);
+    }
+    TEST_ASSERT(script_cache_insert(100, body, 10) == NULL);
+    TEST_ASSERT(!script_cache_remove(5) && script_cache_contains(5));
+    TEST_ASSERT(script_cache_unpin(5));
+    TEST_ASSERT(script_cache_insert(100, body, 10) != NULL && !script_cache_contains(5));
+
+    // A script deactivated recently is activated again from the cache
+    meta.type = SCRIPT_TYPE_LUA;
+    snprintf(meta.name, sizeof(meta.name), "script-1");
+    uint32_t package_size = package_build(package, sizeof(package), &meta, code,
+                                          compile_script("state.l2 = 1", code), NULL, 0);
+    fill_library(64);
+    script_init();
+    TEST_ASSERT(script_lib_store_body("script-1", package, package_size));
+    TEST_ASSERT(script_lib_activate("script-1"));
+    TEST_ASSERT(script_lib_deactivate("script-1"));
+    for (uint32_t i = 2; i < 40; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "script-%u", i);
+        TEST_ASSERT(script_lib_store_body(name, body, 3000));
+    }
+    script_cache_get_stats(&stats);
+    uint32_t misses = stats.misses;
+    TEST_ASSERT(script_lib_activate("script-1"));
+    script_cache_get_stats(&stats);
+    TEST_ASSERT(stats.misses == misses && stats.pinned == 1);
+    TEST_ASSERT(script_lib_body(script_lib_find("script-1"), &size) && size == package_size);
+
+    // An active script stays until deactivated; removed scripts leave the cache
+    TEST_ASSERT(!script_lib_remove("script-1"));
+    script_cache_get_stats(&stats);
+    TEST_ASSERT(stats.pinned == 1 && stats.bodies == 39);
+    TEST_ASSERT(script_lib_remove("script-2"));
+    script_cache_get_stats(&stats);
+    TEST_ASSERT(stats.bodies == 38);
+    script_lib_cleanup();
+    script_cleanup();
+}
+
+// Test every CRC32 engine against known values, odd lengths and alignments
+static void test_crc32(void) {
+    static uint8_t data[4096 + 16];
+    crc32_stream_t stream;
+
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)((i * 2654435761u) >> 13);
+    }
+
+    for (uint32_t e = 0; e < CRC32_ENGINE_COUNT; e++) {
+        if (!crc32_select((crc32_engine_t)e)) {
+            continue;
+        }
+        TEST_ASSERT(crc32("123456789", 9) == 0xCBF43926);
+        TEST_ASSERT(crc32("", 0) == 0);
+        TEST_ASSERT(crc32("The quick brown fox jumps over the lazy dog", 43) == 0x414FA339);
+
+        // Every engine agrees with the reference at any offset and length
+        int agree = 1;
+        for (uint32_t offset = 0; offset < 8; offset++) {
+            for (uint32_t size = 0; size < 80; size += 7) {
+                uint32_t value = crc32(data + offset, size);
+                crc32_select(CRC32_ENGINE_BITWISE);
+                agree &= value == crc32(data + offset, size);
+                crc32_select((crc32_engine_t)e);
+            }
+        }
+        TEST_ASSERT(agree);
+
+        // Streaming in uneven pieces gives the one-shot result
+        uint32_t whole = crc32(data, 4096);
+        crc32_stream_init(&stream);
+        for (uint32_t at = 0, piece = 1; at < 4096; at += piece, piece = piece * 3 % 509 + 1) {
+            crc32_stream_feed(&stream, data + at, at + piece > 4096 ? 4096 - at : piece);
+        }
+        TEST_ASSERT(crc32_stream_final(&stream) == whole && stream.length == 4096);
+    }
+
+    // The best engine is picked, and the library checks bodies against it
+    TEST_ASSERT(crc32_init() != CRC32_ENGINE_BITWISE);
+    fill_library(4);
+    TEST_ASSERT(script_lib_store_body("script-1", data, 1000));
+    script_entry_t entry;
+    TEST_ASSERT(script_lib_get(script_lib_find("script-1"), &entry));
+    TEST_ASSERT(entry.meta.checksum == crc32(data, 1000) && entry.meta.size == 1000);
+    TEST_ASSERT(!script_lib_store_body("script-1", data + 1, 1000));
+    TEST_ASSERT(script_lib_store_body("script-1", data, 1000));
+    script_lib_cleanup();
+}
+
+// Throughput of each CRC32 engine over a 64 KB body
+static void test_crc32_speed(void) {
+    static uint8_t data[SCRIPT_CACHE_MAX_BODY];
+
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 31);
+    }
+
+    for (uint32_t e = 0; e < CRC32_ENGINE_COUNT; e++) {
+        if (!crc32_select((crc32_engine_t)e)) {
+            printf("  crc32: %s not available on this host\n", crc32_engine_name((crc32_engine_t)e));
+            continue;
+        }
+        uint32_t rounds = e == CRC32_ENGINE_BITWISE ? 16 : BENCH_CRC_ROUNDS;
+        uint32_t value = 0;
+        uint64_t start = bench_now_ns();
+        for (uint32_t i = 0; i < rounds; i++) {
+            value = crc32_update(value, data, sizeof(data));
+        }
+        uint64_t elapsed_ns = bench_now_ns() - start;
+        printf("  crc32: %s %.2f GB/s\n", crc32_engine_name((crc32_engine_t)e),
+               (double)rounds * sizeof(data) / (double)elapsed_ns);
+        TEST_ASSERT(value != 0);
+    }
+    crc32_init();
+}
+
+// Test building, validating and running packages in place
+static void test_packages(void) {
+    static uint32_t code[VM_MAX_CODE];
+    static uint32_t buffer[1024];
+    static package_meta_t meta;
+    static script_entry_t entry;
+    static script_meta_t lib_meta;
+    static const package_macro_step_t steps[] = {
+        { 1000000, BTN_CROSS, { 10, 20, 30, 40 }, { 0, 255 } },
+        { 1000000, BTN_CIRCLE | BTN_R1, { 128, 128, 128, 128 }, { 50, 0 } },
+    };
+    ps5_state_t state = {0};
+    package_t package;
+    uint16_t mask;
+
+    // Bytecode round trip: the package points at its own sections
+    uint32_t length = compile_script("state.r2 = 77", code);
+    meta.type = SCRIPT_TYPE_LUA;
+    meta.priority = 3;
+    snprintf(meta.name, sizeof(meta.name), "pulse");
+    uint32_t size = package_build(buffer, sizeof(buffer), &meta, code, length, NULL, 0);
+    TEST_ASSERT(size > 0 && size % 4 == 0);
+    TEST_ASSERT(package_open(&package, buffer, size));
+    TEST_ASSERT(package.code_length == length && package.step_count == 0);
+    TEST_ASSERT((const void*)package.code > (const void*)buffer);
+    TEST_ASSERT(mem_compare(package.code, code, length * sizeof(uint32_t)) == 0);
+    TEST_ASSERT(str_compare(package.meta->name, "pulse") == 0);
+    TEST_ASSERT(package.header->checksum == crc32((const uint8_t*)buffer + sizeof(package_header_t),
+                                                  size - sizeof(package_header_t)));
+    TEST_ASSERT(!package_build(buffer, 64, &meta, code, length, NULL, 0));
+
+    TEST_ASSERT(package_verify(buffer, size));
+
+    // Corruption anywhere is caught by verification; opening only checks
+    // the header and bounds
+    ((uint8_t*)buffer)[size - 1] ^= 0x40;
+    TEST_ASSERT(!package_verify(buffer, size) && package_open(&package, buffer, size));
+    ((uint8_t*)buffer)[size - 1] ^= 0x40;
+    TEST_ASSERT(!package_verify(buffer, size - 4) && !package_open(&package, buffer, size - 4));
+    TEST_ASSERT(!package_verify((const uint8_t*)buffer + 2, size - 2));
+    buffer[0]++;
+    TEST_ASSERT(!package_verify(buffer, size) && !package_open(&package, buffer, size));
+    buffer[0]--;
+
+    // A section outside the package fails even with a matching checksum
+    package_header_t* header = (package_header_t*)buffer;
+    package_section_t* sections = (package_section_t*)(header + 1);
+    sections[1].offset = size;
+    header->checksum = crc32(sections, size - sizeof(*header));
+    TEST_ASSERT(!package_verify(buffer, size) && !package_open(&package, buffer, size));
+
+    // Bytecode runs from the package
+    size = package_build(buffer, sizeof(buffer), &meta, code, length, NULL, 0);
+    sim_reset();
+    script_init();
+    TEST_ASSERT(script_load_package(buffer, size));
+    script_process_input(&state);
+    TEST_ASSERT(state.triggers.r2 == 77);
+    TEST_ASSERT(script_unload("pulse"));
+
+    // A macro timeline is applied step by step
+    meta.type = SCRIPT_TYPE_MACRO;
+    snprintf(meta.name, sizeof(meta.name), "jump");
+    size = package_build(buffer, sizeof(buffer), &meta, NULL, 0, steps, 2);
+    TEST_ASSERT(package_open(&package, buffer, size) && package.step_count == 2);
+    TEST_ASSERT(script_load_package(buffer, size));
+    TEST_ASSERT(!script_load_package(buffer, size));
+    script_process_input(&state);
+    __builtin_memcpy(&mask, &state.buttons, sizeof(mask));
+    TEST_ASSERT(mask == BTN_CROSS && state.sticks.ly == 20 && state.triggers.r2 == 255);
+    sim_advance_us(1000000);
+    script_process_input(&state);
+    script_process_input(&state);
+    __builtin_memcpy(&mask, &state.buttons, sizeof(mask));
+    TEST_ASSERT(mask == (BTN_CIRCLE | BTN_R1) && state.sticks.lx == 128 && state.triggers.l2 == 50);
+    TEST_ASSERT(script_unload("jump"));
+    script_cleanup();
+
+    // Through the library: package a cached body, validate it by path,
+    // and run it while the script is active
+    script_lib_init();
+    snprintf(entry.meta.name, sizeof(entry.meta.name), "pulse");
+    snprintf(entry.path, sizeof(entry.path), "/scripts/pulse.pkg");
+    TEST_ASSERT(script_lib_add(&entry));
+    TEST_ASSERT(script_lib_store_body("pulse", code, length * sizeof(uint32_t)));
+    TEST_ASSERT(!script_validate("/scripts/pulse.pkg"));
+    TEST_ASSERT(!script_lib_activate("pulse") && !script_lib_is_active(script_lib_find("pulse")));
+
+    // Bare bytecode is not a package: the script stays inactive and unpinned
+    script_cache_stats_t cache_stats;
+    TEST_ASSERT(!script_lib_activate("pulse"));
+    TEST_ASSERT(!script_lib_is_active(script_lib_find("pulse")));
+    script_cache_get_stats(&cache_stats);
+    TEST_ASSERT(cache_stats.pinned == 0);
+    lib_meta.type = SCRIPT_TYPE_COMBO;
+    TEST_ASSERT(!script_package("pulse", &lib_meta));
+    lib_meta.type = SCRIPT_TYPE_LUA;
+    snprintf(lib_meta.name, sizeof(lib_meta.name), "pulse");
+    TEST_ASSERT(script_package("pulse", &lib_meta));
+    TEST_ASSERT(script_validate("/scripts/pulse.pkg"));
+    TEST_ASSERT(!script_validate("/scripts/other.pkg"));
+    TEST_ASSERT(script_lib_get(script_lib_find("pulse"), &entry) && entry.meta.checksum != 0);
+
+    sim_reset();
+    script_init();
+    state.triggers.r2 = 0;
+    TEST_ASSERT(script_lib_activate("pulse"));
+    TEST_ASSERT(!script_package("pulse", &lib_meta));
+    script_process_input(&state);
+    TEST_ASSERT(state.triggers.r2 == 77);
+    TEST_ASSERT(script_lib_deactivate("pulse"));
+    TEST_ASSERT(!script_unload("pulse"));
+
+    // In two steps, as across cores: the body stays pinned until unloaded
+    uint32_t key;
+    const void* body;
+    const char* script_run;
+    TEST_ASSERT(script_lib_begin_activate("pulse", &key, &body, &size) && body);
+    TEST_ASSERT(!script_lib_is_active(script_lib_find("pulse")) && !script_lib_remove("pulse"));
+    TEST_ASSERT(!script_lib_begin_activate("pulse", &key, &body, &size));
+    TEST_ASSERT(script_lib_finish_activate(key, script_load_package(body, size)));
+    TEST_ASSERT(script_lib_begin_deactivate("pulse", &key, &script_run));
+    TEST_ASSERT(str_compare(script_run, "pulse") == 0 && script_lib_is_active(script_lib_find("pulse")));
+    script_cache_get_stats(&cache_stats);
+    TEST_ASSERT(cache_stats.pinned == 1);
+    TEST_ASSERT(script_unload(script_run) && script_lib_finish_deactivate(key, 1));
+    script_cache_get_stats(&cache_stats);
+    TEST_ASSERT(cache_stats.pinned == 0 && !script_lib_is_active(script_lib_find("pulse")));
+    script_lib_cleanup();
+    script_cleanup();
+}
+
+// Recorded fields of two states match
+static int macro_fields_equal(const ps5_state_t* a, const ps5_state_t* b) {
+    return mem_compare(&a->buttons, &b->buttons, sizeof(a->buttons)) == 0 &&
+           mem_compare(&a->sticks, &b->sticks, sizeof(a->sticks)) == 0 &&
+           mem_compare(&a->triggers, &b->triggers, sizeof(a->triggers)) == 0 &&
+           a->touch[0].active == b->touch[0].active && a->touch[0].x == b->touch[0].x &&
+           a->touch[1].id == b->touch[1].id && a->touch[1].y == b->touch[1].y;
+}
+
+// Pseudo-random input: each field changes now and then, like a real pad
+static void macro_sample(ps5_state_t* state, uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    uint32_t r = *seed >> 8;
+    if ((r & 15) == 0) {
+        uint16_t mask = (uint16_t)(r >> 4);
+        __builtin_memcpy(&state->buttons, &mask, sizeof(mask));
+    }
+    if ((r & 7) == 1) state->sticks.lx = (uint8_t)(r >> 12);
+    if ((r & 7) == 2) state->sticks.ry = (uint8_t)(r >> 12);
+    if ((r & 31) == 3) state->triggers.r2 = (uint8_t)(r >> 16);
+    if ((r & 63) == 4) {
+        state->touch[0].active = !state->touch[0].active;
+        state->touch[0].x = (uint16_t)(r >> 5) & 0x7FF;
+        state->touch[1].id = (uint8_t)(r >> 9) & 0x7F;
+        state->touch[1].y = (uint16_t)(r >> 3) & 0x3FF;
+    }
+    state->motion.gyro_x = (int16_t)r;
+}
+
+static void test_macro_timeline(void) {
+    static uint8_t buffer[MACRO_TEST_BYTES];
+    static ps5_state_t samples[MACRO_TEST_SAMPLES];
+    timeline_writer_t writer;
+    timeline_player_t player;
+    ps5_state_t state = {0};
+    uint32_t seed = 99;
+
+    // Round trip at 1 kHz: playback reproduces every sample on time
+    timeline_writer_init(&writer, buffer, sizeof(buffer));
+    for (uint32_t i = 0; i < MACRO_TEST_SAMPLES; i++) {
+        macro_sample(&state, &seed);
+        samples[i] = state;
+        TEST_ASSERT(timeline_write(&writer, &state, 5000 + i * 1000ULL));
+    }
+    uint32_t size = timeline_finish(&writer, 5000 + MACRO_TEST_SAMPLES * 1000ULL);
+    TEST_ASSERT(size > 0 && size == writer.size);
+    TEST_ASSERT(size < MACRO_TEST_SAMPLES * sizeof(ps5_state_t) / 4);
+
+    timeline_player_init(&player, buffer, size, 0);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < 2 * MACRO_TEST_SAMPLES; i++) {
+        TEST_ASSERT(timeline_advance(&player, i * 1000ULL, 1));
+        if (!macro_fields_equal(&player.state, &samples[i % MACRO_TEST_SAMPLES])) {
+            mismatches++;
+        }
+    }
+    TEST_ASSERT(mismatches == 0);
+
+    // A held state costs nothing until it changes
+    timeline_writer_init(&writer, buffer, sizeof(buffer));
+    __builtin_memset(&state, 0, sizeof(state));
+    state.sticks.lx = 200;
+    for (uint32_t i = 0; i < 1000; i++) {
+        TEST_ASSERT(timeline_write(&writer, &state, i * 1000ULL));
+    }
+    TEST_ASSERT(writer.steps == 1 && writer.size <= 4);
+
+    // Holds longer than a step can carry stay in time
+    state.sticks.lx = 10;
+    TEST_ASSERT(timeline_write(&writer, &state, 3000000000ULL));
+    size = timeline_finish(&writer, 3000001000ULL);
+    timeline_player_init(&player, buffer, size, 0);
+    TEST_ASSERT(timeline_advance(&player, 2999999999ULL, 0) && player.state.sticks.lx == 200);
+    TEST_ASSERT(timeline_advance(&player, 3000000000ULL, 0) && player.state.sticks.lx == 10);
+
+    // Without looping it stops on the final state
+    TEST_ASSERT(!timeline_advance(&player, 3000001000ULL, 0) && player.state.sticks.lx == 10);
+    TEST_ASSERT(!timeline_advance(&player, 4000000000ULL, 0) && player.state.sticks.lx == 10);
+
+    // A full buffer ends the recording at the last sample that fit
+    timeline_writer_init(&writer, buffer, 64);
+    uint32_t written = 0;
+    while (timeline_write(&writer, &samples[written], written * 1000ULL)) {
+        written++;
+    }
+    TEST_ASSERT(written > 0 && !timeline_write(&writer, &samples[0], 0));
+    TEST_ASSERT(timeline_finish(&writer, 999999999ULL) <= 64);
+    timeline_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_ASSERT(timeline_finish(&writer, 0) == 0);
+
+    // Through the script API: record live input, then play it back
+    ps5_state_t live = {0};
+    sim_reset();
+    script_init();
+    TEST_ASSERT(script_record_macro("strafe"));
+    TEST_ASSERT(!script_record_macro("strafe"));
+    for (uint32_t i = 0; i < 300; i++) {
+        state = live;
+        state.sticks.lx = i < 100 ? 0 : i < 200 ? 128 : 255;
+        state.buttons.cross = i >= 100 && i < 200;
+        script_process_input(&state);
+        sim_advance_us(1000);
+    }
+    TEST_ASSERT(script_stop_recording("strafe"));
+    TEST_ASSERT(!script_stop_recording("strafe"));
+
+    uint32_t checked = 0;
+    for (uint32_t i = 0; i < 600; i++) {
+        state = live;
+        script_process_input(&state);
+        uint32_t phase = (i % 300) / 100;
+        if (i % 100 == 50) {
+            TEST_ASSERT(state.sticks.lx == (phase == 0 ? 0 : phase == 1 ? 128 : 255));
+            TEST_ASSERT(state.buttons.cross == (phase == 1));
+            checked++;
+        }
+        sim_advance_us(1000);
+    }
+    TEST_ASSERT(checked == 6);
+
+    // A second recording plays alongside the first
+    TEST_ASSERT(script_record_macro("hold"));
+    for (uint32_t i = 0; i < 10; i++) {
+        state = live;
+        state.sticks.lx = 128;
+        state.triggers.l2 = 90;
+        script_process_input(&state);
+        sim_advance_us(1000);
+    }
+    TEST_ASSERT(script_stop_recording(NULL));
+    TEST_ASSERT(script_set_macro_mode("hold", MACRO_LOOP, MACRO_BLEND_ADD));
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(state.triggers.l2 == 90);
+    TEST_ASSERT(script_unload("hold"));
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(state.triggers.l2 == 0);
+
+    // Recording under the same name replaces the macro
+    TEST_ASSERT(script_record_macro("strafe"));
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(script_stop_recording("strafe"));
+    TEST_ASSERT(script_unload("strafe"));
+    TEST_ASSERT(!script_unload("strafe"));
+    script_cleanup();
+}
+
+// Run frames 1 ms apart over a fresh copy of the input
+static void run_frames(const ps5_state_t* input, ps5_state_t* state, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) {
+        *state = *input;
+        script_process_input(state);
+        sim_advance_us(1000);
+    }
+}
+
+static void test_scheduler(void) {
+    static uint32_t code[6][VM_MAX_CODE];
+    script_context_t ctx;
+    ps5_state_t input = {0};
+    ps5_state_t state;
+
+    uint32_t first = compile_script("state.lx = 10", code[0]);
+    uint32_t second = compile_script("state.lx = state.lx + 1", code[1]);
+    uint32_t recoil = compile_script("state.ry = 200", code[2]);
+    uint32_t spin = compile_script("state.rx = 99 while 1 do end", code[3]);
+    uint32_t moody = compile_script("while state.l2 > 0 do end state.ly = 33", code[4]);
+    uint32_t heavy = compile_script("local i = 0 while i < 400 do i = i + 1 end state.r2 = 5", code[5]);
+
+    // Priority decides the order, whatever the load order
+    sim_reset();
+    script_init();
+    TEST_ASSERT(script_load_bytecode("second", code[1], second, 1));
+    TEST_ASSERT(script_load_bytecode("first", code[0], first, 9));
+    run_frames(&input, &state, 1);
+    TEST_ASSERT(state.sticks.lx == 11);
+    script_cleanup();
+
+    // A misbehaving low-priority script never costs the anti-recoil a frame
+    TEST_ASSERT(script_load_bytecode("recoil", code[2], recoil, 50));
+    TEST_ASSERT(script_load_bytecode("spin", code[3], spin, 1));
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < 200; i++) {
+        run_frames(&input, &state, 1);
+        misses += state.sticks.ry != 200;
+    }
+    TEST_ASSERT(misses == 0 && state.sticks.rx == 0);
+    TEST_ASSERT(script_get_context("spin", &ctx));
+    TEST_ASSERT(ctx.demotion == SCRIPT_TEST_MAX_DEMOTION && ctx.overruns > 0 && ctx.deferrals > ctx.overruns);
+    TEST_ASSERT(ctx.overruns < 40);
+    TEST_ASSERT(script_get_context("recoil", &ctx));
+    TEST_ASSERT(ctx.demotion == 0 && ctx.overruns == 0 && ctx.deferrals == 0 && ctx.exec_count == 200);
+    TEST_ASSERT(!script_get_context("missing", &ctx));
+    script_cleanup();
+
+    // A high-priority script that keeps overrunning drops below the rest,
+    // and earns its place back once it behaves
+    TEST_ASSERT(script_load_bytecode("moody", code[4], moody, 90));
+    TEST_ASSERT(script_load_bytecode("first", code[0], first, 5));
+    input.triggers.l2 = 1;
+    run_frames(&input, &state, 8);
+    TEST_ASSERT(script_get_context("moody", &ctx) && ctx.demotion >= 1);
+    TEST_ASSERT(state.sticks.lx == 10);
+    input.triggers.l2 = 0;
+    run_frames(&input, &state, 2000);
+    TEST_ASSERT(script_get_context("moody", &ctx) && ctx.demotion == 0 && state.sticks.ly == 33);
+    script_cleanup();
+
+    // Per-script budgets: too small cuts a script off, raising it lets it finish
+    TEST_ASSERT(script_load_bytecode("heavy", code[5], heavy, 1));
+    TEST_ASSERT(script_set_budget("heavy", 100));
+    TEST_ASSERT(!script_set_budget("missing", 100));
+    run_frames(&input, &state, 1);
+    TEST_ASSERT(state.triggers.r2 == 0);
+    TEST_ASSERT(script_get_context("heavy", &ctx) && ctx.budget_ops == 100 && ctx.overruns == 1);
+    TEST_ASSERT(script_set_budget("heavy", 1000000));
+    TEST_ASSERT(script_get_context("heavy", &ctx) && ctx.budget_ops < 1000000);
+    run_frames(&input, &state, 1);
+    TEST_ASSERT(state.triggers.r2 == 5);
+
+    // When the frame budget runs out, lower-priority scripts wait
+    char name[8][8];
+    for (uint32_t i = 0; i < 8; i++) {
+        snprintf(name[i], sizeof(name[i]), "h%u", i);
+        TEST_ASSERT(script_load_bytecode(name[i], code[5], heavy, 10 + i));
+        TEST_ASSERT(script_set_budget(name[i], 1000000));
+    }
+    run_frames(&input, &state, 1);
+    TEST_ASSERT(script_get_context("h7", &ctx) && ctx.deferrals == 0 && ctx.exec_count == 1);
+    TEST_ASSERT(script_get_context("heavy", &ctx) && ctx.deferrals == 1 && ctx.overruns == 1);
+    script_cleanup();
+}
+
+// Build a packaged macro in its own buffer
+static uint32_t build_macro(uint32_t* buffer, uint32_t max_size, const char* name, uint32_t priority,
+                            const package_macro_step_t* steps, uint32_t step_count) {
+    static package_meta_t meta;
+    __builtin_memset(&meta, 0, sizeof(meta));
+    meta.type = SCRIPT_TYPE_MACRO;
+    meta.priority = priority;
+    snprintf(meta.name, sizeof(meta.name), "%s", name);
+    return package_build(buffer, max_size, &meta, NULL, 0, steps, step_count);
+}
+
+static void test_macro_players(void) {
+    static uint32_t packages[MACRO_MAX_PLAYERS + 1][256];
+    // Rapid fire: cross on for 100 ms, off for 100 ms
+    static const package_macro_step_t fire[] = {
+        { 100000, BTN_CROSS, { 128, 128, 128, 128 }, { 0, 0 } },
+        { 100000, 0, { 128, 128, 128, 128 }, { 0, 0 } },
+    };
+    // Recoil: pull ry down by 20 for 300 ms, then rest for 300 ms
+    static const package_macro_step_t recoil[] = {
+        { 300000, 0, { 128, 128, 128, 148 }, { 0, 0 } },
+        { 300000, 0, { 128, 128, 128, 128 }, { 0, 0 } },
+    };
+    // Jump: circle and full r2 for 50 ms, then nothing
+    static const package_macro_step_t jump[] = {
+        { 50000, BTN_CIRCLE, { 0, 0, 0, 0 }, { 0, 255 } },
+        { 50000, 0, { 10, 20, 30, 40 }, { 0, 0 } },
+    };
+    ps5_state_t live = {0};
+    ps5_state_t state;
+    uint16_t mask;
+
+    live.sticks.lx = live.sticks.ly = live.sticks.rx = 128;
+    live.sticks.ry = 100;
+    live.buttons.square = 1;
+    live.motion.gyro_y = -77;
+
+    // Two macros with independent playheads, blended over live input
+    sim_reset();
+    script_init();
+    uint32_t size = build_macro(packages[0], sizeof(packages[0]), "fire", 1, fire, 2);
+    TEST_ASSERT(script_load_package(packages[0], size));
+    TEST_ASSERT(script_set_macro_mode("fire", MACRO_LOOP, MACRO_BLEND_OR));
+    size = build_macro(packages[1], sizeof(packages[1]), "recoil", 2, recoil, 2);
+    TEST_ASSERT(script_load_package(packages[1], size));
+    TEST_ASSERT(script_set_macro_mode("recoil", MACRO_LOOP, MACRO_BLEND_ADD));
+    TEST_ASSERT(!script_set_macro_mode("missing", MACRO_LOOP, MACRO_BLEND_ADD));
+
+    uint32_t errors = 0;
+    // Frames are 1 ms apart plus a few us of timer reads, so allow for drift
+    for (uint32_t ms = 0; ms < 1200; ms++) {
+        state = live;
+        script_process_input(&state);
+        __builtin_memcpy(&mask, &state.buttons, sizeof(mask));
+        uint32_t fire_phase = ms % 200;
+        uint32_t recoil_phase = ms % 600;
+        if (fire_phase > 15 && fire_phase < 85 && mask != (BTN_SQUARE | BTN_CROSS)) errors++;
+        if (fire_phase > 115 && fire_phase < 185 && mask != BTN_SQUARE) errors++;
+        if (recoil_phase > 15 && recoil_phase < 285 && state.sticks.ry != 120) errors++;
+        if (recoil_phase > 315 && recoil_phase < 585 && state.sticks.ry != 100) errors++;
+        if (state.sticks.lx != 128 || state.motion.gyro_y != -77) errors++;
+        sim_advance_us(1000);
+    }
+    TEST_ASSERT(errors == 0);
+
+    // A higher-priority override wins; played once it hands the input back
+    size = build_macro(packages[2], sizeof(packages[2]), "jump", 5, jump, 2);
+    TEST_ASSERT(script_load_package(packages[2], size));
+    TEST_ASSERT(!script_load_package(packages[2], size));
+    TEST_ASSERT(script_set_macro_mode("jump", MACRO_ONCE, MACRO_BLEND_OVERRIDE));
+    state = live;
+    script_process_input(&state);
+    __builtin_memcpy(&mask, &state.buttons, sizeof(mask));
+    TEST_ASSERT(mask == BTN_CIRCLE && state.triggers.r2 == 255 && state.sticks.ry == 0);
+    sim_advance_us(60000);
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.lx == 10 && state.sticks.ry == 40);
+    sim_advance_us(60000);
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.lx == 128 && state.buttons.square);
+
+    // Held, it keeps applying its last step
+    TEST_ASSERT(script_set_macro_mode("jump", MACRO_HOLD, MACRO_BLEND_OVERRIDE));
+    sim_advance_us(500000);
+    state = live;
+    script_process_input(&state);
+    TEST_ASSERT(state.sticks.lx == 10 && state.sticks.ry == 40 && !state.buttons.square);
+    TEST_ASSERT(script_unload("jump"));
+
+    // Players are limited; a failed load leaves no context behind
+    uint32_t loaded = 2;
+    char name[16];
+    for (uint32_t i = 2; i <= MACRO_MAX_PLAYERS; i++) {
+        snprintf(name, sizeof(name), "m%u", i);
+        size = build_macro(packages[i], sizeof(packages[i]), name, 0, fire, 2);
+        loaded += script_load_package(packages[i], size);
+    }
+    TEST_ASSERT(loaded == MACRO_MAX_PLAYERS);
+    TEST_ASSERT(!script_unload("m8"));
+    TEST_ASSERT(script_unload("fire") && script_unload("recoil"));
+
+    // Two recorders at once, stopped separately
+    TEST_ASSERT(script_record_macro("left"));
+    TEST_ASSERT(script_record_macro("right"));
+    for (uint32_t ms = 0; ms < 20; ms++) {
+        state = live;
+        state.triggers.l2 = (uint8_t)(ms * 10);
+        script_process_input(&state);
+        if (ms == 9) {
+            TEST_ASSERT(script_stop_recording("left"));
+        }
+        sim_advance_us(1000);
+    }
+    TEST_ASSERT(script_stop_recording("right"));
+    TEST_ASSERT(!script_stop_recording(NULL));
+    TEST_ASSERT(script_unload("left") && script_unload("right"));
+    script_cleanup();
+}
+
+// Frame cost with one macro and with a full set of players
+static void test_macro_mix_cost(void) {
+    static uint32_t packages[MACRO_MAX_PLAYERS][256];
+    static const package_macro_step_t steps[] = {
+        { 1000, BTN_CROSS, { 0, 64, 128, 255 }, { 10, 200 } },
+        { 3000, BTN_CIRCLE, { 255, 128, 64, 0 }, { 200, 10 } },
+    };
+    double frame_ns[2];
+    char name[16];
+
+    for (uint32_t run = 0; run < 2; run++) {
+        uint32_t players = run ? MACRO_MAX_PLAYERS : 1;
+        sim_reset();
+        script_init();
+        for (uint32_t i = 0; i < players; i++) {
+            snprintf(name, sizeof(name), "bench%u", i);
+            uint32_t size = build_macro(packages[i], sizeof(packages[i]), name, i, steps, 2);
+            TEST_ASSERT(script_load_package(packages[i], size));
+            script_set_macro_mode(name, MACRO_LOOP, (macro_blend_t)(i % 3));
+        }
+
+        ps5_state_t state = {0};
+        uint64_t start = bench_now_ns();
+        for (uint32_t frame = 0; frame < BENCH_MACRO_FRAMES; frame++) {
+            script_process_input(&state);
+            sim_advance_us(1000);
+        }
+        frame_ns[run] = (double)(bench_now_ns() - start) / BENCH_MACRO_FRAMES;
+        script_cleanup();
+    }
+
+    printf("  macro mix: %.0f ns/frame with 1 macro, %.0f ns/frame with %u\n",
+           frame_ns[0], frame_ns[1], MACRO_MAX_PLAYERS);
+    TEST_ASSERT(frame_ns[1] < frame_ns[0] * MACRO_MAX_PLAYERS / 2);
+}
+
+// A three-minute macro in the space the old format used for one second
+static void test_macro_capacity(void) {
+    static uint8_t buffer[MACRO_BENCH_BYTES];
+    timeline_writer_t writer;
+    timeline_player_t player;
+    ps5_state_t state = {0};
+
+    // Rapid fire at 10 Hz, a recoil pull every 100 ms, a jump every 2 s
+    // and a strafe every 5 s, sampled at 1 kHz
+    timeline_writer_init(&writer, buffer, sizeof(buffer));
+    uint32_t samples = MACRO_BENCH_SECONDS * 1000;
+    for (uint32_t ms = 0; ms < samples; ms++) {
+        state.triggers.r2 = (ms / 50) % 2 ? 255 : 0;
+        state.sticks.ry = (uint8_t)(128 + (ms % 1000) / 100);
+        state.buttons.cross = ms % 2000 < 100;
+        state.sticks.lx = ms % 5000 < 400 ? 0 : 128;
+        TEST_ASSERT(timeline_write(&writer, &state, ms * 1000ULL));
+    }
+    TEST_ASSERT(!writer.full);
+    uint32_t size = timeline_finish(&writer, samples * 1000ULL);
+
+    // Decode cost per played step
+    timeline_player_init(&player, buffer, size, 0);
+    uint64_t start = bench_now_ns();
+    for (uint32_t ms = 0; ms < samples; ms++) {
+        timeline_advance(&player, ms * 1000ULL, 1);
+    }
+    uint64_t elapsed_ns = bench_now_ns() - start;
+
+    printf("  macro: %u s at 1 kHz in %u bytes (%u steps, %.1f B/s), %u frames in the old format, %.1f ns/frame\n",
+           MACRO_BENCH_SECONDS, size, writer.steps, (double)size / MACRO_BENCH_SECONDS,
+           (uint32_t)(sizeof(buffer) / (sizeof(ps5_state_t) + sizeof(uint32_t))),
+           (double)elapsed_ns / samples);
+    TEST_ASSERT(size <= sizeof(buffer));
+}
+
+// Search cost with a full library of realistic entries
+static void test_lib_search_speed(void) {
+    static const char* words[] = {
+        "rapid", "fire", "anti", "recoil", "stick", "trigger", "macro", "combo",
+        "slide", "cancel", "jump", "shot", "aim", "assist", "deadzone", "curve",
+        "sprint", "reload", "crouch", "strafe", "burst", "tap", "hold", "toggle",
+        "sniper", "parry", "skill", "dribble", "boost", "drift", "turbo", "remap"
+    };
+    static const char* games[] = {
+        "Warzone", "FIFA 24", "Fortnite", "Apex Legends", "Gran Turismo 7",
+        "Elden Ring", "Rocket League", "Call of Duty", "Destiny 2", "Tekken 8"
+    };
+    char name[64];
+    char description[256];
+    uint32_t seed = 12345;
+
+    script_lib_init();
+    for (uint32_t i = 0; i < LIB_ENTRIES; i++) {
+        uint32_t len = 0;
+        for (uint32_t w = 0; w < 16; w++) {
+            seed = seed * 1103515245 + 12345;
+            len += snprintf(description + len, sizeof(description) - len, "%s%s",
+                            w ? " " : "", words[(seed >> 16) % 32]);
+        }
+        snprintf(name, sizeof(name), "%s-%s-%u", words[i % 32], words[(i / 32) % 32], i);
+        add_script(name, games[i % 10], description, i);
+    }
+
+    static const char* queries[] = {
+        "recoil", "warzone", "slide cancel", "deadzone", "turbo", "elden", "xyzzy", "rapid-fire"
+    };
+    script_handle_t handles[32];
+    uint32_t results = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_SEARCHES; i++) {
+        results += script_lib_query(queries[i & 7], handles, 32);
+    }
+    uint64_t elapsed_ns = bench_now_ns() - start;
+
+    uint64_t per_query_us = elapsed_ns / BENCH_SEARCHES / 1000;
+    printf("  library: %llu us per search with %u entries (frame %u us)\n",
+           (unsigned long long)per_query_us, LIB_ENTRIES, FRAME_US);
+    TEST_ASSERT(results > 0);
+    TEST_ASSERT(per_query_us < FRAME_US / 10);
+
+    // Scroll a broad result list one screen at a time
+    script_view_t view;
+    uint32_t pages = 0;
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_SEARCH, "recoil"));
+    start = bench_now_ns();
+    for (uint32_t first = 0; script_lib_view_page(&view, first, handles, 12) > 0; first += 12) {
+        pages++;
+    }
+    elapsed_ns = bench_now_ns() - start;
+
+    uint64_t per_page_us = elapsed_ns / (pages ? pages : 1) / 1000;
+    printf("  library: %llu us per 12-row page over %u results\n",
+           (unsigned long long)per_page_us, script_lib_view_count(&view));
+    TEST_ASSERT(pages > 1);
+    TEST_ASSERT(per_page_us < FRAME_US / 10);
+    script_lib_cleanup();
+}
+
+// Register all script engine tests
+void register_script_tests(void) {
+    TEST_ADD_TYPE(test_combo_match, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_combo_script, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_combo_scaling, TEST_SCRIPTS, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_vm_scripts, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_vm_budget, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_vm_validate, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_scheduler, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_vm_throughput, TEST_SCRIPTS, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_crc32, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_crc32_speed, TEST_SCRIPTS, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_packages, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_macro_timeline, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_macro_players, TEST_SCRIPTS, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_macro_capacity, TEST_SCRIPTS, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_macro_mix_cost, TEST_SCRIPTS, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_lib_index, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_lib_lookup, TEST_CATALOG, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_lib_search, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_lib_strings, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_lib_views, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_script_cache, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_lib_search_speed, TEST_CATALOG, TEST_TYPE_PERFORMANCE);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_SCRIPT_H
+#define TEST_SCRIPT_H
+
+// Function to register script engine tests
+void register_script_tests(void);
+
+#endif // TEST_SCRIPT_H
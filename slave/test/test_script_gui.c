@@ -41,6 +41,26 @@ static script_entry_t test_scripts[] = {
     }
 };
 
+// Stands in for the script core, which answers the GUI's page requests
+static script_pager_t pager;
+
+// Put the test scripts in the library
+static void load_test_library(void) {
+    script_lib_init();
+    pager.open = 0;
+    TEST_ASSERT(script_lib_add(&test_scripts[0]));
+    TEST_ASSERT(script_lib_add(&test_scripts[1]));
+}
+
+// Answer the GUI's page requests the way the script core does
+static void serve_pages(void) {
+    const script_page_request_t* request;
+    while ((request = script_gui_page_request()) != NULL) {
+        script_gui_page_requested();
+        script_gui_take_page(script_lib_page(&pager, request));
+    }
+}
+
 // Test callback data
 static struct {
     gui_event_t last_event;
@@ -83,22 +103,46 @@ void test_gui_navigation(void) {
 
 // Test script list display and interaction
 void test_gui_script_list(void) {
-    script_gui_show_scripts(test_scripts, 2);
+    load_test_library();
+    script_gui_show_scripts(SCRIPT_VIEW_ALL, NULL);
     test_gui_verify_state(GUI_STATE_SCRIPT_LIST);
+    TEST_ASSERT(script_gui_get_selected() == NULL);
+    serve_pages();
+    TEST_ASSERT(str_compare(script_gui_get_selected()->name, "Test Script 1") == 0);
     
     // Test script selection
     test_gui_simulate_input(BUTTON_DOWN);
     test_gui_verify_selection(1);
+    TEST_ASSERT(str_compare(script_gui_get_selected()->name, "Test Script 2") == 0);
+    test_gui_simulate_input(BUTTON_DOWN);
+    test_gui_verify_selection(1);
     
     test_gui_simulate_input(BUTTON_A);
     TEST_ASSERT(test_data.callback_called);
     TEST_ASSERT(test_data.last_event == GUI_EVENT_SELECT);
+    
+    // A changed library is asked for again; a removed entry's key no
+    // longer names anything, even after another takes its place
+    uint32_t key = script_gui_get_selected()->key;
+    TEST_ASSERT(script_lib_find_key(key) == script_lib_find("Test Script 2"));
+    TEST_ASSERT(script_gui_page_request() == NULL);
+    TEST_ASSERT(script_lib_remove("Test Script 2"));
+    script_gui_library_changed();
+    TEST_ASSERT(script_gui_page_request() != NULL);
+    serve_pages();
+    TEST_ASSERT(script_lib_find_key(key) == SCRIPT_HANDLE_NONE);
+    test_gui_verify_selection(0);
+    TEST_ASSERT(str_compare(script_gui_get_selected()->name, "Test Script 1") == 0);
+    TEST_ASSERT(script_lib_add(&test_scripts[1]));
 }
 
 // Test script details display
 void test_gui_script_details(void) {
-    script_gui_show_script_details(&test_scripts[0]);
+    script_row_t row;
+    TEST_ASSERT(script_lib_row(script_lib_find("Test Script 1"), &row));
+    script_gui_show_script_details(&row);
     test_gui_verify_state(GUI_STATE_SCRIPT_DETAILS);
+    TEST_ASSERT(str_compare(script_gui_get_selected()->author, "Test Author") == 0);
     
     // Test script activation
     test_gui_simulate_input(BUTTON_A);
@@ -117,8 +161,12 @@ void test_gui_catalog_browse(void) {
     TEST_ASSERT(test_data.last_event == GUI_EVENT_DOWNLOAD);
     
     // Test search
-    script_gui_show_search_results(test_scripts, 2);
+    load_test_library();
+    script_gui_show_search_results("another");
+    serve_pages();
     test_gui_verify_state(GUI_STATE_CATALOG_SEARCH);
+    TEST_ASSERT(str_compare(script_gui_get_selected()->name, "Test Script 2") == 0);
+    script_lib_cleanup();
 }
 
 // Test script editor
@@ -30,4 +30,7 @@ void test_gui_verify_selection(uint32_t expected_item);
 void test_gui_verify_message(const char* expected_message);
 void test_gui_verify_progress(const char* operation, uint32_t progress);
 
+// Register GUI tests
+void register_gui_tests(void);
+
 #endif // TEST_SCRIPT_GUI_H
@@ -0,0 +1,1211 @@
+#include "test_framework.h"
+#include "test_sim.h"
+#include "sim.h"
+#include "../src/hardware.h"
+#include "../src/usb.h"
+#include "../src/ps5.h"
+#include "../src/status.h"
+#include "../src/optimize.h"
+#include "../src/irq.h"
+#include "../src/report_ring.h"
+#include "../src/latency_hist.h"
+#include "../src/profile.h"
+#include "../src/smp.h"
+#include "../src/dma.h"
+#include "../src/mem.h"
+#include "../src/clock.h"
+#include "../src/uart.h"
+#include "../src/script.h"
+#include "../src/vm.h"
+#include "../tools/vm_compile.h"
+#include "test_config.h"
+#include <stdio.h>
+#include <string.h>
+
+// Status LED pin
+#define TEST_LED_PIN 47
+
+// Test virtual system timer
+static void test_sim_timer(void) {
+    sim_reset();
+
+    uint64_t start = get_system_time();
+    TEST_ASSERT(get_system_time() > start);
+
+    delay_microseconds(250);
+    TEST_ASSERT(get_system_time() - start >= 250);
+
+    sim_advance_us(1ull << 32);
+    TEST_ASSERT(get_system_time() - start > (1ull << 32));
+}
+
+// Deadlines seen by the clock tests
+static struct {
+    uint32_t calls;
+    uint32_t ids[8];
+    uint64_t at_us[8];
+    uint32_t chain;
+} clock_seen;
+
+static void clock_record(uint32_t id, void* user) {
+    (void)user;
+    if (clock_seen.calls < 8) {
+        clock_seen.ids[clock_seen.calls] = id;
+        clock_seen.at_us[clock_seen.calls] = sim_time_us();
+    }
+    clock_seen.calls++;
+
+    // Callbacks may set the next deadline
+    if (clock_seen.chain) {
+        clock_seen.chain--;
+        clock_deadline_in(20000, clock_record, 0);
+    }
+}
+
+// Test generic timer timestamps, frame caching and deadline interrupts
+static void test_clock(void) {
+    clock_stats_t stats;
+    sim_stats_t before, after;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(clock_init());
+    clock_get_stats(&stats);
+    TEST_ASSERT(stats.frequency == 64000000);
+
+    // Same epoch as the system timer, without touching it
+    sim_get_stats(&before);
+    uint64_t us = clock_now_us();
+    TEST_ASSERT(us == sim_time_us());
+    uint64_t ns = clock_now_ns();
+    TEST_ASSERT(ns == sim_time_us() * 1000);
+    TEST_ASSERT(get_system_time() == sim_time_us());
+    sim_get_stats(&after);
+    TEST_ASSERT(after.timer_reads == before.timer_reads);
+    TEST_ASSERT(after.counter_reads == before.counter_reads + 3);
+    TEST_ASSERT(clock_ticks_to_ns(64) == 1000 && clock_ns_to_ticks(1) == 1);
+    TEST_ASSERT(clock_ns_to_ticks(3000000000ull) == 192000000ull);
+
+    // A frame reads the counter once
+    uint64_t frame = clock_frame_begin();
+    sim_advance_us(50);
+    sim_get_stats(&before);
+    TEST_ASSERT(clock_frame_us() == frame && clock_frame_ns() == frame * 1000);
+    sim_get_stats(&after);
+    TEST_ASSERT(after.counter_reads == before.counter_reads);
+    clock_frame_end();
+    TEST_ASSERT(clock_frame_us() >= frame + 50);
+
+    // Interrupt deadlines fire in time order, on time
+    memset(&clock_seen, 0, sizeof(clock_seen));
+    irq_cpu_enable();
+    uint64_t start = sim_time_us();
+    uint32_t late = clock_deadline_in(300000, clock_record, 0);
+    uint32_t early = clock_deadline_in(100000, clock_record, 0);
+    uint32_t dropped = clock_deadline_in(200000, clock_record, 0);
+    TEST_ASSERT(late && early && dropped && clock_deadline_pending(early));
+    TEST_ASSERT(clock_deadline_cancel(dropped) && !clock_deadline_cancel(dropped));
+    sim_advance_us(95);
+    TEST_ASSERT(clock_seen.calls == 0);
+    while (clock_seen.calls < 2 && sim_time_us() - start < 1000) {
+        sim_advance_us(1);
+    }
+    TEST_ASSERT(clock_seen.calls == 2);
+    TEST_ASSERT(clock_seen.ids[0] == early && clock_seen.ids[1] == late);
+    TEST_ASSERT(clock_seen.at_us[0] - start >= 100 && clock_seen.at_us[0] - start <= 104);
+    TEST_ASSERT(clock_seen.at_us[1] - start >= 300 && clock_seen.at_us[1] - start <= 304);
+    TEST_ASSERT(!clock_deadline_pending(early));
+
+    // Chained from the callback; a deadline already past fires at once
+    memset(&clock_seen, 0, sizeof(clock_seen));
+    clock_seen.chain = 2;
+    clock_deadline_in(0, clock_record, 0);
+    TEST_ASSERT(clock_seen.calls == 1);
+    sim_advance_us(25);
+    sim_advance_us(25);
+    TEST_ASSERT(clock_seen.calls == 3 && clock_seen.chain == 0);
+
+    // Polled where interrupts are off; full slots are refused
+    irq_cpu_disable();
+    memset(&clock_seen, 0, sizeof(clock_seen));
+    for (uint32_t i = 0; i < CLOCK_MAX_DEADLINES; i++) {
+        TEST_ASSERT(clock_deadline_in(10000 * (i + 1), clock_record, 0) != 0);
+    }
+    TEST_ASSERT(clock_deadline_in(1000, clock_record, 0) == 0);
+    sim_advance_us(1000);
+    TEST_ASSERT(clock_seen.calls == 0);
+    TEST_ASSERT(clock_deadline_poll() == 0 && clock_seen.calls == CLOCK_MAX_DEADLINES);
+    clock_get_stats(&stats);
+    TEST_ASSERT(stats.rejected == 1 && stats.cancelled == 1);
+    TEST_ASSERT(stats.fired == 2 + 3 + CLOCK_MAX_DEADLINES);
+}
+
+// Test DWC2 root port detection
+static void test_sim_usb_detect(void) {
+    sim_reset();
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(usb_detect_device(USB_DEVICE_PS5));
+    TEST_ASSERT(usb_detect_device(USB_DEVICE_CONTROLLER));
+
+    sim_attach_device(SIM_PORT_CONTROLLER, 0);
+    TEST_ASSERT(!usb_detect_device(USB_DEVICE_CONTROLLER));
+    TEST_ASSERT(usb_detect_device(USB_DEVICE_PS5));
+}
+
+// Bring up USB and the controller input stream with interrupts enabled
+static void start_input_stream(void) {
+    irq_init();
+    usb_init();
+    ps5_init();
+    irq_cpu_enable();
+}
+
+// Test input report capture on transfer completion
+static void test_sim_input_report(void) {
+    sim_reset();
+    sim_controller_set_report_interval(0);
+    start_input_stream();
+
+    ps5_state_t sent = {0};
+    sent.sticks.lx = 12;
+    sent.sticks.ry = 200;
+    sent.battery_level = 55;
+    sim_controller_set_state(&sent);
+    uint64_t sent_at = sim_time_us();
+
+    // Captured now, read a millisecond later
+    ps5_state_t received = {0};
+    sim_advance_us(10);
+    sim_advance_us(1000);
+    TEST_ASSERT(ps5_process_input(&received) == 1);
+    TEST_ASSERT(received.sticks.lx == 12);
+    TEST_ASSERT(received.sticks.ry == 200);
+    TEST_ASSERT(ps5_get_battery_level() == 55);
+
+    // Stamped when the transfer completed, not when it was read
+    TEST_ASSERT(ps5_get_input_timestamp() - sent_at < 50);
+
+    // No new report: returns at once instead of waiting out a poll period
+    uint64_t before = sim_time_us();
+    TEST_ASSERT(!ps5_process_input(&received));
+    TEST_ASSERT(sim_time_us() - before < 10);
+
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.irqs_taken >= 1);
+    TEST_ASSERT(stats.in_naks == 0);
+}
+
+// Test that draining keeps the newest report and counts the rest
+static void test_sim_input_ring(void) {
+    sim_reset();
+    sim_controller_set_report_interval(0);
+    start_input_stream();
+
+    ps5_state_t sent = {0};
+    for (uint8_t i = 1; i <= 3; i++) {
+        sent.sticks.lx = i;
+        sim_controller_set_state(&sent);
+        get_system_time();   // Register access lets the interrupt in
+    }
+
+    ps5_state_t received = {0};
+    TEST_ASSERT(ps5_process_input(&received) == 3);
+    TEST_ASSERT(received.sticks.lx == 3);
+    TEST_ASSERT(ps5_take_input_overruns() == 0);
+
+    // More reports than slots: the excess is counted, not silently lost
+    for (uint32_t i = 0; i < REPORT_RING_SIZE + 4; i++) {
+        sent.sticks.lx = (uint8_t)(10 + i);
+        sim_controller_set_state(&sent);
+        get_system_time();
+    }
+    TEST_ASSERT(ps5_process_input(&received) == REPORT_RING_SIZE);
+    TEST_ASSERT(received.sticks.lx == 10 + REPORT_RING_SIZE - 1);
+    TEST_ASSERT(ps5_take_input_overruns() == 4);
+    TEST_ASSERT(ps5_take_input_overruns() == 0);
+}
+
+// Test ring ordering and wraparound
+static void test_report_ring(void) {
+    static report_ring_t ring;
+    input_report_t report;
+    ps5_state_t state = {0};
+
+    report_ring_reset(&ring);
+    TEST_ASSERT(!report_ring_pop(&ring, &report));
+
+    for (uint32_t round = 0; round < 3; round++) {
+        for (uint32_t i = 0; i < REPORT_RING_SIZE - 1; i++) {
+            state.sticks.lx = (uint8_t)i;
+            TEST_ASSERT(report_ring_push(&ring, 100 + i, &state));
+        }
+        TEST_ASSERT(report_ring_count(&ring) == REPORT_RING_SIZE - 1);
+
+        int ordered = 1;
+        for (uint32_t i = 0; i < REPORT_RING_SIZE - 1; i++) {
+            if (!report_ring_pop(&ring, &report) || report.state.sticks.lx != i ||
+                report.timestamp_us != 100 + i) {
+                ordered = 0;
+            }
+        }
+        TEST_ASSERT(ordered);
+    }
+    TEST_ASSERT(report_ring_count(&ring) == 0);
+    TEST_ASSERT(ring.overruns == 0);
+}
+
+// Test histogram bucketing and percentiles
+static void test_latency_hist(void) {
+    static latency_hist_t hist;
+
+    latency_hist_reset(&hist);
+    TEST_ASSERT(latency_hist_percentile(&hist, 500) == 0);
+
+    // Exact below 32 us, within 1/16 above, clamped at the top
+    int bounded = 1;
+    for (uint32_t value = 0; value < 1000000; value += 7) {
+        uint32_t bucket_max = latency_hist_bucket_max(latency_hist_index(value));
+        if (bucket_max < value || (value < 32 && bucket_max != value) ||
+            bucket_max - value > value / 16) {
+            bounded = 0;
+        }
+    }
+    TEST_ASSERT(bounded);
+    TEST_ASSERT(latency_hist_index(0xFFFFFFFF) == LATENCY_HIST_BUCKETS - 1);
+
+    // 990 fast samples and 10 slow ones: p50 and p99 ignore the tail
+    for (uint32_t i = 0; i < 990; i++) {
+        latency_hist_record(&hist, 10 + i % 5);
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        latency_hist_record(&hist, 5000);
+    }
+    TEST_ASSERT(hist.count == 1000);
+    TEST_ASSERT(latency_hist_percentile(&hist, 500) == 12);
+    TEST_ASSERT(latency_hist_percentile(&hist, 990) == 14);
+    TEST_ASSERT(latency_hist_percentile(&hist, 999) == 5000);
+    TEST_ASSERT(latency_hist_percentile(&hist, 1000) == 5000);
+}
+
+// Test output report capture
+static void test_sim_output_report(void) {
+    uint8_t report[64];
+
+    sim_reset();
+    usb_init();
+    ps5_init();
+    sim_advance_us(PS5_OUTPUT_LED_INTERVAL_US);
+    ps5_set_led_color(10, 20, 30);
+
+    TEST_ASSERT(sim_controller_get_output(report, sizeof(report)) == 64);
+    TEST_ASSERT(report[0] == PS5_REPORT_OUTPUT);
+    TEST_ASSERT(report[1] == 10 && report[2] == 20 && report[3] == 30);
+}
+
+// Last output state the controller received
+static ps5_output_t controller_output(void) {
+    uint8_t report[64] = {0};
+    ps5_output_t output;
+    sim_controller_get_output(report, sizeof(report));
+    __builtin_memcpy(&output, report + 1, sizeof(output));
+    return output;
+}
+
+// Test that output changes merge into one report per slot and respect
+// per-category rates
+static void test_sim_output_coalescing(void) {
+    ps5_output_t out;
+    sim_stats_t stats;
+
+    sim_reset();
+    usb_init();
+    ps5_init();
+    sim_advance_us(PS5_OUTPUT_AUDIO_INTERVAL_US);
+
+    // Unchanged state sends nothing
+    sim_get_stats(&stats);
+    uint32_t sent = stats.out_reports;
+    ps5_set_led_color(0, 0, 64);
+    ps5_flush_output();
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.out_reports == sent);
+
+    // Several setters in one slot: first goes out, the rest merge
+    ps5_set_led_color(1, 2, 3);
+    ps5_set_haptic_feedback(40, 50);
+    ps5_set_audio(20, 30, 1);
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.out_reports == sent + 1);
+
+    sim_advance_us(PS5_OUTPUT_SLOT_US);
+    ps5_flush_output();
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.out_reports == sent + 2);
+    out = controller_output();
+    TEST_ASSERT(out.led_r == 1 && out.haptic_left_intensity == 40);
+    TEST_ASSERT(out.haptic_right_intensity == 50 && out.speaker_volume == 20);
+
+    // LED changes inside its rate window are held, other categories are not
+    ps5_set_led_color(9, 9, 9);
+    ps5_set_haptic_feedback(60, 70);
+    sim_advance_us(PS5_OUTPUT_SLOT_US);
+    ps5_flush_output();
+    out = controller_output();
+    TEST_ASSERT(out.led_r == 1 && out.haptic_left_intensity == 60);
+
+    // Only the latest held LED value goes out once the window elapses
+    ps5_set_led_color(7, 7, 7);
+    sim_advance_us(PS5_OUTPUT_LED_INTERVAL_US);
+    ps5_flush_output();
+    out = controller_output();
+    TEST_ASSERT(out.led_r == 7 && out.led_g == 7 && out.led_b == 7);
+
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.out_reports == sent + 4);
+}
+
+// Test DMA control block execution
+static void test_sim_dma(void) {
+    uint8_t src[256];
+    uint8_t dst[256] = {0};
+
+    sim_reset();
+    enable_dma();
+    for (uint32_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i * 7);
+    }
+    dma_memcpy(dst, src, sizeof(src));
+
+    int match = 1;
+    for (uint32_t i = 0; i < sizeof(src); i++) {
+        if (dst[i] != src[i]) match = 0;
+    }
+    TEST_ASSERT(match);
+
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.dma_transfers == 1);
+}
+
+// Bus masters reach memory only through the translated alias
+static void test_bus_addr(void) {
+    uint8_t buffer[64];
+
+    sim_reset();
+    TEST_ASSERT(hal_phys_to_bus(MMIO_BASE + 0x201000) == UART0_DR_BUS);
+    TEST_ASSERT(hal_phys_to_bus(0x00080000) == 0xC0080000);
+
+    uint32_t bus = hal_bus_addr(&buffer[8]);
+    TEST_ASSERT((bus & HAL_BUS_SDRAM) == HAL_BUS_SDRAM);
+    TEST_ASSERT(sim_bus_to_virt(bus) == &buffer[8]);
+    TEST_ASSERT(sim_bus_to_virt(hal_phys_addr(&buffer[8])) == NULL);
+}
+
+// Completions seen by the DMA tests
+static struct {
+    uint32_t calls;
+    uint32_t tickets[8];
+    int ok;
+    int resubmit;
+    uint32_t follow_up;
+} dma_seen;
+
+static uint8_t dma_src[4096];
+static uint8_t dma_dst[4096];
+
+static void dma_record(uint32_t ticket, int ok, void* user) {
+    (void)user;
+    if (dma_seen.calls < 8) {
+        dma_seen.tickets[dma_seen.calls] = ticket;
+    }
+    dma_seen.calls++;
+    dma_seen.ok &= ok;
+
+    // Callbacks may chain the next transfer
+    if (dma_seen.resubmit) {
+        dma_seen.resubmit = 0;
+        dma_segment_t segment = { &dma_dst[3072], &dma_src[3072], 1024 };
+        dma_seen.follow_up = dma_submit(&segment, 1, dma_record, 0);
+    }
+}
+
+// Test scatter-gather submissions, queueing, fills and IRQ completion
+static void test_dma_engine(void) {
+    dma_stats_t stats;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+    memset(&dma_seen, 0, sizeof(dma_seen));
+    dma_seen.ok = 1;
+    for (uint32_t i = 0; i < sizeof(dma_src); i++) {
+        dma_src[i] = (uint8_t)(i * 13 + 1);
+    }
+    memset(dma_dst, 0, sizeof(dma_dst));
+
+    // Three pieces, one chain; nothing lands until the chain finishes
+    dma_segment_t gather[3] = {
+        { &dma_dst[0], &dma_src[2048], 512 },
+        { &dma_dst[512], &dma_src[0], 100 },
+        { &dma_dst[612], &dma_src[1000], 900 }
+    };
+    uint32_t ticket = dma_submit(gather, 3, dma_record, 0);
+    TEST_ASSERT(ticket != 0);
+    TEST_ASSERT(!dma_done(ticket) && dma_dst[0] == 0);
+    TEST_ASSERT(dma_poll() == 1 && dma_seen.calls == 0);
+    TEST_ASSERT(dma_wait(ticket) && dma_done(ticket));
+    TEST_ASSERT(dma_seen.calls == 1 && dma_seen.tickets[0] == ticket && dma_seen.ok);
+    TEST_ASSERT(memcmp(&dma_dst[0], &dma_src[2048], 512) == 0);
+    TEST_ASSERT(memcmp(&dma_dst[512], &dma_src[0], 100) == 0);
+    TEST_ASSERT(memcmp(&dma_dst[612], &dma_src[1000], 900) == 0);
+
+    // More requests than channels: the rest wait their turn
+    uint32_t tickets[5];
+    memset(&dma_seen, 0, sizeof(dma_seen));
+    dma_seen.ok = 1;
+    memset(dma_dst, 0, sizeof(dma_dst));
+    for (uint32_t i = 0; i < 5; i++) {
+        dma_segment_t segment = { &dma_dst[i * 512], &dma_src[i * 512], 512 };
+        tickets[i] = dma_submit(&segment, 1, dma_record, 0);
+        TEST_ASSERT(tickets[i] != 0);
+    }
+    dma_get_stats(&stats);
+    TEST_ASSERT(stats.queued == 5 - DMA_ENGINE_CHANNELS);
+    TEST_ASSERT(dma_wait(tickets[4]));
+    TEST_ASSERT(dma_poll() == 0 && dma_seen.calls == 5 && dma_seen.ok);
+    TEST_ASSERT(memcmp(dma_dst, dma_src, 5 * 512) == 0);
+
+    // Fill, and a callback that submits the next transfer
+    dma_seen.resubmit = 1;
+    ticket = dma_fill(&dma_dst[2560], 0x5A, 500, dma_record, 0);
+    TEST_ASSERT(dma_wait(ticket) && dma_seen.follow_up != 0);
+    TEST_ASSERT(dma_wait(dma_seen.follow_up) && dma_seen.calls == 7);
+    TEST_ASSERT(dma_dst[2560] == 0x5A && dma_dst[3059] == 0x5A && dma_dst[3060] == 0);
+    TEST_ASSERT(memcmp(&dma_dst[3072], &dma_src[3072], 1024) == 0);
+
+    // Bad lists and an exhausted control block pool are refused
+    dma_segment_t many[DMA_MAX_SEGMENTS + 1];
+    for (uint32_t i = 0; i <= DMA_MAX_SEGMENTS; i++) {
+        many[i] = (dma_segment_t){ &dma_dst[i * 16], &dma_src[i * 16], 16 };
+    }
+    TEST_ASSERT(dma_submit(many, 0, 0, 0) == 0);
+    TEST_ASSERT(dma_submit(many, DMA_MAX_SEGMENTS + 1, 0, 0) == 0);
+    gather[1].src = 0;
+    TEST_ASSERT(dma_submit(gather, 3, 0, 0) == 0);
+    for (uint32_t i = 0; i < DMA_CB_POOL / DMA_MAX_SEGMENTS; i++) {
+        TEST_ASSERT(dma_submit(many, DMA_MAX_SEGMENTS, 0, 0) != 0);
+    }
+    TEST_ASSERT(dma_submit(many, 1, 0, 0) == 0);
+    dma_get_stats(&stats);
+    TEST_ASSERT(stats.rejected == 1 && stats.failed == 0);
+    while (dma_poll()) {
+        sim_advance_us(10);
+    }
+    TEST_ASSERT(dma_submit(many, 1, 0, 0) != 0);
+
+    // Interrupt completion: no polling needed
+    TEST_ASSERT(dma_init(DMA_COMPLETE_IRQ));
+    irq_cpu_enable();
+    memset(&dma_seen, 0, sizeof(dma_seen));
+    dma_seen.ok = 1;
+    ticket = dma_submit(gather, 1, dma_record, 0);
+    TEST_ASSERT(ticket != 0 && dma_seen.calls == 0);
+    sim_advance_us(100);
+    TEST_ASSERT(dma_seen.calls == 1 && dma_seen.tickets[0] == ticket && dma_done(ticket));
+    sim_stats_t sim_stats;
+    sim_get_stats(&sim_stats);
+    TEST_ASSERT(sim_stats.irqs_taken >= 1);
+    irq_cpu_disable();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+}
+
+// Test withdrawing requests, and the synchronous copy's CPU fallback when
+// the engine never finishes
+static void test_dma_cancel(void) {
+    dma_stats_t stats;
+    uint32_t tickets[DMA_ENGINE_CHANNELS + 1];
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+    memset(&dma_seen, 0, sizeof(dma_seen));
+    dma_seen.ok = 1;
+    for (uint32_t i = 0; i < sizeof(dma_src); i++) {
+        dma_src[i] = (uint8_t)(i * 5 + 3);
+    }
+    memset(dma_dst, 0, sizeof(dma_dst));
+
+    // Every channel busy and one queued; cancelling a running request
+    // hands its channel to the queued one
+    sim_set_dma_stall(1);
+    for (uint32_t i = 0; i <= DMA_ENGINE_CHANNELS; i++) {
+        dma_segment_t segment = { &dma_dst[i * 256], &dma_src[i * 256], 256 };
+        tickets[i] = dma_submit(&segment, 1, dma_record, 0);
+        TEST_ASSERT(tickets[i] != 0);
+    }
+    TEST_ASSERT(dma_cancel(tickets[0]));
+    TEST_ASSERT(dma_done(tickets[0]) && !dma_cancel(tickets[0]));
+    sim_set_dma_stall(0);
+    while (dma_poll()) {
+        sim_advance_us(10);
+    }
+    TEST_ASSERT(dma_seen.calls == DMA_ENGINE_CHANNELS && dma_seen.ok);
+    TEST_ASSERT(memcmp(&dma_dst[256], &dma_src[256], DMA_ENGINE_CHANNELS * 256) == 0);
+    TEST_ASSERT(!dma_cancel(tickets[DMA_ENGINE_CHANNELS]));
+
+    // A queued request leaves the FIFO without running
+    sim_set_dma_stall(1);
+    for (uint32_t i = 0; i <= DMA_ENGINE_CHANNELS; i++) {
+        dma_segment_t segment = { &dma_dst[i * 256], &dma_src[i * 256], 256 };
+        tickets[i] = dma_submit(&segment, 1, dma_record, 0);
+    }
+    TEST_ASSERT(dma_cancel(tickets[DMA_ENGINE_CHANNELS]));
+    for (uint32_t i = 0; i < DMA_ENGINE_CHANNELS; i++) {
+        TEST_ASSERT(dma_cancel(tickets[i]));
+    }
+    TEST_ASSERT(dma_poll() == 0);
+
+    // Timed out copies and fills are done on the CPU
+    memset(dma_dst, 0, sizeof(dma_dst));
+    dma_memcpy(dma_dst, dma_src, 1024);
+    TEST_ASSERT(memcmp(dma_dst, dma_src, 1024) == 0);
+    dma_memset(dma_dst, 0x5A, 512);
+    TEST_ASSERT(dma_dst[0] == 0x5A && dma_dst[511] == 0x5A && dma_dst[512] == dma_src[512]);
+    TEST_ASSERT(dma_poll() == 0);
+
+    dma_get_stats(&stats);
+    TEST_ASSERT(stats.cancelled == 1 + DMA_ENGINE_CHANNELS + 1 + 2);
+    sim_set_dma_stall(0);
+}
+
+static uint8_t HAL_BULK_BUFFER mem_src[4096];
+static uint8_t HAL_BULK_BUFFER mem_dst[4096];
+
+static struct {
+    uint32_t calls;
+    uint32_t ticket;
+} mem_seen;
+
+static void mem_record(uint32_t ticket, int ok, void* user) {
+    (void)user;
+    mem_seen.calls++;
+    mem_seen.ticket = ok ? ticket : MEM_NEVER;
+}
+
+static int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+// Copy, set and compare every small size and misalignment against libc
+static int mem_paths_match(void) {
+    uint8_t expect[128];
+    for (uint32_t size = 0; size <= 80; size++) {
+        for (uint32_t d = 0; d < 4; d++) {
+            for (uint32_t s = 0; s < 4; s++) {
+                memset(mem_dst, 0xEE, 128);
+                memset(expect, 0xEE, 128);
+                mem_copy(&mem_dst[d], &mem_src[s], size);
+                memcpy(&expect[d], &mem_src[s], size);
+                if (memcmp(mem_dst, expect, 128) != 0) return 0;
+
+                // First difference in every position, both signs
+                if (size && sign(mem_compare(&mem_dst[d], &mem_src[s], size)) != 0) return 0;
+                if (size) {
+                    uint32_t at = (size * 7 + s) % size;
+                    mem_dst[d + at] ^= (uint8_t)(1u << (d + s));
+                    if (sign(mem_compare(&mem_dst[d], &mem_src[s], size)) !=
+                        sign(memcmp(&mem_dst[d], &mem_src[s], size))) return 0;
+                    if (sign(mem_compare(&mem_src[s], &mem_dst[d], size)) !=
+                        sign(memcmp(&mem_src[s], &mem_dst[d], size))) return 0;
+                }
+            }
+            memset(mem_dst, 0xEE, 128);
+            memset(expect, 0xEE, 128);
+            mem_set(&mem_dst[d], (uint8_t)size, size);
+            memset(&expect[d], (uint8_t)size, size);
+            if (memcmp(mem_dst, expect, 128) != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// Test path selection and that every path gives the same bytes
+static void test_mem_paths(void) {
+    mem_thresholds_t saved;
+    mem_thresholds_t cpu = { MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER, MEM_NEVER };
+    mem_thresholds_t neon = { 16, MEM_NEVER, MEM_NEVER, 16, MEM_NEVER, 16 };
+    mem_thresholds_t dma = { 16, 64, 64, 16, 64, 16 };
+    dma_stats_t before, after;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+    mem_get_thresholds(&saved);
+    for (uint32_t i = 0; i < sizeof(mem_src); i++) {
+        mem_src[i] = (uint8_t)(i * 29 + 3);
+    }
+
+    // Words only when the pointers share an offset
+    mem_set_thresholds(&cpu);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_src, 100) == MEM_PATH_WORDS);
+    TEST_ASSERT(mem_copy_path(mem_dst + 4, mem_src + 8, 100) == MEM_PATH_WORDS);
+    TEST_ASSERT(mem_copy_path(mem_dst + 1, mem_src, 100) == MEM_PATH_BYTES);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_src, 3) == MEM_PATH_BYTES);
+    TEST_ASSERT(mem_set_path(mem_dst + 3, 4096) == MEM_PATH_WORDS);
+    TEST_ASSERT(mem_paths_match());
+
+    mem_set_thresholds(&neon);
+    TEST_ASSERT(mem_copy_path(mem_dst + 1, mem_src, 100) == MEM_PATH_NEON);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_src, 15) == MEM_PATH_WORDS);
+    TEST_ASSERT(mem_paths_match());
+
+    // Short NEON copies are all tail
+    memset(mem_dst, 0, 16);
+    neon_copy_block(mem_dst, mem_src, 7);
+    TEST_ASSERT(memcmp(mem_dst, mem_src, 7) == 0 && mem_dst[7] == 0);
+
+    // DMA only for whole lines that do not overlap the source
+    mem_set_thresholds(&dma);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_src, 4096) == MEM_PATH_DMA);
+    TEST_ASSERT(mem_copy_path(mem_dst + 4, mem_src, 1024) == MEM_PATH_NEON);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_src, 1000) == MEM_PATH_NEON);
+    TEST_ASSERT(mem_copy_path(mem_dst, mem_dst + 64, 1024) == MEM_PATH_NEON);
+    TEST_ASSERT(mem_set_path(mem_dst, 64) == MEM_PATH_DMA);
+    TEST_ASSERT(mem_paths_match());
+
+    dma_get_stats(&before);
+    memset(mem_dst, 0, sizeof(mem_dst));
+    mem_copy(mem_dst, mem_src, sizeof(mem_dst));
+    TEST_ASSERT(memcmp(mem_dst, mem_src, sizeof(mem_dst)) == 0);
+    mem_set(mem_dst, 0xA5, 2048);
+    TEST_ASSERT(mem_dst[0] == 0xA5 && mem_dst[2047] == 0xA5 && mem_dst[2048] == mem_src[2048]);
+    dma_get_stats(&after);
+    TEST_ASSERT(after.completed == before.completed + 2);
+
+    // Overlapping moves towards lower addresses stay on the CPU
+    memcpy(mem_dst, mem_src, sizeof(mem_dst));
+    mem_copy(mem_dst, mem_dst + 64, 2048);
+    TEST_ASSERT(memcmp(mem_dst, mem_src + 64, 2048) == 0);
+
+    // Async: a ticket for large copies, done on the spot for small ones
+    memset(&mem_seen, 0, sizeof(mem_seen));
+    memset(mem_dst, 0, sizeof(mem_dst));
+    uint32_t ticket = mem_copy_async(mem_dst, mem_src, 2048, mem_record, 0);
+    TEST_ASSERT(ticket != 0 && mem_seen.calls == 0);
+    TEST_ASSERT(dma_wait(ticket) && mem_seen.calls == 1 && mem_seen.ticket == ticket);
+    TEST_ASSERT(mem_copy_async(&mem_dst[2048], &mem_src[2048], 40, mem_record, 0) == 0);
+    TEST_ASSERT(mem_seen.calls == 2 && mem_seen.ticket == 0);
+    TEST_ASSERT(memcmp(mem_dst, mem_src, 2088) == 0);
+
+    // Without the engine DMA sizes fall back to the CPU
+    sim_reset();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+    for (uint32_t i = 0; i < DMA_MAX_REQUESTS; i++) {
+        TEST_ASSERT(dma_fill(&mem_dst[i * 64], 0, 64, 0, 0) != 0);
+    }
+    mem_copy(mem_dst, mem_src, sizeof(mem_dst));
+    while (dma_poll()) {
+        sim_advance_us(10);
+    }
+    TEST_ASSERT(memcmp(mem_dst + DMA_MAX_REQUESTS * 64, mem_src + DMA_MAX_REQUESTS * 64,
+                       sizeof(mem_dst) - DMA_MAX_REQUESTS * 64) == 0);
+
+    mem_set_thresholds(&saved);
+}
+
+// 2 MB blit against input forwarding
+#define BLIT_WIDTH  1024
+#define BLIT_HEIGHT 512
+static uint8_t HAL_BULK_BUFFER blit_src[BLIT_WIDTH * BLIT_HEIGHT * 4];
+static uint8_t HAL_BULK_BUFFER blit_dst[BLIT_WIDTH * BLIT_HEIGHT * 4];
+
+// Test that a large transfer runs while input keeps being forwarded
+static void test_dma_overlap(void) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+    performance_stats_t perf;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    for (uint32_t i = 0; i < sizeof(blit_src); i += 64) {
+        blit_src[i] = (uint8_t)(i >> 6);
+    }
+
+    // The old way: the caller waits out the whole copy (before the link
+    // is up, so no reports pile up meanwhile)
+    uint64_t start = sim_time_us();
+    dma_memcpy(blit_dst, blit_src, sizeof(blit_src));
+    uint64_t blocked_us = sim_time_us() - start;
+    TEST_ASSERT(memcmp(blit_dst, blit_src, sizeof(blit_src)) == 0);
+
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_FAST);
+
+    // Submitted, then frames are forwarded while it runs
+    memset(blit_dst, 0, sizeof(blit_dst));
+    start = sim_time_us();
+    uint32_t ticket = gpu_process_frame(blit_dst, blit_src, BLIT_WIDTH, BLIT_HEIGHT);
+    uint64_t submit_us = sim_time_us() - start;
+    TEST_ASSERT(ticket != 0);
+
+    uint32_t frames = 0;
+    uint32_t forwarded = 0;
+    while (!dma_done(ticket) && frames < 100) {
+        sim_advance_us(1000);
+        if (optimize_process_input(&state)) {
+            forwarded++;
+            optimize_process_output(&output);
+        }
+        dma_poll();
+        frames++;
+    }
+    TEST_ASSERT(dma_done(ticket));
+    TEST_ASSERT(memcmp(blit_dst, blit_src, sizeof(blit_src)) == 0);
+
+    printf("  dma: %u KB blit, caller blocked %llu us synchronously, %llu us async "
+           "with %u of %u frames forwarded meanwhile\n",
+           (unsigned)(sizeof(blit_src) / 1024), (unsigned long long)blocked_us,
+           (unsigned long long)submit_us, forwarded, frames);
+    TEST_ASSERT(blocked_us > 1000);
+    TEST_ASSERT(submit_us * 100 < blocked_us);
+    TEST_ASSERT(frames >= blocked_us / 1000 && forwarded + 1 >= frames);
+
+    // Input latency is not disturbed by the transfer
+    optimize_retire_window();
+    optimize_get_stats(&perf);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].p99_us < 100);
+}
+
+static void print_threshold(const char* name, uint32_t threshold) {
+    if (threshold == MEM_NEVER) {
+        printf("  mem: %-12s never\n", name);
+    } else {
+        printf("  mem: %-12s from %u bytes\n", name, threshold);
+    }
+}
+
+// Test the boot calibration and report the crossovers it found
+static void test_mem_calibrate(void) {
+    mem_thresholds_t saved;
+    mem_thresholds_t found;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(dma_init(DMA_COMPLETE_POLL));
+    mem_get_thresholds(&saved);
+
+    uint32_t start = hal_cycles();
+    mem_calibrate();
+    uint32_t elapsed_us = (hal_cycles() - start) / 1000;
+    mem_get_thresholds(&found);
+
+    printf("  mem: calibrated in %u us (configured neon %u, dma %u)\n",
+           elapsed_us, PERF_TEST_NEON_THRESHOLD, PERF_TEST_DMA_THRESHOLD);
+    print_threshold("copy neon", found.copy_neon);
+    print_threshold("copy dma", found.copy_dma);
+    print_threshold("copy async", found.copy_async);
+    print_threshold("set neon", found.set_neon);
+    print_threshold("set dma", found.set_dma);
+    print_threshold("compare neon", found.compare_neon);
+
+    // Every threshold is a measured size or never
+    const uint32_t* values = &found.copy_neon;
+    for (uint32_t i = 0; i < sizeof(found) / sizeof(uint32_t); i++) {
+        TEST_ASSERT(values[i] == MEM_NEVER ||
+                    (values[i] >= MEM_CALIBRATE_MIN && values[i] <= MEM_CALIBRATE_MAX &&
+                     (values[i] & (values[i] - 1)) == 0));
+    }
+
+    // The engine is left idle and the chosen paths copy correctly
+    TEST_ASSERT(dma_poll() == 0);
+    TEST_ASSERT(mem_paths_match());
+    memset(mem_dst, 0, sizeof(mem_dst));
+    mem_copy(mem_dst, mem_src, sizeof(mem_dst));
+    TEST_ASSERT(memcmp(mem_dst, mem_src, sizeof(mem_dst)) == 0);
+
+    mem_set_thresholds(&saved);
+}
+
+// Test status LED GPIO
+static void test_sim_status_led(void) {
+    sim_reset();
+    TEST_ASSERT(status_init());
+    status_update(LED_STATE_READY);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 1);
+}
+
+// Test LED patterns advance from the timer without blocking
+static void test_sim_status_pattern(void) {
+    sim_reset();
+    status_init();
+
+    // Double blink: on, off, on, then a long gap
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 1);
+
+    // A call costs one timer read, not a blink period
+    uint64_t before = sim_time_us();
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_time_us() - before <= 1);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 1);
+
+    sim_advance_us(LED_BLINK_ON);
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 0);
+
+    sim_advance_us(LED_BLINK_OFF);
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 1);
+
+    sim_advance_us(LED_BLINK_ON);
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 0);
+
+    sim_advance_us(LED_BLINK_OFF);
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 0);
+
+    sim_advance_us(LED_PATTERN_GAP);
+    status_update(LED_STATE_HDMI_WAIT);
+    TEST_ASSERT(sim_gpio_get(TEST_LED_PIN) == 1);
+
+    // Repeated calls within a phase do not touch the GPIO
+    sim_stats_t stats;
+    sim_get_stats(&stats);
+    uint32_t edges = stats.led_toggles;
+    for (int i = 0; i < 1000; i++) {
+        status_update(LED_STATE_HDMI_WAIT);
+    }
+    sim_get_stats(&stats);
+    TEST_ASSERT(stats.led_toggles == edges);
+}
+
+// Test thermal, load and voltage registers
+static void test_sim_thermal(void) {
+    performance_stats_t stats;
+
+    sim_reset();
+    sim_set_temperature(72);
+    sim_set_voltage_mv(900);
+    sim_set_cpu_load(50);
+    optimize_get_stats(&stats);
+
+    TEST_ASSERT(stats.temperature == 72);
+    TEST_ASSERT(stats.voltage_mv >= 899 && stats.voltage_mv <= 900);
+    TEST_ASSERT(stats.cpu_usage > 49.0f && stats.cpu_usage < 51.0f);
+}
+
+// Test input pipeline end to end at the simulated 1 kHz report rate
+static void test_sim_pipeline(void) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+    uint32_t forwarded = 0;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_FAST);
+    TEST_ASSERT(sim_cpu_freq() == 1400000000);
+
+    for (uint32_t frame = 0; frame < 100; frame++) {
+        sim_advance_us(1000);
+        if (optimize_process_input(&state)) {
+            forwarded++;
+            optimize_process_output(&output);
+        }
+    }
+
+    // Every captured report is either forwarded or superseded by a newer one
+    sim_stats_t stats;
+    performance_stats_t perf;
+    sim_get_stats(&stats);
+    optimize_retire_window();
+    optimize_get_stats(&perf);
+    TEST_ASSERT(forwarded > 90);
+    TEST_ASSERT(stats.reports_delivered == forwarded + perf.frames_dropped);
+    TEST_ASSERT(perf.frames_dropped < 5);
+
+    // Forwarded as soon as captured, not on a poll boundary
+    const latency_percentiles_t* e2e = &perf.stage_latency[LATENCY_STAGE_END_TO_END];
+    TEST_ASSERT(perf.input_latency_us < 100);
+    TEST_ASSERT(e2e->samples == forwarded);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_USB_READ].samples == forwarded);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_VALIDATE].samples == forwarded);
+    TEST_ASSERT(e2e->p50_us <= e2e->p99_us && e2e->p99_us <= e2e->p999_us);
+    TEST_ASSERT(e2e->p99_us < 100);
+    test_record_latency(e2e->p50_us, e2e->p99_us, e2e->p999_us);
+}
+
+// Test that scripts edit the report being forwarded, not the last one
+static void test_sim_pipeline_scripts(void) {
+    uint32_t code[VM_MAX_CODE];
+    uint32_t length = 0;
+    char error[64];
+    ps5_state_t state = {0};
+
+    sim_reset();
+    sim_controller_set_report_interval(0);
+    start_input_stream();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(script_init());
+    TEST_ASSERT(vm_compile("state.r2 = 200", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    TEST_ASSERT(script_load_bytecode("pipeline-r2", code, length, 5));
+
+    // Nothing captured yet: nothing forwarded, the scripts do not run
+    TEST_ASSERT(!optimize_process_input(&state));
+
+    ps5_state_t sent = {0};
+    sent.triggers.l2 = 40;
+    sim_controller_set_state(&sent);
+    sim_advance_us(1000);
+    TEST_ASSERT(optimize_process_input(&state));
+    TEST_ASSERT(state.triggers.l2 == 40 && state.triggers.r2 == 200);
+
+    // The next report arrives with the edit on top of it
+    sent.triggers.l2 = 90;
+    sim_controller_set_state(&sent);
+    sim_advance_us(1000);
+    TEST_ASSERT(optimize_process_input(&state));
+    TEST_ASSERT(state.triggers.l2 == 90 && state.triggers.r2 == 200);
+
+    // Unloaded, the controller's value goes through untouched
+    TEST_ASSERT(script_unload("pipeline-r2"));
+    sim_controller_set_state(&sent);
+    sim_advance_us(1000);
+    TEST_ASSERT(optimize_process_input(&state));
+    TEST_ASSERT(state.triggers.l2 == 90 && state.triggers.r2 == 0);
+    irq_cpu_disable();
+}
+
+// Profile dump captured for inspection
+static char profile_text[1024];
+static uint32_t profile_text_length;
+
+static void capture_profile(const char* text, uint32_t length) {
+    if (profile_text_length + length < sizeof(profile_text)) {
+        memcpy(&profile_text[profile_text_length], text, length);
+        profile_text_length += length;
+        profile_text[profile_text_length] = '\0';
+    }
+}
+
+// Test profiling zones around the pipeline stages
+static void test_profile_zones(void) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+    uint32_t forwarded = 0;
+    uint32_t core = smp_core_id();
+    profile_zone_stats_t zones[PROFILE_ZONE_COUNT];
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    profile_init();
+    profile_reset();
+
+    // Framed the way the input core frames them
+    for (uint32_t frame = 0; frame < 100; frame++) {
+        sim_advance_us(1000);
+        PROFILE_BEGIN(PROFILE_ZONE_FRAME);
+        if (optimize_process_input(&state)) {
+            forwarded++;
+            optimize_process_output(&output);
+        }
+        PROFILE_END(PROFILE_ZONE_FRAME);
+    }
+    for (uint32_t z = 0; z < PROFILE_ZONE_COUNT; z++) {
+        TEST_ASSERT(profile_get(core, (profile_zone_t)z, &zones[z]));
+        TEST_ASSERT(zones[z].self_cycles <= zones[z].cycles);
+        TEST_ASSERT(zones[z].hist.count == zones[z].count);
+    }
+    TEST_ASSERT(profile_unbalanced() == 0);
+
+    // Every stage ran once per frame, the write once per forwarded report
+    TEST_ASSERT(zones[PROFILE_ZONE_FRAME].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_VALIDATE].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_SCRIPTS].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_MACROS].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_SCRIPT_VM].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_COMBOS].count == 0);
+    TEST_ASSERT(zones[PROFILE_ZONE_USB_READ].count == 100);
+    TEST_ASSERT(zones[PROFILE_ZONE_USB_WRITE].count == forwarded);
+    TEST_ASSERT(forwarded > 90);
+
+    // Nested zones are carved out of their parent's self time
+    uint64_t stages = zones[PROFILE_ZONE_VALIDATE].cycles + zones[PROFILE_ZONE_SCRIPTS].cycles +
+                      zones[PROFILE_ZONE_USB_READ].cycles + zones[PROFILE_ZONE_USB_WRITE].cycles;
+    TEST_ASSERT(zones[PROFILE_ZONE_FRAME].cycles >= stages);
+    TEST_ASSERT(zones[PROFILE_ZONE_FRAME].self_cycles == zones[PROFILE_ZONE_FRAME].cycles - stages);
+    TEST_ASSERT(zones[PROFILE_ZONE_SCRIPTS].self_cycles ==
+                zones[PROFILE_ZONE_SCRIPTS].cycles - zones[PROFILE_ZONE_MACROS].cycles -
+                zones[PROFILE_ZONE_SCRIPT_VM].cycles);
+
+    // One dump line per zone that ran, below the header
+    performance_stats_t perf;
+    optimize_get_stats(&perf);
+    profile_text_length = 0;
+    profile_dump(capture_profile);
+    uint32_t lines = 0;
+    for (uint32_t i = 0; i < profile_text_length; i++) {
+        lines += profile_text[i] == '\n';
+    }
+    TEST_ASSERT(lines == 1 + PROFILE_ZONE_COUNT - 1);
+    TEST_ASSERT(strstr(profile_text, " usb_write ") != NULL);
+    TEST_ASSERT(strstr(profile_text, " combos ") == NULL);
+
+    // Mismatched and overly deep zones are dropped, not misattributed
+    profile_reset();
+    profile_end(PROFILE_ZONE_STATS);
+    TEST_ASSERT(profile_unbalanced() == 1);
+    for (uint32_t i = 0; i < PROFILE_MAX_DEPTH + 2; i++) {
+        profile_begin(PROFILE_ZONE_VALIDATE);
+    }
+    for (uint32_t i = 0; i < PROFILE_MAX_DEPTH + 2; i++) {
+        profile_end(PROFILE_ZONE_VALIDATE);
+    }
+    TEST_ASSERT(profile_get(core, PROFILE_ZONE_VALIDATE, &zones[0]));
+    TEST_ASSERT(zones[0].count == PROFILE_MAX_DEPTH);
+    TEST_ASSERT(profile_unbalanced() == 1);
+    TEST_ASSERT(!profile_get(SMP_MAX_CORES, PROFILE_ZONE_VALIDATE, &zones[0]));
+}
+
+// Run frames through the pipeline, stalling before the output every
+// slow_every frames (0 = never) except on the last frame when last_slow
+static void run_governor_window(uint32_t frames, uint32_t slow_every, int last_slow) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        sim_advance_us(1000);
+        if (optimize_process_input(&state)) {
+            if ((slow_every && frame % slow_every == 0) || (last_slow && frame == frames - 1)) {
+                sim_advance_us(5000);
+            }
+            optimize_process_output(&output);
+        }
+    }
+}
+
+// Test the governor acts on the latency tail, not the last sample
+static void test_sim_governor(void) {
+    performance_stats_t perf;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_FAST);
+
+    // One stall at the very end: p99 is still fast, so the clock may drop
+    run_governor_window(500, 0, 1);
+    optimize_retire_window();
+    optimize_get_stats(&perf);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].max_us >= 5000);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].p99_us < 100);
+    uint32_t freq = sim_cpu_freq();
+    optimize_tune_performance();
+    TEST_ASSERT(sim_cpu_freq() < freq);
+
+    // The tuner reads the retired window while the next one records
+    run_governor_window(10, 0, 0);
+    optimize_get_stats(&perf);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].max_us >= 5000);
+    optimize_retire_window();
+    optimize_get_stats(&perf);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].samples <= 10);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].max_us < 5000);
+
+    // Stalls on 5% of frames put p99 over target: clock goes up
+    run_governor_window(500, 20, 0);
+    optimize_retire_window();
+    optimize_get_stats(&perf);
+    TEST_ASSERT(perf.stage_latency[LATENCY_STAGE_END_TO_END].p99_us > 2000);
+    freq = sim_cpu_freq();
+    optimize_tune_performance();
+    TEST_ASSERT(sim_cpu_freq() > freq);
+}
+
+// Test that the frame path takes its timestamps from the generic timer
+static void test_clock_frame_cost(void) {
+    ps5_state_t state = {0};
+    ps5_output_t output = {0};
+    sim_stats_t before, after;
+    const uint32_t frames = 200;
+    uint32_t forwarded = 0;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(clock_init());
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_FAST);
+
+    sim_get_stats(&before);
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        sim_advance_us(1000);
+        clock_frame_begin();
+        if (optimize_process_input(&state)) {
+            forwarded++;
+            optimize_process_output(&output);
+        }
+        ps5_flush_output();
+        clock_frame_end();
+    }
+    sim_get_stats(&after);
+    irq_cpu_disable();
+
+    uint64_t counter_reads = after.counter_reads - before.counter_reads;
+    uint64_t timer_reads = after.timer_reads - before.timer_reads;
+    uint64_t mmio = after.mmio_accesses - before.mmio_accesses;
+    printf("  clock: %llu.%02llu counter reads per frame, %llu system timer reads, "
+           "%llu MMIO accesses per frame (%u of %u frames forwarded)\n",
+           (unsigned long long)(counter_reads / frames),
+           (unsigned long long)(counter_reads * 100 / frames % 100),
+           (unsigned long long)timer_reads, (unsigned long long)(mmio / frames),
+           forwarded, frames);
+    TEST_ASSERT(forwarded > frames * 9 / 10);
+    TEST_ASSERT(timer_reads == 0);
+    TEST_ASSERT(counter_reads <= frames * 12);
+}
+
+// Register all simulator tests
+void register_sim_tests(void) {
+    TEST_ADD_TYPE(test_sim_timer, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_clock, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_usb_detect, TEST_USB, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_input_report, TEST_USB, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_input_ring, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_report_ring, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_latency_hist, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_output_report, TEST_USB, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_output_coalescing, TEST_USB, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_dma, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_bus_addr, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_dma_engine, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_dma_cancel, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_mem_paths, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_status_led, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_status_pattern, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_thermal, TEST_THERMAL, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_pipeline, TEST_LATENCY, TEST_TYPE_INTEGRATION);
+    TEST_ADD_TYPE(test_sim_pipeline_scripts, TEST_LATENCY, TEST_TYPE_INTEGRATION);
+    TEST_ADD_TYPE(test_profile_zones, TEST_LATENCY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_sim_governor, TEST_LATENCY, TEST_TYPE_INTEGRATION);
+    TEST_ADD_TYPE(test_dma_overlap, TEST_LATENCY, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_mem_calibrate, TEST_LATENCY, TEST_TYPE_PERFORMANCE);
+    TEST_ADD_TYPE(test_clock_frame_cost, TEST_LATENCY, TEST_TYPE_PERFORMANCE);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_SIM_H
+#define TEST_SIM_H
+
+// Function to register simulator and HAL tests
+void register_sim_tests(void);
+
+#endif // TEST_SIM_H
@@ -0,0 +1,152 @@
+#include <pthread.h>
+#include "test_framework.h"
+#include "test_smp.h"
+#include "sim.h"
+#include "../src/smp.h"
+#include "../src/cores.h"
+#include "../src/irq.h"
+#include "../src/usb.h"
+#include "../src/ps5.h"
+#include "../src/optimize.h"
+
+#define THREAD_MESSAGES 200000
+
+// Test mailbox ordering, wraparound and the full condition
+static void test_mailbox_order(void) {
+    static mailbox_t mailbox;
+    mailbox_msg_t msg = {0};
+
+    mailbox_reset(&mailbox);
+    TEST_ASSERT(!mailbox_fetch(&mailbox, &msg));
+
+    for (uint32_t round = 0; round < 3; round++) {
+        for (uint32_t i = 0; i < MAILBOX_SIZE; i++) {
+            msg.type = 1;
+            msg.arg0 = round * MAILBOX_SIZE + i;
+            TEST_ASSERT(mailbox_post(&mailbox, &msg));
+        }
+        TEST_ASSERT(!mailbox_post(&mailbox, &msg));
+
+        int ordered = 1;
+        for (uint32_t i = 0; i < MAILBOX_SIZE; i++) {
+            if (!mailbox_fetch(&mailbox, &msg) || msg.arg0 != round * MAILBOX_SIZE + i) {
+                ordered = 0;
+            }
+        }
+        TEST_ASSERT(ordered);
+    }
+    TEST_ASSERT(mailbox.dropped == 3);
+}
+
+// Producer thread for the concurrency test
+static void* mailbox_producer(void* arg) {
+    mailbox_t* mailbox = (mailbox_t*)arg;
+    mailbox_msg_t msg = {0};
+
+    for (uint32_t i = 0; i < THREAD_MESSAGES; ) {
+        msg.arg0 = i;
+        msg.arg1 = ~i;
+        if (mailbox_post(mailbox, &msg)) {
+            i++;
+        }
+    }
+    return NULL;
+}
+
+// Test the mailbox across two real threads
+static void test_mailbox_threads(void) {
+    static mailbox_t mailbox;
+    pthread_t producer;
+    mailbox_msg_t msg;
+    uint32_t expected = 0;
+    int intact = 1;
+
+    mailbox_reset(&mailbox);
+    TEST_ASSERT(pthread_create(&producer, NULL, mailbox_producer, &mailbox) == 0);
+
+    while (expected < THREAD_MESSAGES) {
+        if (mailbox_fetch(&mailbox, &msg)) {
+            if (msg.arg0 != expected || msg.arg1 != ~expected) {
+                intact = 0;
+            }
+            expected++;
+        }
+    }
+    pthread_join(producer, NULL);
+
+    TEST_ASSERT(intact);
+    TEST_ASSERT(mailbox_pending(&mailbox) == 0);
+}
+
+// Test core bring-up and per-core mailboxes
+static void test_smp_start(void) {
+    smp_init();
+    TEST_ASSERT(smp_core_id() == 0);
+    TEST_ASSERT(smp_core_running(0));
+    TEST_ASSERT(!smp_core_running(1));
+    TEST_ASSERT(!smp_start_core(0, NULL, NULL));
+
+    TEST_ASSERT(cores_start());
+    TEST_ASSERT(smp_core_running(SMP_CORE_INPUT));
+    TEST_ASSERT(smp_core_running(SMP_CORE_SCRIPTS));
+    TEST_ASSERT(smp_core_running(SMP_CORE_GUI));
+
+    // Mailboxes are per sender: core 0 -> 2 is not core 3 -> 2
+    mailbox_msg_t msg = { 7, 1, 2, NULL };
+    TEST_ASSERT(smp_send(SMP_CORE_SCRIPTS, &msg));
+    TEST_ASSERT(!smp_receive(SMP_CORE_GUI, &msg));
+}
+
+// Test input forwarding on its core with the GUI and tuning alongside
+static void test_smp_roles(void) {
+    core_telemetry_t telemetry;
+
+    sim_reset();
+    irq_init();
+    TEST_ASSERT(optimize_init());
+    TEST_ASSERT(usb_init());
+    TEST_ASSERT(ps5_init());
+    irq_cpu_enable();
+    optimize_set_mode(PROCESS_MODE_FAST);
+
+    smp_init();
+    TEST_ASSERT(cores_start());
+
+    // Link down: nothing is forwarded
+    for (uint32_t frame = 0; frame < 10; frame++) {
+        sim_advance_us(1000);
+        smp_service();
+    }
+    cores_get_telemetry(&telemetry);
+    TEST_ASSERT(telemetry.frames == 0);
+
+    cores_set_link(1);
+    for (uint32_t frame = 0; frame < 1100; frame++) {
+        sim_advance_us(1000);
+        smp_service();
+    }
+    cores_get_telemetry(&telemetry);
+    TEST_ASSERT(telemetry.frames > 1000);
+    TEST_ASSERT(telemetry.max_latency_us < 100);
+    TEST_ASSERT(telemetry.renders >= 30);
+    TEST_ASSERT(telemetry.tune_passes >= 1);
+    TEST_ASSERT(smp_dropped(SMP_CORE_INPUT, SMP_CORE_GUI) == 0);
+
+    // Link down waits for the frame in flight, then forwarding stops
+    cores_set_link(0);
+    uint32_t frames = telemetry.frames;
+    for (uint32_t frame = 0; frame < 10; frame++) {
+        sim_advance_us(1000);
+        smp_service();
+    }
+    cores_get_telemetry(&telemetry);
+    TEST_ASSERT(telemetry.frames == frames);
+}
+
+// Register all multi-core tests
+void register_smp_tests(void) {
+    TEST_ADD_TYPE(test_mailbox_order, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_mailbox_threads, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_smp_start, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_smp_roles, TEST_LATENCY, TEST_TYPE_INTEGRATION);
+}
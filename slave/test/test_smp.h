@@ -0,0 +1,7 @@
+#ifndef TEST_SMP_H
+#define TEST_SMP_H
+
+// Function to register multi-core and mailbox tests
+void register_smp_tests(void);
+
+#endif // TEST_SMP_H
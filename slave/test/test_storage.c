@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "test_framework.h"
+#include "test_storage.h"
+#include "sim.h"
+#include "../src/emmc.h"
+#include "../src/fat32.h"
+#include "../src/package.h"
+#include "../src/script.h"
+#include "../src/script_lib.h"
+#include "../src/vm.h"
+#include "../tools/vm_compile.h"
+
+// Test card: MBR, one FAT32 partition of 4 KB clusters
+#define IMAGE_PARTITION     64
+#define IMAGE_RESERVED      32
+#define IMAGE_CLUSTERS      4096
+#define IMAGE_SPC           8
+#define IMAGE_FAT_SECTORS   ((IMAGE_CLUSTERS + 2) * 4 / 512 + 1)
+#define IMAGE_SECTORS       (IMAGE_PARTITION + IMAGE_RESERVED + 2 * IMAGE_FAT_SECTORS + \
+                             IMAGE_CLUSTERS * IMAGE_SPC)
+#define CLUSTER_BYTES       (IMAGE_SPC * 512)
+#define DIR_CLUSTERS        16
+#define BENCH_PACKAGES      500
+
+// Image under construction
+typedef struct {
+    uint8_t* data;
+    uint32_t next_cluster;
+} image_t;
+
+// Directory being filled
+typedef struct {
+    uint32_t cluster;
+    uint32_t used;          // Bytes of entries written
+    uint32_t files;
+} image_dir_t;
+
+static image_t image;
+static char image_path[64];
+
+static void put16(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+
+static uint8_t* sector_at(uint32_t lba) {
+    return image.data + (size_t)lba * 512;
+}
+
+static uint8_t* cluster_at(uint32_t cluster) {
+    return sector_at(IMAGE_PARTITION + IMAGE_RESERVED + 2 * IMAGE_FAT_SECTORS + (cluster - 2) * IMAGE_SPC);
+}
+
+static void fat_set(uint32_t cluster, uint32_t value) {
+    for (uint32_t copy = 0; copy < 2; copy++) {
+        put32(sector_at(IMAGE_PARTITION + IMAGE_RESERVED + copy * IMAGE_FAT_SECTORS) + cluster * 4, value);
+    }
+}
+
+// Allocate a chain, optionally leaving a free cluster after each one
+static uint32_t chain_alloc(uint32_t count, int fragmented) {
+    uint32_t first = image.next_cluster;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t cluster = image.next_cluster;
+        image.next_cluster += fragmented ? 2 : 1;
+        fat_set(cluster, i + 1 < count ? image.next_cluster : 0x0FFFFFFF);
+    }
+    return first;
+}
+
+static void chain_write(uint32_t first, const void* data, uint32_t size) {
+    uint32_t cluster = first;
+    for (uint32_t offset = 0; offset < size; offset += CLUSTER_BYTES) {
+        uint32_t length = size - offset < CLUSTER_BYTES ? size - offset : CLUSTER_BYTES;
+        memcpy(cluster_at(cluster), (const uint8_t*)data + offset, length);
+        uint8_t* fat = sector_at(IMAGE_PARTITION + IMAGE_RESERVED) + cluster * 4;
+        cluster = (uint32_t)fat[0] | ((uint32_t)fat[1] << 8) | ((uint32_t)fat[2] << 16) | ((uint32_t)fat[3] << 24);
+    }
+}
+
+static uint8_t* dir_slot(image_dir_t* dir) {
+    uint8_t* slot = cluster_at(dir->cluster) + dir->used;
+    dir->used += 32;
+    return slot;
+}
+
+// Add an entry with a long name ahead of its 8.3 alias
+static void dir_add(image_dir_t* dir, const char* long_name, const char* alias,
+                    uint8_t attr, uint32_t cluster, uint32_t size) {
+    uint8_t short_name[11];
+    memcpy(short_name, alias, 11);
+
+    if (long_name) {
+        uint8_t checksum = 0;
+        for (uint32_t i = 0; i < 11; i++) {
+            checksum = (uint8_t)(((checksum & 1) << 7) + (checksum >> 1) + short_name[i]);
+        }
+        static const uint8_t offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+        uint32_t length = (uint32_t)strlen(long_name);
+        uint32_t pieces = (length + 12) / 13;
+        for (uint32_t piece = pieces; piece >= 1; piece--) {
+            uint8_t* slot = dir_slot(dir);
+            memset(slot, 0, 32);
+            slot[0] = (uint8_t)(piece | (piece == pieces ? 0x40 : 0));
+            slot[11] = FAT32_ATTR_LONG_NAME;
+            slot[13] = checksum;
+            for (uint32_t i = 0; i < 13; i++) {
+                uint32_t at = (piece - 1) * 13 + i;
+                put16(slot + offsets[i], at < length ? (uint8_t)long_name[at] : at == length ? 0 : 0xFFFF);
+            }
+        }
+    }
+
+    uint8_t* slot = dir_slot(dir);
+    memset(slot, 0, 32);
+    memcpy(slot, short_name, 11);
+    slot[11] = attr;
+    put16(slot + 20, cluster >> 16);
+    put16(slot + 26, cluster & 0xFFFF);
+    put32(slot + 28, size);
+}
+
+static image_dir_t dir_create(image_dir_t* parent, const char* alias) {
+    image_dir_t dir = { chain_alloc(DIR_CLUSTERS, 0), 0, 0 };
+    memset(cluster_at(dir.cluster), 0, DIR_CLUSTERS * CLUSTER_BYTES);
+    dir_add(parent, NULL, alias, FAT32_ATTR_DIRECTORY, dir.cluster, 0);
+    dir_add(&dir, NULL, ".          ", FAT32_ATTR_DIRECTORY, dir.cluster, 0);
+    dir_add(&dir, NULL, "..         ", FAT32_ATTR_DIRECTORY, 0, 0);
+    return dir;
+}
+
+// Store a file under a long name with a generated 8.3 alias
+static void file_add(image_dir_t* dir, const char* name, const void* data, uint32_t size, int fragmented) {
+    char alias[12];
+    uint32_t cluster = 0;
+    if (size) {
+        cluster = chain_alloc((size + CLUSTER_BYTES - 1) / CLUSTER_BYTES, fragmented);
+        chain_write(cluster, data, size);
+    }
+    snprintf(alias, sizeof(alias), "F%07uDAT", dir->files++);
+    dir_add(dir, name, alias, FAT32_ATTR_ARCHIVE, cluster, size);
+}
+
+// Format an empty volume with a /scripts directory
+static image_dir_t image_format(image_dir_t* root) {
+    image.data = calloc(IMAGE_SECTORS, 512);
+    image.next_cluster = 2;
+
+    // MBR with one FAT32 (LBA) partition
+    uint8_t* mbr = sector_at(0);
+    mbr[446 + 4] = 0x0C;
+    put32(mbr + 446 + 8, IMAGE_PARTITION);
+    put32(mbr + 446 + 12, IMAGE_SECTORS - IMAGE_PARTITION);
+    put16(mbr + 510, 0xAA55);
+
+    uint8_t* bpb = sector_at(IMAGE_PARTITION);
+    bpb[0] = 0xEB;
+    put16(bpb + 11, 512);
+    bpb[13] = IMAGE_SPC;
+    put16(bpb + 14, IMAGE_RESERVED);
+    bpb[16] = 2;
+    put32(bpb + 32, IMAGE_SECTORS - IMAGE_PARTITION);
+    put32(bpb + 36, IMAGE_FAT_SECTORS);
+    put32(bpb + 44, 2);
+    memcpy(bpb + 82, "FAT32   ", 8);
+    put16(bpb + 510, 0xAA55);
+
+    fat_set(0, 0x0FFFFFF8);
+    fat_set(1, 0x0FFFFFFF);
+    *root = (image_dir_t){ chain_alloc(DIR_CLUSTERS, 0), 0, 0 };
+    dir_add(root, NULL, "CONTROLHUB ", FAT32_ATTR_VOLUME_ID, 0, 0);
+    return dir_create(root, "SCRIPTS    ");
+}
+
+// Write the image out and put it in the simulated SD slot
+static void image_insert(void) {
+    snprintf(image_path, sizeof(image_path), "/tmp/controlhub-sd-%d.img", (int)getpid());
+    FILE* file = fopen(image_path, "wb");
+    TEST_ASSERT(file != NULL);
+    if (file) {
+        fwrite(image.data, 512, IMAGE_SECTORS, file);
+        fclose(file);
+    }
+    free(image.data);
+    image.data = NULL;
+    sim_reset();
+    TEST_ASSERT(sim_sd_attach_image(image_path));
+}
+
+static void image_remove(void) {
+    sim_sd_attach_image(NULL);
+    remove(image_path);
+}
+
+// Package a compiled one-line script under a name
+static uint32_t make_package(uint32_t* out, uint32_t max_size, const char* name, const char* game, const char* source) {
+    static uint32_t code[VM_MAX_CODE];
+    static package_meta_t meta;
+    char error[128];
+    uint32_t length = 0;
+
+    TEST_ASSERT(vm_compile(source, code, VM_MAX_CODE, &length, error, sizeof(error)));
+    memset(&meta, 0, sizeof(meta));
+    meta.type = SCRIPT_TYPE_LUA;
+    snprintf(meta.name, sizeof(meta.name), "%s", name);
+    snprintf(meta.author, sizeof(meta.author), "tester");
+    snprintf(meta.game, sizeof(meta.game), "%s", game);
+    return package_build(out, max_size, &meta, code, length, NULL, 0);
+}
+
+// Test the card, partition and directory handling, and reads through the window
+static void test_fat32_reads(void) {
+    static uint8_t big[40000];
+    static uint8_t buffer[40000];
+    const fat32_dirent_t* files;
+    fat32_file_t file;
+    fat32_stats_t stats;
+    uint32_t count;
+    image_dir_t root;
+
+    // No card, no volume
+    sim_reset();
+    sim_sd_attach_image(NULL);
+    TEST_ASSERT(!emmc_init());
+    TEST_ASSERT(!fat32_mount());
+
+    for (uint32_t i = 0; i < sizeof(big); i++) {
+        big[i] = (uint8_t)(i * 13 + (i >> 9));
+    }
+    image_dir_t scripts = image_format(&root);
+    file_add(&root, "Read me first.txt", "hello", 5, 0);
+    file_add(&scripts, "a-rather-long-script-name-for-the-fragmented-one.bin", big, sizeof(big), 1);
+    file_add(&scripts, "contiguous.bin", big, sizeof(big), 0);
+    file_add(&scripts, "empty.bin", NULL, 0, 0);
+    image_insert();
+
+    TEST_ASSERT(fat32_mount());
+    TEST_ASSERT(fat32_list("/", &files, &count) && count == 2);
+    TEST_ASSERT(strcmp(files[0].name, "SCRIPTS") == 0 && (files[0].attr & FAT32_ATTR_DIRECTORY));
+    TEST_ASSERT(strcmp(files[1].name, "Read me first.txt") == 0 && files[1].size == 5);
+    TEST_ASSERT(fat32_list("/scripts/", &files, &count) && count == 3);
+    TEST_ASSERT(!fat32_list("/missing", &files, &count));
+    TEST_ASSERT(!fat32_list("/Read me first.txt", &files, &count));
+
+    // Names match in any case; directories do not open as files
+    TEST_ASSERT(fat32_open(&file, "/READ ME FIRST.TXT"));
+    TEST_ASSERT(fat32_read(&file, buffer, sizeof(buffer)) == 5 && memcmp(buffer, "hello", 5) == 0);
+    TEST_ASSERT(fat32_read(&file, buffer, sizeof(buffer)) == 0);
+    TEST_ASSERT(!fat32_open(&file, "/scripts"));
+    TEST_ASSERT(!fat32_open(&file, "/scripts/nope.bin"));
+    TEST_ASSERT(fat32_open(&file, "/scripts/empty.bin") && fat32_read(&file, buffer, 10) == 0);
+
+    // A contiguous file comes in with one multi-block read per window
+    fat32_get_stats(&stats);
+    uint32_t fills = stats.window_fills;
+    TEST_ASSERT(fat32_open(&file, "/scripts/contiguous.bin"));
+    TEST_ASSERT(fat32_read(&file, buffer, sizeof(buffer)) == sizeof(big));
+    TEST_ASSERT(memcmp(buffer, big, sizeof(big)) == 0);
+    fat32_get_stats(&stats);
+    TEST_ASSERT(stats.window_fills - fills == (sizeof(big) + 32767) / 32768);
+
+    // A fragmented one needs a read per cluster, in odd-sized pieces
+    fills = stats.window_fills;
+    TEST_ASSERT(fat32_open(&file, "/scripts/A-RATHER-LONG-SCRIPT-NAME-FOR-THE-FRAGMENTED-ONE.BIN"));
+    uint32_t total = 0;
+    uint32_t piece;
+    while ((piece = fat32_read(&file, buffer + total, 777)) > 0) {
+        total += piece;
+    }
+    TEST_ASSERT(total == sizeof(big) && memcmp(buffer, big, sizeof(big)) == 0);
+    fat32_get_stats(&stats);
+    TEST_ASSERT(stats.window_fills - fills == (sizeof(big) + CLUSTER_BYTES - 1) / CLUSTER_BYTES);
+
+    // Listings come from the cache the second time
+    uint32_t misses = stats.dir_misses;
+    TEST_ASSERT(fat32_list("/scripts", &files, &count) && count == 3);
+    fat32_get_stats(&stats);
+    TEST_ASSERT(stats.dir_misses == misses && stats.dir_hits > 0);
+
+    fat32_unmount();
+    image_remove();
+}
+
+// Test loading packages from the card and activating one from it
+static void test_load_local(void) {
+    static uint32_t package[1024];
+    ps5_state_t state = {0};
+    script_view_t view;
+    script_entry_t entry;
+    image_dir_t root;
+    char name[64];
+
+    image_dir_t scripts = image_format(&root);
+    for (uint32_t i = 0; i < 8; i++) {
+        snprintf(name, sizeof(name), "script-%u", i);
+        uint32_t size = make_package(package, sizeof(package), name, i & 1 ? "Warzone" : "Any",
+                                     i == 3 ? "state.r2 = 99" : "state.l2 = 1");
+        snprintf(name, sizeof(name), "script-%u.PKG", i);
+        file_add(&scripts, name, package, size, 0);
+    }
+
+    // Skipped: a corrupted package, a duplicate name, another extension
+    uint32_t size = make_package(package, sizeof(package), "corrupt", "Any", "state.l2 = 1");
+    ((uint8_t*)package)[size - 1] ^= 1;
+    file_add(&scripts, "corrupt.pkg", package, size, 0);
+    size = make_package(package, sizeof(package), "script-1", "Any", "state.l2 = 1");
+    file_add(&scripts, "again.pkg", package, size, 0);
+    file_add(&scripts, "notes.txt", "x", 1, 0);
+    image_insert();
+
+    script_lib_init();
+    TEST_ASSERT(!script_lib_load_local("/missing"));
+    TEST_ASSERT(script_lib_load_local("/scripts"));
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_ALL, NULL) && script_lib_view_count(&view) == 8);
+    TEST_ASSERT(script_lib_get(script_lib_find("script-3"), &entry));
+    TEST_ASSERT(entry.is_local && strcmp(entry.path, "/scripts/script-3.PKG") == 0);
+    TEST_ASSERT(strcmp(entry.meta.author, "tester") == 0 && entry.meta.type == SCRIPT_TYPE_LUA);
+    TEST_ASSERT(entry.meta.size > 0 && entry.meta.checksum != 0);
+    TEST_ASSERT(script_lib_find("corrupt") == SCRIPT_HANDLE_NONE);
+
+    // Validation reads an uncached body from the card
+    TEST_ASSERT(script_lib_body(script_lib_find("script-5"), NULL) == NULL);
+    TEST_ASSERT(script_validate("/scripts/script-5.PKG"));
+    TEST_ASSERT(script_lib_body(script_lib_find("script-5"), NULL) != NULL);
+
+    // Activation reads the body from the card and runs it in place
+    script_init();
+    TEST_ASSERT(script_lib_activate("script-3"));
+    TEST_ASSERT(script_validate("/scripts/script-3.PKG"));
+    script_process_input(&state);
+    TEST_ASSERT(state.triggers.r2 == 99);
+    TEST_ASSERT(script_lib_deactivate("script-3"));
+    script_cleanup();
+    script_lib_cleanup();
+    image_remove();
+}
+
+// Boot-time load of a full script directory
+static void test_load_local_speed(void) {
+    static uint32_t package[1024];
+    script_view_t view;
+    image_dir_t root;
+    sim_stats_t stats;
+    char name[64];
+
+    image_dir_t scripts = image_format(&root);
+    for (uint32_t i = 0; i < BENCH_PACKAGES; i++) {
+        snprintf(name, sizeof(name), "community-script-%u", i);
+        uint32_t size = make_package(package, sizeof(package), name, "Any", "state.l2 = 1");
+        snprintf(name, sizeof(name), "community-script-%u.pkg", i);
+        file_add(&scripts, name, package, size, 0);
+    }
+    image_insert();
+
+    struct timespec start, end;
+    script_lib_init();
+    uint64_t sim_start = sim_time_us();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT(script_lib_load_local("/scripts"));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t sim_us = sim_time_us() - sim_start;
+    uint64_t host_us = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+                       (uint64_t)(end.tv_nsec - start.tv_nsec) / 1000;
+    sim_get_stats(&stats);
+
+    printf("  storage: %u packages in %llu us simulated (%u SD commands, %u blocks), %llu us host\n",
+           BENCH_PACKAGES, (unsigned long long)sim_us, stats.sd_commands, stats.sd_blocks_read,
+           (unsigned long long)host_us);
+    TEST_ASSERT(script_lib_view_open(&view, SCRIPT_VIEW_ALL, NULL) &&
+                script_lib_view_count(&view) == BENCH_PACKAGES);
+
+    // One read per package plus a handful for the card, FAT and directory
+    TEST_ASSERT(stats.sd_commands < BENCH_PACKAGES + 64);
+    TEST_ASSERT(sim_us < 200000);
+    script_lib_cleanup();
+    image_remove();
+}
+
+void register_storage_tests(void) {
+    TEST_ADD_TYPE(test_fat32_reads, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_load_local, TEST_CATALOG, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_load_local_speed, TEST_CATALOG, TEST_TYPE_PERFORMANCE);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_STORAGE_H
+#define TEST_STORAGE_H
+
+// Function to register SD card and FAT32 tests
+void register_storage_tests(void);
+
+#endif // TEST_STORAGE_H
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_framework.h"
+#include "test_telemetry.h"
+#include "sim.h"
+#include "../src/telemetry.h"
+#include "../src/uart.h"
+#include "../src/optimize.h"
+#include "../src/profile.h"
+#include "../src/script.h"
+#include "../src/vm.h"
+#include "../tools/tlm_decode.h"
+#include "../tools/vm_compile.h"
+
+#define CAPTURE_SIZE    65536
+#define MAX_RECORDS     256
+
+// Records decoded from the captured line
+typedef struct {
+    uint32_t count;
+    uint8_t types[MAX_RECORDS];
+    uint32_t seqs[MAX_RECORDS];
+    telemetry_stats_t stats;
+    char script_name[TELEMETRY_NAME_MAX + 1];
+    char text[128];
+    uint32_t profile_zones;
+} collected_t;
+
+static uint8_t capture[CAPTURE_SIZE];
+static tlm_decoder_t decoder;
+static collected_t collected;
+static char formatted[64 * 1024];
+
+static void collect(const tlm_record_t* record, void* user) {
+    collected_t* c = (collected_t*)user;
+    uint32_t length = record->header.length;
+
+    if (c->count < MAX_RECORDS) {
+        c->types[c->count] = record->header.type;
+        c->seqs[c->count] = record->header.seq;
+    }
+    c->count++;
+
+    switch (record->header.type) {
+        case TELEMETRY_REC_STATS:
+            memcpy(&c->stats, record->payload, sizeof(c->stats));
+            break;
+        case TELEMETRY_REC_SCRIPT:
+            length -= sizeof(telemetry_script_t);
+            memcpy(c->script_name, record->payload + sizeof(telemetry_script_t), length);
+            c->script_name[length] = '\0';
+            break;
+        case TELEMETRY_REC_PROFILE:
+            c->profile_zones++;
+            break;
+        case TELEMETRY_REC_TEXT:
+            if (length < sizeof(c->text)) {
+                memcpy(c->text, record->payload, length);
+                c->text[length] = '\0';
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Let the DMA channel drain the ring at line rate. Returns simulated us.
+static uint64_t drain(void) {
+    uint64_t start = sim_time_us();
+    while (telemetry_pump()) {
+        sim_advance_us(100);
+    }
+    return sim_time_us() - start;
+}
+
+// Decode everything on the line so far
+static uint32_t decode_line(void) {
+    uint32_t size = sim_uart_take(capture, sizeof(capture));
+    memset(&collected, 0, sizeof(collected));
+    tlm_decoder_init(&decoder);
+    tlm_decode(&decoder, capture, size, collect, &collected);
+    return size;
+}
+
+// Test records through the DMA-fed UART and back through the decoder
+static void test_telemetry_stream(void) {
+    static uint32_t code[VM_MAX_CODE];
+    char error[128];
+    uint32_t length = 0;
+    telemetry_counters_t counters;
+    performance_stats_t perf;
+    uint8_t polled[8];
+
+    sim_reset();
+    TEST_ASSERT(!telemetry_init(0));
+    TEST_ASSERT(telemetry_init(UART_DEFAULT_BAUD));
+    TEST_ASSERT(uart_baud() > 900000 && uart_baud() < 940000);
+
+    // Polled writes share the line
+    uart_write("hi", 2);
+    TEST_ASSERT(sim_uart_take(polled, sizeof(polled)) == 2 && memcmp(polled, "hi", 2) == 0);
+
+    // One script, one profiling zone
+    script_init();
+    TEST_ASSERT(vm_compile("state.l2 = 1", code, VM_MAX_CODE, &length, error, sizeof(error)));
+    TEST_ASSERT(script_load_bytecode("tlm-script", code, length, 5));
+    profile_reset();
+    PROFILE_BEGIN(PROFILE_ZONE_STATS);
+    optimize_get_stats(&perf);
+    PROFILE_END(PROFILE_ZONE_STATS);
+
+    // Unload the script once it is snapshotted; the record keeps its name
+    script_snapshot_t scripts[SCRIPT_MAX_SCRIPTS];
+    uint32_t script_count = script_snapshot(scripts, SCRIPT_MAX_SCRIPTS);
+    TEST_ASSERT(script_count == 1);
+    TEST_ASSERT(script_unload("tlm-script"));
+
+    telemetry_send_pipeline(&perf, scripts, script_count);
+    telemetry_send_profile();
+    telemetry_text("say \"hi\"\n", 9);
+    telemetry_get_counters(&counters);
+    uint32_t expected = 1 + LATENCY_STAGE_COUNT + 1 + 1 + 1 + 1;
+    TEST_ASSERT(counters.records_sent == expected && counters.records_dropped == 0);
+
+    // Paced by the line: 10 bits per byte
+    uint64_t line_us = drain();
+    telemetry_get_counters(&counters);
+    uint64_t expected_us = (uint64_t)counters.bytes_sent * 10 * 1000000 / uart_baud();
+    TEST_ASSERT(line_us >= expected_us && line_us < expected_us + 500);
+
+    // Every record arrives intact and in order
+    TEST_ASSERT(decode_line() == counters.bytes_sent);
+    TEST_ASSERT(collected.count == expected);
+    TEST_ASSERT(decoder.bad_frames == 0 && decoder.lost == 0 && decoder.skipped_bytes == 0);
+    TEST_ASSERT(collected.types[0] == TELEMETRY_REC_STATS);
+    TEST_ASSERT(collected.types[1] == TELEMETRY_REC_LATENCY);
+    TEST_ASSERT(collected.types[expected - 1] == TELEMETRY_REC_TEXT);
+    TEST_ASSERT(collected.seqs[expected - 1] == expected - 1);
+    TEST_ASSERT(collected.stats.frames_processed == perf.frames_processed);
+    TEST_ASSERT(strcmp(collected.script_name, "tlm-script") == 0);
+    TEST_ASSERT(collected.profile_zones == 1);
+    TEST_ASSERT(strcmp(collected.text, "say \"hi\"\n") == 0);
+
+    // CSV rows and JSON lines
+    const char* text = "x\"y";
+    telemetry_header_t header = { TELEMETRY_SYNC, TELEMETRY_REC_TEXT, 3, 7, 100 };
+    tlm_record_t record = { header, (const uint8_t*)text };
+    TEST_ASSERT(tlm_format(&record, TLM_FORMAT_CSV, formatted, sizeof(formatted)) > 0);
+    TEST_ASSERT(strcmp(formatted, "7,100,text,text,\"x\"\"y\"\n") == 0);
+    TEST_ASSERT(tlm_format(&record, TLM_FORMAT_JSON, formatted, sizeof(formatted)) > 0);
+    TEST_ASSERT(strcmp(formatted, "{\"seq\":7,\"time_us\":100,\"record\":\"text\",\"text\":\"x\\\"y\"}\n") == 0);
+    TEST_ASSERT(tlm_format(&record, TLM_FORMAT_JSON, formatted, 8) == 0);
+
+    // A corrupt frame is skipped and shows up as a lost record
+    telemetry_text("first", 5);
+    telemetry_text("second", 6);
+    drain();
+    uint32_t size = sim_uart_take(capture, sizeof(capture));
+    capture[sizeof(telemetry_header_t) + 2] ^= 0x40;
+    memset(&collected, 0, sizeof(collected));
+    tlm_decoder_init(&decoder);
+    tlm_decode(&decoder, (const uint8_t*)"\x01\x02", 2, collect, &collected);
+    for (uint32_t i = 0; i < size; i++) {
+        tlm_decode(&decoder, &capture[i], 1, collect, &collected);
+    }
+    TEST_ASSERT(collected.count == 1 && strcmp(collected.text, "second") == 0);
+    TEST_ASSERT(decoder.bad_frames >= 1 && decoder.skipped_bytes >= 2);
+
+    // A full ring drops records instead of waiting for the line
+    uint32_t first_seq = collected.seqs[0] + 1;
+    char line[100];
+    memset(line, '.', sizeof(line));
+    telemetry_get_counters(&counters);
+    uint32_t dropped_before = counters.records_dropped;
+    for (uint32_t i = 0; i < 400; i++) {
+        telemetry_text(line, sizeof(line));
+    }
+    telemetry_get_counters(&counters);
+    uint32_t dropped = counters.records_dropped - dropped_before;
+    TEST_ASSERT(dropped > 0 && dropped < 400);
+    drain();
+    telemetry_text("after", 5);
+    drain();
+    decode_line();
+    TEST_ASSERT(collected.count == 400 - dropped + 1);
+    TEST_ASSERT(collected.seqs[0] == first_seq);
+    TEST_ASSERT(decoder.lost == dropped && decoder.bad_frames == 0);
+    TEST_ASSERT(strcmp(collected.text, "after") == 0);
+
+    script_cleanup();
+}
+
+// Test what a telemetry pass costs the sending core
+static void test_telemetry_cost(void) {
+    performance_stats_t perf;
+    telemetry_counters_t counters;
+
+    sim_reset();
+    TEST_ASSERT(telemetry_init(UART_DEFAULT_BAUD));
+    script_init();
+    optimize_get_stats(&perf);
+
+    // Once a second on the GUI core; the line drains in between
+    const uint32_t passes = 200;
+    uint64_t send_ns = 0;
+    uint64_t send_us = 0;
+    for (uint32_t i = 0; i < passes; i++) {
+        uint64_t sim_start = sim_time_us();
+        uint32_t start = sim_cycles();
+        telemetry_send_pipeline(&perf, NULL, 0);
+        telemetry_pump();
+        send_ns += sim_cycles() - start;
+        send_us += sim_time_us() - sim_start;
+        drain();
+    }
+    telemetry_get_counters(&counters);
+    uint32_t pass_bytes = counters.bytes_sent / passes;
+    uint32_t line_us = pass_bytes * 10 * 1000000 / uart_baud();
+
+    printf("  telemetry: %u bytes per pass, %llu ns host and %llu us simulated to queue, %u us on the line\n",
+           pass_bytes, (unsigned long long)(send_ns / passes),
+           (unsigned long long)(send_us / passes), line_us);
+    TEST_ASSERT(counters.records_dropped == 0);
+
+    // Queuing costs the sender a small fraction of the time the line takes
+    TEST_ASSERT(send_us / passes * 20 < line_us);
+    script_cleanup();
+}
+
+void register_telemetry_tests(void) {
+    TEST_ADD_TYPE(test_telemetry_stream, TEST_STABILITY, TEST_TYPE_UNIT);
+    TEST_ADD_TYPE(test_telemetry_cost, TEST_STABILITY, TEST_TYPE_PERFORMANCE);
+}
@@ -0,0 +1,7 @@
+#ifndef TEST_TELEMETRY_H
+#define TEST_TELEMETRY_H
+
+// Function to register UART telemetry tests
+void register_telemetry_tests(void);
+
+#endif // TEST_TELEMETRY_H
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm_compile.h"
+#include "../src/package.h"
+#include "../src/script.h"
+#include "../src/vm.h"
+
+// Script packer
+//
+//   scpk [options] <script.lua|macro.txt> <script.pkg>
+//
+//   -n name  -a author  -v version  -g game  -d description  -p priority
+//
+// .lua sources are compiled to bytecode (see vm_compile.h). Anything else
+// is read as a macro timeline, one step per line:
+//
+//   <delay_us> <buttons> <lx> <ly> <rx> <ry> <l2> <r2>
+//
+// with buttons as a mask in ps5_buttons_t bit order (0x1 cross, 0x2 circle,
+// ...). Blank lines and lines starting with # are skipped. The package is
+// written little-endian, as package_verify() expects.
+
+#define MAX_STEPS  5000
+
+static int set_field(char* field, size_t size, const char* value, const char* what) {
+    if (strlen(value) >= size) {
+        fprintf(stderr, "%s too long (max %zu)\n", what, size - 1);
+        return 0;
+    }
+    strcpy(field, value);
+    return 1;
+}
+
+// Parse a macro timeline. Returns the step count, or -1 on error.
+static int parse_macro(const char* path, char* text, package_macro_step_t* steps) {
+    int count = 0;
+    int line_number = 0;
+    
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        unsigned delay, buttons, lx, ly, rx, ry, l2, r2;
+        line_number++;
+        while (*line == ' ' || *line == '\t') line++;
+        if (!*line || *line == '#' || *line == '\r') {
+            continue;
+        }
+        if (sscanf(line, "%u %i %u %u %u %u %u %u", &delay, &buttons, &lx, &ly, &rx, &ry, &l2, &r2) != 8 ||
+            buttons > 0xFFFF || lx > 255 || ly > 255 || rx > 255 || ry > 255 || l2 > 255 || r2 > 255) {
+            fprintf(stderr, "%s:%d: expected <delay_us> <buttons> <lx> <ly> <rx> <ry> <l2> <r2>\n",
+                    path, line_number);
+            return -1;
+        }
+        if (count == MAX_STEPS) {
+            fprintf(stderr, "%s: more than %d steps\n", path, MAX_STEPS);
+            return -1;
+        }
+        
+        package_macro_step_t* step = &steps[count++];
+        step->delay_us = delay;
+        step->buttons = (uint16_t)buttons;
+        step->sticks[0] = (uint8_t)lx;
+        step->sticks[1] = (uint8_t)ly;
+        step->sticks[2] = (uint8_t)rx;
+        step->sticks[3] = (uint8_t)ry;
+        step->triggers[0] = (uint8_t)l2;
+        step->triggers[1] = (uint8_t)r2;
+    }
+    
+    if (count == 0) {
+        fprintf(stderr, "%s: no steps\n", path);
+        return -1;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    static char source[256 * 1024];
+    static uint32_t code[VM_MAX_CODE];
+    static package_macro_step_t steps[MAX_STEPS];
+    static uint32_t package[(sizeof(steps) + sizeof(code)) / sizeof(uint32_t) + 1024];
+    static package_meta_t meta;
+    char error[128];
+    int arg;
+    
+    for (arg = 1; arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] && !argv[arg][2]; arg += 2) {
+        const char* value = argv[arg + 1];
+        int ok = 1;
+        switch (argv[arg][1]) {
+            case 'n': ok = set_field(meta.name, sizeof(meta.name), value, "name"); break;
+            case 'a': ok = set_field(meta.author, sizeof(meta.author), value, "author"); break;
+            case 'v': ok = set_field(meta.version, sizeof(meta.version), value, "version"); break;
+            case 'g': ok = set_field(meta.game, sizeof(meta.game), value, "game"); break;
+            case 'd': ok = set_field(meta.description, sizeof(meta.description), value, "description"); break;
+            case 'p': meta.priority = (uint32_t)strtoul(value, NULL, 0); break;
+            default: ok = 0; break;
+        }
+        if (!ok) {
+            arg = argc;
+            break;
+        }
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-n name] [-a author] [-v version] [-g game] [-d description] "
+                        "[-p priority] <script.lua|macro.txt> <script.pkg>\n", argv[0]);
+        return 2;
+    }
+    const char* in_path = argv[arg];
+    const char* out_path = argv[arg + 1];
+    
+    FILE* in = fopen(in_path, "rb");
+    if (!in) {
+        perror(in_path);
+        return 1;
+    }
+    size_t size = fread(source, 1, sizeof(source) - 1, in);
+    fclose(in);
+    source[size] = '\0';
+    
+    // Default name: the file name without directory or extension
+    if (!meta.name[0]) {
+        const char* base = strrchr(in_path, '/') ? strrchr(in_path, '/') + 1 : in_path;
+        size_t length = strcspn(base, ".");
+        if (length == 0 || length >= sizeof(meta.name)) {
+            fprintf(stderr, "%s: give a name with -n\n", in_path);
+            return 1;
+        }
+        memcpy(meta.name, base, length);
+    }
+    
+    uint32_t package_size;
+    const char* extension = strrchr(in_path, '.');
+    if (extension && strcmp(extension, ".lua") == 0) {
+        uint32_t length;
+        if (!vm_compile(source, code, VM_MAX_CODE, &length, error, sizeof(error))) {
+            fprintf(stderr, "%s:%s\n", in_path, error);
+            return 1;
+        }
+        meta.type = SCRIPT_TYPE_LUA;
+        package_size = package_build(package, sizeof(package), &meta, code, length, NULL, 0);
+    } else {
+        int count = parse_macro(in_path, source, steps);
+        if (count < 0) {
+            return 1;
+        }
+        meta.type = SCRIPT_TYPE_MACRO;
+        package_size = package_build(package, sizeof(package), &meta, NULL, 0, steps, (uint32_t)count);
+    }
+    
+    package_t check;
+    if (!package_size || !package_verify(package, package_size) ||
+        !package_open(&check, package, package_size)) {
+        fprintf(stderr, "%s: could not build a valid package\n", in_path);
+        return 1;
+    }
+    
+    FILE* out = fopen(out_path, "wb");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fwrite(package, 1, package_size, out);
+    fclose(out);
+    
+    printf("%s: %s, %u bytes, crc32 %08x\n", out_path, meta.type == SCRIPT_TYPE_LUA ? "bytecode" : "macro",
+           package_size, check.header->checksum);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tlm_decode.h"
+
+// Telemetry decoder
+//
+//   tlm [--csv|--json] [stream]
+//
+// Reads a captured UART stream (a file, a pty such as the one SIM_UART
+// points at, or stdin) and prints every record as CSV rows (the default)
+// or JSON lines. A summary of decoded, corrupt and lost records goes to
+// stderr at the end of the stream.
+
+typedef struct {
+    tlm_format_t format;
+    char text[64 * 1024];
+} output_t;
+
+static void print_record(const tlm_record_t* record, void* user) {
+    output_t* output = (output_t*)user;
+    uint32_t length = tlm_format(record, output->format, output->text, sizeof(output->text));
+    fwrite(output->text, 1, length, stdout);
+}
+
+int main(int argc, char** argv) {
+    static output_t output;
+    static tlm_decoder_t decoder;
+    static uint8_t chunk[4096];
+    const char* path = NULL;
+
+    output.format = TLM_FORMAT_CSV;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            output.format = TLM_FORMAT_CSV;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            output.format = TLM_FORMAT_JSON;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "usage: tlm [--csv|--json] [stream]\n");
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    FILE* in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        in = fopen(path, "rb");
+        if (!in) {
+            fprintf(stderr, "cannot open %s\n", path);
+            return 1;
+        }
+    }
+
+    tlm_decoder_init(&decoder);
+    if (output.format == TLM_FORMAT_CSV) {
+        fputs(TLM_CSV_HEADER, stdout);
+    }
+
+    // read() rather than fread() so a live pty is decoded as bytes arrive
+    ssize_t n;
+    while ((n = read(fileno(in), chunk, sizeof(chunk))) > 0) {
+        tlm_decode(&decoder, chunk, (uint32_t)n, print_record, &output);
+        fflush(stdout);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    fprintf(stderr, "tlm: %u records, %u corrupt, %u lost, %u bytes skipped\n",
+            decoder.records, decoder.bad_frames, decoder.lost, decoder.skipped_bytes);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "tlm_decode.h"
+#include "../src/crc32.h"
+#include "../src/latency_hist.h"
+
+static const char* const record_names[TELEMETRY_REC_COUNT] = {
+    "unknown", "stats", "latency", "script", "usb", "profile", "text"
+};
+
+static const char* const stage_names[] = {
+    "validate", "scripts", "usb_read", "usb_write", "end_to_end"
+};
+
+static const char* const script_types[] = { "lua", "macro", "combo" };
+
+void tlm_decoder_init(tlm_decoder_t* decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+const char* tlm_record_name(uint8_t type) {
+    return type < TELEMETRY_REC_COUNT ? record_names[type] : "unknown";
+}
+
+static void discard(tlm_decoder_t* decoder, uint32_t count) {
+    memmove(decoder->buffer, decoder->buffer + count, decoder->fill - count);
+    decoder->fill -= count;
+}
+
+// Frame at the start of the buffer: 1 if complete and valid, 0 if more
+// bytes are needed, -1 if it is not a frame
+static int check_frame(const tlm_decoder_t* decoder, telemetry_header_t* header) {
+    if (decoder->fill < sizeof(*header)) {
+        return 0;
+    }
+    memcpy(header, decoder->buffer, sizeof(*header));
+    if (header->type == 0 || header->type >= TELEMETRY_REC_COUNT ||
+        header->length > TELEMETRY_MAX_PAYLOAD) {
+        return -1;
+    }
+
+    uint32_t body = sizeof(*header) + header->length;
+    if (decoder->fill < body + sizeof(uint32_t)) {
+        return 0;
+    }
+    uint32_t crc;
+    memcpy(&crc, decoder->buffer + body, sizeof(crc));
+    return crc32(decoder->buffer, body) == crc ? 1 : -1;
+}
+
+void tlm_decode(tlm_decoder_t* decoder, const uint8_t* data, uint32_t size,
+                tlm_emit_t emit, void* user) {
+    while (size > 0) {
+        uint32_t room = sizeof(decoder->buffer) - decoder->fill;
+        uint32_t take = size < room ? size : room;
+        memcpy(decoder->buffer + decoder->fill, data, take);
+        decoder->fill += take;
+        data += take;
+        size -= take;
+
+        while (decoder->fill > 0) {
+            // Hunt for sync
+            uint32_t skip = 0;
+            while (skip < decoder->fill && decoder->buffer[skip] != TELEMETRY_SYNC) {
+                skip++;
+            }
+            if (skip) {
+                decoder->skipped_bytes += skip;
+                discard(decoder, skip);
+                continue;
+            }
+
+            telemetry_header_t header;
+            int status = check_frame(decoder, &header);
+            if (status == 0) {
+                break;
+            }
+            if (status < 0) {
+                // Not a frame after all: resync past this sync byte
+                decoder->bad_frames++;
+                decoder->skipped_bytes++;
+                discard(decoder, 1);
+                continue;
+            }
+
+            if (decoder->have_seq && header.seq != decoder->next_seq) {
+                decoder->lost += header.seq - decoder->next_seq;
+            }
+            decoder->next_seq = header.seq + 1;
+            decoder->have_seq = 1;
+            decoder->records++;
+
+            tlm_record_t record = { header, decoder->buffer + sizeof(header) };
+            if (emit) {
+                emit(&record, user);
+            }
+            discard(decoder, sizeof(header) + header.length + sizeof(uint32_t));
+        }
+    }
+}
+
+// Output under construction
+typedef struct {
+    tlm_format_t format;
+    const tlm_record_t* record;
+    char* out;
+    uint32_t size;
+    uint32_t pos;
+    int overflow;
+} writer_t;
+
+__attribute__((format(printf, 2, 3)))
+static void put(writer_t* w, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w->out + w->pos, w->size - w->pos, format, args);
+    va_end(args);
+    if (n < 0 || (uint32_t)n >= w->size - w->pos) {
+        w->overflow = 1;
+        return;
+    }
+    w->pos += (uint32_t)n;
+}
+
+// CSV row prefix, or the separator before a JSON member
+static void key(writer_t* w, const char* name) {
+    if (w->format == TLM_FORMAT_CSV) {
+        put(w, "%u,%u,%s,%s,", w->record->header.seq, w->record->header.time_us,
+            tlm_record_name(w->record->header.type), name);
+    } else {
+        put(w, ",\"%s\":", name);
+    }
+}
+
+static void field(writer_t* w, const char* name, uint64_t value) {
+    key(w, name);
+    put(w, "%llu%s", (unsigned long long)value, w->format == TLM_FORMAT_CSV ? "\n" : "");
+}
+
+// Quoted and escaped for the format
+static void text_field(writer_t* w, const char* name, const uint8_t* text, uint32_t length) {
+    key(w, name);
+    put(w, "\"");
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t c = text[i];
+        if (w->format == TLM_FORMAT_CSV) {
+            if (c == '"') {
+                put(w, "\"\"");
+            } else {
+                put(w, "%c", c == '\n' ? ' ' : c);
+            }
+        } else if (c == '"' || c == '\\') {
+            put(w, "\\%c", c);
+        } else if (c < 0x20) {
+            put(w, "\\u%04x", c);
+        } else {
+            put(w, "%c", c);
+        }
+    }
+    put(w, "\"%s", w->format == TLM_FORMAT_CSV ? "\n" : "");
+}
+
+static void format_latency(writer_t* w, const uint8_t* payload, uint32_t length) {
+    static latency_hist_t hist;
+    telemetry_latency_t record;
+    memcpy(&record, payload, sizeof(record));
+
+    // Rebuild the histogram for percentiles
+    latency_hist_reset(&hist);
+    uint32_t count = record.bucket_count;
+    if (sizeof(record) + count * sizeof(telemetry_bucket_t) > length) {
+        count = 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        telemetry_bucket_t bucket;
+        memcpy(&bucket, payload + sizeof(record) + i * sizeof(bucket), sizeof(bucket));
+        if (bucket.index < LATENCY_HIST_BUCKETS) {
+            hist.buckets[bucket.index] = bucket.count;
+        }
+    }
+    hist.count = record.samples;
+    hist.max_us = record.max_us;
+
+    key(w, "stage");
+    put(w, "\"%s\"%s", record.stage < sizeof(stage_names) / sizeof(stage_names[0]) ?
+        stage_names[record.stage] : "unknown", w->format == TLM_FORMAT_CSV ? "\n" : "");
+    field(w, "samples", record.samples);
+    field(w, "p50_us", latency_hist_percentile(&hist, 500));
+    field(w, "p99_us", latency_hist_percentile(&hist, 990));
+    field(w, "p999_us", latency_hist_percentile(&hist, 999));
+    field(w, "max_us", record.max_us);
+
+    // Bucket upper bounds and counts, JSON only
+    if (w->format == TLM_FORMAT_JSON) {
+        put(w, ",\"buckets\":[");
+        for (uint32_t i = 0, n = 0; i < LATENCY_HIST_BUCKETS; i++) {
+            if (hist.buckets[i]) {
+                put(w, "%s[%u,%u]", n++ ? "," : "", latency_hist_bucket_max(i), hist.buckets[i]);
+            }
+        }
+        put(w, "]");
+    }
+}
+
+// Format one record; returns the length written, 0 if it did not fit
+uint32_t tlm_format(const tlm_record_t* record, tlm_format_t format, char* out, uint32_t size) {
+    writer_t w = { format, record, out, size, 0, 0 };
+    const uint8_t* payload = record->payload;
+    uint32_t length = record->header.length;
+
+    if (format == TLM_FORMAT_JSON) {
+        put(&w, "{\"seq\":%u,\"time_us\":%u,\"record\":\"%s\"", record->header.seq,
+            record->header.time_us, tlm_record_name(record->header.type));
+    }
+
+    switch (record->header.type) {
+        case TELEMETRY_REC_STATS: {
+            telemetry_stats_t stats = {0};
+            memcpy(&stats, payload, length < sizeof(stats) ? length : sizeof(stats));
+            field(&w, "frames_processed", stats.frames_processed);
+            field(&w, "frames_dropped", stats.frames_dropped);
+            field(&w, "input_errors", stats.input_errors);
+            field(&w, "output_errors", stats.output_errors);
+            field(&w, "buffer_overruns", stats.buffer_overruns);
+            field(&w, "input_latency_us", stats.input_latency_us);
+            field(&w, "output_latency_us", stats.output_latency_us);
+            field(&w, "temperature", stats.temperature);
+            field(&w, "voltage_mv", stats.voltage_mv);
+            field(&w, "cpu_permille", stats.cpu_permille);
+            field(&w, "uptime_ms", stats.uptime_ms);
+            field(&w, "records_dropped", stats.records_dropped);
+            break;
+        }
+        case TELEMETRY_REC_LATENCY:
+            if (length >= sizeof(telemetry_latency_t)) {
+                format_latency(&w, payload, length);
+            }
+            break;
+        case TELEMETRY_REC_SCRIPT: {
+            telemetry_script_t script;
+            if (length < sizeof(script)) {
+                break;
+            }
+            memcpy(&script, payload, sizeof(script));
+            text_field(&w, "name", payload + sizeof(script), length - sizeof(script));
+            key(&w, "type");
+            put(&w, "\"%s\"%s", script.type < 3 ? script_types[script.type] : "unknown",
+                format == TLM_FORMAT_CSV ? "\n" : "");
+            field(&w, "priority", script.priority);
+            field(&w, "exec_count", script.exec_count);
+            field(&w, "exec_time_us", script.exec_time_us);
+            field(&w, "exec_cycles", script.exec_cycles);
+            field(&w, "budget_ops", script.budget_ops);
+            field(&w, "overruns", script.overruns);
+            field(&w, "deferrals", script.deferrals);
+            field(&w, "demotion", script.demotion);
+            break;
+        }
+        case TELEMETRY_REC_USB: {
+            telemetry_usb_t usb = {0};
+            memcpy(&usb, payload, length < sizeof(usb) ? length : sizeof(usb));
+            field(&w, "in_reports", usb.in_reports);
+            field(&w, "in_naks", usb.in_naks);
+            field(&w, "in_errors", usb.in_errors);
+            field(&w, "out_transfers", usb.out_transfers);
+            field(&w, "out_failures", usb.out_failures);
+            break;
+        }
+        case TELEMETRY_REC_PROFILE: {
+            telemetry_profile_t zone;
+            if (length < sizeof(zone)) {
+                break;
+            }
+            memcpy(&zone, payload, sizeof(zone));
+            text_field(&w, "zone", payload + sizeof(zone), length - sizeof(zone));
+            field(&w, "core", zone.core);
+            field(&w, "count", zone.count);
+            field(&w, "cycles", zone.cycles);
+            field(&w, "self_cycles", zone.self_cycles);
+            field(&w, "p50_cycles", zone.p50_cycles);
+            field(&w, "p99_cycles", zone.p99_cycles);
+            field(&w, "max_cycles", zone.max_cycles);
+            break;
+        }
+        case TELEMETRY_REC_TEXT:
+            text_field(&w, "text", payload, length);
+            break;
+        default:
+            break;
+    }
+
+    if (format == TLM_FORMAT_JSON) {
+        put(&w, "}\n");
+    }
+    return w.overflow ? 0 : w.pos;
+}
@@ -0,0 +1,49 @@
+#ifndef TLM_DECODE_H
+#define TLM_DECODE_H
+
+#include <stdint.h>
+#include "../src/telemetry.h"
+
+// Host-side decoder for the telemetry stream (src/telemetry.h).
+//
+// Bytes can be fed in pieces of any size. A frame whose length or CRC is
+// wrong is skipped by searching for the next sync byte, so the decoder
+// recovers from line noise and from joining a stream part way through.
+// Gaps in the sequence numbers are counted as lost records.
+//
+// Records format as CSV rows (seq,time_us,record,key,value, one row per
+// field) or as one JSON object per line.
+
+typedef struct {
+    telemetry_header_t header;
+    const uint8_t* payload;     // header.length bytes
+} tlm_record_t;
+
+typedef void (*tlm_emit_t)(const tlm_record_t* record, void* user);
+
+typedef struct {
+    uint8_t buffer[sizeof(telemetry_header_t) + TELEMETRY_MAX_PAYLOAD + sizeof(uint32_t)];
+    uint32_t fill;
+    uint32_t records;           // Frames decoded
+    uint32_t bad_frames;        // Frames failing the length or CRC check
+    uint32_t skipped_bytes;     // Bytes discarded looking for sync
+    uint32_t lost;              // Records missing from the sequence
+    uint32_t next_seq;
+    int have_seq;
+} tlm_decoder_t;
+
+typedef enum {
+    TLM_FORMAT_CSV,
+    TLM_FORMAT_JSON
+} tlm_format_t;
+
+#define TLM_CSV_HEADER  "seq,time_us,record,key,value\n"
+
+// Function Prototypes
+void tlm_decoder_init(tlm_decoder_t* decoder);
+void tlm_decode(tlm_decoder_t* decoder, const uint8_t* data, uint32_t size,
+                tlm_emit_t emit, void* user);
+const char* tlm_record_name(uint8_t type);
+uint32_t tlm_format(const tlm_record_t* record, tlm_format_t format, char* out, uint32_t size);
+
+#endif // TLM_DECODE_H
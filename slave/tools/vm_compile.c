@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "vm_compile.h"
+#include "../src/vm.h"
+
+#define MAX_LOCALS      12      // Registers left for temporaries
+#define MAX_NAME        32
+
+typedef enum {
+    TOK_EOF, TOK_NUM, TOK_NAME,
+    TOK_LOCAL, TOK_IF, TOK_THEN, TOK_ELSEIF, TOK_ELSE, TOK_END, TOK_WHILE, TOK_DO,
+    TOK_AND, TOK_OR, TOK_NOT, TOK_RETURN,
+    TOK_PLUS, TOK_MINUS, TOK_STAR, TOK_SLASH, TOK_PERCENT,
+    TOK_EQ, TOK_NE, TOK_LT, TOK_LE, TOK_GT, TOK_GE, TOK_ASSIGN,
+    TOK_LPAREN, TOK_RPAREN, TOK_COMMA, TOK_DOT,
+    TOK_AMP, TOK_PIPE, TOK_TILDE, TOK_SHL, TOK_SHR
+} token_t;
+
+static const struct {
+    const char* word;
+    token_t token;
+} keywords[] = {
+    {"local", TOK_LOCAL}, {"if", TOK_IF}, {"then", TOK_THEN}, {"elseif", TOK_ELSEIF},
+    {"else", TOK_ELSE}, {"end", TOK_END}, {"while", TOK_WHILE}, {"do", TOK_DO},
+    {"and", TOK_AND}, {"or", TOK_OR}, {"not", TOK_NOT}, {"return", TOK_RETURN},
+};
+
+static const char* const field_names[VM_FIELD_COUNT] = {
+    "buttons", "lx", "ly", "rx", "ry", "l2", "r2",
+    "accel_x", "accel_y", "accel_z", "gyro_x", "gyro_y", "gyro_z",
+    "battery", "temperature",
+};
+
+// ps5_buttons_t bit order
+static const char* const button_names[VM_BUTTON_COUNT] = {
+    "cross", "circle", "triangle", "square", "l1", "r1", "l2", "r2",
+    "share", "options", "l3", "r3", "ps", "touchpad", "mute",
+};
+
+typedef struct {
+    const char* src;
+    const char* pos;
+    uint32_t line;
+    token_t tok;
+    int32_t num;
+    char name[MAX_NAME];
+    
+    uint32_t* code;
+    uint32_t max_words;
+    uint32_t length;
+    
+    char locals[MAX_LOCALS][MAX_NAME];
+    uint32_t local_count;
+    uint32_t top;                       // Next free register
+    char globals[VM_GLOBALS][MAX_NAME];
+    uint32_t global_count;
+    
+    int failed;
+    char* error;
+    uint32_t error_size;
+} compiler_t;
+
+static void fail(compiler_t* c, const char* fmt, ...) {
+    if (c->failed) {
+        return;
+    }
+    c->failed = 1;
+    if (c->error && c->error_size) {
+        int n = snprintf(c->error, c->error_size, "line %u: ", c->line);
+        if (n >= 0 && (uint32_t)n < c->error_size) {
+            va_list args;
+            va_start(args, fmt);
+            vsnprintf(c->error + n, c->error_size - n, fmt, args);
+            va_end(args);
+        }
+    }
+}
+
+// Lexer
+
+static int is_alpha(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+static int is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+static void next(compiler_t* c) {
+    for (;;) {
+        while (*c->pos == ' ' || *c->pos == '\t' || *c->pos == '\r' || *c->pos == '\n') {
+            if (*c->pos == '\n') {
+                c->line++;
+            }
+            c->pos++;
+        }
+        if (c->pos[0] == '-' && c->pos[1] == '-') {
+            while (*c->pos && *c->pos != '\n') {
+                c->pos++;
+            }
+            continue;
+        }
+        break;
+    }
+    
+    const char* p = c->pos;
+    if (!*p) {
+        c->tok = TOK_EOF;
+        return;
+    }
+    
+    if (is_digit(*p)) {
+        uint32_t value = 0;
+        if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+            p += 2;
+            while (is_digit(*p) || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F')) {
+                value = value * 16 + (uint32_t)(is_digit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+                p++;
+            }
+        } else {
+            while (is_digit(*p)) {
+                value = value * 10 + (uint32_t)(*p - '0');
+                p++;
+            }
+        }
+        c->num = (int32_t)value;
+        c->tok = TOK_NUM;
+        c->pos = p;
+        return;
+    }
+    
+    if (is_alpha(*p)) {
+        uint32_t n = 0;
+        while (is_alpha(*p) || is_digit(*p)) {
+            if (n < MAX_NAME - 1) {
+                c->name[n++] = *p;
+            }
+            p++;
+        }
+        c->name[n] = '\0';
+        c->pos = p;
+        c->tok = TOK_NAME;
+        for (uint32_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+            if (strcmp(c->name, keywords[i].word) == 0) {
+                c->tok = keywords[i].token;
+                break;
+            }
+        }
+        return;
+    }
+    
+    c->pos = p + 1;
+    switch (*p) {
+        case '+': c->tok = TOK_PLUS; return;
+        case '-': c->tok = TOK_MINUS; return;
+        case '*': c->tok = TOK_STAR; return;
+        case '/': c->tok = TOK_SLASH; return;
+        case '%': c->tok = TOK_PERCENT; return;
+        case '(': c->tok = TOK_LPAREN; return;
+        case ')': c->tok = TOK_RPAREN; return;
+        case ',': c->tok = TOK_COMMA; return;
+        case '.': c->tok = TOK_DOT; return;
+        case '&': c->tok = TOK_AMP; return;
+        case '|': c->tok = TOK_PIPE; return;
+        case '=':
+            if (p[1] == '=') { c->pos++; c->tok = TOK_EQ; } else { c->tok = TOK_ASSIGN; }
+            return;
+        case '~':
+            if (p[1] == '=') { c->pos++; c->tok = TOK_NE; } else { c->tok = TOK_TILDE; }
+            return;
+        case '<':
+            if (p[1] == '=') { c->pos++; c->tok = TOK_LE; }
+            else if (p[1] == '<') { c->pos++; c->tok = TOK_SHL; }
+            else { c->tok = TOK_LT; }
+            return;
+        case '>':
+            if (p[1] == '=') { c->pos++; c->tok = TOK_GE; }
+            else if (p[1] == '>') { c->pos++; c->tok = TOK_SHR; }
+            else { c->tok = TOK_GT; }
+            return;
+        default:
+            fail(c, "unexpected character '%c'", *p);
+            c->tok = TOK_EOF;
+            return;
+    }
+}
+
+static int accept(compiler_t* c, token_t tok) {
+    if (c->tok == tok) {
+        next(c);
+        return 1;
+    }
+    return 0;
+}
+
+static void expect(compiler_t* c, token_t tok, const char* what) {
+    if (!accept(c, tok)) {
+        fail(c, "expected %s", what);
+    }
+}
+
+// Code generation
+
+static uint32_t emit(compiler_t* c, uint32_t insn) {
+    if (c->length >= c->max_words) {
+        fail(c, "program too long");
+        return c->length;
+    }
+    c->code[c->length] = insn;
+    return c->length++;
+}
+
+static uint32_t alloc_reg(compiler_t* c) {
+    if (c->top >= VM_REGISTERS) {
+        fail(c, "expression too complex");
+        return VM_REGISTERS - 1;
+    }
+    return c->top++;
+}
+
+static void emit_const(compiler_t* c, uint32_t reg, int32_t value) {
+    emit(c, VM_ENC_I(VM_LOADI, reg, (uint32_t)value & 0xFFFF));
+    if (value < -32768 || value > 32767) {
+        emit(c, VM_ENC_I(VM_LOADHI, reg, (uint32_t)value >> 16));
+    }
+}
+
+// Point the jump at 'at' to 'target'
+static void patch(compiler_t* c, uint32_t at, uint32_t target) {
+    if (c->failed) {
+        return;
+    }
+    int32_t offset = (int32_t)target - (int32_t)(at + 1);
+    if (offset < -32768 || offset > 32767) {
+        fail(c, "jump too far");
+        return;
+    }
+    c->code[at] = (c->code[at] & 0xFFFF0000u) | ((uint32_t)offset & 0xFFFF);
+}
+
+static int lookup(const char names[][MAX_NAME], uint32_t count, const char* name) {
+    for (uint32_t i = count; i-- > 0; ) {
+        if (strcmp(names[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int lookup_table(const char* const* names, uint32_t count, const char* name) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int global_index(compiler_t* c, const char* name) {
+    int index = lookup(c->globals, c->global_count, name);
+    if (index >= 0) {
+        return index;
+    }
+    if (c->global_count >= VM_GLOBALS) {
+        fail(c, "too many globals");
+        return 0;
+    }
+    strcpy(c->globals[c->global_count], name);
+    return (int)c->global_count++;
+}
+
+// Parse ".member" after state/button/g; returns its index or -1
+static int member(compiler_t* c, const char* base) {
+    expect(c, TOK_DOT, "'.'");
+    if (c->tok != TOK_NAME) {
+        fail(c, "expected member of %s", base);
+        return -1;
+    }
+    int index;
+    if (strcmp(base, "state") == 0) {
+        index = lookup_table(field_names, VM_FIELD_COUNT, c->name);
+    } else if (strcmp(base, "button") == 0) {
+        index = lookup_table(button_names, VM_BUTTON_COUNT, c->name);
+    } else {
+        index = global_index(c, c->name);
+    }
+    if (index < 0) {
+        fail(c, "unknown %s.%s", base, c->name);
+    }
+    next(c);
+    return index;
+}
+
+// Expressions: each leaves its value in a newly allocated register
+
+static uint32_t expression(compiler_t* c, int level);
+
+static uint32_t call_builtin(compiler_t* c, const char* name) {
+    uint32_t args[3];
+    uint32_t argc = 0;
+    
+    expect(c, TOK_LPAREN, "'('");
+    if (c->tok != TOK_RPAREN) {
+        do {
+            if (argc >= 3) {
+                fail(c, "too many arguments to %s", name);
+                break;
+            }
+            args[argc++] = expression(c, 0);
+        } while (accept(c, TOK_COMMA) && !c->failed);
+    }
+    expect(c, TOK_RPAREN, "')'");
+    
+    uint32_t need = strcmp(name, "abs") == 0 ? 1 : (strcmp(name, "clamp") == 0 ? 3 : 2);
+    if (argc != need) {
+        fail(c, "%s takes %u arguments", name, need);
+        return argc ? args[0] : alloc_reg(c);
+    }
+    
+    uint32_t r = args[0];
+    if (strcmp(name, "min") == 0) {
+        emit(c, VM_ENC(VM_MIN, r, r, args[1]));
+    } else if (strcmp(name, "max") == 0) {
+        emit(c, VM_ENC(VM_MAX, r, r, args[1]));
+    } else if (strcmp(name, "abs") == 0) {
+        uint32_t t = alloc_reg(c);
+        emit(c, VM_ENC(VM_NEG, t, r, 0));
+        emit(c, VM_ENC(VM_MAX, r, r, t));
+    } else {
+        emit(c, VM_ENC(VM_MAX, r, r, args[1]));
+        emit(c, VM_ENC(VM_MIN, r, r, args[2]));
+    }
+    c->top = r + 1;
+    return r;
+}
+
+static uint32_t primary(compiler_t* c) {
+    if (c->tok == TOK_NUM) {
+        uint32_t r = alloc_reg(c);
+        emit_const(c, r, c->num);
+        next(c);
+        return r;
+    }
+    
+    if (accept(c, TOK_LPAREN)) {
+        uint32_t r = expression(c, 0);
+        expect(c, TOK_RPAREN, "')'");
+        return r;
+    }
+    
+    if (c->tok != TOK_NAME) {
+        fail(c, "expected expression");
+        return alloc_reg(c);
+    }
+    
+    char name[MAX_NAME];
+    strcpy(name, c->name);
+    next(c);
+    
+    if (strcmp(name, "state") == 0 || strcmp(name, "button") == 0 || strcmp(name, "g") == 0) {
+        int index = member(c, name);
+        uint32_t r = alloc_reg(c);
+        uint32_t op = name[0] == 's' ? VM_GETF : (name[0] == 'b' ? VM_BTN : VM_GETG);
+        emit(c, VM_ENC(op, r, index < 0 ? 0 : index, 0));
+        return r;
+    }
+    if (strcmp(name, "time") == 0) {
+        uint32_t r = alloc_reg(c);
+        emit(c, VM_ENC(VM_TIME, r, 0, 0));
+        return r;
+    }
+    if (c->tok == TOK_LPAREN) {
+        if (strcmp(name, "min") && strcmp(name, "max") && strcmp(name, "abs") && strcmp(name, "clamp")) {
+            fail(c, "unknown function %s", name);
+        }
+        return call_builtin(c, name);
+    }
+    
+    int local = lookup(c->locals, c->local_count, name);
+    if (local < 0) {
+        fail(c, "unknown variable %s", name);
+        return alloc_reg(c);
+    }
+    uint32_t r = alloc_reg(c);
+    emit(c, VM_ENC(VM_MOV, r, local, 0));
+    return r;
+}
+
+static uint32_t unary(compiler_t* c) {
+    if (accept(c, TOK_MINUS)) {
+        uint32_t r = unary(c);
+        emit(c, VM_ENC(VM_NEG, r, r, 0));
+        return r;
+    }
+    if (accept(c, TOK_NOT)) {
+        uint32_t r = unary(c);
+        emit(c, VM_ENC(VM_NOT, r, r, 0));
+        return r;
+    }
+    if (accept(c, TOK_TILDE)) {
+        uint32_t r = unary(c);
+        uint32_t t = alloc_reg(c);
+        emit(c, VM_ENC_I(VM_LOADI, t, 0xFFFF));
+        emit(c, VM_ENC(VM_XOR, r, r, t));
+        c->top = r + 1;
+        return r;
+    }
+    return primary(c);
+}
+
+// Binary operator levels, loosest first
+#define LEVELS 8
+
+static int binary_level(token_t tok) {
+    switch (tok) {
+        case TOK_OR:    return 0;
+        case TOK_AND:   return 1;
+        case TOK_EQ: case TOK_NE: case TOK_LT: case TOK_LE: case TOK_GT: case TOK_GE:
+                        return 2;
+        case TOK_PIPE:  return 3;
+        case TOK_TILDE: return 4;
+        case TOK_AMP:   return 5;
+        case TOK_SHL: case TOK_SHR:
+                        return 6;
+        case TOK_PLUS: case TOK_MINUS:
+                        return 7;
+        case TOK_STAR: case TOK_SLASH: case TOK_PERCENT:
+                        return 8;
+        default:        return -1;
+    }
+}
+
+static void emit_binary(compiler_t* c, token_t tok, uint32_t l, uint32_t r) {
+    switch (tok) {
+        case TOK_OR:
+            emit(c, VM_ENC(VM_OR, l, l, r));
+            emit(c, VM_ENC(VM_BOOL, l, l, 0));
+            break;
+        case TOK_AND:
+            emit(c, VM_ENC(VM_BOOL, l, l, 0));
+            emit(c, VM_ENC(VM_BOOL, r, r, 0));
+            emit(c, VM_ENC(VM_AND, l, l, r));
+            break;
+        case TOK_EQ:      emit(c, VM_ENC(VM_EQ, l, l, r)); break;
+        case TOK_NE:      emit(c, VM_ENC(VM_NE, l, l, r)); break;
+        case TOK_LT:      emit(c, VM_ENC(VM_LT, l, l, r)); break;
+        case TOK_LE:      emit(c, VM_ENC(VM_LE, l, l, r)); break;
+        case TOK_GT:      emit(c, VM_ENC(VM_LT, l, r, l)); break;
+        case TOK_GE:      emit(c, VM_ENC(VM_LE, l, r, l)); break;
+        case TOK_PIPE:    emit(c, VM_ENC(VM_OR, l, l, r)); break;
+        case TOK_TILDE:   emit(c, VM_ENC(VM_XOR, l, l, r)); break;
+        case TOK_AMP:     emit(c, VM_ENC(VM_AND, l, l, r)); break;
+        case TOK_SHL:     emit(c, VM_ENC(VM_SHL, l, l, r)); break;
+        case TOK_SHR:     emit(c, VM_ENC(VM_SHR, l, l, r)); break;
+        case TOK_PLUS:    emit(c, VM_ENC(VM_ADD, l, l, r)); break;
+        case TOK_MINUS:   emit(c, VM_ENC(VM_SUB, l, l, r)); break;
+        case TOK_STAR:    emit(c, VM_ENC(VM_MUL, l, l, r)); break;
+        case TOK_SLASH:   emit(c, VM_ENC(VM_DIV, l, l, r)); break;
+        case TOK_PERCENT: emit(c, VM_ENC(VM_MOD, l, l, r)); break;
+        default:          break;
+    }
+}
+
+// Precedence climbing from 'level' up
+static uint32_t expression(compiler_t* c, int level) {
+    if (level > LEVELS) {
+        return unary(c);
+    }
+    
+    uint32_t l = expression(c, level + 1);
+    while (!c->failed && binary_level(c->tok) == level) {
+        token_t op = c->tok;
+        next(c);
+        uint32_t r = expression(c, level + 1);
+        emit_binary(c, op, l, r);
+        c->top = l + 1;
+        
+        // Comparisons do not chain
+        if (level == 2) {
+            break;
+        }
+    }
+    return l;
+}
+
+// Statements
+
+static void block(compiler_t* c);
+
+static void assignment(compiler_t* c, const char* name) {
+    if (strcmp(name, "state") == 0 || strcmp(name, "button") == 0 || strcmp(name, "g") == 0) {
+        int index = member(c, name);
+        expect(c, TOK_ASSIGN, "'='");
+        uint32_t r = expression(c, 0);
+        uint32_t op = name[0] == 's' ? VM_SETF : (name[0] == 'b' ? VM_SETBTN : VM_SETG);
+        emit(c, VM_ENC(op, index < 0 ? 0 : index, r, 0));
+        c->top = c->local_count;
+        return;
+    }
+    
+    int local = lookup(c->locals, c->local_count, name);
+    if (local < 0) {
+        fail(c, "unknown variable %s", name);
+        return;
+    }
+    expect(c, TOK_ASSIGN, "'='");
+    uint32_t r = expression(c, 0);
+    emit(c, VM_ENC(VM_MOV, local, r, 0));
+    c->top = c->local_count;
+}
+
+static void statement(compiler_t* c) {
+    if (accept(c, TOK_LOCAL)) {
+        if (c->tok != TOK_NAME) {
+            fail(c, "expected local name");
+            return;
+        }
+        char name[MAX_NAME];
+        strcpy(name, c->name);
+        next(c);
+        if (c->local_count >= MAX_LOCALS) {
+            fail(c, "too many locals");
+            return;
+        }
+        
+        // The value lands in the next register, which becomes the local
+        uint32_t r;
+        if (accept(c, TOK_ASSIGN)) {
+            r = expression(c, 0);
+        } else {
+            r = alloc_reg(c);
+            emit_const(c, r, 0);
+        }
+        strcpy(c->locals[c->local_count], name);
+        c->local_count++;
+        c->top = c->local_count;
+        (void)r;
+        return;
+    }
+    
+    if (accept(c, TOK_IF)) {
+        uint32_t exits[64];
+        uint32_t exit_count = 0;
+        
+        for (;;) {
+            uint32_t cond = expression(c, 0);
+            expect(c, TOK_THEN, "'then'");
+            uint32_t skip = emit(c, VM_ENC_I(VM_JZ, cond, 0));
+            c->top = c->local_count;
+            block(c);
+            
+            if (c->tok == TOK_ELSEIF || c->tok == TOK_ELSE) {
+                if (exit_count >= 64) {
+                    fail(c, "too many elseif branches");
+                    return;
+                }
+                exits[exit_count++] = emit(c, VM_ENC_I(VM_JMP, 0, 0));
+            }
+            patch(c, skip, c->length);
+            
+            if (accept(c, TOK_ELSEIF)) {
+                continue;
+            }
+            if (accept(c, TOK_ELSE)) {
+                block(c);
+            }
+            break;
+        }
+        expect(c, TOK_END, "'end'");
+        for (uint32_t i = 0; i < exit_count; i++) {
+            patch(c, exits[i], c->length);
+        }
+        return;
+    }
+    
+    if (accept(c, TOK_WHILE)) {
+        uint32_t start = c->length;
+        uint32_t cond = expression(c, 0);
+        expect(c, TOK_DO, "'do'");
+        uint32_t done = emit(c, VM_ENC_I(VM_JZ, cond, 0));
+        c->top = c->local_count;
+        block(c);
+        expect(c, TOK_END, "'end'");
+        uint32_t back = emit(c, VM_ENC_I(VM_JMP, 0, 0));
+        patch(c, back, start);
+        patch(c, done, c->length);
+        return;
+    }
+    
+    if (accept(c, TOK_DO)) {
+        block(c);
+        expect(c, TOK_END, "'end'");
+        return;
+    }
+    
+    if (accept(c, TOK_RETURN)) {
+        emit(c, VM_ENC(VM_HALT, 0, 0, 0));
+        return;
+    }
+    
+    if (c->tok == TOK_NAME) {
+        char name[MAX_NAME];
+        strcpy(name, c->name);
+        next(c);
+        assignment(c, name);
+        return;
+    }
+    
+    fail(c, "expected statement");
+}
+
+// Statements up to a block terminator; locals declared inside go out of scope
+static void block(compiler_t* c) {
+    uint32_t scope = c->local_count;
+    
+    while (!c->failed && c->tok != TOK_EOF && c->tok != TOK_END &&
+           c->tok != TOK_ELSE && c->tok != TOK_ELSEIF) {
+        statement(c);
+    }
+    
+    c->local_count = scope;
+    c->top = scope;
+}
+
+// Compile source into code. Returns 1 on success; on failure error holds
+// a message with the line number.
+int vm_compile(const char* source, uint32_t* code, uint32_t max_words,
+               uint32_t* length, char* error, uint32_t error_size) {
+    compiler_t c;
+    
+    memset(&c, 0, sizeof(c));
+    c.src = source;
+    c.pos = source;
+    c.line = 1;
+    c.code = code;
+    c.max_words = max_words < VM_MAX_CODE ? max_words : VM_MAX_CODE;
+    c.error = error;
+    c.error_size = error_size;
+    if (error && error_size) {
+        error[0] = '\0';
+    }
+    
+    next(&c);
+    block(&c);
+    if (c.tok != TOK_EOF) {
+        fail(&c, "unexpected '%s'", c.tok == TOK_END ? "end" : "else");
+    }
+    emit(&c, VM_ENC(VM_HALT, 0, 0, 0));
+    
+    if (c.failed) {
+        return 0;
+    }
+    if (!vm_validate(code, c.length)) {
+        fail(&c, "generated invalid bytecode");
+        return 0;
+    }
+    *length = c.length;
+    return 1;
+}
@@ -0,0 +1,27 @@
+#ifndef VM_COMPILE_H
+#define VM_COMPILE_H
+
+#include <stdint.h>
+
+// Host-side compiler from a Lua subset to script VM bytecode (src/vm.h).
+//
+//   -- comment
+//   local x = state.lx - 128            locals live in registers
+//   if button.cross and x > 20 then     if / elseif / else / end
+//       state.r2 = 255                  fields: buttons lx ly rx ry l2 r2
+//   end                                   accel_x.. gyro_z battery temperature
+//   while x > 0 do x = x - 1 end        while / do / end
+//   g.counter = g.counter + 1           up to 16 persistent globals
+//   button.square = time % 100 < 50     button bits, time in ms
+//   return                              stop early (state is committed)
+//
+// Values are 32-bit integers. Operators, loosest first: or, and,
+// comparisons (== ~= < <= > >=), |, ~, &, << >>, + -, * / %, unary - not ~.
+// and/or/not yield 0 or 1 and always evaluate both sides.
+// Builtins: min(a, b), max(a, b), abs(x), clamp(x, lo, hi).
+
+// Function Prototypes
+int vm_compile(const char* source, uint32_t* code, uint32_t max_words,
+               uint32_t* length, char* error, uint32_t error_size);
+
+#endif // VM_COMPILE_H
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "vm_compile.h"
+#include "../src/vm.h"
+
+// Script bytecode compiler
+//
+//   vmc <script.lua> <script.bin>
+//
+// Output is the instruction words, little-endian, ready for
+// script_load_bytecode().
+
+int main(int argc, char** argv) {
+    static char source[64 * 1024];
+    static uint32_t code[VM_MAX_CODE];
+    char error[128];
+    uint32_t length;
+    
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <script.lua> <script.bin>\n", argv[0]);
+        return 2;
+    }
+    
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t size = fread(source, 1, sizeof(source) - 1, in);
+    fclose(in);
+    source[size] = '\0';
+    
+    if (!vm_compile(source, code, VM_MAX_CODE, &length, error, sizeof(error))) {
+        fprintf(stderr, "%s:%s\n", argv[1], error);
+        return 1;
+    }
+    
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t bytes[4] = {
+            (uint8_t)code[i], (uint8_t)(code[i] >> 8),
+            (uint8_t)(code[i] >> 16), (uint8_t)(code[i] >> 24)
+        };
+        fwrite(bytes, 1, sizeof(bytes), out);
+    }
+    fclose(out);
+    
+    printf("%s: %u instructions\n", argv[2], length);
+    return 0;
+}